@@ -0,0 +1,439 @@
+// headless cloth benchmark, no window or GL context needed (make cloth_bench).
+//
+// builds an NxN cloth for every size in the sweep, pins the top row, blows a constant wind
+// through it and steps it a fixed number of times. prints the time of each Simulate phase in
+// ns per particle-step, and a checksum of the final particle positions so a change that
+// alters the result shows up next to one that only alters the speed.
+//
+//   ./cloth_bench [-steps n] [-dt seconds] [-wind x y z] [-pd] [-self] [-nosleep] [-tear stretch]
+//                 [-windfield turbulence] [-obstacles n] [-instances n] [-separate] [-o file] [-check file] [sizes...]
+//
+// with no wind the cloth comes to rest and falls asleep part of the way through, which is the
+// idle case; the default wind keeps it flapping.
+//
+// -windfield blows the wind through a WindField around the cloths instead, with default gusts
+// and the given turbulence in m/s, shared by all instances.
+//
+// -obstacles adds a floor the cloth drapes on, a sphere it swings into and n - 2 more spheres,
+// capsules and boxes around it that it never reaches (at least the floor and the sphere).
+//
+// -instances runs n cloths of each size side by side in one ClothWorld, -separate steps them
+// as n separate Cloth objects instead. both give the same positions to the bit (the same hash),
+// only the time differs.
+//
+// -o writes the checksums to a file, -check compares against such a file and exits with 1
+// when a result moved. the hash is over exact bits and will differ between compilers/flags,
+// so the check only fails when the centroid moves by more than a small tolerance.
+
+#include "ClothWorld.h"
+#include <cfloat>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+struct BenchResult
+{
+    int size;
+    uint64_t hash;
+    glm::vec3 centroid;
+};
+
+// fnv-1a over the bit patterns of every particle position, cloth after cloth
+static uint64_t HashPositions(std::vector<Cloth*>& cloths)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (Cloth* cloth : cloths)
+    {
+        for (Particle* particle : cloth->GetParticles())
+        {
+            glm::vec3 position = particle->GetPosition();
+            const unsigned char* bytes = (const unsigned char*)&position[0];
+            for (int i = 0; i < (int)sizeof(glm::vec3); i++)
+            {
+                hash ^= bytes[i];
+                hash *= 1099511628211ULL;
+            }
+        }
+    }
+    return hash;
+}
+
+static glm::vec3 Centroid(std::vector<Cloth*>& cloths)
+{
+    glm::dvec3 sum(0.0);
+    int numParticles = 0;
+    for (Cloth* cloth : cloths)
+    {
+        for (Particle* particle : cloth->GetParticles())
+        {
+            sum += glm::dvec3(particle->GetPosition());
+        }
+        numParticles += cloth->GetNumParticles();
+    }
+    return glm::vec3(sum / (double)numParticles);
+}
+
+static BenchResult RunSize(int size, int steps, float dt, glm::vec3 wind, bool projectiveDynamics, bool selfCollision, bool sleeping,
+    float tearStretch, float turbulence, int numObstacles, int instances, bool separate)
+{
+    // same material as the default -cloth scene, the first row is pinned by the constructor.
+    // instances stand next to each other so they never touch
+    std::vector<Cloth*> cloths;
+    std::vector<glm::vec3> offsets;
+    for (int i = 0; i < instances; i++)
+    {
+        cloths.push_back(new Cloth(size, size, 0.2f, 1.0f, 300.0f, 15.0f));
+        offsets.push_back(glm::vec3(i * (size * 0.2f + 1.0f), 0.0f, 0.0f));
+    }
+
+    ClothWorld world;
+    if (separate)
+    {
+        for (int i = 0; i < instances; i++)
+        {
+            for (Particle* particle : cloths[i]->GetParticles())
+            {
+                particle->SetPosition(particle->GetPosition() + offsets[i]);
+            }
+        }
+    }
+    else
+    {
+        world.Add(cloths, offsets);
+        cloths.assign(1, world.GetCloth());
+    }
+
+    // one field over every instance, with room to swing
+    WindField* windField = nullptr;
+    if (turbulence >= 0.0f)
+    {
+        glm::vec3 minCorner(FLT_MAX);
+        glm::vec3 maxCorner(-FLT_MAX);
+        for (Cloth* cloth : cloths)
+        {
+            for (Particle* particle : cloth->GetParticles())
+            {
+                minCorner = glm::min(minCorner, particle->GetPosition());
+                maxCorner = glm::max(maxCorner, particle->GetPosition());
+            }
+        }
+        windField = new WindField(minCorner - glm::vec3(2.0f), maxCorner + glm::vec3(2.0f), 0.5f);
+        windField->SetMeanWind(wind);
+        windField->SetTurbulenceStrength(turbulence);
+    }
+
+    for (Cloth* cloth : cloths)
+    {
+        cloth->SetWind(windField ? glm::vec3(0.0f) : wind);
+        cloth->SetWindField(windField);
+        cloth->SetSleepingEnabled(sleeping);
+        cloth->SetSolver(projectiveDynamics ? ClothSolver::ProjectiveDynamics : ClothSolver::Explicit);
+        cloth->SetSelfCollisionEnabled(selfCollision);
+        cloth->SetTearingEnabled(tearStretch > 0.0f);
+        cloth->SetTearStretch(tearStretch);
+
+        // the cloth hangs from y = 2 and swings through x in [0, width], z in [0, height]
+        if (numObstacles > 0)
+        {
+            float width = size * 0.2f * instances + (instances - 1) * 1.0f;
+            float length = size * 0.2f;
+            ClothObstacles* obstacles = cloth->GetObstacles();
+            obstacles->AddPlane(glm::vec3(0.0f, 1.0f, 0.0f), 2.0f - length * 0.8f);
+            obstacles->AddSphere(glm::vec3(width * 0.5f, 2.0f - length * 0.5f, length * 0.3f), length * 0.2f);
+            for (int o = 2; o < numObstacles; o++)
+            {
+                // a ring above the pinned edge
+                float angle = o * 6.2831853f / numObstacles;
+                glm::vec3 centre = glm::vec3(width * 0.5f, 2.0f + length, 0.0f) + glm::vec3(cosf(angle), 0.0f, sinf(angle)) * (width + length);
+                if (o % 3 == 0)
+                {
+                    obstacles->AddSphere(centre, 0.5f);
+                }
+                else if (o % 3 == 1)
+                {
+                    obstacles->AddCapsule(centre, centre + glm::vec3(0.0f, 1.0f, 0.0f), 0.3f);
+                }
+                else
+                {
+                    obstacles->AddBox(centre, glm::vec3(0.4f), glm::mat3(glm::rotate(angle, glm::vec3(0.0f, 1.0f, 0.0f))));
+                }
+            }
+        }
+
+        // one untimed step so lazy setup (factorisation, hash tables) isn't counted
+        cloth->Simulate(dt);
+        cloth->ResetProfile();
+    }
+
+    for (int i = 1; i < steps; i++)
+    {
+        for (Cloth* cloth : cloths)
+        {
+            cloth->Simulate(dt);
+        }
+    }
+
+    // phases summed over all cloths
+    ClothProfile profile = cloths[0]->GetProfile();
+    int numParticles = 0;
+    int numTorn = 0;
+    int numSplit = 0;
+    int numAwake = 0;
+    int numPatches = 0;
+    for (int i = 0; i < cloths.size(); i++)
+    {
+        if (i > 0)
+        {
+            profile.forces += cloths[i]->GetProfile().forces;
+            profile.solver += cloths[i]->GetProfile().solver;
+            profile.collision += cloths[i]->GetProfile().collision;
+            profile.selfCollision += cloths[i]->GetProfile().selfCollision;
+        }
+        numParticles += cloths[i]->GetNumParticles();
+        numTorn += cloths[i]->GetNumTornSprings();
+        numSplit += cloths[i]->GetNumSplitParticles();
+        numAwake += cloths[i]->GetPatches()->GetNumAwakePatches();
+        numPatches += cloths[i]->GetPatches()->GetNumPatches();
+    }
+
+    double scale = 1e9 / ((double)profile.steps * numParticles);
+    double total = profile.forces + profile.solver + profile.collision + profile.selfCollision;
+
+    printf("%6d %9d %10.1f %10.1f %10.1f %10.1f %10.1f %10.3f %6d/%d\n",
+        size, numParticles,
+        profile.forces * scale, profile.solver * scale, profile.collision * scale, profile.selfCollision * scale,
+        total * scale, total * 1e3 / profile.steps, numAwake, numPatches);
+    if (tearStretch > 0.0f)
+    {
+        printf("%6s %d springs torn, %d particles split\n", "", numTorn, numSplit);
+    }
+
+    BenchResult result;
+    result.size = size;
+    result.hash = HashPositions(cloths);
+    result.centroid = Centroid(cloths);
+
+    if (separate)
+    {
+        for (Cloth* cloth : cloths)
+        {
+            delete cloth;
+        }
+    }
+    delete windField;
+    return result;
+}
+
+static std::map<int, BenchResult> ReadResults(const char* filename)
+{
+    std::map<int, BenchResult> results;
+
+    FILE* file = fopen(filename, "r");
+    if (!file)
+    {
+        printf("cloth_bench - failed to open %s\n", filename);
+        return results;
+    }
+
+    BenchResult result;
+    unsigned long long hash;
+    while (fscanf(file, "%d %llx %f %f %f", &result.size, &hash, &result.centroid.x, &result.centroid.y, &result.centroid.z) == 5)
+    {
+        result.hash = hash;
+        results[result.size] = result;
+    }
+
+    fclose(file);
+    return results;
+}
+
+static void PrintUsage()
+{
+    printf("usage: cloth_bench [-steps n] [-dt seconds] [-wind x y z] [-pd] [-self] [-nosleep] [-tear stretch]\n");
+    printf("                   [-windfield turbulence] [-obstacles n] [-instances n] [-separate] [-o file] [-check file] [sizes...]\n");
+}
+
+// the whole of text as a number, false and value left alone when it isn't one
+static bool ParseInt(const char* text, int& value)
+{
+    char* end;
+    long parsed = strtol(text, &end, 10);
+    if (end == text || *end != '\0')
+    {
+        return false;
+    }
+    value = (int)parsed;
+    return true;
+}
+
+static bool ParseFloat(const char* text, float& value)
+{
+    char* end;
+    float parsed = strtof(text, &end);
+    if (end == text || *end != '\0')
+    {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    int steps = 500;
+    float dt = 0.002f;
+    bool projectiveDynamics = false;
+    bool selfCollision = false;
+    bool sleeping = true;
+    float tearStretch = 0.0f;
+    float turbulence = -1.0f;
+    int numObstacles = 0;
+    int instances = 1;
+    bool separate = false;
+    glm::vec3 wind = glm::vec3(0.0f, 0.0f, 3.0f);
+    const char* outputFile = nullptr;
+    const char* checkFile = nullptr;
+    std::vector<int> sizes;
+
+    for (int i = 1; i < argc; i++)
+    {
+        // options need all their values, and every value and size has to be a whole number
+        const char* arg = argv[i];
+        bool ok = true;
+        if (strcmp(arg, "-steps") == 0) ok = i + 1 < argc && ParseInt(argv[++i], steps);
+        else if (strcmp(arg, "-dt") == 0) ok = i + 1 < argc && ParseFloat(argv[++i], dt);
+        else if (strcmp(arg, "-wind") == 0)
+        {
+            ok = i + 3 < argc && ParseFloat(argv[i + 1], wind.x) && ParseFloat(argv[i + 2], wind.y) && ParseFloat(argv[i + 3], wind.z);
+            i += 3;
+        }
+        else if (strcmp(arg, "-pd") == 0) projectiveDynamics = true;
+        else if (strcmp(arg, "-nosleep") == 0) sleeping = false;
+        else if (strcmp(arg, "-self") == 0) selfCollision = true;
+        else if (strcmp(arg, "-tear") == 0) ok = i + 1 < argc && ParseFloat(argv[++i], tearStretch);
+        else if (strcmp(arg, "-windfield") == 0) ok = i + 1 < argc && ParseFloat(argv[++i], turbulence);
+        else if (strcmp(arg, "-obstacles") == 0)
+        {
+            ok = i + 1 < argc && ParseInt(argv[++i], numObstacles);
+            numObstacles = std::max(numObstacles, 2);
+        }
+        else if (strcmp(arg, "-instances") == 0)
+        {
+            ok = i + 1 < argc && ParseInt(argv[++i], instances);
+            instances = std::max(instances, 1);
+        }
+        else if (strcmp(arg, "-separate") == 0) separate = true;
+        else if (strcmp(arg, "-o") == 0)
+        {
+            ok = i + 1 < argc;
+            outputFile = ok ? argv[++i] : nullptr;
+        }
+        else if (strcmp(arg, "-check") == 0)
+        {
+            ok = i + 1 < argc;
+            checkFile = ok ? argv[++i] : nullptr;
+        }
+        else
+        {
+            int size = 0;
+            ok = ParseInt(arg, size) && size >= 2;
+            sizes.push_back(size);
+        }
+
+        if (!ok)
+        {
+            printf("cloth_bench - bad argument %s\n", arg);
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (sizes.empty())
+    {
+        sizes = { 16, 32, 64, 128 };
+    }
+    steps = std::max(steps, 2);
+
+    printf("cloth_bench - %d steps of %g s, wind %s, %s solver%s%s, %d threads\n", steps, dt, glm::to_string(wind).c_str(),
+        projectiveDynamics ? "projective dynamics" : "explicit", selfCollision ? ", self-collision" : "",
+        sleeping ? "" : ", no sleeping", ThreadPool::GetShared()->GetNumThreads());
+    if (turbulence >= 0.0f)
+    {
+        printf("  wind field with %g m/s turbulence\n", turbulence);
+    }
+    if (numObstacles > 0)
+    {
+        printf("  %d obstacles\n", numObstacles);
+    }
+    if (instances > 1)
+    {
+        printf("  %d instances per size, %s\n", instances, separate ? "separate cloths" : "one ClothWorld");
+    }
+    printf("  ns per particle-step\n");
+    printf("%6s %9s %10s %10s %10s %10s %10s %10s %8s\n", "size", "particles", "forces", "solver", "collide", "self", "total", "ms/step", "awake");
+
+    std::vector<BenchResult> results;
+    for (int size : sizes)
+    {
+        results.push_back(RunSize(size, steps, dt, wind, projectiveDynamics, selfCollision, sleeping, tearStretch, turbulence, numObstacles, instances, separate));
+    }
+
+    printf("  final state\n");
+    for (const BenchResult& result : results)
+    {
+        printf("%6d %016llx centroid %s\n", result.size, (unsigned long long)result.hash, glm::to_string(result.centroid).c_str());
+    }
+
+    if (outputFile)
+    {
+        FILE* file = fopen(outputFile, "w");
+        if (!file)
+        {
+            printf("cloth_bench - failed to write %s\n", outputFile);
+            return 1;
+        }
+        for (const BenchResult& result : results)
+        {
+            fprintf(file, "%d %016llx %.9g %.9g %.9g\n", result.size, (unsigned long long)result.hash,
+                result.centroid.x, result.centroid.y, result.centroid.z);
+        }
+        fclose(file);
+    }
+
+    int failures = 0;
+    if (checkFile)
+    {
+        std::map<int, BenchResult> expected = ReadResults(checkFile);
+        for (const BenchResult& result : results)
+        {
+            if (expected.find(result.size) == expected.end())
+            {
+                printf("%6d not in %s\n", result.size, checkFile);
+                continue;
+            }
+
+            const BenchResult& reference = expected[result.size];
+            float drift = glm::length(result.centroid - reference.centroid);
+            if (result.hash == reference.hash)
+            {
+                printf("%6d identical\n", result.size);
+            }
+            else if (drift <= 1e-3f)
+            {
+                printf("%6d bits differ, centroid within %g\n", result.size, drift);
+            }
+            else
+            {
+                printf("%6d CHANGED, centroid moved %g\n", result.size, drift);
+                failures++;
+            }
+        }
+    }
+
+    return failures > 0 ? 1 : 0;
+}
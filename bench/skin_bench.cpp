@@ -0,0 +1,397 @@
+// headless skinning benchmark, no window or GL context needed (make skin_bench).
+//
+// loads a skeleton and a skin (furina by default), then plays a fixed procedural animation on
+// every joint and deforms the skin for each frame, once on the calling thread and once per chunk
+// size over the shared thread pool. prints the time of Skin::Deform (palette + vertex kernel)
+// per frame and per vertex, and a hash of the final deformed positions and normals, which has to
+// be the same for every configuration since the chunks only split the work. then moves one joint
+// per frame like the ui's DOF sliders, to time the partial re-skinning of just its vertices, and
+// times frames where nothing moves. a skin with morph targets also gets one weight changed per
+// frame, timing the morph pass and the re-skinning of the vertices it moved. last, a SkinCrowd of
+// the skin's mesh skins every instance in its own pose each frame, and each instance is checked
+// against the skin's own packed output for the same pose.
+//
+//   ./skin_bench [-frames n] [-chunk n] [-dq] [-packed] [-crowd n] [-gpu] [file.skel file.skin]
+//
+// -chunk times only that chunk size instead of the sweep. -dq skins with dual quaternions
+// instead of linear blending. -packed writes the interleaved output with octahedral normals.
+// -crowd sets the number of crowd instances (16 by default, 0 for none). -gpu opens a hidden window and checks
+// the skinning shader against the cpu on a handful of poses (run from the repo root so the
+// shaders are found). skeleton loading prints a lot, the results come after it.
+
+#include "Skin.h"
+#include "SkinCrowd.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// fnv-1a over some bytes
+static uint64_t Hash(uint64_t hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// over the bit patterns of every deformed position and normal, in whichever output is in use
+static uint64_t HashVertices(Skin* skin)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    if (skin->IsPackedOutputEnabled())
+    {
+        std::vector<SkinBatch::PackedVertex>& vertices = skin->GetPackedVertices();
+        return Hash(hash, vertices.data(), vertices.size() * sizeof(SkinBatch::PackedVertex));
+    }
+    hash = Hash(hash, skin->GetTransformedPositions().data(), skin->GetTransformedPositions().size() * sizeof(glm::vec3));
+    return Hash(hash, skin->GetTransformedNormals().data(), skin->GetTransformedNormals().size() * sizeof(glm::vec3));
+}
+
+// every joint swings on all three axes at its own phase
+static void Pose(Skeleton* skeleton, int frame)
+{
+    std::vector<Joint*> joints = skeleton->GetJointList();
+    float time = frame / 60.0f;
+    for (int j = 0; j < joints.size(); j++)
+    {
+        joints[j]->SetPose(0.3f * sinf(1.7f * time + j), 0.3f * sinf(2.3f * time + 2.0f * j), 0.3f * sinf(1.1f * time + 3.0f * j));
+    }
+    skeleton->Update();
+}
+
+// a third of the morph targets on at a weight that changes with the frame, the rest off
+static void PoseMorphs(Skin* skin, int frame)
+{
+    MorphTargets* morphs = skin->GetMorphTargets();
+    for (int t = 0; morphs && t < morphs->GetNumTargets(); t++)
+    {
+        morphs->SetWeight(t, (t + frame) % 3 == 0 ? 0.5f + 0.5f * sinf(0.3f * frame + t) : 0.0f);
+    }
+}
+
+// skin.vert against Skin::Deform through transform feedback, on the first frames of the animation
+static int ValidateGPU(Skeleton* skeleton, Skin* skin, int frames)
+{
+    if (!glfwInit())
+    {
+        printf("skin_bench - glfw failed to initialise\n");
+        return 1;
+    }
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    GLFWwindow* window = glfwCreateWindow(64, 64, "skin_bench", NULL, NULL);
+    if (!window)
+    {
+        printf("skin_bench - no opengl 3.3 context\n");
+        glfwTerminate();
+        return 1;
+    }
+    glfwMakeContextCurrent(window);
+    printf("skin_bench - gpu: %s\n", (const char*)glGetString(GL_RENDERER));
+
+    int failures = 0;
+    for (int frame = 0; frame < frames; frame++)
+    {
+        Pose(skeleton, frame * 7);
+        PoseMorphs(skin, frame);
+        failures += !skin->ValidateGPU();
+    }
+
+    skin->SetGPUSkinningEnabled(false);
+    int cpuBytes = skin->GetUploadSize();
+    skin->SetGPUSkinningEnabled(true);
+    int gpuBytes = skin->GetUploadSize();
+    printf("skin_bench - upload per frame: %d bytes on the cpu path, %d bytes on the gpu path\n", cpuBytes, gpuBytes);
+
+    // the skin's buffers belong to this context
+    delete skin;
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return failures > 0 ? 1 : 0;
+}
+
+// ms per frame spent in Skin::Deform, chunkSize 0 for the calling thread only
+static double Run(Skeleton* skeleton, Skin* skin, int frames, int chunkSize, uint64_t& hash)
+{
+    skin->SetParallelEnabled(chunkSize > 0);
+    if (chunkSize > 0)
+    {
+        skin->SetChunkSize(chunkSize);
+    }
+
+    // one untimed frame to warm the caches and the pool
+    Pose(skeleton, 0);
+    skin->Deform();
+
+    double seconds = 0.0;
+    for (int frame = 1; frame <= frames; frame++)
+    {
+        Pose(skeleton, frame);
+
+        auto start = std::chrono::steady_clock::now();
+        skin->Deform();
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    hash = HashVertices(skin);
+    return seconds * 1e3 / frames;
+}
+
+// ms per frame of Skin::Deform when one joint moves per frame, the way a DOF slider in the ui
+// moves it, and in still when nothing moves. fraction gets the share of the vertices re-skinned
+// while posing
+static double Posing(Skeleton* skeleton, Skin* skin, int frames, double& still, double& fraction)
+{
+    std::vector<Joint*> joints = skeleton->GetJointList();
+    Pose(skeleton, 0);
+    skin->Deform();
+
+    double seconds = 0.0;
+    long long skinned = 0;
+    for (int frame = 1; frame <= frames; frame++)
+    {
+        DOF& dof = joints[frame % joints.size()]->GetDOF(0);
+        float value = dof.GetValue();
+        dof.SetValue(value + 0.01f <= dof.GetMax() ? value + 0.01f : value - 0.01f);
+        skeleton->Update();
+
+        auto start = std::chrono::steady_clock::now();
+        skin->Deform();
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        skinned += skin->GetNumSkinnedVertices();
+    }
+    fraction = double(skinned) / (double(frames) * skin->GetNumVertices());
+
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 1; frame <= frames; frame++)
+    {
+        skin->Deform();
+    }
+    still = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e3 / frames;
+
+    return seconds * 1e3 / frames;
+}
+
+// ms per frame of Skin::Deform when one morph weight changes per frame and no joint moves,
+// fraction gets the share of the vertices re-skinned
+static double Morphing(Skin* skin, int frames, double& fraction)
+{
+    MorphTargets* morphs = skin->GetMorphTargets();
+    PoseMorphs(skin, 0);
+    skin->Deform();
+
+    double seconds = 0.0;
+    long long skinned = 0;
+    for (int frame = 1; frame <= frames; frame++)
+    {
+        int target = frame % morphs->GetNumTargets();
+        morphs->SetWeight(target, morphs->GetWeight(target) > 0.5f ? 0.25f : 0.75f);
+
+        auto start = std::chrono::steady_clock::now();
+        skin->Deform();
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        skinned += skin->GetNumSkinnedVertices();
+    }
+    fraction = double(skinned) / (double(frames) * skin->GetNumVertices());
+    return seconds * 1e3 / frames;
+}
+
+// ms per frame of SkinCrowd::Deform with every instance posed at its own frame of the animation,
+// then checks each instance's vertices against the skin's packed output for its last pose
+static double Crowd(Skeleton* skeleton, Skin* skin, int numInstances, int frames, int& failures)
+{
+    SkinCrowd* crowd = new SkinCrowd(skin);
+    crowd->SetSkinningMode(skin->GetSkinningMode());
+    for (int i = 0; i < numInstances; i++)
+    {
+        crowd->AddInstance();
+    }
+
+    double seconds = 0.0;
+    for (int frame = 0; frame <= frames; frame++)
+    {
+        for (int i = 0; i < numInstances; i++)
+        {
+            Pose(skeleton, frame + 13 * i);
+            crowd->SetPose(i, skeleton);
+        }
+
+        // the first frame is an untimed warm up
+        auto start = std::chrono::steady_clock::now();
+        crowd->Deform();
+        if (frame > 0)
+        {
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
+
+    skin->SetPackedOutputEnabled(true);
+    for (int i = 0; i < numInstances; i++)
+    {
+        Pose(skeleton, frames + 13 * i);
+        skin->Deform();
+        if (memcmp(crowd->GetVertices(i), skin->GetPackedVertices().data(), sizeof(SkinBatch::PackedVertex) * skin->GetNumVertices()) != 0)
+        {
+            printf("skin_bench - crowd instance %d DIFFERS from the skin\n", i);
+            failures++;
+        }
+    }
+
+    delete crowd;
+    return seconds * 1e3 / frames;
+}
+
+static void PrintUsage()
+{
+    printf("usage: skin_bench [-frames n] [-chunk n] [-dq] [-packed] [-crowd n] [-gpu] [file.skel file.skin]\n");
+}
+
+// the whole of text as a number, false and value left alone when it isn't one
+static bool ParseInt(const char* text, int& value)
+{
+    char* end;
+    long parsed = strtol(text, &end, 10);
+    if (end == text || *end != '\0')
+    {
+        return false;
+    }
+    value = (int)parsed;
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    int frames = 200;
+    std::vector<int> chunkSizes = { 512, 1024, 2048, 4096, 8192 };
+    std::vector<const char*> files;
+    bool gpu = false;
+    bool packed = false;
+    int crowdSize = 16;
+    SkinningMode mode = SkinningMode::Linear;
+
+    for (int i = 1; i < argc; i++)
+    {
+        // options need their values as whole numbers, anything else not starting with - is a file
+        const char* arg = argv[i];
+        bool ok = true;
+        int value = 0;
+        if (strcmp(arg, "-frames") == 0)
+        {
+            ok = i + 1 < argc && ParseInt(argv[++i], value);
+            frames = std::max(value, 1);
+        }
+        else if (strcmp(arg, "-chunk") == 0)
+        {
+            ok = i + 1 < argc && ParseInt(argv[++i], value);
+            chunkSizes.assign(1, std::max(value, 1));
+        }
+        else if (strcmp(arg, "-dq") == 0) mode = SkinningMode::DualQuaternion;
+        else if (strcmp(arg, "-packed") == 0) packed = true;
+        else if (strcmp(arg, "-crowd") == 0)
+        {
+            ok = i + 1 < argc && ParseInt(argv[++i], value);
+            crowdSize = std::max(value, 0);
+        }
+        else if (strcmp(arg, "-gpu") == 0) gpu = true;
+        else if (arg[0] != '-') files.push_back(arg);
+        else ok = false;
+
+        if (!ok)
+        {
+            printf("skin_bench - bad argument %s\n", arg);
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    // both files or neither
+    if (files.size() != 0 && files.size() != 2)
+    {
+        printf("skin_bench - needs a skeleton and a skin file\n");
+        PrintUsage();
+        return 1;
+    }
+
+    const char* skeletonFile = files.size() >= 2 ? files[0] : "unused/furina.skel";
+    const char* skinFile = files.size() >= 2 ? files[1] : "unused/furina.skin";
+
+    Skeleton* skeleton = new Skeleton();
+    if (!skeleton->Load(skeletonFile))
+    {
+        printf("skin_bench - failed to load %s\n", skeletonFile);
+        return 1;
+    }
+    skeleton->PopulateJointList();
+
+    // the skin deletes the skeleton
+    Skin* skin = new Skin();
+    if (!skin->Load(skinFile, skeleton))
+    {
+        printf("skin_bench - failed to load %s\n", skinFile);
+        return 1;
+    }
+
+    skin->SetSkinningMode(mode);
+    skin->SetPackedOutputEnabled(packed);
+
+    if (gpu)
+    {
+        return ValidateGPU(skeleton, skin, std::min(frames, 10));
+    }
+
+    int numVertices = skin->GetNumVertices();
+    printf("skin_bench - %s, %d vertices, %d joints, %d frames, %d threads, %s\n", skinFile, numVertices,
+        (int)skeleton->GetJointList().size(), frames, ThreadPool::GetShared()->GetNumThreads(),
+        mode == SkinningMode::DualQuaternion ? "dual quaternion" : "linear blend");
+    printf("skin_bench - %.1f bytes read per vertex, %d bytes uploaded per frame\n", skin->GetBytesPerVertex(), skin->GetUploadSize());
+    printf("%10s %10s %10s %16s\n", "chunk", "ms/frame", "ns/vertex", "hash");
+
+    uint64_t reference;
+    double serial = Run(skeleton, skin, frames, 0, reference);
+    printf("%10s %10.3f %10.2f %016llx\n", "serial", serial, serial * 1e6 / numVertices, (unsigned long long)reference);
+
+    int failures = 0;
+    for (int chunkSize : chunkSizes)
+    {
+        uint64_t hash;
+        double parallel = Run(skeleton, skin, frames, chunkSize, hash);
+        printf("%10d %10.3f %10.2f %016llx%s\n", chunkSize, parallel, parallel * 1e6 / numVertices, (unsigned long long)hash,
+            hash == reference ? "" : " DIFFERS");
+        failures += hash != reference;
+    }
+
+    double still;
+    double fraction;
+    double posing = Posing(skeleton, skin, frames, still, fraction);
+    printf("skin_bench - one joint moving per frame: %.3f ms/frame, %.1f%% of the vertices re-skinned\n", posing, fraction * 100.0);
+    printf("skin_bench - nothing moving: %.4f ms/frame\n", still);
+
+    MorphTargets* morphs = skin->GetMorphTargets();
+    if (morphs)
+    {
+        double morphing = Morphing(skin, frames, fraction);
+        printf("skin_bench - one of %d morph targets (%d deltas) changing per frame: %.3f ms/frame, %.1f%% of the vertices re-skinned\n",
+            morphs->GetNumTargets(), morphs->GetNumDeltas(), morphing, fraction * 100.0);
+    }
+
+    if (crowdSize > 0)
+    {
+        double crowd = Crowd(skeleton, skin, crowdSize, frames, failures);
+        printf("skin_bench - crowd of %d instances: %.3f ms/frame, %.2f ns/vertex\n", crowdSize, crowd,
+            crowd * 1e6 / (double(crowdSize) * numVertices));
+    }
+
+    delete skin;
+    return failures > 0 ? 1 : 0;
+}
@@ -20,6 +20,7 @@ public:
     void SetClip(AnimationClip* clip);
     const Pose& GetCurrentPose();
     void SetRig(Rig* rig);
+    float GetTime();
 
     // update animation (call each frame)
     void Update(float deltaTime);
@@ -1,9 +1,42 @@
 #pragma once
 
 #include "ClothTriangle.h"
+#include "ClothTriangleBatch.h"
+#include "ClothSpringBatch.h"
+#include "ClothPatches.h"
+#include "ClothObstacles.h"
+#include "ProjectiveDynamics.h"
+#include "SelfCollision.h"
+#include "MeshBVH.h"
+#include "ClothMesh.h"
 #include <vector>
 #include <iostream>
+#include <chrono>
 
+// how Cloth::Simulate advances the particles
+enum class ClothSolver
+{
+    // spring-damper forces + symplectic euler, needs small timesteps
+    Explicit,
+    // prefactored local/global solve, stable at large timesteps
+    ProjectiveDynamics
+};
+
+// wall time spent in each phase of Cloth::Simulate since the last ResetProfile, in seconds
+struct ClothProfile
+{
+    int steps;
+    // gravity and the triangle pass (aerodynamic drag + normals)
+    double forces;
+    // springs + integration, or the projective dynamics step
+    double solver;
+    // external collision mesh
+    double collision;
+    double selfCollision;
+};
+
+// particles, springs and triangles of a piece of cloth. this is simulation only, nothing here
+// touches GL (ClothRenderer draws it), so a Cloth can be stepped without a window.
 class Cloth
 {
 private:
@@ -14,35 +47,197 @@ private:
     glm::vec3 wind;
     glm::vec3 gravity;
 
-    // rendering
-    GLuint VAO;
-    GLuint VBO_positions;
-    GLuint VBO_normals;
-    GLuint EBO;
-    std::vector<glm::vec3> vertexPositions;
-    std::vector<glm::vec3> vertexNormals;
-    std::vector<unsigned int> triangleIndices;
+    // wind that varies over the scene, added to wind (not owned, can be shared between cloths)
+    WindField* windField;
+    // simulated seconds, the wind field is evaluated at this time
+    float time;
+
+    // structural spring constant (bending springs use a fraction of this)
+    float springConstant;
+    // typical distance between neighbouring particles, collision sizes are based on it
+    float particleSpacing;
+
+    // drag and normals for all triangles in one pass. Simulate runs it on the final state of
+    // each step and reuses the drag at the start of the next, so it runs once per step
+    ClothTriangleBatch* triangleBatch;
+    // false when the particles or the wind changed since the last pass
+    bool triangleBatchCurrent;
+
+    // all spring-damper forces of the explicit solver in one pass
+    ClothSpringBatch* springBatch;
+
+    // sleeping of patches that came to rest
+    ClothPatches* patches;
+    bool sleepingEnabled;
+
+    // tearing (explicit solver only): springs stretched past tearStretch break. once the
+    // triangles around a particle no longer hang together across unbroken edges, the particle is
+    // split: every piece but the biggest gets a spare particle, and its triangles and the springs
+    // on its side move over to it, so the cloth parts along the broken springs. the spares are
+    // allocated when tearing is turned on and everything else has room for them from the start,
+    // so a tear only rewires. when the spares (or the room in the logs) run out, the triangles
+    // along a broken spring are torn out instead
+    bool tearingEnabled;
+    float tearStretch;
+    // triangles along each spring, springTriangles[springTriangleStart[s] .. springTriangleStart[s + 1])
+    std::vector<int> springTriangleStart;
+    std::vector<int> springTriangles;
+    std::vector<char> triangleTorn;
+    // the spring along each triangle edge, 3 * t + k for corner k to k + 1, -1 for none
+    std::vector<int> triangleSprings;
+    // corners (3 * triangle + k) and spring ends (2 * spring + end) at each particle as linked
+    // lists: the first is particleCorners[p], the next cornerNext[c], -1 ends the list
+    std::vector<int> particleCorners;
+    std::vector<int> cornerNext;
+    std::vector<int> particleSpringEnds;
+    std::vector<int> springEndNext;
+    // room for particles, the spares waiting to be split off, where the split off ones start,
+    // and the particle each one was split off (itself for the others)
+    int maxParticles;
+    std::vector<Particle*> spareParticles;
+    int firstSplitParticle;
+    std::vector<int> particleOrigin;
+    // everything torn so far, in order. a spring or triangle tears at most once, so these are
+    // sized for all of them up front and only ever written further along
+    std::vector<int> tornSprings;
+    std::vector<int> tornTriangles;
+    int numTornSprings;
+    int numTornTriangles;
+    // every corner and spring end a split moved, in order, as (3 * triangle + k, particle) and
+    // (2 * spring + end, particle). room for every corner and end to move once
+    std::vector<glm::ivec2> splitCorners;
+    std::vector<glm::ivec2> splitSpringEnds;
+    int numSplitCorners;
+    int numSplitSpringEnds;
+
+    // break the springs the last spring pass flagged, and split their ends
+    void Tear();
+    // split a particle whose triangles came apart, false if there was no room to
+    bool SplitParticle(int particle);
+    // tear a triangle out of the cloth, for broken springs whose ends couldn't be split
+    void RemoveTriangle(int triangle);
+
+    // wake every patch and make the next step redo the triangle pass
+    void WakeAll();
+    // limit the batched passes to the particles that are awake
+    void UpdateActive();
 
-    glm::mat4 model;
-    glm::vec3 color;
+    // solver
+    ClothSolver solver;
+    ProjectiveDynamics* projectiveDynamics;
 
-    // persistent rendering
-    GLuint springVAO, springVBO;
-    std::vector<glm::vec3> springLines;
+    // collision
+    SelfCollision* selfCollision;
+    bool selfCollisionEnabled;
+    // external mesh the cloth collides with (not owned, e.g. a skin's bvh)
+    MeshBVH* collisionMesh;
+    float collisionThickness;
+    float collisionFriction;
+    // planes, spheres, capsules and boxes (owned), kept collisionThickness away like the mesh
+    ClothObstacles* obstacles;
+    // obstacles version the cloth last woke up for
+    unsigned int obstaclesVersion;
+
+    void CollideWithMesh(float dt);
+
+    // everything after the particles, springs and triangles exist
+    void Initialise(float springConstant, float particleSpacing);
+
+    // bumped every time the particles move
+    unsigned int version;
+    ClothProfile profile;
+
+    // seconds elapsed since the given time point, which then moves up to now
+    static double ElapsedSeconds(std::chrono::steady_clock::time_point& since);
 
 public:
     Cloth(int width, int height, float particleSpacing, float mass, float springConstant, float dampingConstant);
+    // any triangle mesh, one particle per vertex (mass is per particle)
+    Cloth(ClothMesh* mesh, float mass, float springConstant, float dampingConstant);
+    // all of the given cloths as one, in order, with each one's indices shifted past the ones
+    // before it (see ClothWorld). takes over their particles, springs and triangles and leaves
+    // them empty, ready to be deleted. wind, solver and other settings come from the first
+    Cloth(std::vector<Cloth*>& cloths);
     ~Cloth();
 
     void SetWind(glm::vec3 wind);
+    WindField* GetWindField();
+    void SetWindField(WindField* windField);
 
     void Simulate(float dt);
 
-    void Draw(glm::mat4 viewProjMtx, GLuint shader);
+    void Translate(glm::vec3 translation);
+    // only the pinned particles in [begin, end)
+    void Translate(glm::vec3 translation, int begin, int end);
+    // moves every particle to a recorded position (see ClothCache), no physics
+    void SetPositions(const std::vector<glm::vec3>& positions);
 
-    void SetupBuffers();
+    // solver selection
+    ClothSolver GetSolver();
+    void SetSolver(ClothSolver solver);
+    ProjectiveDynamics* GetProjectiveDynamics();
 
-    void UpdateBuffers();
+    // material and pinning (both invalidate the projective dynamics factorisation)
+    float GetSpringConstant();
+    void SetSpringConstant(float springConstant);
+    int GetNumParticles();
+    bool IsParticleFixed(int index);
+    void SetParticleFixed(int index, bool fixed);
 
-    void Translate(glm::vec3 translation);
+    // self-collision (off by default)
+    bool IsSelfCollisionEnabled();
+    void SetSelfCollisionEnabled(bool enabled);
+    SelfCollision* GetSelfCollision();
+
+    // analytic obstacles: add, move and remove them here, the cloth wakes up for any change
+    ClothObstacles* GetObstacles();
+
+    // collision against a deforming mesh, nullptr to turn off. the thickness applies to the
+    // obstacles too, they have their own friction
+    MeshBVH* GetCollisionMesh();
+    void SetCollisionMesh(MeshBVH* collisionMesh);
+    float GetCollisionThickness();
+    void SetCollisionThickness(float collisionThickness);
+    float GetCollisionFriction();
+    void SetCollisionFriction(float collisionFriction);
+
+    // tearing (off by default, explicit solver only). springs tear at tearStretch times their rest length,
+    // particles along a tear are split so the two sides come apart
+    bool IsTearingEnabled();
+    void SetTearingEnabled(bool enabled);
+    float GetTearStretch();
+    void SetTearStretch(float tearStretch);
+    // springs and triangles torn so far, in the order they tore, and the corners and spring ends
+    // moved onto split off particles. the arrays never reallocate and entries below the count
+    // never change, so a renderer can patch its index buffers from them
+    std::vector<int>& GetTornSprings();
+    int GetNumTornSprings();
+    std::vector<int>& GetTornTriangles();
+    int GetNumTornTriangles();
+    std::vector<glm::ivec2>& GetSplitCorners();
+    int GetNumSplitCorners();
+    std::vector<glm::ivec2>& GetSplitSpringEnds();
+    int GetNumSplitSpringEnds();
+    int GetNumSplitParticles();
+    // the particle count can grow up to this by tearing, renderers size their buffers by it
+    int GetMaxParticles();
+
+    // sleeping (on by default, never while colliding with a mesh or in a wind field). changing the wind, moving
+    // the pinned particles or changing the material wakes the cloth up again
+    bool IsSleepingEnabled();
+    void SetSleepingEnabled(bool enabled);
+    ClothPatches* GetPatches();
+
+    // simulation state, for renderers and tools
+    std::vector<Particle*>& GetParticles();
+    std::vector<SpringDamper*>& GetSprings();
+    std::vector<ClothTriangle*>& GetTriangles();
+    // unit vertex normals for the current particle positions
+    std::vector<glm::vec3>& GetVertexNormals();
+    // changes whenever the particles move (Simulate, Translate)
+    unsigned int GetVersion();
+
+    // per-phase timings of Simulate
+    ClothProfile& GetProfile();
+    void ResetProfile();
 };
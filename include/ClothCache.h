@@ -0,0 +1,102 @@
+#pragma once
+
+#include "Cloth.h"
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// baked cloth animation: particle positions per frame, replayed without running the simulation.
+//
+// positions are snapped to a grid of quantum metres and stored as integers, so decoding is exact
+// and never drifts however many frames are chained. every keyframeInterval-th frame is a keyframe,
+// stored as the difference of each particle from the previous one (neighbouring particles are
+// close together). the frames in between store each particle's error against a linear prediction
+// from the two frames before it, which is a few grid steps for smoothly moving cloth.
+//
+// the values are zigzag varints, one byte for anything within +-63 steps, written plane by
+// plane (every x, then every y, then every z) so similar numbers sit next to each other and
+// the file still compresses well with a general purpose compressor. a table of frame offsets
+// at the end lets the reader jump to any frame through its keyframe.
+//
+// file layout: ClothCacheHeader, frames, uint64 offset of every frame.
+struct ClothCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t numParticles;
+    // only to check the cache is replayed on the same cloth (see GetNumTriangles)
+    uint32_t numTriangles;
+    uint32_t numFrames;
+    uint32_t keyframeInterval;
+    // grid size in metres and seconds between frames
+    float quantum;
+    float frameTime;
+    uint64_t indexOffset;
+};
+
+class ClothCacheWriter
+{
+private:
+    FILE* file;
+    ClothCacheHeader header;
+    std::vector<uint64_t> frameOffsets;
+
+    // the two frames before the current one, on the grid
+    std::vector<int32_t> previous[3];
+    std::vector<int32_t> beforePrevious[3];
+    std::vector<int32_t> current[3];
+
+    std::vector<uint8_t> buffer;
+
+public:
+    ClothCacheWriter();
+    ~ClothCacheWriter();
+
+    // quantum 1e-4 keeps every position within 0.05 mm of the simulated one. tears aren't
+    // stored, so a cloth with tearing on or anything torn can't be recorded and AddFrame fails
+    // once the cloth tears
+    bool Open(const char* filename, Cloth* cloth, float frameTime, float quantum = 1e-4f, int keyframeInterval = 30);
+    bool AddFrame(Cloth* cloth);
+    // writes the frame table and the final header
+    bool Close();
+
+    bool IsOpen();
+    int GetNumFrames();
+    // bytes written so far
+    uint64_t GetSize();
+};
+
+// reads a cache through a read-only memory map, the file is never loaded as a whole
+class ClothCacheReader
+{
+private:
+    const uint8_t* data;
+    size_t size;
+    ClothCacheHeader header;
+    // copy of the table at the end of the file, checked when opening
+    std::vector<uint64_t> frameOffsets;
+
+    // the last decoded frame and the one before it, so playing forward decodes one frame each time
+    int decodedFrame;
+    std::vector<int32_t> previous[3];
+    std::vector<int32_t> beforePrevious[3];
+    std::vector<int32_t> current[3];
+
+    bool DecodeFrame(int frame);
+
+public:
+    ClothCacheReader();
+    ~ClothCacheReader();
+
+    bool Open(const char* filename);
+    void Close();
+
+    int GetNumFrames();
+    // the cloth a cache is replayed on needs the recorded cloth's particle and triangle counts
+    int GetNumParticles();
+    int GetNumTriangles();
+    float GetFrameTime();
+
+    // positions of any frame, in particle order
+    bool ReadFrame(int frame, std::vector<glm::vec3>& positions);
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "core.h"
+#include "Tokenizer.h"
+#include <vector>
+
+// triangle mesh to build a Cloth from, loaded from a .skin (positions + triangles blocks)
+// or a wavefront .obj file.
+//
+// springs come from a half-edge structure: every triangle contributes three half-edges and
+// twins are matched by bucketing half-edges on their lower vertex (counting sort), so the
+// whole build is linear in the number of triangles. each edge becomes a structural spring
+// and each interior edge also gets a bending spring between the two vertices opposite it.
+class ClothMesh
+{
+private:
+    std::vector<glm::vec3> positions;
+    std::vector<glm::ivec3> triangles;
+
+    // half-edge h goes from triangles[h / 3][h % 3] to triangles[h / 3][(h + 1) % 3],
+    // twins[h] is the half-edge going the other way (-1 on the boundary). on an edge shared by
+    // more than two faces the third and later half-edges point at the first one, which points back
+    // at the second
+    std::vector<int> twins;
+
+    // derived spring topology
+    std::vector<glm::ivec2> edges;
+    std::vector<glm::ivec2> bendingPairs;
+
+    bool BuildTopology();
+
+public:
+    ClothMesh();
+
+    // pick the loader from the file extension
+    bool Load(const char* filename);
+    bool LoadSkin(const char* filename);
+    bool LoadOBJ(const char* filename);
+
+    // use positions and triangles that are already in memory
+    bool Build(const std::vector<glm::vec3>& positions, const std::vector<glm::ivec3>& triangles);
+
+    // getters
+    std::vector<glm::vec3>& GetPositions();
+    std::vector<glm::ivec3>& GetTriangles();
+    std::vector<glm::ivec2>& GetEdges();
+    std::vector<glm::ivec2>& GetBendingPairs();
+    int GetNumBoundaryEdges();
+    float GetAverageEdgeLength();
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "Particle.h"
+#include "ThreadPool.h"
+#include <vector>
+
+enum class ClothObstacleType
+{
+    Plane,
+    Sphere,
+    Capsule,
+    Box
+};
+
+// one analytic shape. plane: unit normal in p0, offset along it in radius (n . x = offset is the
+// surface, the front is solid free space). sphere: centre p0. capsule: ends p0 and p1. box:
+// centre p0, half extents p1 and the box axes as the columns of rotation
+struct ClothObstacle
+{
+    ClothObstacleType type;
+    glm::vec3 p0;
+    glm::vec3 p1;
+    float radius;
+    glm::mat3 rotation;
+
+    // coulomb friction coefficient, and the fraction of the approach speed the particle bounces off with
+    float friction;
+    float restitution;
+};
+
+// simple shapes the cloth collides with: a floor, props, a character made of capsules.
+//
+// the obstacles live in one flat array with their bounding boxes next to it. the cloth's
+// particles are gathered into structure-of-arrays form in chunks of consecutive particles
+// (neighbours on the cloth, so each chunk covers a small area), and every chunk gets a bounding
+// box. only obstacles whose box overlaps the whole cloth's box are looked at, and only chunks
+// that overlap an obstacle run the distance test for it, in a tight loop over the chunk's
+// arrays with one shape per loop. a cloth away from all obstacles costs little more than the
+// gather.
+//
+// a particle closer than thickness to a surface is pushed out to thickness, loses its velocity
+// into the surface (bouncing back with restitution times it) and slows down along the surface
+// by coulomb friction.
+class ClothObstacles
+{
+private:
+    std::vector<ClothObstacle> obstacles;
+    std::vector<glm::vec3> boundsMin;
+    std::vector<glm::vec3> boundsMax;
+
+    // bumped on every change, so the cloth can wake up when something moved into it
+    unsigned int version;
+
+    // particle positions, gathered for every pass. velocities are only read for particles in contact
+    std::vector<float> positionX, positionY, positionZ;
+
+    // bounds of each chunk of CHUNK_SIZE particles
+    std::vector<glm::vec3> chunkMin;
+    std::vector<glm::vec3> chunkMax;
+    // obstacles overlapping the cloth in this pass
+    std::vector<int> candidates;
+
+    void UpdateBounds(int obstacle);
+    // whether the obstacle can come within thickness of anything in the box
+    bool Overlaps(int obstacle, glm::vec3 lower, glm::vec3 upper, float thickness);
+
+    // push the awake, unpinned particles of [begin, end) out of one obstacle
+    void CollideRange(std::vector<Particle*>& particles, std::vector<char>& awake, const ClothObstacle& obstacle, int begin, int end, float thickness);
+
+public:
+    static const int CHUNK_SIZE = 256;
+
+    ClothObstacles();
+
+    int AddPlane(glm::vec3 normal, float offset, float friction = 0.5f, float restitution = 0.0f);
+    int AddSphere(glm::vec3 centre, float radius, float friction = 0.5f, float restitution = 0.0f);
+    int AddCapsule(glm::vec3 end0, glm::vec3 end1, float radius, float friction = 0.5f, float restitution = 0.0f);
+    int AddBox(glm::vec3 centre, glm::vec3 halfExtents, glm::mat3 rotation = glm::mat3(1.0f), float friction = 0.5f, float restitution = 0.0f);
+
+    // to move, resize or otherwise change an obstacle get it, change it and set it back
+    ClothObstacle GetObstacle(int obstacle);
+    void SetObstacle(int obstacle, const ClothObstacle& shape);
+    // the obstacles after it move down one index
+    void Remove(int obstacle);
+    void Clear();
+
+    int GetNumObstacles();
+    unsigned int GetVersion();
+
+    // one collision pass over the particles, only touching the ones flagged in awake
+    void Collide(std::vector<Particle*>& particles, std::vector<char>& awake, float thickness);
+};
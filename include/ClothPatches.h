@@ -0,0 +1,68 @@
+#pragma once
+
+#include "SpringDamper.h"
+#include "ThreadPool.h"
+#include <vector>
+
+// splits a cloth into small patches of connected particles so parts of it that have come to
+// rest can be put to sleep and skipped by the simulation.
+//
+// patches are grown breadth-first over the spring graph up to PATCH_SIZE particles, so they are
+// compact on any mesh and never span two disconnected islands. a patch falls asleep once none of
+// its particles has been faster than the sleep speed for sleepDelay seconds, and only if none of
+// its neighbours is still moving. a moving patch wakes the sleeping patches next to it, so a
+// disturbance spreads through the cloth the same way it would through the springs.
+class ClothPatches
+{
+private:
+    // particles of each patch, patchParticles[patchStart[p] .. patchStart[p + 1])
+    std::vector<int> patchStart;
+    std::vector<int> patchParticles;
+    std::vector<int> patchOfParticle;
+
+    // patches sharing a spring with each patch, same layout
+    std::vector<int> neighbourStart;
+    std::vector<int> neighbours;
+
+    // per patch state
+    std::vector<char> awake;
+    std::vector<char> moving;
+    std::vector<float> restTime;
+
+    // awake flag of each particle's patch, for quick lookups from springs and particles
+    std::vector<char> particleAwake;
+    int numAwakePatches;
+
+    float sleepSpeed;
+    float sleepDelay;
+
+    void SetAwake(int patch, bool isAwake);
+
+public:
+    // room for maxParticles, the particles tearing adds included
+    ClothPatches(std::vector<Particle*>& particles, std::vector<SpringDamper*>& springs, int maxParticles);
+
+    // measure the patches after a step, put resting ones to sleep (zeroing their velocities) and
+    // wake the neighbours of moving ones. with together set nothing sleeps until every patch is
+    // ready to (for solvers that move all particles at once). returns true if any patch changed state
+    bool Update(std::vector<Particle*>& particles, float dt, bool together);
+
+    // a particle split off copyOf by a tear, added as the next index in copyOf's patch
+    void AddParticle(int particle, int copyOf);
+    void WakeAll();
+    void WakePatchOf(int particle);
+
+    bool IsParticleAwake(int particle);
+    // per particle awake flags, 1 = awake
+    std::vector<char>& GetParticleAwake();
+    bool IsAllAsleep();
+
+    int GetNumPatches();
+    int GetNumAwakePatches();
+
+    // speed below which a particle counts as resting, and how long a patch has to rest to sleep
+    float GetSleepSpeed();
+    void SetSleepSpeed(float sleepSpeed);
+    float GetSleepDelay();
+    void SetSleepDelay(float sleepDelay);
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Cloth.h"
+#include "ClothSimulationThread.h"
+#include <vector>
+
+// GL side of a Cloth: vertex/index buffers and the draw calls. Cloth itself only holds the
+// simulation, so it can be built and stepped without a GL context (see bench/cloth_bench.cpp).
+//
+// topology is uploaded once in the constructor, positions and normals are re-uploaded in
+// Draw only when the cloth's version says its particles moved since the last upload, or,
+// while the cloth runs on a ClothSimulationThread, when that thread published a new frame.
+// when the cloth tears, just the indices of the torn and split pieces are overwritten in place.
+class ClothRenderer
+{
+private:
+    Cloth* cloth;
+    // set while the cloth runs on its own thread, frames then come from here instead
+    ClothSimulationThread* simulationThread;
+
+    GLuint VAO;
+    GLuint VBO_positions;
+    GLuint VBO_normals;
+    GLuint EBO;
+    std::vector<glm::vec3> vertexPositions;
+    std::vector<unsigned int> triangleIndices;
+
+    glm::mat4 model;
+    glm::vec3 color;
+
+    // springs are drawn as lines straight out of VBO_positions through their own index buffer
+    GLuint springVAO, springEBO;
+    std::vector<unsigned int> springIndices;
+
+    // Cloth::GetVersion at the last upload
+    unsigned int uploadedVersion;
+    // entries of the cloth's tear log already patched into the index buffers
+    int patchedTornSprings;
+    int patchedTornTriangles;
+    int patchedSplitCorners;
+    int patchedSplitSpringEnds;
+    bool drawTriangles;
+    bool drawSprings;
+
+    void SetupBuffers();
+
+    // upload positions and the cloth's vertex normals
+    void UpdateBuffers();
+    void Upload(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals);
+    // rewire split corners and spring ends, then collapse torn springs and triangles in the index
+    // buffers, only the new log entries are touched
+    void PatchTorn(int numTornSprings, int numTornTriangles, int numSplitCorners, int numSplitSpringEnds);
+
+public:
+    // needs a current GL context, the cloth must outlive the renderer
+    ClothRenderer(Cloth* cloth);
+    ~ClothRenderer();
+
+    void Draw(glm::mat4 viewProjMtx, GLuint shader);
+
+    Cloth* GetCloth();
+
+    // draw from a simulation thread's published frames, nullptr to read the cloth directly again
+    void SetSimulationThread(ClothSimulationThread* simulationThread);
+
+    // what Draw shows
+    bool GetDrawTriangles();
+    void SetDrawTriangles(bool drawTriangles);
+    bool GetDrawSprings();
+    void SetDrawSprings(bool drawSprings);
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "Cloth.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// input for the cloth from the ui thread, applied by the simulation thread before its next step
+struct ClothCommand
+{
+    enum Type
+    {
+        SetWind,
+        Translate,
+        SetTimestep
+    };
+
+    Type type;
+    glm::vec3 value;
+};
+
+// positions and normals of one published simulation state
+struct ClothFrame
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    // Cloth::GetVersion when it was published
+    unsigned int version;
+    // how much of the cloth's tear log this state includes (the log itself is never reallocated)
+    int numTornSprings;
+    int numTornTriangles;
+    int numSplitCorners;
+    int numSplitSpringEnds;
+};
+
+// runs a Cloth on its own thread at a fixed rate, so the frame rate and the simulation rate no
+// longer hold each other back.
+//
+// results come back through a lock-free triple buffer: the simulation thread fills its back
+// frame and swaps it with the middle one, the render thread swaps the middle one into its front
+// frame whenever a new one has been published. neither side ever waits for the other and the
+// renderer always sees a complete state. input goes the other way through a single-producer
+// single-consumer ring of commands.
+//
+// while the thread runs it owns the cloth, only the ui thread may call the methods below and
+// nothing else may touch the cloth until the thread is deleted.
+class ClothSimulationThread
+{
+private:
+    Cloth* cloth;
+    std::thread thread;
+    std::atomic<bool> running;
+    std::atomic<bool> paused;
+    float timestep;
+
+    // triple buffer, middle holds a frame index plus FRESH_FRAME once there's something new
+    ClothFrame frames[3];
+    int backFrame;
+    int frontFrame;
+    std::atomic<int> middleFrame;
+
+    // command ring, the ui thread only moves commandTail and the simulation thread only commandHead
+    std::vector<ClothCommand> commands;
+    std::atomic<unsigned int> commandHead;
+    std::atomic<unsigned int> commandTail;
+    // last wind pushed (ui thread only)
+    glm::vec3 queuedWind;
+
+    // measured simulation steps per second
+    std::atomic<float> stepRate;
+
+    void Run();
+    // apply everything queued so far, returns how many commands there were
+    int ProcessCommands();
+    // copy the cloth's current state into a frame
+    void Capture(ClothFrame& frame);
+    void Publish();
+    bool Push(ClothCommand::Type type, glm::vec3 value);
+
+public:
+    ClothSimulationThread(Cloth* cloth, float timestep);
+    // stops and joins the thread, the cloth can be used directly again afterwards
+    ~ClothSimulationThread();
+
+    // forwarded to the cloth through the command queue
+    void SetWind(glm::vec3 wind);
+    void Translate(glm::vec3 translation);
+    void SetTimestep(float timestep);
+
+    void SetPaused(bool paused);
+
+    // swap in the latest published frame, returns false if nothing new was published since the last call
+    bool AcquireFrame();
+    // frame from the last successful AcquireFrame
+    ClothFrame& GetFrame();
+
+    float GetStepRate();
+};
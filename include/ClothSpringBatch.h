@@ -0,0 +1,101 @@
+#pragma once
+
+#include "SpringDamper.h"
+#include "ThreadPool.h"
+#include <atomic>
+#include <vector>
+
+// every spring-damper of a cloth in one pass, the batched version of SpringDamper::ComputeForce.
+//
+// spring data is kept as structure-of-arrays and particle state is gathered into flat float
+// arrays, so the spring loop handles 8 springs per iteration with AVX2 (gathering both ends
+// through the index arrays) and falls back to a plain loop the compiler can vectorise elsewhere.
+// the force on each spring is written to its own slot and summed per particle afterwards through
+// a particle -> spring table, so the pass can run on several threads without two of them ever
+// writing to the same particle.
+//
+// tearing: the same pass flags springs stretched past the tear limit, and Break turns them into
+// tombstones in place (no force, never flagged again) so the arrays and the table stay valid.
+// once enough tombstones pile up the active arrays are compacted. a tear that splits a particle
+// moves spring ends onto its copy with SetEnds. all of it works inside the arrays sized at
+// construction, tearing never allocates.
+class ClothSpringBatch
+{
+private:
+    // every spring, in the order of Cloth's spring list
+    std::vector<int> indexP1;
+    std::vector<int> indexP2;
+    std::vector<float> restLength;
+    std::vector<float> springConstant;
+    std::vector<float> dampingConstant;
+
+    // the springs with at least one awake end, packed so the kernel runs over contiguous data
+    std::vector<int> activeP1;
+    std::vector<int> activeP2;
+    std::vector<float> activeRestLength;
+    std::vector<float> activeSpringConstant;
+    std::vector<float> activeDampingConstant;
+    // slot -> index of the spring
+    std::vector<int> activeSpring;
+
+    // particles at either end of an active spring, the only ones gathered and summed
+    std::vector<int> activeParticles;
+
+    // active springs at each particle, particleSprings[particleSpringStart[p] .. particleSpringStart[p + 1]).
+    // entries are slots in the active arrays, +1 when the particle is the first end and negated
+    // (-(slot + 1)) when it is the second, which takes the opposite force
+    std::vector<int> particleSpringStart;
+    std::vector<int> particleSprings;
+
+    // particle state, gathered at the start of every pass
+    std::vector<float> positionX, positionY, positionZ;
+    std::vector<float> velocityX, velocityY, velocityZ;
+
+    // per active spring: force on its first end
+    std::vector<float> forceX, forceY, forceZ;
+
+    // torn springs, left out of the active arrays on the next Pack
+    std::vector<char> broken;
+    // per active spring: stretched past tearStretch in the last pass
+    std::vector<char> overstretched;
+    std::atomic<int> numOverstretched;
+    // length / rest length at which a spring tears, 0 for never
+    float tearStretch;
+    // broken springs still in the active arrays
+    int numTombstones;
+
+    // counting sort space for Pack
+    std::vector<int> fill;
+
+    // awake flags from the last SetActive, kept to repack after a change of constants
+    std::vector<char> particleAwake;
+
+    // rebuild the active arrays and the particle -> spring table from particleAwake
+    void Pack();
+    // forces of active springs [begin, end), returns how many were overstretched
+    int ComputeSprings(int begin, int end);
+
+public:
+    // particle arrays have room for maxParticles, the particles tearing adds included
+    ClothSpringBatch(std::vector<SpringDamper*>& springs, int maxParticles);
+
+    // compute every active spring's force and add it to both of its particles
+    void ApplyForces(std::vector<Particle*>& particles);
+
+    // limit the pass to springs with an awake end (see ClothPatches). springs between two
+    // sleeping particles are at rest and would only push on particles that don't move
+    void SetActive(std::vector<char>& particleAwake);
+
+    // pick up changed spring constants (Cloth::SetSpringConstant)
+    void SetSpringConstants(std::vector<SpringDamper*>& springs);
+
+    // tearing limit as length / rest length, 0 turns tearing off
+    float GetTearStretch();
+    void SetTearStretch(float tearStretch);
+    // springs flagged by the last ApplyForces
+    int GetNumOverstretched();
+    // break every flagged spring, writing their indices to brokenSprings from numBroken on
+    void BreakOverstretched(std::vector<int>& brokenSprings, int& numBroken);
+    // move a spring onto other particles, used from the next SetActive on
+    void SetEnds(int spring, int indexP1, int indexP2);
+};
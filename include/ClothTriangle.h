@@ -36,4 +36,6 @@ public:
     int GetIndexP1();
     int GetIndexP2();
     int GetIndexP3();
+    // put corner 0, 1 or 2 on another particle (a tear split the old one)
+    void SetCorner(int corner, Particle* particle, int index);
 };
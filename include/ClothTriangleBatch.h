@@ -0,0 +1,94 @@
+#pragma once
+
+#include "ClothTriangle.h"
+#include "ThreadPool.h"
+#include "WindField.h"
+#include <vector>
+
+// every triangle of a cloth in one fused pass: one cross product per triangle gives the face
+// normal, the area and the aerodynamic drag, and the same normal feeds the vertex normals the
+// renderer draws with.
+//
+// particle state is gathered into flat float arrays first so the triangle loop is a straight,
+// branch-free run over structure-of-arrays data the compiler can vectorise. results are
+// written per triangle and then summed per vertex through a vertex -> triangle table, so no
+// two threads ever write to the same vertex (and the sums come out in the same order every run).
+//
+// with a wind field, each chunk of triangles first writes its centroids out and samples the field
+// for all of them in one call, and the drag then uses the wind at each centroid.
+class ClothTriangleBatch
+{
+private:
+    // corners of each triangle
+    std::vector<int> indexP1;
+    std::vector<int> indexP2;
+    std::vector<int> indexP3;
+
+    // particle state, gathered at the start of every pass
+    std::vector<float> positionX, positionY, positionZ;
+    std::vector<float> velocityX, velocityY, velocityZ;
+
+    // per triangle: drag force on each corner and unit face normal
+    std::vector<float> forceX, forceY, forceZ;
+    std::vector<float> normalX, normalY, normalZ;
+
+    // centroids of the active triangles and the field's wind there, by position in activeTriangles
+    std::vector<float> centroidX, centroidY, centroidZ;
+    std::vector<float> airX, airY, airZ;
+
+    // triangles touching each vertex, vertexTriangles[vertexTriangleStart[v] .. vertexTriangleStart[v + 1])
+    std::vector<int> vertexTriangleStart;
+    std::vector<int> vertexTriangles;
+
+    // triangles with at least one awake corner and the corners of those, Compute only touches these
+    std::vector<int> activeTriangles;
+    std::vector<int> activeVertices;
+
+    // 1 for triangles still in the cloth, 0 once torn out. a torn triangle stays in the active
+    // list as a tombstone with no drag and no normal until enough of them are compacted away
+    std::vector<float> alive;
+    int numTombstones;
+
+    // awake flags from the last SetActive and scratch space for it, kept so nothing allocates later
+    std::vector<char> particleAwake;
+    std::vector<char> touched;
+
+    // rebuild the active lists from particleAwake and alive
+    void Pack();
+    // counting sort of the corners into vertexTriangleStart / vertexTriangles, in place
+    std::vector<int> vertexFill;
+    void BuildVertexTable();
+
+    // per vertex results
+    std::vector<glm::vec3> vertexForces;
+    std::vector<glm::vec3> vertexNormals;
+
+    // same constants as ClothTriangle (flat plate, air at 15 C)
+    float dragCoefficient;
+    float fluidDensity;
+
+public:
+    // per vertex arrays have room for maxParticles, the particles tearing adds included
+    ClothTriangleBatch(std::vector<ClothTriangle*>& triangles, int maxParticles);
+
+    // normals and drag for the particles' current positions and velocities. the air moves at
+    // wind everywhere, plus the field's wind at each triangle when there is a field
+    void Compute(std::vector<Particle*>& particles, glm::vec3 wind, WindField* windField);
+
+    // limit Compute to the triangles around awake particles (see ClothPatches). the rest keep the
+    // results of the last pass, which stay valid as long as their particles don't move
+    void SetActive(std::vector<char>& particleAwake);
+
+    // tear a triangle out of the cloth (see Cloth tearing), in place. only used once the cloth
+    // has no spare particles left to split
+    void RemoveTriangle(int triangle);
+    // a tear split vertex: the given triangles now use copy instead, in place. takes effect for
+    // Compute at the next SetActive
+    void SplitVertex(int vertex, int copy, const int* triangles, int numTriangles);
+
+    // add the drag from the last Compute to the particles
+    void ApplyForces(std::vector<Particle*>& particles);
+
+    // area-independent average of the face normals around each vertex, as of the last Compute
+    std::vector<glm::vec3>& GetVertexNormals();
+};
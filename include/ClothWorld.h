@@ -0,0 +1,54 @@
+#pragma once
+
+#include "Cloth.h"
+#include <vector>
+
+// where one cloth of a ClothWorld lives in the world's shared arrays
+struct ClothInstance
+{
+    int particleOffset;
+    int numParticles;
+    int springOffset;
+    int numSprings;
+    int triangleOffset;
+    int numTriangles;
+};
+
+// many separate cloths (flags, banners, ...) simulated and drawn as one.
+//
+// every added cloth is merged into a single Cloth, with its particles, springs and triangles
+// stored as a range of the shared arrays. one Simulate then runs each batched pass (forces,
+// springs, integration, the triangle pass) once over all of them, with the thread pool
+// splitting the whole world instead of each small cloth on its own, and one ClothRenderer on
+// GetCloth() draws all of them from a single set of buffers. the cloths share the wind and
+// the solver settings, and patches never span two cloths, so each one still sleeps on its own.
+class ClothWorld
+{
+private:
+    // every instance, owned
+    Cloth* cloth;
+    std::vector<ClothInstance> instances;
+
+public:
+    ClothWorld();
+    ~ClothWorld();
+
+    // take over a cloth (it is deleted), moved by offset. returns the new instance's index.
+    // rebuilds the shared cloth, so add everything before handing GetCloth() to a renderer
+    int Add(Cloth* instance, glm::vec3 offset = glm::vec3(0.0f));
+    // the same for several at once, returns the index of the first
+    int Add(std::vector<Cloth*>& added, std::vector<glm::vec3>& offsets);
+
+    void SetWind(glm::vec3 wind);
+    // one field blows through every instance, each sees the wind where it stands
+    void SetWindField(WindField* windField);
+    void Simulate(float dt);
+
+    // move the pinned particles of one instance
+    void Translate(int instance, glm::vec3 translation);
+
+    // the shared cloth, for rendering and whole-world settings
+    Cloth* GetCloth();
+    int GetNumInstances();
+    ClothInstance& GetInstance(int instance);
+};
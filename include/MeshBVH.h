@@ -0,0 +1,63 @@
+#pragma once
+
+#include "core.h"
+#include "ThreadPool.h"
+#include <vector>
+
+// closest point on the mesh found by MeshBVH::FindClosest
+struct MeshHit
+{
+    int triangle;
+    glm::vec3 point;
+    // face normal of the hit triangle (from the winding order)
+    glm::vec3 normal;
+    float distance;
+};
+
+// bounding volume hierarchy over a triangle mesh whose vertices move every frame (e.g. a skin).
+//
+// the tree is built once from the bind pose with median splits on the longest centroid axis.
+// after the vertices move only the boxes are refit: leaves are recomputed in parallel, then
+// the internal nodes bottom-up (children are always stored after their parent, so a reverse
+// sweep visits them in the right order). the topology stays the same, so the tree gets looser
+// as the mesh deforms but a character never strays far enough from its bind pose to matter.
+class MeshBVH
+{
+private:
+    struct Node
+    {
+        glm::vec3 boxMin;
+        // leaf: first entry in triangleOrder, internal: index of the left child (right is + 1)
+        int firstOrChild;
+        glm::vec3 boxMax;
+        // number of triangles, 0 for internal nodes
+        int count;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<glm::ivec3> triangles;
+    // triangles in leaf order
+    std::vector<int> triangleOrder;
+
+    // vertex positions of the last build/refit, owned by the mesh
+    const std::vector<glm::vec3>* positions;
+
+    void BuildNode(int node, int first, int count, std::vector<glm::vec3>& centroids);
+    void ComputeLeafBox(Node& node);
+
+public:
+    MeshBVH();
+
+    // build the tree over the triangles at the given vertex positions
+    void Build(const std::vector<glm::vec3>& positions, const std::vector<glm::ivec3>& triangles);
+
+    // update the boxes after the vertices moved, positions must have the same layout as in Build
+    void Refit(const std::vector<glm::vec3>& positions);
+
+    // closest point on the mesh to point within maxDistance, returns false if there is none.
+    // safe to call from several threads at once
+    bool FindClosest(glm::vec3 point, float maxDistance, MeshHit& hit);
+
+    int GetNumTriangles();
+    int GetNumNodes();
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "core.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// blend shapes of a skin, layered on the rest pose before it is skinned: rest = base + Σ wt * Δt.
+//
+// every target is sparse, a list of the vertices it moves with a position delta and a normal
+// delta each, so a face rig of dozens of targets that each touch a few hundred vertices costs
+// what those vertices cost and not a dense copy of the mesh per target. the entries of all
+// targets sit one after another, sorted by vertex within a target, with the 6 floats of their
+// deltas in one array so AVX moves a whole entry with one 8 float load.
+//
+// Apply only touches what changed since its last call: the vertices of targets whose weight
+// changed go back to the base and then get every target with a nonzero weight added again, the
+// rest already hold the right sum. targets at weight 0 are never read.
+class MorphTargets
+{
+private:
+    int numVertices;
+
+    std::vector<std::string> names;
+    // entries of target t are [targetStart[t], targetStart[t + 1])
+    std::vector<int> targetStart;
+    // per entry, the vertex and DELTA_STRIDE floats of delta: position x, y, z, normal x, y, z.
+    // 2 floats of padding at the end so the last entry can be loaded 8 floats wide
+    std::vector<int> indices;
+    std::vector<float> deltas;
+
+    std::vector<float> weights;
+    // what the output currently holds
+    std::vector<float> appliedWeights;
+
+    // vertices the last Apply changed, each once in no particular order, and a flag per vertex as
+    // scratch for finding them
+    std::vector<int> changedVertices;
+    std::vector<uint8_t> marks;
+
+    // output += weight * deltas for the entries [begin, end), only where marked when masked
+    void Accumulate(int begin, int end, float weight, bool masked, glm::vec3* positions, glm::vec3* normals);
+
+public:
+    static const int DELTA_STRIDE = 6;
+
+    MorphTargets(int numVertices);
+
+    // a target's entries in any order, indices in [0, numVertices). a vertex listed twice gets
+    // both deltas
+    void AddTarget(const std::string& name, const std::vector<int>& vertices, const std::vector<glm::vec3>& positionDeltas, const std::vector<glm::vec3>& normalDeltas);
+
+    int GetNumTargets();
+    const std::string& GetName(int target);
+    // -1 if there is no target of that name
+    int FindTarget(const std::string& name);
+    float GetWeight(int target);
+    void SetWeight(int target, float weight);
+
+    // bring positions and normals (the morphed rest pose, base + the weighted deltas) up to date
+    // with the current weights. both have to hold the result of the previous call, or a copy of
+    // the base before the first. false if no weight changed and nothing was touched
+    bool Apply(const glm::vec3* basePositions, const glm::vec3* baseNormals, glm::vec3* positions, glm::vec3* normals);
+    const std::vector<int>& GetChangedVertices();
+
+    // total entries over every target, and the bytes they take
+    int GetNumDeltas();
+    int GetBytes();
+};
@@ -41,4 +41,5 @@ public:
     void SetPressure(float pressure);
 
     bool IsFixed();
+    void SetFixed(bool fixed);
 };
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "SpringDamper.h"
+#include "ThreadPool.h"
+#include <vector>
+
+// projective dynamics solver for mass-spring cloth (liu et al. 2013, bouaziz et al. 2014)
+//
+// each step minimises
+//   (1/(2h^2)) * |x - y|_M^2 + Σ (k/2) * |xa - xb - d|^2
+// where y = x + h * v + h^2 * M^(-1) * fext is the inertial target and d is the spring
+// direction scaled to rest length. alternating between
+//   local:  d = l0 * (xa - xb) / |xa - xb|          (independent per spring, run in parallel)
+//   global: (M/h^2 + L) x = M * y / h^2 + J * d     (same matrix every iteration)
+// means the system matrix only has to be factored once, and each iteration is just a
+// back-substitution. iterates are accelerated with the chebyshev semi-iterative method (wang 2015).
+//
+// fixed particles are removed from the unknowns, so the matrix only changes when the
+// spring constants, the fixed set or the timestep change.
+//
+// the factor is a supernodal cholesky on a nested dissection ordering. nested dissection keeps
+// the fill near O(n log n) where the old reverse cuthill-mckee envelope grew as O(n^1.5), and
+// the separators it produces come out as wide supernodes that are solved with dense loops.
+class ProjectiveDynamics
+{
+private:
+    // solver settings
+    int numIterations;
+    // estimated spectral radius and under-relaxation for chebyshev acceleration
+    float chebyshevRho;
+    float chebyshevGamma;
+    // plain iterations before chebyshev kicks in
+    int chebyshevDelay;
+    // fraction of velocity removed each step (pd has no implicit dashpots)
+    float damping;
+
+    // factorisation state
+    bool needsFactorization;
+    float factoredTimestep;
+
+    // particle index -> row of the system and row -> particle index. the first numRows rows are
+    // the free particles in nested dissection order (recursive coordinate bisection, each half
+    // before the particles separating them), the fixed particles come after them so springs can
+    // still reach them
+    int numRows;
+    std::vector<int> particleToRow;
+    std::vector<int> rowToParticle;
+
+    // supernodes: runs of consecutive columns of L that share their pattern below the diagonal.
+    // supernode s covers columns supernodeStart[s]..supernodeStart[s + 1], its rows (its own
+    // columns first) are supernodeRows[rowStart[s]..rowStart[s + 1]] and its values are a dense
+    // block stored by rows at supernodeValues[valueStart[s]], with 1 / L_jj on the diagonal
+    std::vector<int> supernodeStart;
+    std::vector<int> rowStart;
+    std::vector<int> supernodeRows;
+    std::vector<int> valueStart;
+    std::vector<double> supernodeValues;
+
+    // springs flattened to rows at factorisation so the iterations don't chase SpringDamper pointers
+    std::vector<int> springRow1;
+    std::vector<int> springRow2;
+    std::vector<float> springRestLength;
+    std::vector<float> springStiffness;
+    // springs with one fixed end, they add a constant k * x_fixed to the right hand side
+    std::vector<int> fixedSprings;
+    // springs at each free row, rowSprings[rowSpringStart[row] .. rowSpringStart[row + 1]). entries are
+    // s + 1 when the row is the first end of spring s and -(s + 1) when it is the second
+    std::vector<int> rowSpringStart;
+    std::vector<int> rowSprings;
+    // M / h^2 per row
+    std::vector<double> rowInertia;
+
+    // per iteration data, indexed by row. the right hand side keeps x, y, z and a zero of each
+    // row together, so one avx2 register holds a row and the three axes are solved at once
+    std::vector<glm::vec3> iterate;
+    std::vector<glm::vec3> previousIterate;
+    // k * d of every spring from the local step
+    std::vector<float> projectionX;
+    std::vector<float> projectionY;
+    std::vector<float> projectionZ;
+    std::vector<double> constantRhs;
+    std::vector<double> rhs;
+    std::vector<double> work;
+
+    void Factorize(std::vector<Particle*>& particles, std::vector<SpringDamper*>& springs, float dt);
+    void ComputeOrdering(std::vector<Particle*>& particles, std::vector<SpringDamper*>& springs);
+    void Dissect(std::vector<int>& nodes, const std::vector<glm::vec3>& positions, const std::vector<int>& adjacencyStart,
+                 const std::vector<int>& adjacency, std::vector<int>& label, int& nextLabel, std::vector<int>& order);
+    void Solve();
+    void ComputeProjections(int begin, int end);
+
+public:
+    ProjectiveDynamics();
+
+    // advance the cloth by dt, forces already applied to particles are treated as external forces
+    void Step(std::vector<Particle*>& particles, std::vector<SpringDamper*>& springs, float dt);
+
+    // call when spring constants or the fixed particle set change
+    void Invalidate();
+
+    // getters and setters
+    int GetNumIterations();
+    void SetNumIterations(int numIterations);
+    float GetChebyshevRho();
+    void SetChebyshevRho(float chebyshevRho);
+    float GetDamping();
+    void SetDamping(float damping);
+};
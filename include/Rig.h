@@ -16,5 +16,10 @@ public:
 
     Skeleton* GetSkeleton();
 
+    // channels 0-2 are the root translation, then 3 rotations per joint, then one weight per
+    // morph target of the skin (a clip without them leaves the weights alone)
     void ApplyPose(Pose& pose);
+    // just the joints, the skin and its morph weights are left alone (for posing a skeleton to
+    // read its world matrices off, see SkinCrowd)
+    void PoseSkeleton(Pose& pose);
 };
\ No newline at end of file
@@ -0,0 +1,268 @@
+#pragma once
+
+#include "ClothTriangle.h"
+#include "ThreadPool.h"
+#include <vector>
+
+// particle vs triangle contact, closest point on the triangle is b1 * x1 + b2 * x2 + b3 * x3
+struct PointTriangleContact
+{
+    int particle;
+    int triangle;
+    glm::vec3 barycentric;
+    glm::vec3 normal;
+};
+
+// edge vs edge contact, closest points are lerp(edgeA, s) and lerp(edgeB, t)
+struct EdgeEdgeContact
+{
+    int edgeA;
+    int edgeB;
+    float s;
+    float t;
+    glm::vec3 normal;
+};
+
+// spatial hash entry (a triangle, an edge or a particle as a point), the box is kept next to
+// the item so a query walks the bucket without touching per-item data
+struct HashEntry
+{
+    int item;
+    glm::vec3 boxMin;
+    glm::vec3 boxMax;
+};
+
+// a pair searched but left out of the candidates that was still within the search distance,
+// (particle, triangle) or (lower edge, higher edge), and how far it was from the thickness
+struct NearMiss
+{
+    glm::ivec2 pair;
+    float slack;
+};
+
+// cloth self-collision using a spatial hash and candidate lists that are reused between steps.
+//
+// contacts are only looked for among candidates, the particle-triangle and edge-edge pairs that
+// were closer than the thickness plus a margin when they were last searched. a pair that was
+// further apart can only come within the thickness once its particles have moved relative to
+// each other by more than the margin, so the lists stay good as long as particles that were near
+// each other have kept moving together. that is checked between groups of particles (coarse
+// cells at the last full search): the displacements of two groups may not spread further than
+// the slack the pair has left, or than their distance less what two triangles and the thickness
+// span. the search looks a little further than the candidates go, and a pair of groups gets as
+// slack how far the closest pair it found past the candidates was from the thickness (at most
+// the search distance less the thickness, more than the margin). a group that moved too far is
+// dirty, and only the pairs with a particle in a dirty group, or in one that used half of what
+// it may move, are searched again, the rest of the lists is kept. the whole cloth is searched
+// and regrouped when more than half of it is dirty. a cloth that hangs still, sleeps, or swings
+// and falls without folding rarely searches, a folding one searches around the fold.
+//
+// a search hashes the thickened bounding boxes of the triangles and of the edges by the cell of
+// the box centre, one entry each. the hashes are kept between searches: the boxes are computed
+// in parallel, and a partial search only updates the entries of the groups around the dirty
+// ones, moving an entry to another bucket when its cell changed. the cell size is kept at least
+// as large as the biggest box, so a query visits a handful of cells. dirty particles query the
+// triangles around them, dirty triangles the clean particles and dirty edges the other edges,
+// in parallel; a particle is culled against its own triangles and an edge against edges it
+// shares an endpoint with (read from the ClothTriangle indices) before the distance test. the
+// lists are kept sorted, so they don't depend on which searches were partial.
+//
+// contacts are resolved in the order they were found by pushing the pair apart to the thickness
+// and removing the approaching normal velocity. contacts that share no moving particle don't
+// affect each other, so they are put in batches that run one after another, the contacts of a
+// batch in parallel, which gives the same result as resolving them one by one. fixed and
+// sleeping particles don't move.
+class SelfCollision
+{
+private:
+    // distance kept between the two sides of the cloth
+    float thickness;
+    // how much further than the thickness the candidates are searched
+    float margin;
+    // hash grid cell size, grows if a box gets bigger than a cell
+    float cellSize;
+
+    // particle indices of each triangle and unique edges, the edges of each triangle and how
+    // many triangles that aren't torn each edge still has
+    std::vector<glm::ivec3> triangleIndices;
+    std::vector<glm::ivec2> edges;
+    std::vector<glm::ivec3> triangleEdges;
+    std::vector<int> edgeTriangles;
+    std::vector<char> triangleTorn;
+    // the particle each one was split off by tearing, itself if it wasn't. particles of the same
+    // origin are culled like one particle, the two sides of a tear start out touching
+    std::vector<int> particleOrigin;
+    // edges of the triangles being moved by SplitParticle and how many of them each one has
+    std::vector<glm::ivec2> splitEdges;
+
+    // spatial hashes of the triangles, the edges and the particles: fixed size tables of
+    // buckets, cells are hashed into a bucket so unrelated cells can share one (a query reads each
+    // bucket once, entries of far away cells fail the box test). kept between searches, an item
+    // only moves when its cell changed
+    int bucketMask;
+    std::vector<std::vector<HashEntry>> triangleHash;
+    std::vector<std::vector<HashEntry>> edgeHash;
+    std::vector<std::vector<HashEntry>> particleHash;
+
+    // boxes thickened by the search distance, the cell each item is in the hash with and where
+    // in its bucket (-1 when it isn't in yet)
+    std::vector<glm::vec3> triangleMin;
+    std::vector<glm::vec3> triangleMax;
+    std::vector<glm::ivec3> triangleCells;
+    std::vector<int> triangleSlots;
+    std::vector<glm::vec3> edgeMin;
+    std::vector<glm::vec3> edgeMax;
+    std::vector<glm::ivec3> edgeCells;
+    std::vector<int> edgeSlots;
+    std::vector<glm::ivec3> particleCells;
+    std::vector<int> particleSlots;
+    // half size of the biggest box on each axis
+    glm::vec3 largestTriangleHalfExtent;
+    glm::vec3 largestEdgeHalfExtent;
+
+    // candidate pairs, (particle, triangle) and (lower edge, higher edge), and where the
+    // particles were at the last search
+    std::vector<glm::ivec2> pointTriangleCandidates;
+    std::vector<glm::ivec2> edgeEdgeCandidates;
+    std::vector<NearMiss> pointTriangleMisses;
+    std::vector<NearMiss> edgeEdgeMisses;
+    std::vector<glm::vec3> searchPositions;
+    bool searched;
+    int numSearches;
+    int numFullSearches;
+
+    // particles grouped by coarse cells of GROUP_CELLS hash cells (more if that makes over
+    // MAX_GROUPS groups) at the last full search, group g is groupParticles[groupStart[g] ..
+    // groupStart[g + 1]). the bounds of each group's positions at the last search and of its
+    // displacements since (and of all displacements), the size of the biggest triangle then,
+    // which groups moved too far and particles and edges of those
+    float groupSize;
+    std::vector<long long> particleKeys;
+    std::vector<long long> groupKeys;
+    std::vector<int> particleGroups;
+    std::vector<int> triangleGroups;
+    std::vector<int> edgeGroups;
+    std::vector<int> groupStart;
+    std::vector<int> groupParticles;
+    std::vector<glm::vec3> groupMin;
+    std::vector<glm::vec3> groupMax;
+    std::vector<glm::vec3> displacementMin;
+    std::vector<glm::vec3> displacementMax;
+    float largestTriangle;
+    std::vector<char> groupDirty;
+    std::vector<char> particleDirty;
+    std::vector<char> edgeDirty;
+    // the groups near each group at the last search (closer than the reach of two triangles and
+    // the thickness plus NEAR_GROUPS group sizes, itself included) are nearGroups[nearStart[g] ..
+    // nearStart[g + 1]), with the slack each pair has left and how far it may move against the
+    // other before it is dirty: the slack or the pair's distance less the reach, whichever is more
+    std::vector<int> nearStart;
+    std::vector<int> nearGroups;
+    std::vector<float> nearSlack;
+    std::vector<int> newNearStart;
+    std::vector<int> newNearGroups;
+    std::vector<float> newNearSlack;
+    std::vector<int> nearIndex;
+    std::vector<float> nearAllowance;
+    // group bounds to sweep for pairs closer than a distance, the groups in sweep order, their
+    // bounds in that order and the pairs found
+    std::vector<glm::vec3> sweepMin;
+    std::vector<glm::vec3> sweepMax;
+    std::vector<int> sweepOrder;
+    std::vector<glm::vec3> sortedMin;
+    std::vector<glm::vec3> sortedMax;
+    std::vector<glm::ivec2> groupPairs;
+    // groups whose items a partial search can find
+    std::vector<char> groupInRegion;
+
+    // per step data
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> velocities;
+    std::vector<float> inverseMasses;
+    std::vector<char> active;
+    std::vector<PointTriangleContact> pointTriangleContacts;
+    std::vector<EdgeEdgeContact> edgeEdgeContacts;
+
+    // what each chunk of a parallel loop found, joined in chunk order so the results don't
+    // depend on which thread ran what
+    std::vector<std::vector<glm::ivec2>> chunkCandidates;
+    std::vector<std::vector<NearMiss>> chunkMisses;
+    std::vector<std::vector<PointTriangleContact>> chunkPointTriangleContacts;
+    std::vector<std::vector<EdgeEdgeContact>> chunkEdgeEdgeContacts;
+
+    // resolve batches, contacts of batch b are batchContacts[batchStart[b] .. batchStart[b + 1]).
+    // particleBatch is the last batch that moved each particle
+    std::vector<int> contactBatches;
+    std::vector<int> particleBatch;
+    std::vector<int> batchStart;
+    std::vector<int> batchContacts;
+
+    static const int CHUNK_SIZE = 256;
+    // cells are at least as big as any box, so a query covers at most 3 cells on an axis (4 with
+    // rounding)
+    static const int QUERY_BUCKETS = 64;
+    static const int GROUP_CELLS = 2;
+    static const int NEAR_GROUPS = 1;
+    static const int MAX_GROUPS = 1024;
+
+    glm::ivec3 CellOf(glm::vec3 position);
+    int BucketOf(glm::ivec3 cell);
+    // the buckets of the cells from low to high, each once
+    int BucketsOf(glm::ivec3 low, glm::ivec3 high, int* buckets);
+
+    bool NeedsSearch(ThreadPool* pool);
+    void Search(ThreadPool* pool);
+    void GroupParticles(ThreadPool* pool);
+    // bounds of the groups at the search positions and what slack the pairs have left, at most
+    // the given one for the pairs searched again
+    void UpdateGroups(ThreadPool* pool, bool full, float slack);
+    void LowerSlack(int group1, int group2, float slack);
+    void FindGroupPairs(float distance, std::vector<glm::ivec2>& pairs);
+    void ComputeBoxes(ThreadPool* pool, float distance);
+    void ClearHash(std::vector<glm::ivec3>& cells, std::vector<int>& slots, std::vector<std::vector<HashEntry>>& hash);
+    // give the items in a group in the search region (all of them if all is set) their new boxes
+    // and move those whose cell changed
+    void UpdateHash(const std::vector<glm::vec3>& boxMin, const std::vector<glm::vec3>& boxMax, const std::vector<int>& groups, bool all, std::vector<glm::ivec3>& cells, std::vector<int>& slots, std::vector<std::vector<HashEntry>>& hash);
+    // replace the candidates that have a dirty particle, or all of them after a full search, and
+    // keep the near misses up to the search distance
+    void FindPointTriangleCandidates(ThreadPool* pool, float distance, float searchDistance, bool full);
+    void FindEdgeEdgeCandidates(ThreadPool* pool, float distance, float searchDistance, bool full);
+    void JoinCandidates(int numChunks, std::vector<glm::ivec2>& candidates, std::vector<NearMiss>& misses);
+
+    void FindContacts(ThreadPool* pool);
+    bool TestPointTriangle(int particle, int triangle, PointTriangleContact& contact);
+    bool TestEdges(int edgeA, int edgeB, EdgeEdgeContact& contact);
+    // the up to 4 particles of contact c (point-triangle ones first), their weights and the normal
+    void GetContact(int c, int* index, float* weight, glm::vec3& normal);
+    void ResolveContact(int c);
+    void ResolveContacts(ThreadPool* pool);
+
+public:
+    SelfCollision(std::vector<ClothTriangle*>& triangles, float thickness, float cellSize);
+
+    // detect and resolve self-collisions, positions and velocities of the awake particles are
+    // changed in place. contacts between sleeping particles only are skipped
+    void Resolve(std::vector<Particle*>& particles, std::vector<char>& awake);
+
+    // forget the candidates (needed after teleporting the cloth or changing a distance)
+    void Reset();
+
+    // a triangle torn out of the cloth no longer collides, nor do edges left without a triangle.
+    // the candidates holding them are dropped, the rest are kept
+    void RemoveTriangle(int triangle);
+    // a tear split particle: the given triangles now use copy (the next particle index) instead.
+    // an edge moves with them, or gets a copy when triangles on both sides still use it, and the
+    // copies take over the candidates of what they were copied from, so nothing is searched again
+    void SplitParticle(int particle, int copy, const int* triangles, int numTriangles);
+
+    // getters and setters
+    float GetThickness();
+    void SetThickness(float thickness);
+    float GetMargin();
+    void SetMargin(float margin);
+    int GetNumContacts();
+    int GetNumCandidates();
+    // searches done since the last Reset, partial ones included
+    int GetNumSearches();
+    int GetNumFullSearches();
+};
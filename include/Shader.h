@@ -11,3 +11,6 @@
 #include "core.h"
 
 GLuint LoadShaders(const char* vertex_file_path, const char* fragment_file_path);
+
+// vertex shader only, linked to capture the given outputs into separate buffers with transform feedback
+GLuint LoadFeedbackShader(const char* vertex_file_path, const char* const* varyings, int numVaryings);
@@ -2,8 +2,20 @@
 
 #include "Triangle.h"
 #include "Skeleton.h"
+#include "MeshBVH.h"
+#include "SkinBatch.h"
+#include "MorphTargets.h"
 #include <vector>
 
+// how Skin::Deform blends the joints of a vertex
+enum class SkinningMode
+{
+    // weighted sum of the skinning matrices, volume collapses at twisting joints
+    Linear,
+    // weighted sum of unit dual quaternions, keeps volume but ignores any scale in the joints
+    DualQuaternion
+};
+
 class Skin
 {
 private:
@@ -12,20 +24,93 @@ private:
     std::vector<glm::vec3> normals;
     std::vector<Triangle> triangles;
     std::vector<glm::mat4> bindings;
+    // inverted once at load, identity for a singular binding
+    std::vector<glm::mat4> inverseBindings;
 
     // processed vertex data
-    std::vector<Vertex> vertices;
     std::vector<glm::vec3> transformedPositions;
     std::vector<glm::vec3> transformedNormals;
 
     // skinning data
     Skeleton* skeleton;
+    // palette, once per joint per frame: Wi * Bi^(-1) for positions and its inverse transpose for normals
     std::vector<glm::mat4> skinningMatrices;
+    std::vector<glm::mat3> normalMatrices;
+    // the same, packed for the skinning kernel (see SkinBatch). dual quaternions instead in
+    // dual quaternion mode
+    std::vector<float> palette;
+    SkinningMode skinningMode;
+
+    // vertex streams for the skinning kernel, built at load. with a skeleton the positions,
+    // normals and triangles are put in the batch's order (grouped by number of joints)
+    SkinBatch* batch;
+
+    // blend shapes from the file's morphtarget sections, nullptr without any. positions and
+    // normals stay the unmorphed base, the batch skins morphedPositions and morphedNormals, which
+    // UpdateMorphs keeps at the base plus the weighted targets
+    MorphTargets* morphs;
+    std::vector<glm::vec3> morphedPositions;
+    std::vector<glm::vec3> morphedNormals;
+    // vertices whose morphed rest pose changed since the gpu's copy was last filled
+    std::vector<glm::ivec2> restUploadRanges;
+
+    // apply any morph weights that changed since the last call, true if a vertex moved
+    bool UpdateMorphs();
+    void UploadRestPose();
+
+    // split the vertices into chunks of chunkSize over the shared thread pool, or skin them all
+    // on the calling thread
+    bool parallelEnabled;
+    int chunkSize;
+
+    // fill the palette from the skeleton's current world matrices
+    void UpdatePalette();
+
+    // change tracking. UpdatePalette only rebuilds the joints whose world matrix differs from
+    // the one it last saw and lists them in dirtyJoints, and Deform only re-skins the vertices
+    // those joints influence. paletteValid false rebuilds every joint (nothing built yet, or the
+    // mode changed), meshValid false re-skins every vertex (the palette moved on without them).
+    // paletteUploaded is false while the palette texture is behind
+    std::vector<glm::mat4> worldMatrices;
+    std::vector<int> dirtyJoints;
+    bool paletteValid;
+    bool paletteUploaded;
+    bool meshValid;
+    // what the last Deform skinned, and what has been skinned since the vertex buffers were last
+    // filled, as [x, y) ranges of vertices
+    std::vector<glm::ivec2> skinnedRanges;
+    std::vector<glm::ivec2> uploadRanges;
+    int numSkinnedVertices;
+
+    // collision hierarchy over the deformed triangles, built on first use and refit every update
+    MeshBVH* bvh;
 
     // rendering stuff - based off Cube.h
     GLuint VAO;
     GLuint VBO_positions, VBO_normals, EBO;
 
+    // packed output: the kernel writes position and octahedral normal interleaved 16 bytes a
+    // vertex (SkinBatch::PackedVertex) instead of transformedPositions and transformedNormals,
+    // and that goes up as one buffer with shader.vert decoding the normal
+    bool packedOutputEnabled;
+    std::vector<SkinBatch::PackedVertex> packedVertices;
+    GLuint packedVAO;
+    GLuint VBO_packed;
+
+    // gpu skinning: the rest pose and skin weights go up once and only the palette each frame,
+    // as a buffer texture since 240 joints of 96 bytes don't fit the 16KB a uniform block is
+    // guaranteed. the vertex shader does the blending (shaders/skin.vert)
+    bool gpuSkinningEnabled;
+    GLuint skinningShader;
+    GLuint gpuVAO;
+    GLuint VBO_restPositions, VBO_restNormals, VBO_joints, VBO_weights;
+    GLuint paletteBuffer, paletteTexture;
+    // skin.vert linked for transform feedback, loaded on the first ValidateGPU
+    GLuint feedbackShader;
+    GLuint feedbackPositions, feedbackNormals;
+
+    void UploadPalette();
+
     glm::mat4 model;
     glm::vec3 color;
     // glDrawElements expects GL_UNSIGNED_INT
@@ -39,8 +124,64 @@ public:
     // functions
     // optional skeleton parameter
     bool Load(const char* filename, Skeleton* skeleton = nullptr);
+    // Deform, then upload the result
     void Update();
+    // skin the vertices for the skeleton's current pose without touching GL (see bench/skin_bench.cpp).
+    // only re-skins the vertices of joints that moved since the last call
+    void Deform();
     void Draw(const glm::mat4& viewProjMtx, GLuint shader, const glm::vec3& lightDirection1, const glm::vec3& lightColor1, const glm::vec3& lightDirection2, const glm::vec3& lightColor2);
-    // can't do in constructor because skin file is not loaded yet
+    // can't do in constructor because skin file is not loaded yet, done on the first Update or
+    // Draw so a skin can be loaded and deformed without a GL context
     void SetupBuffers();
+
+    // deformed mesh for collisions
+    MeshBVH* GetBVH();
+
+    // blend shapes, nullptr if the file has none. a weight set here is applied by the next Deform
+    MorphTargets* GetMorphTargets();
+
+    // the mesh as loaded, in the batch's order with a skeleton, for sharing it between several
+    // poses (see SkinCrowd). the batch is nullptr without a skeleton
+    SkinBatch* GetBatch();
+    std::vector<Triangle>& GetTriangles();
+    const std::vector<glm::mat4>& GetBindings();
+    const std::vector<glm::mat4>& GetInverseBindings();
+
+    SkinningMode GetSkinningMode();
+    void SetSkinningMode(SkinningMode mode);
+
+    bool IsParallelEnabled();
+    void SetParallelEnabled(bool enabled);
+    // vertices per task, small enough that a chunk's streams and output stay in cache
+    int GetChunkSize();
+    void SetChunkSize(int chunkSize);
+
+    int GetNumVertices();
+    // vertices re-skinned by the last Deform, 0 when nothing moved
+    int GetNumSkinnedVertices();
+    // bytes the skinning kernel reads per vertex, 0 without a skeleton
+    float GetBytesPerVertex();
+    // not kept up to date while the output is packed, apart from the positions when something
+    // collides with the skin
+    std::vector<glm::vec3>& GetTransformedPositions();
+    std::vector<glm::vec3>& GetTransformedNormals();
+
+    // Deform writes packedVertices instead of the float arrays, and Update uploads 16 bytes a
+    // vertex instead of 24
+    bool IsPackedOutputEnabled();
+    void SetPackedOutputEnabled(bool enabled);
+    std::vector<SkinBatch::PackedVertex>& GetPackedVertices();
+
+    // with gpu skinning on, Update only builds and uploads the palette and Draw skins in the
+    // vertex shader. the cpu still deforms the mesh while something collides with it
+    bool IsGPUSkinningEnabled();
+    void SetGPUSkinningEnabled(bool enabled);
+    // program built from shaders/skin.vert, needed before gpu skinning draws anything
+    void SetSkinningShader(GLuint shader);
+    // skin the current pose on both the cpu and the gpu (captured with transform feedback) and
+    // compare every vertex, true if no position or normal is further off than tolerance
+    bool ValidateGPU(float tolerance = 1e-4f);
+    // bytes sent to the gpu by one Update in the current mode when every joint moved, a pose
+    // that only moves some joints sends less and an unchanged one nothing
+    int GetUploadSize();
 };
\ No newline at end of file
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "core.h"
+#include <cstdint>
+#include <vector>
+
+// every vertex of a skin in one linear blend skinning pass, the batched version of the vertex
+// loop in Skin::Update.
+//
+// the vertices are grouped by how many joints they are attached to (1, 2, 3, 4 and more), and
+// each group is skinned by a kernel compiled for exactly that many influences, so there is no
+// per vertex loop count or zero weight to test. the owner puts its mesh in the same order
+// (GetOrder) so every group reads and writes a contiguous range. per vertex the joint streams
+// only hold 16 bit joint indices and 16 bit weights (fractions of 65535, renormalised at build
+// so they sum to exactly one), and no weight at all for a single joint. the rest pose is read
+// from the owner's float3 positions and normals, there is no second copy.
+//
+// the joint palette is a flat float array of PALETTE_STRIDE floats per joint: each row of the
+// affine 3x4 skinning matrix followed by the same row of the normal matrix (padded to 4), so
+// with AVX one 8 float load brings in a row of both. a vertex blends its joints' rows with
+// multiply-adds and then transforms its position and normal once with the blended rows. SSE2
+// does the same with 4 float rows, and there is a plain loop for everything else.
+//
+// SkinDualQuaternion reads the same streams with a palette of unit dual quaternions instead,
+// laid out with the same PALETTE_STRIDE so the joint offsets work for both: the rotation
+// (x, y, z, w) then the dual part (x, y, z, w), one 8 float load with AVX.
+class SkinBatch
+{
+private:
+    int numVertices;
+
+    // groups[k] is the first vertex with k + 1 joints, groups[4] the first with more than 4,
+    // groups[5] the end
+    int groups[6];
+    // skin order -> order the influences were given in
+    std::vector<int> order;
+
+    // the influences of every vertex in skin order, heaviest first. the single joint group has
+    // no weights, the group with more than 4 finds its vertices' ranges through offsets
+    std::vector<uint16_t> joints;
+    std::vector<uint16_t> weights;
+    // where each group starts in joints and weights
+    int jointStart[5];
+    int weightStart[5];
+    // per vertex of the last group, relative to its starts, one past the end for the last vertex
+    std::vector<int> offsets;
+
+    // joint -> the vertices it influences, in skin order: jointVertices[jointVertexStart[j]] up
+    // to jointVertices[jointVertexStart[j + 1]]
+    std::vector<int> jointVertexStart;
+    std::vector<int> jointVertices;
+    // a flag per vertex, scratch for GetDirtyRanges
+    std::vector<uint8_t> marks;
+
+    // rest pose of the owner, in skin order
+    const glm::vec3* restPositions;
+    const glm::vec3* restNormals;
+
+    // the kernels write through one of these, separate float3 arrays or PackedVertex
+    struct SplitOutput;
+    struct PackedOutput;
+    template <bool DualQuaternion, int K, typename Output> void SkinGroup(const float* palette, int begin, int end, const Output& output);
+    template <bool DualQuaternion, typename Output> void SkinGroups(const float* palette, int begin, int end, const Output& output);
+
+public:
+    static const int MAX_GROUPED_INFLUENCES = 4;
+    static const int PALETTE_STRIDE = 24;
+
+    // a skinned vertex ready for a vertex buffer, 16 bytes instead of 24: the position, and the
+    // unit normal octahedral encoded (EncodeNormal) as 2 snorm16 in the space of a 4th float
+    struct PackedVertex
+    {
+        glm::vec3 position;
+        int16_t normal[2];
+    };
+
+    // counts[i] joints per vertex, their indices and weights one vertex after another. the
+    // weights of a vertex don't have to sum to one
+    SkinBatch(const std::vector<int>& counts, const std::vector<int>& joints, const std::vector<float>& weights);
+
+    // skin order -> input order, for the owner to rearrange its mesh. the rest pose has to be
+    // set in skin order before anything is skinned
+    const std::vector<int>& GetOrder();
+    void SetRestPose(const glm::vec3* positions, const glm::vec3* normals);
+
+    // write one joint's skinning matrix and normal matrix into a palette of PALETTE_STRIDE floats per joint
+    static void SetJoint(float* palette, int joint, const glm::mat4& skinningMatrix, const glm::mat3& normalMatrix);
+    // write one joint's skinning matrix as a unit dual quaternion. only the rotation and
+    // translation survive, any scale in the matrix is dropped
+    static void SetDualQuaternion(float* palette, int joint, const glm::mat4& skinningMatrix);
+
+    // skin vertices [begin, end) of the skin order with the palette, writing blended positions
+    // and unit normals. nothing outside [begin, end) of the outputs is touched
+    void Skin(const float* palette, int begin, int end, glm::vec3* positions, glm::vec3* normals);
+    // the same with dual quaternion blending: every joint's quaternion is flipped into the
+    // hemisphere of the vertex's first joint before the weighted sum, which is then normalised
+    // and applied as a rotation and translation, so twisting joints keep their volume
+    void SkinDualQuaternion(const float* palette, int begin, int end, glm::vec3* positions, glm::vec3* normals);
+    // the same two, writing interleaved PackedVertex instead. the normal goes straight from the
+    // blend onto the octahedron, which makes it unit length on the way
+    void SkinPacked(const float* palette, int begin, int end, PackedVertex* vertices);
+    void SkinDualQuaternionPacked(const float* palette, int begin, int end, PackedVertex* vertices);
+
+    // a normal divided by |x| + |y| + |z| lands on an octahedron, whose lower half (z < 0) is
+    // folded out over the corners of the upper half's square, leaving x and y in [-1, 1] to
+    // keep as snorm16. decoding undoes the fold and normalises, off by about 1e-4 at most
+    static void EncodeNormal(const glm::vec3& normal, int16_t encoded[2]);
+    static glm::vec3 DecodeNormal(const int16_t encoded[2]);
+
+    // the heaviest 4 influences of a vertex with weights that sum to 65535, padded with weight 0
+    // on joint 0 (vertex attributes for the gpu, which only blends 4)
+    void GetInfluences(int vertex, uint16_t joints[4], uint16_t weights[4]);
+
+    // ranges [x, y) of the skin order that hold every vertex influenced by one of joints, and
+    // every one of vertices (whose rest pose changed), sorted, with gaps shorter than maxGap
+    // bridged so there are fewer calls and uploads. returns the number of vertices in the ranges
+    int GetDirtyRanges(const std::vector<int>& joints, const std::vector<int>& vertices, int maxGap, std::vector<glm::ivec2>& ranges);
+
+    int GetNumVertices();
+    // bytes the kernels read per vertex, rest pose included
+    float GetBytesPerVertex();
+};
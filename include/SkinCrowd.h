@@ -0,0 +1,100 @@
+#pragma once
+
+#include "Skin.h"
+#include <cstdint>
+#include <vector>
+
+// many copies of one skin, each in its own pose, for crowds.
+//
+// the mesh (skinning streams, rest pose, triangles, bindings) stays with the Skin and is only
+// read, an instance is just its joints' world matrices, the palette built from them and a model
+// matrix. Deform skins every instance that was posed since the last call in one parallel batch,
+// chunks of every instance over the shared thread pool, into one arena that holds all the
+// instances' vertices one after another as SkinBatch::PackedVertex. the arena goes up as one
+// buffer and is drawn with one instanced draw: shaders/crowd.vert reads the vertex of its
+// instance out of the arena through a buffer texture and takes the model matrix from a per
+// instance attribute. so adding an instance costs its vertices and nothing else, no more meshes,
+// buffers or draws.
+//
+// morph targets are part of the shared rest pose, every instance gets the weights the skin's
+// own Deform last applied.
+class SkinCrowd
+{
+private:
+    // the shared mesh, not owned
+    Skin* skin;
+    SkinBatch* batch;
+    int numVertices;
+    int numJoints;
+    SkinningMode skinningMode;
+
+    // per instance, numJoints world matrices each and the palette built from them
+    // (SkinBatch::PALETTE_STRIDE floats a joint)
+    std::vector<glm::mat4> models;
+    std::vector<glm::mat4> worldMatrices;
+    std::vector<float> palettes;
+    // posed since the last Deform, and skinned since the arena was last uploaded
+    std::vector<uint8_t> posed;
+    std::vector<uint8_t> skinned;
+    // instances the current Deform skins
+    std::vector<int> posedInstances;
+    int numSkinnedVertices;
+    bool modelsChanged;
+
+    // every instance's vertices, instance i from i * numVertices
+    std::vector<SkinBatch::PackedVertex> arena;
+
+    int chunkSize;
+
+    void BuildPalette(int instance);
+
+    // rendering: the arena as a buffer texture, a buffer of model matrices as 4 vec4 attributes
+    // advancing once per instance, and the skin's triangles
+    GLuint shader;
+    GLuint VAO, EBO, VBO_models;
+    GLuint arenaBuffer, arenaTexture;
+    int numIndices;
+    // instances the buffers have room for, and the most the buffer texture can address
+    int capacity;
+    int maxInstances;
+    glm::vec3 color;
+
+    // done on the first Update or Draw, like Skin's
+    void SetupBuffers();
+
+public:
+    // skin has to be loaded with a skeleton
+    SkinCrowd(Skin* skin);
+    ~SkinCrowd();
+
+    // a new instance in the bind pose, returns its index
+    int AddInstance(const glm::mat4& model = glm::mat4(1.0f));
+    void Clear();
+    int GetNumInstances();
+
+    const glm::mat4& GetModel(int instance);
+    void SetModel(int instance, const glm::mat4& model);
+    // take the world matrices of skeleton's joints, which has to be the skeleton the skin was
+    // bound to or one with the same joints. an instance whose matrices are unchanged isn't
+    // skinned again
+    void SetPose(int instance, Skeleton* skeleton);
+
+    SkinningMode GetSkinningMode();
+    void SetSkinningMode(SkinningMode mode);
+    int GetChunkSize();
+    void SetChunkSize(int chunkSize);
+
+    // skin the instances posed since the last call, without touching GL
+    void Deform();
+    // Deform, then upload the instances it skinned and any moved model matrices
+    void Update();
+    // every instance with one draw, needs the program built from shaders/crowd.vert
+    void SetShader(GLuint shader);
+    void Draw(const glm::mat4& viewProjMtx, const glm::vec3& lightDirection1, const glm::vec3& lightColor1, const glm::vec3& lightDirection2, const glm::vec3& lightColor2);
+
+    // the skinned vertices of an instance, numVertices of them
+    const SkinBatch::PackedVertex* GetVertices(int instance);
+    int GetNumVertices();
+    // vertices skinned by the last Deform over every instance
+    int GetNumSkinnedVertices();
+};
@@ -13,8 +13,15 @@ private:
     Particle* p1;
     Particle* p2;
 
+    // indices
+    int indexP1;
+    int indexP2;
+
+    // torn apart, exerts no force any more
+    bool broken;
+
 public:
-    SpringDamper(Particle* p1, Particle* p2, float springConstant, float dampingConstant, float restLength);
+    SpringDamper(Particle* p1, Particle* p2, int indexP1, int indexP2, float springConstant, float dampingConstant, float restLength);
     
     // compute and apply spring-damper forces
     void ComputeForce();
@@ -22,4 +29,20 @@ public:
     // getters and setters
     Particle* GetP1();
     Particle* GetP2();
+
+    int GetIndexP1();
+    int GetIndexP2();
+
+    float GetSpringConstant();
+    float GetDampingConstant();
+    float GetRestLength();
+
+    void SetSpringConstant(float springConstant);
+    // hang an end on another particle (a tear split the old one)
+    void SetP1(Particle* p1, int indexP1);
+    void SetP2(Particle* p2, int indexP2);
+
+    // tear the spring, zeroes its constants so every solver ignores it from now on
+    void Break();
+    bool IsBroken();
 };
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// small persistent worker pool used by the simulation code to split loops over
+// particles, springs, triangles etc. the calling thread always takes part in the
+// work, so a pool with zero workers just runs everything inline.
+class ThreadPool
+{
+private:
+    std::vector<std::thread> workers;
+
+    // current job (only one ParallelFor runs at a time)
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable doneCondition;
+    const std::function<void(int, int)>* task;
+    int count;
+    int grainSize;
+    std::atomic<int> nextIndex;
+    int busyWorkers;
+    unsigned int generation;
+    bool stopping;
+
+    // serialises callers so two threads can't submit jobs at the same time
+    std::mutex submitMutex;
+
+    void WorkerLoop();
+    void RunChunks();
+
+public:
+    // numThreads is the total number of threads including the caller, 0 = hardware concurrency
+    ThreadPool(int numThreads = 0);
+    ~ThreadPool();
+
+    // calls task(begin, end) over [0, count) in chunks of grainSize, returns once all chunks are done
+    void ParallelFor(int count, int grainSize, const std::function<void(int, int)>& task);
+
+    int GetNumThreads();
+
+    // pool shared by all simulation objects
+    static ThreadPool* GetShared();
+};
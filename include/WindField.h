@@ -0,0 +1,87 @@
+#pragma once
+
+#include "core.h"
+#include "ThreadPool.h"
+#include <vector>
+
+// air velocity that varies over space and time, shared by every cloth in a scene.
+//
+// the wind lives on a regular grid of nodes covering a box. each node holds the sum of a
+// static velocity volume (SetNodeVelocity, zero by default), the mean wind scaled by gusts and
+// curl-noise turbulence. gusts are slow swells of the mean wind that travel downwind through
+// the box. turbulence is the curl of a smooth noise potential, so it swirls without pushing air
+// in or out anywhere, and the whole pattern drifts with the mean wind.
+//
+// the procedural part is only evaluated at the grid nodes, and only when Update is called with
+// a time at least refreshInterval after the last evaluation. cloths then read the grid with
+// trilinear interpolation, in bulk for all their triangles at once (8 points per iteration
+// with AVX2). points outside the box get the wind at the nearest boundary.
+class WindField
+{
+private:
+    glm::vec3 minCorner;
+    float cellSize;
+    int sizeX, sizeY, sizeZ;
+
+    // the static volume and the sampled velocity at every node, x fastest, then y, then z
+    std::vector<glm::vec3> nodeVelocities;
+    std::vector<float> velocityX, velocityY, velocityZ;
+
+    // turbulence potential at every node and the noise lattice under the box, scratch for Bake
+    std::vector<glm::vec3> potential;
+    std::vector<glm::vec3> lattice;
+
+    glm::vec3 meanWind;
+    // gust swell as a fraction of the mean wind, and the typical time between gusts
+    float gustStrength;
+    float gustPeriod;
+    // turbulence speed in m/s and size of the swirls in metres
+    float turbulenceStrength;
+    float turbulenceScale;
+
+    float refreshInterval;
+    float bakedTime;
+    // settings changed since the last Bake
+    bool dirty;
+
+    // evaluate everything at the nodes for the given time
+    void Bake(float time);
+
+    int NodeIndex(int x, int y, int z);
+
+public:
+    // box from minCorner to maxCorner with nodes cellSize apart (at least 2 in every direction)
+    WindField(glm::vec3 minCorner, glm::vec3 maxCorner, float cellSize);
+
+    // rebake if time moved on by refreshInterval or the settings changed. every cloth sharing the
+    // field calls this each step, the calls after the first for the same time do nothing, so all
+    // of them have to be stepped from the same thread
+    void Update(float time);
+
+    // wind at one point
+    glm::vec3 Sample(glm::vec3 position);
+    // wind at count points given as separate x, y, z arrays, safe to call from several threads
+    void Sample(const float* x, const float* y, const float* z, int count, float* windX, float* windY, float* windZ);
+
+    int GetSizeX();
+    int GetSizeY();
+    int GetSizeZ();
+    glm::vec3 GetMinCorner();
+    float GetCellSize();
+
+    glm::vec3 GetNodeVelocity(int x, int y, int z);
+    void SetNodeVelocity(int x, int y, int z, glm::vec3 velocity);
+
+    glm::vec3 GetMeanWind();
+    void SetMeanWind(glm::vec3 meanWind);
+    float GetGustStrength();
+    void SetGustStrength(float gustStrength);
+    float GetGustPeriod();
+    void SetGustPeriod(float gustPeriod);
+    float GetTurbulenceStrength();
+    void SetTurbulenceStrength(float turbulenceStrength);
+    float GetTurbulenceScale();
+    void SetTurbulenceScale(float turbulenceScale);
+    float GetRefreshInterval();
+    void SetRefreshInterval(float refreshInterval);
+};
@@ -10,6 +10,7 @@
 
 #ifdef INCLUDE_SKIN
 #include "Skin.h"
+#include "SkinCrowd.h"
 #endif
 
 #ifdef INCLUDE_ANIMATION
@@ -18,6 +19,9 @@
 
 #ifdef INCLUDE_CLOTH
 #include "Cloth.h"
+#include "ClothRenderer.h"
+#include "ClothWorld.h"
+#include "ClothCache.h"
 #endif
 
 #ifdef INCLUDE_SPH
@@ -46,6 +50,10 @@ public:
 
     #ifdef INCLUDE_SKIN
     static Skin* skin;
+    // copies of skin in a grid behind it, created from the ui
+    static SkinCrowd* crowd;
+    static void SetCrowdSize(int size);
+    static void UpdateCrowd();
     #endif
 
     #ifdef INCLUDE_ANIMATION
@@ -56,9 +64,24 @@ public:
 
     #ifdef INCLUDE_CLOTH
     static Cloth* cloth;
+    // set when cloth is the shared cloth of several instances, owns it then
+    static ClothWorld* clothWorld;
+    // created on the first frame with a cloth, once there is a GL context
+    static ClothRenderer* clothRenderer;
+    // steps the cloth on its own thread when set
+    static ClothSimulationThread* clothThread;
     static glm::vec3 wind;
+    // when set, wind is the mean wind of the field
+    static WindField* windField;
     static bool pauseSimulation;
+    static float timestep;
+    // recording the simulation to a cache, or replaying one instead of simulating
+    static ClothCacheWriter* cacheWriter;
+    static ClothCacheReader* cacheReader;
+    static int cacheFrame;
+    static void ShowCacheFrame();
     static void RenderClothControls();
+    static void TranslateCloth(glm::vec3 translation);
     #endif
 
     #ifdef INCLUDE_SPH
@@ -68,6 +91,12 @@ public:
     // Shader Program
     static GLuint shaderProgram;
     static GLuint ptShaderProgram;
+    #ifdef INCLUDE_SKIN
+    // shader.vert with skinning, for the skin's gpu skinning mode
+    static GLuint skinShaderProgram;
+    // instanced draw of the crowd
+    static GLuint crowdShaderProgram;
+    #endif
 
     // Act as Constructors and destructors
     // static bool initializeProgram();
@@ -1,5 +1,6 @@
 #include "Window.h"
 #include "core.h"
+#include <cfloat>
 #include <iostream>
 
 void error_callback(int error, const char* description)
@@ -139,6 +140,84 @@ int main(int argc, char* argv[])
                 std::cout << "failed to create cloth!" << std::endl;
             }
         }
+
+        if (filename == "-cloth-world")
+        {
+            // rows of small flags simulated and drawn together
+            int count = 24;
+            int size = 10;
+            float spacing = 0.1f;
+
+            if (argc > 2) count = std::stoi(argv[2]);
+            if (argc > 3) size = std::stoi(argv[3]);
+
+            int columns = (int)ceil(sqrt((float)count));
+            float gap = size * spacing + 0.3f;
+
+            std::vector<Cloth*> flags;
+            std::vector<glm::vec3> offsets;
+            for (int i = 0; i < count; i++)
+            {
+                flags.push_back(new Cloth(size, size, spacing, 0.25f, 300.0f, 5.0f));
+                offsets.push_back(glm::vec3((i % columns) * gap, 0.0f, (i / columns) * gap));
+            }
+
+            Window::clothWorld = new ClothWorld();
+            Window::clothWorld->Add(flags, offsets);
+            Window::cloth = Window::clothWorld->GetCloth();
+
+            std::cout << "cloth world created with " << count << " flags of " << size << "x" << size << std::endl;
+        }
+
+        if (filename == "-cloth-mesh" && argc > 2)
+        {
+            // cloth from a .skin or .obj garment
+            float mass = 0.05f;
+            float springConstant = 300.0f;
+            float dampingConstant = 15.0f;
+
+            if (argc > 3) mass = std::stof(argv[3]);
+            if (argc > 4) springConstant = std::stof(argv[4]);
+            if (argc > 5) dampingConstant = std::stof(argv[5]);
+
+            ClothMesh mesh;
+            if (mesh.Load(argv[2]))
+            {
+                Window::cloth = new Cloth(&mesh, mass, springConstant, dampingConstant);
+
+                // pin the top rim so the garment hangs
+                std::vector<glm::vec3>& positions = mesh.GetPositions();
+                float tolerance = mesh.GetAverageEdgeLength() * 0.5f;
+                float top = -FLT_MAX;
+                for (const glm::vec3& position : positions)
+                {
+                    top = glm::max(top, position.y);
+                }
+                for (int i = 0; i < positions.size(); i++)
+                {
+                    if (positions[i].y > top - tolerance)
+                    {
+                        Window::cloth->SetParticleFixed(i, true);
+                    }
+                }
+
+                std::cout << "cloth created from mesh: " << argv[2] << std::endl;
+            }
+            else
+            {
+                std::cout << "failed to create cloth!" << std::endl;
+            }
+        }
+        #endif
+
+        #if defined(INCLUDE_SKIN) && defined(INCLUDE_CLOTH)
+        // drape build: hang the default cloth over the character and collide it with the skin
+        if (Window::skin && Window::cloth == nullptr && filename.find(".skel") != std::string::npos && argc > 2)
+        {
+            Window::cloth = new Cloth(20, 20, 0.2f, 1.0f, 300.0f, 15.0f);
+            Window::cloth->SetCollisionMesh(Window::skin->GetBVH());
+            std::cout << "cloth created over the character, move it with w/a/s/d/q/e" << std::endl;
+        }
         #endif
 
         #ifdef INCLUDE_SPH
@@ -0,0 +1,46 @@
+#version 330 core
+// shader.vert for SkinCrowd: every instance of a skin in one instanced draw, with the vertices
+// skinned on the cpu read out of the crowd's arena
+
+// per instance, moves on once per instance instead of once per vertex
+layout (location = 0) in mat4 model;
+
+// Uniform variables
+uniform mat4 viewProj;
+
+// the skinned vertices of every instance, instance i's from i * numVertices. a texel is one
+// SkinBatch::PackedVertex: the bits of the position's 3 floats, then the 2 shorts of the
+// octahedral encoded normal (SkinBatch::EncodeNormal), x in the low half
+uniform usamplerBuffer vertices;
+uniform int numVertices;
+
+// Outputs of the vertex shader are the inputs of the same name of the fragment shader.
+out vec3 fragNormal;
+
+
+vec3 DecodeNormal(vec2 encoded)
+{
+    // undo the fold of the lower half over the corners
+    vec2 octahedron = clamp(encoded / 32767.0, -1.0, 1.0);
+    vec3 n = vec3(octahedron, 1.0 - abs(octahedron.x) - abs(octahedron.y));
+    if (n.z < 0.0)
+    {
+        n.xy = (1.0 - abs(octahedron.yx)) * vec2(octahedron.x < 0.0 ? -1.0 : 1.0, octahedron.y < 0.0 ? -1.0 : 1.0);
+    }
+    return normalize(n);
+}
+
+void main()
+{
+    // gl_VertexID is the index from the element buffer
+    uvec4 vertex = texelFetch(vertices, gl_InstanceID * numVertices + gl_VertexID);
+    vec3 position = uintBitsToFloat(vertex.xyz);
+    // the conversion keeps the bits, the shifts sign extend each short
+    int normalBits = int(vertex.w);
+    vec2 normal = vec2(float((normalBits << 16) >> 16), float(normalBits >> 16));
+
+    gl_Position = viewProj * model * vec4(position, 1.0);
+
+    // for shading
+    fragNormal = vec3(model * vec4(DecodeNormal(normal), 0));
+}
@@ -8,16 +8,32 @@ layout (location = 1) in vec3 normal;
 uniform mat4 viewProj;
 uniform mat4 model;
 
+// the normal comes as the 2 shorts of an octahedral encoded unit normal (SkinBatch::EncodeNormal),
+// in x and y of normal
+uniform bool packedNormal;
+
 // Outputs of the vertex shader are the inputs of the same name of the fragment shader.
 // The default output, gl_Position, should be assigned something. 
 out vec3 fragNormal;
 
 
+vec3 DecodeNormal(vec2 encoded)
+{
+    // undo the fold of the lower half over the corners
+    vec2 octahedron = clamp(encoded / 32767.0, -1.0, 1.0);
+    vec3 n = vec3(octahedron, 1.0 - abs(octahedron.x) - abs(octahedron.y));
+    if (n.z < 0.0)
+    {
+        n.xy = (1.0 - abs(octahedron.yx)) * vec2(octahedron.x < 0.0 ? -1.0 : 1.0, octahedron.y < 0.0 ? -1.0 : 1.0);
+    }
+    return normalize(n);
+}
+
 void main()
 {
     // OpenGL maintains the D matrix so you only need to multiply by P, V (aka C inverse), and M
     gl_Position = viewProj * model * vec4(position, 1.0);
 
     // for shading
-	fragNormal = vec3(model * vec4(normal, 0));
+	fragNormal = vec3(model * vec4(packedNormal ? DecodeNormal(normal.xy) : normal, 0));
 }
\ No newline at end of file
@@ -0,0 +1,87 @@
+#version 330 core
+// shader.vert with linear blend skinning, for Skin's gpu skinning mode
+
+// rest pose and skin weights, uploaded once
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+layout (location = 2) in uvec4 joints;
+// 16 bit fractions normalised to [0, 1] by the attribute, summing to 1
+layout (location = 3) in vec4 weights;
+
+// Uniform variables
+uniform mat4 viewProj;
+uniform mat4 model;
+
+// joint palette in the SkinBatch layout, 6 texels per joint: skinning row 0, normal row 0,
+// skinning row 1, normal row 1, skinning row 2, normal row 2
+uniform samplerBuffer palette;
+// the palette holds a dual quaternion per joint instead, rotation then dual part in the first
+// 2 texels
+uniform bool dualQuaternion;
+
+// Outputs of the vertex shader are the inputs of the same name of the fragment shader.
+out vec3 fragNormal;
+
+// skinned position and normal before the model matrix, captured with transform feedback to
+// check against the cpu (Skin::ValidateGPU)
+out vec3 skinnedPosition;
+out vec3 skinnedNormal;
+
+
+void main()
+{
+    if (dualQuaternion)
+    {
+        // flip every rotation into the hemisphere of the first joint's before blending
+        vec4 pivot = texelFetch(palette, int(joints[0]) * 6);
+        vec4 real = vec4(0.0);
+        vec4 dual = vec4(0.0);
+        for (int k = 0; k < 4; k++)
+        {
+            int base = int(joints[k]) * 6;
+            vec4 q = texelFetch(palette, base);
+            float weight = dot(q, pivot) < 0.0 ? -weights[k] : weights[k];
+            real += weight * q;
+            dual += weight * texelFetch(palette, base + 1);
+        }
+        float len = length(real);
+        real /= len;
+        dual /= len;
+
+        // rotate, then translate by 2 * dual * conjugate(real)
+        skinnedPosition = position + 2.0 * cross(real.xyz, cross(real.xyz, position) + real.w * position)
+                        + 2.0 * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+        skinnedNormal = normalize(normal + 2.0 * cross(real.xyz, cross(real.xyz, normal) + real.w * normal));
+    }
+    else
+    {
+        // blend the rows of the attached joints, then transform once
+        vec4 row0 = vec4(0.0);
+        vec4 row1 = vec4(0.0);
+        vec4 row2 = vec4(0.0);
+        vec4 normalRow0 = vec4(0.0);
+        vec4 normalRow1 = vec4(0.0);
+        vec4 normalRow2 = vec4(0.0);
+        for (int k = 0; k < 4; k++)
+        {
+            int base = int(joints[k]) * 6;
+            float weight = weights[k];
+            row0 += weight * texelFetch(palette, base);
+            normalRow0 += weight * texelFetch(palette, base + 1);
+            row1 += weight * texelFetch(palette, base + 2);
+            normalRow1 += weight * texelFetch(palette, base + 3);
+            row2 += weight * texelFetch(palette, base + 4);
+            normalRow2 += weight * texelFetch(palette, base + 5);
+        }
+
+        vec4 restPosition = vec4(position, 1.0);
+        vec4 restNormal = vec4(normal, 0.0);
+        skinnedPosition = vec3(dot(row0, restPosition), dot(row1, restPosition), dot(row2, restPosition));
+        skinnedNormal = normalize(vec3(dot(normalRow0, restNormal), dot(normalRow1, restNormal), dot(normalRow2, restNormal)));
+    }
+
+    gl_Position = viewProj * model * vec4(skinnedPosition, 1.0);
+
+    // for shading
+    fragNormal = vec3(model * vec4(skinnedNormal, 0));
+}
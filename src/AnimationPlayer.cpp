@@ -32,6 +32,11 @@ void AnimationPlayer::SetRig(Rig* rig)
     currentPose = Pose(rig->GetSkeleton());
 }
 
+float AnimationPlayer::GetTime()
+{
+    return time;
+}
+
 void AnimationPlayer::Update(float deltaTime)
 {
     if (!clip)
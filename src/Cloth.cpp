@@ -1,13 +1,15 @@
 #include "Cloth.h"
+#include <algorithm>
+#include <cfloat>
+
+// a tear can split off a quarter as many particles as the cloth starts with
+static const int SPARE_PARTICLE_FRACTION = 4;
+// particles with more triangles or springs than this around them aren't split
+static const int MAX_SPLIT_TRIANGLES = 32;
+static const int MAX_SPLIT_SPRINGS = 64;
 
 Cloth::Cloth(int width, int height, float particleSpacing, float mass, float springConstant, float dampingConstant)
 {
-    // initialise wind with zero velocity, can be set later by ui
-    wind = glm::vec3(0.0f);
-
-    // initialise gravity
-    gravity = glm::vec3(0.0f, -9.81f, 0.0f);
-
     // initial height of cloth
     float initialHeight = 2.0f;
 
@@ -49,14 +51,14 @@ Cloth::Cloth(int width, int height, float particleSpacing, float mass, float spr
             // horizontal spring: p1 --- p2
             if (x < width - 1)
             {
-                SpringDamper* p1p2 = new SpringDamper(particles[i], particles[i + 1], springConstant, dampingConstant, particleSpacing);
+                SpringDamper* p1p2 = new SpringDamper(particles[i], particles[i + 1], i, i + 1, springConstant, dampingConstant, particleSpacing);
                 springs.push_back(p1p2);
             }
 
             // vertical spring: p1 --- p3
             if (y < height - 1)
             {
-                SpringDamper* p1p3 = new SpringDamper(particles[i], particles[i + width], springConstant, dampingConstant, particleSpacing);
+                SpringDamper* p1p3 = new SpringDamper(particles[i], particles[i + width], i, i + width, springConstant, dampingConstant, particleSpacing);
                 springs.push_back(p1p3);
             }
 
@@ -64,11 +66,11 @@ Cloth::Cloth(int width, int height, float particleSpacing, float mass, float spr
             if (x < width - 1 && y < height - 1)
             {    
                 // p1 --- p4
-                SpringDamper* p1p4 = new SpringDamper(particles[i], particles[i + width + 1], springConstant, dampingConstant, particleSpacing * sqrt(2.0f));
+                SpringDamper* p1p4 = new SpringDamper(particles[i], particles[i + width + 1], i, i + width + 1, springConstant, dampingConstant, particleSpacing * sqrt(2.0f));
                 springs.push_back(p1p4);
 
                 // p2 --- p3
-                SpringDamper* p2p3 = new SpringDamper(particles[i + 1], particles[i + width], springConstant, dampingConstant, particleSpacing * sqrt(2.0f));
+                SpringDamper* p2p3 = new SpringDamper(particles[i + 1], particles[i + width], i + 1, i + width, springConstant, dampingConstant, particleSpacing * sqrt(2.0f));
                 springs.push_back(p2p3);
             }
         }
@@ -93,14 +95,14 @@ Cloth::Cloth(int width, int height, float particleSpacing, float mass, float spr
             // horizontal bending spring: p1 --- p3
             if (x < width - 2)
             {
-                SpringDamper* p1p3 = new SpringDamper(particles[i], particles[i + 2], springConstant * 0.5f, dampingConstant * 1.5f, particleSpacing * 2.0f);
+                SpringDamper* p1p3 = new SpringDamper(particles[i], particles[i + 2], i, i + 2, springConstant * 0.5f, dampingConstant * 1.5f, particleSpacing * 2.0f);
                 springs.push_back(p1p3);
             }
 
             // vertical bending spring: p1 --- p7
             if (y < height - 2)
             {
-                SpringDamper* p1p7 = new SpringDamper(particles[i], particles[i + width * 2], springConstant * 0.5f, dampingConstant * 1.5f, particleSpacing * 2.0f);
+                SpringDamper* p1p7 = new SpringDamper(particles[i], particles[i + width * 2], i, i + width * 2, springConstant * 0.5f, dampingConstant * 1.5f, particleSpacing * 2.0f);
                 springs.push_back(p1p7);
             }
 
@@ -108,11 +110,11 @@ Cloth::Cloth(int width, int height, float particleSpacing, float mass, float spr
             if (x < width - 2 && y < height - 2)
             {
                 // p1 --- p9
-                SpringDamper* p1p9 = new SpringDamper(particles[i], particles[i + width * 2 + 2], springConstant * 0.5f, dampingConstant * 1.5f, (particleSpacing * 2.0f) * sqrt(2.0f));
+                SpringDamper* p1p9 = new SpringDamper(particles[i], particles[i + width * 2 + 2], i, i + width * 2 + 2, springConstant * 0.5f, dampingConstant * 1.5f, (particleSpacing * 2.0f) * sqrt(2.0f));
                 springs.push_back(p1p9);
 
                 // p3 --- p7
-                SpringDamper* p3p7 = new SpringDamper(particles[i + 2], particles[i + width * 2], springConstant * 0.5f, dampingConstant * 1.5f, (particleSpacing * 2.0f) * sqrt(2.0f));
+                SpringDamper* p3p7 = new SpringDamper(particles[i + 2], particles[i + width * 2], i + 2, i + width * 2, springConstant * 0.5f, dampingConstant * 1.5f, (particleSpacing * 2.0f) * sqrt(2.0f));
                 springs.push_back(p3p7);
             }
         }
@@ -147,11 +149,239 @@ Cloth::Cloth(int width, int height, float particleSpacing, float mass, float spr
         }
     }
 
-    // initialise rendering data
-    model = glm::mat4(1.0f);
-    color = glm::vec3(0.7f, 0.7f, 0.9f);
+    Initialise(springConstant, particleSpacing);
+}
+
+Cloth::Cloth(ClothMesh* mesh, float mass, float springConstant, float dampingConstant)
+{
+    std::vector<glm::vec3>& positions = mesh->GetPositions();
+    std::vector<glm::ivec3>& meshTriangles = mesh->GetTriangles();
 
-    SetupBuffers();
+    // one particle per mesh vertex, nothing is pinned (use SetParticleFixed)
+    for (int i = 0; i < positions.size(); i++)
+    {
+        particles.push_back(new Particle(positions[i], mass, false));
+    }
+
+    // structural springs along every edge, rest lengths straight from the mesh
+    for (const glm::ivec2& edge : mesh->GetEdges())
+    {
+        float restLength = glm::length(positions[edge.x] - positions[edge.y]);
+        springs.push_back(new SpringDamper(particles[edge.x], particles[edge.y], edge.x, edge.y, springConstant, dampingConstant, restLength));
+    }
+
+    // bending springs across every interior edge, same weakening as the grid's bending springs
+    for (const glm::ivec2& pair : mesh->GetBendingPairs())
+    {
+        float restLength = glm::length(positions[pair.x] - positions[pair.y]);
+        springs.push_back(new SpringDamper(particles[pair.x], particles[pair.y], pair.x, pair.y, springConstant * 0.5f, dampingConstant * 1.5f, restLength));
+    }
+
+    for (const glm::ivec3& triangle : meshTriangles)
+    {
+        triangles.push_back(new ClothTriangle(particles[triangle.x], particles[triangle.y], particles[triangle.z], triangle.x, triangle.y, triangle.z));
+    }
+
+    // collision sizes follow the typical edge, like the grid spacing
+    Initialise(springConstant, mesh->GetAverageEdgeLength());
+}
+
+Cloth::Cloth(std::vector<Cloth*>& cloths)
+{
+    for (Cloth* cloth : cloths)
+    {
+        int offset = particles.size();
+
+        // the particles move over as they are, springs and triangles are rebuilt with shifted indices
+        particles.insert(particles.end(), cloth->particles.begin(), cloth->particles.end());
+
+        for (SpringDamper* spring : cloth->springs)
+        {
+            springs.push_back(new SpringDamper(spring->GetP1(), spring->GetP2(), spring->GetIndexP1() + offset, spring->GetIndexP2() + offset,
+                spring->GetSpringConstant(), spring->GetDampingConstant(), spring->GetRestLength()));
+            if (spring->IsBroken())
+            {
+                springs.back()->Break();
+            }
+            delete spring;
+        }
+
+        for (ClothTriangle* triangle : cloth->triangles)
+        {
+            triangles.push_back(new ClothTriangle(triangle->GetP1(), triangle->GetP2(), triangle->GetP3(),
+                triangle->GetIndexP1() + offset, triangle->GetIndexP2() + offset, triangle->GetIndexP3() + offset));
+            delete triangle;
+        }
+
+        // nothing left for the old cloth's destructor to delete
+        cloth->particles.clear();
+        cloth->springs.clear();
+        cloth->triangles.clear();
+    }
+
+    if (cloths.empty())
+    {
+        Initialise(0.0f, 1.0f);
+        return;
+    }
+
+    Cloth* first = cloths[0];
+    Initialise(first->springConstant, first->particleSpacing);
+
+    wind = first->wind;
+    windField = first->windField;
+    time = first->time;
+    solver = first->solver;
+    selfCollisionEnabled = first->selfCollisionEnabled;
+    collisionMesh = first->collisionMesh;
+    collisionThickness = first->collisionThickness;
+    collisionFriction = first->collisionFriction;
+    *obstacles = *first->obstacles;
+    sleepingEnabled = first->sleepingEnabled;
+    tearStretch = first->tearStretch;
+    SetTearingEnabled(first->tearingEnabled);
+    triangleBatch->Compute(particles, wind, windField);
+}
+
+void Cloth::Initialise(float springConstant, float particleSpacing)
+{
+    // initialise wind with zero velocity, can be set later by ui
+    wind = glm::vec3(0.0f);
+    windField = nullptr;
+    time = 0.0f;
+
+    // initialise gravity
+    gravity = glm::vec3(0.0f, -9.81f, 0.0f);
+
+    // explicit integration by default, projective dynamics can be switched on from the ui
+    this->springConstant = springConstant;
+    this->particleSpacing = particleSpacing;
+    solver = ClothSolver::Explicit;
+    projectiveDynamics = new ProjectiveDynamics();
+
+    // self-collision keeps the two sides a fraction of the particle spacing apart,
+    // hash cells are about one triangle across
+    selfCollision = new SelfCollision(triangles, particleSpacing * 0.2f, particleSpacing * 1.5f);
+    selfCollisionEnabled = false;
+
+    // no external collider until one is set
+    collisionMesh = nullptr;
+    collisionThickness = particleSpacing * 0.25f;
+    collisionFriction = 0.5f;
+    obstacles = new ClothObstacles();
+    obstaclesVersion = obstacles->GetVersion();
+
+    // room for the particles tears split off, everything per particle is sized for them
+    firstSplitParticle = particles.size();
+    maxParticles = particles.size() + particles.size() / SPARE_PARTICLE_FRACTION;
+    particles.reserve(maxParticles);
+
+    // fused drag + normal pass, run once now so there are normals before the first step
+    triangleBatch = new ClothTriangleBatch(triangles, maxParticles);
+    triangleBatch->Compute(particles, wind, windField);
+    triangleBatchCurrent = true;
+
+    springBatch = new ClothSpringBatch(springs, maxParticles);
+
+    // triangles along each spring, from the sorted edges of all triangles
+    std::vector<std::pair<long long, int>> edges;
+    edges.reserve(triangles.size() * 3);
+    for (int t = 0; t < triangles.size(); t++)
+    {
+        int corners[3] = { triangles[t]->GetIndexP1(), triangles[t]->GetIndexP2(), triangles[t]->GetIndexP3() };
+        for (int i = 0; i < 3; i++)
+        {
+            long long a = std::min(corners[i], corners[(i + 1) % 3]);
+            long long b = std::max(corners[i], corners[(i + 1) % 3]);
+            edges.push_back(std::make_pair(a * (long long)particles.size() + b, t));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+
+    springTriangleStart.assign(1, 0);
+    springTriangles.clear();
+    for (SpringDamper* spring : springs)
+    {
+        long long a = std::min(spring->GetIndexP1(), spring->GetIndexP2());
+        long long b = std::max(spring->GetIndexP1(), spring->GetIndexP2());
+        long long key = a * (long long)particles.size() + b;
+        std::vector<std::pair<long long, int>>::iterator edge = std::lower_bound(edges.begin(), edges.end(), std::make_pair(key, -1));
+        for (; edge != edges.end() && edge->first == key; edge++)
+        {
+            springTriangles.push_back(edge->second);
+        }
+        springTriangleStart.push_back(springTriangles.size());
+    }
+
+    // and the other way round, the spring along each triangle edge
+    triangleSprings.assign(triangles.size() * 3, -1);
+    for (int s = 0; s < springs.size(); s++)
+    {
+        for (int j = springTriangleStart[s]; j < springTriangleStart[s + 1]; j++)
+        {
+            int t = springTriangles[j];
+            int corners[3] = { triangles[t]->GetIndexP1(), triangles[t]->GetIndexP2(), triangles[t]->GetIndexP3() };
+            for (int k = 0; k < 3; k++)
+            {
+                int a = corners[k];
+                int b = corners[(k + 1) % 3];
+                if ((a == springs[s]->GetIndexP1() && b == springs[s]->GetIndexP2()) || (a == springs[s]->GetIndexP2() && b == springs[s]->GetIndexP1()))
+                {
+                    triangleSprings[t * 3 + k] = s;
+                }
+            }
+        }
+    }
+
+    // corners and spring ends at each particle
+    particleCorners.assign(maxParticles, -1);
+    cornerNext.assign(triangles.size() * 3, -1);
+    for (int t = 0; t < triangles.size(); t++)
+    {
+        int corners[3] = { triangles[t]->GetIndexP1(), triangles[t]->GetIndexP2(), triangles[t]->GetIndexP3() };
+        for (int k = 0; k < 3; k++)
+        {
+            cornerNext[t * 3 + k] = particleCorners[corners[k]];
+            particleCorners[corners[k]] = t * 3 + k;
+        }
+    }
+    particleSpringEnds.assign(maxParticles, -1);
+    springEndNext.assign(springs.size() * 2, -1);
+    for (int s = 0; s < springs.size(); s++)
+    {
+        int ends[2] = { springs[s]->GetIndexP1(), springs[s]->GetIndexP2() };
+        for (int end = 0; end < 2; end++)
+        {
+            springEndNext[s * 2 + end] = particleSpringEnds[ends[end]];
+            particleSpringEnds[ends[end]] = s * 2 + end;
+        }
+    }
+    particleOrigin.resize(maxParticles);
+    for (int i = 0; i < maxParticles; i++)
+    {
+        particleOrigin[i] = i;
+    }
+
+    // nothing torn yet, room for everything to tear. spares are only made once tearing is on
+    tearingEnabled = false;
+    tearStretch = 3.0f;
+    triangleTorn.assign(triangles.size(), 0);
+    tornSprings.assign(springs.size(), -1);
+    tornTriangles.assign(triangles.size(), -1);
+    numTornSprings = 0;
+    numTornTriangles = 0;
+    splitCorners.assign(triangles.size() * 3, glm::ivec2(-1));
+    splitSpringEnds.assign(springs.size() * 2, glm::ivec2(-1));
+    numSplitCorners = 0;
+    numSplitSpringEnds = 0;
+
+    // everything starts awake, patches fall asleep once they come to rest
+    patches = new ClothPatches(particles, springs, maxParticles);
+    sleepingEnabled = true;
+
+    // nothing has moved yet, ClothRenderer compares against this
+    version = 0;
+    ResetProfile();
 }
 
 Cloth::~Cloth()
@@ -168,23 +398,31 @@ Cloth::~Cloth()
     {
         delete triangle;
     }
+    for (Particle* particle : spareParticles)
+    {
+        delete particle;
+    }
 
     particles.clear();
     springs.clear();
     triangles.clear();
 
-    // clean up OpenGL stuff
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO_positions);
-    glDeleteBuffers(1, &VBO_normals);
-    glDeleteBuffers(1, &EBO);
-    glDeleteVertexArrays(1, &springVAO);
-    glDeleteBuffers(1, &springVBO);
+    delete projectiveDynamics;
+    delete selfCollision;
+    delete triangleBatch;
+    delete springBatch;
+    delete patches;
+    delete obstacles;
 }
 
 void Cloth::SetWind(glm::vec3 wind)
 {
-    this->wind = wind;
+    // the drag from the end of the last step was for the old wind, and resting cloth has to react
+    if (wind != this->wind)
+    {
+        this->wind = wind;
+        WakeAll();
+    }
 }
 
 void Cloth::Simulate(float dt)
@@ -220,190 +458,836 @@ void Cloth::Simulate(float dt)
 
     // printf("Cloth::Simulate - dt = %f\n", dt);
 
+    std::chrono::steady_clock::time_point phaseStart = std::chrono::steady_clock::now();
+
+    // an obstacle that moved or appeared may now be in the way
+    if (obstacles->GetVersion() != obstaclesVersion)
+    {
+        obstaclesVersion = obstacles->GetVersion();
+        WakeAll();
+    }
+
+    // a cloth that is completely at rest stays exactly where it is
+    if (patches->IsAllAsleep())
+    {
+        profile.steps++;
+        return;
+    }
+
+    // the projective dynamics solve moves every particle, so it can't leave part of the cloth asleep
+    if (solver == ClothSolver::ProjectiveDynamics && patches->GetNumAwakePatches() < patches->GetNumPatches())
+    {
+        WakeAll();
+    }
+
+    // sleeping particles get no forces and don't move
+    std::vector<char>& awake = patches->GetParticleAwake();
+
     // apply gravity: F = m * g
-    for (Particle* particle : particles)
+    for (int i = 0; i < particles.size(); i++)
     {
-        particle->ApplyForce(gravity * particle->GetMass());
+        if (awake[i])
+        {
+            particles[i]->ApplyForce(gravity * particles[i]->GetMass());
+        }
     }
 
-    // compute and apply spring-damper forces
-    for (SpringDamper* spring : springs)
+    // aerodynamic forces using wind, normally already computed at the end of the last step
+    if (!triangleBatchCurrent)
     {
-        spring->ComputeForce();
+        triangleBatch->Compute(particles, wind, windField);
     }
+    triangleBatch->ApplyForces(particles);
+    profile.forces += ElapsedSeconds(phaseStart);
 
-    // compute and apply aerodynamic forces using wind
-    for (ClothTriangle* triangle : triangles)
+    if (solver == ClothSolver::ProjectiveDynamics)
     {
-        triangle->ComputeAerodynamicForce(wind);
+        // springs are handled implicitly, gravity and drag are the external forces.
+        // the global solve moves everything, so here the cloth only ever sleeps as a whole
+        projectiveDynamics->Step(particles, springs, dt);
     }
+    else
+    {
+        // compute and apply spring-damper forces, a spring between two sleeping particles is at rest
+        springBatch->ApplyForces(particles);
 
-    // update particle positions by integrating forces
-    for (Particle* particle : particles)
+        // the pass above flags the springs that were pulled too far
+        if (tearingEnabled && springBatch->GetNumOverstretched() > 0)
+        {
+            Tear();
+        }
+
+        // update particle positions by integrating forces, sleeping ones drop what awake neighbours pushed on them
+        for (int i = 0; i < particles.size(); i++)
+        {
+            if (awake[i])
+            {
+                particles[i]->Integrate(dt);
+            }
+            else
+            {
+                particles[i]->SetForce(glm::vec3(0.0f));
+            }
+        }
+    }
+    profile.solver += ElapsedSeconds(phaseStart);
+
+    // push particles out of the obstacles and the character before resolving cloth-cloth contacts
+    obstacles->Collide(particles, awake, collisionThickness);
+    if (collisionMesh)
+    {
+        CollideWithMesh(dt);
+    }
+    profile.collision += ElapsedSeconds(phaseStart);
+
+    // fix up any interpenetration the step introduced
+    if (selfCollisionEnabled)
+    {
+        selfCollision->Resolve(particles, awake);
+    }
+    profile.selfCollision += ElapsedSeconds(phaseStart);
+
+    // put resting patches to sleep before the triangle pass, so it only covers what is still awake.
+    // a moving character or a changing wind field can push the cloth at any time, so nothing
+    // sleeps while there is one
+    if (sleepingEnabled && !collisionMesh && !windField)
+    {
+        if (patches->Update(particles, dt, solver == ClothSolver::ProjectiveDynamics))
+        {
+            UpdateActive();
+        }
+    }
+
+    // one triangle pass over the final state: normals for drawing it, drag for the next step
+    time += dt;
+    if (windField)
     {
-        particle->Integrate(dt);
+        windField->Update(time);
     }
+    triangleBatch->Compute(particles, wind, windField);
+    triangleBatchCurrent = true;
+    profile.forces += ElapsedSeconds(phaseStart);
+    profile.steps++;
 
-    // after simulation is done, update buffers
-    UpdateBuffers();
+    // renderers refresh their buffers once per frame, however many steps ran
+    version++;
 }
 
-void Cloth::Draw(glm::mat4 viewProjMtx, GLuint shader)
+double Cloth::ElapsedSeconds(std::chrono::steady_clock::time_point& since)
 {
-    glUseProgram(shader);
-    
-    glUniformMatrix4fv(glGetUniformLocation(shader, "viewProj"), 1, false, (float*)&viewProjMtx);
-    glUniformMatrix4fv(glGetUniformLocation(shader, "model"), 1, GL_FALSE, (float*)&model);
-    
-    // triangles
-    // glUniform3fv(glGetUniformLocation(shader, "DiffuseColor"), 1, &color[0]);
-    // glBindVertexArray(VAO);
-    // glDrawElements(GL_TRIANGLES, triangleIndices.size(), GL_UNSIGNED_INT, 0);
-    // glBindVertexArray(0);
-    
-    // springs
-    glm::vec3 springColor = glm::vec3(0.0f, 0.5f, 1.0f);
-    glUniform3fv(glGetUniformLocation(shader, "DiffuseColor"), 1, &springColor[0]);
-    
-    // line rendering for springs
-    springLines.clear();
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - since).count();
+    since = now;
+    return seconds;
+}
+
+void Cloth::Translate(glm::vec3 translation)
+{
+    Translate(translation, 0, particles.size());
+}
+
+void Cloth::Translate(glm::vec3 translation, int begin, int end)
+{
+    // the pinned particles pull on their neighbours, wake them. particles split off one in the
+    // range come along
+    for (int i = 0; i < particles.size(); i++)
+    {
+        bool inRange = (i >= begin && i < end) || (i >= firstSplitParticle && particleOrigin[i] >= begin && particleOrigin[i] < end);
+        if (inRange && particles[i]->IsFixed())
+        {
+            particles[i]->SetPosition(particles[i]->GetPosition() + translation);
+            patches->WakePatchOf(i);
+        }
+    }
+    UpdateActive();
+
+    // keep the normals in step with the moved particles
+    triangleBatch->Compute(particles, wind, windField);
+    triangleBatchCurrent = true;
+
+    version++;
+}
+
+void Cloth::SetPositions(const std::vector<glm::vec3>& positions)
+{
+    // a replayed frame, the particles are placed rather than simulated
+    for (int i = 0; i < particles.size() && i < positions.size(); i++)
+    {
+        particles[i]->SetPosition(positions[i]);
+        particles[i]->SetVelocity(glm::vec3(0.0f));
+    }
+    WakeAll();
+
+    triangleBatch->Compute(particles, wind, windField);
+    triangleBatchCurrent = true;
+
+    version++;
+}
+
+ClothSolver Cloth::GetSolver()
+{
+    return solver;
+}
+
+void Cloth::SetSolver(ClothSolver solver)
+{
+    this->solver = solver;
+    WakeAll();
+}
+
+ProjectiveDynamics* Cloth::GetProjectiveDynamics()
+{
+    return projectiveDynamics;
+}
+
+float Cloth::GetSpringConstant()
+{
+    return springConstant;
+}
+
+void Cloth::SetSpringConstant(float springConstant)
+{
+    // a zero constant would leave nothing to rescale from on the next call
+    if (springConstant <= 0.0f)
+    {
+        printf("Cloth::SetSpringConstant - spring constant must be positive\n");
+        return;
+    }
+    if (springConstant == this->springConstant)
+    {
+        return;
+    }
+    if (this->springConstant <= 0.0f)
+    {
+        printf("Cloth::SetSpringConstant - cloth was built without stiffness, nothing to rescale\n");
+        return;
+    }
+
+    // rescale every spring so bending springs keep their ratio to the structural ones
+    float scale = springConstant / this->springConstant;
     for (SpringDamper* spring : springs)
     {
-        springLines.push_back(spring->GetP1()->GetPosition());
-        springLines.push_back(spring->GetP2()->GetPosition());
+        spring->SetSpringConstant(spring->GetSpringConstant() * scale);
     }
-    
-    // spring VAO/VBO
-    glBindVertexArray(springVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, springVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * springLines.size(), springLines.data(), GL_DYNAMIC_DRAW);
-    
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    
-    glLineWidth(1.5f);
-    glDrawArrays(GL_LINES, 0, springLines.size());
-    glBindVertexArray(0);
-    
-    // reset point size and line width
-    glPointSize(1.0f);
-    glLineWidth(1.0f);
-    
-    // unbind shader
-    glUseProgram(0);
+    this->springConstant = springConstant;
+
+    springBatch->SetSpringConstants(springs);
+    projectiveDynamics->Invalidate();
+    WakeAll();
 }
-void Cloth::SetupBuffers()
+
+int Cloth::GetNumParticles()
 {
-    // clear old data
-    vertexPositions.clear();
-    vertexNormals.clear();
-    triangleIndices.clear();
+    return particles.size();
+}
 
-    // for each particle, store position and initialise normal to zero
-    for (Particle* particle : particles)
+bool Cloth::IsParticleFixed(int index)
+{
+    return particles[index]->IsFixed();
+}
+
+void Cloth::SetParticleFixed(int index, bool fixed)
+{
+    if (particles[index]->IsFixed() == fixed)
     {
-        vertexPositions.push_back(particle->GetPosition());
-        vertexNormals.push_back(glm::vec3(0.0f));
+        return;
     }
 
-    // for each triangle, store indices of particles
-    for (ClothTriangle* triangle : triangles)
+    particles[index]->SetFixed(fixed);
+    particles[index]->SetVelocity(glm::vec3(0.0f));
+
+    projectiveDynamics->Invalidate();
+
+    // a released particle has to be able to fall
+    patches->WakePatchOf(index);
+    UpdateActive();
+    triangleBatchCurrent = false;
+}
+
+bool Cloth::IsSelfCollisionEnabled()
+{
+    return selfCollisionEnabled;
+}
+
+void Cloth::SetSelfCollisionEnabled(bool enabled)
+{
+    // stale hash contents would be moved cell by cell, just start over
+    if (enabled && !selfCollisionEnabled)
     {
-        int indexP1 = triangle->GetIndexP1();
-        int indexP2 = triangle->GetIndexP2();
-        int indexP3 = triangle->GetIndexP3();
+        selfCollision->Reset();
     }
+    selfCollisionEnabled = enabled;
+    WakeAll();
+}
 
-    // generate VAO and VBOs for triangles
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO_positions);
-    glGenBuffers(1, &VBO_normals);
-    glGenBuffers(1, &EBO);
+SelfCollision* Cloth::GetSelfCollision()
+{
+    return selfCollision;
+}
 
-    // bind VAO
-    glBindVertexArray(VAO);
+void Cloth::CollideWithMesh(float dt)
+{
+    // every particle only touches itself, so they can all be handled at once
+    ThreadPool::GetShared()->ParallelFor(particles.size(), 128, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            Particle* particle = particles[i];
+            if (particle->IsFixed())
+            {
+                continue;
+            }
 
-    // bind VBO_positions
-    glBindBuffer(GL_ARRAY_BUFFER, VBO_positions);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * vertexPositions.size(), vertexPositions.data(), GL_DYNAMIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
+            // the particle may have gone through the surface during the step, so look as far
+            // back as it moved
+            glm::vec3 position = particle->GetPosition();
+            float searchRadius = collisionThickness + glm::length(particle->GetVelocity()) * dt;
+            MeshHit hit;
+            if (!collisionMesh->FindClosest(position, searchRadius, hit))
+            {
+                continue;
+            }
 
-    // bind VBO_normals
-    glBindBuffer(GL_ARRAY_BUFFER, VBO_normals);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * vertexNormals.size(), vertexNormals.data(), GL_DYNAMIC_DRAW);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
+            // outside the surface push away from the closest point, inside push out along the face normal.
+            // only the distance along the normal changes, so neighbouring particles don't get snapped together
+            glm::vec3 normal;
+            float distance;
+            glm::vec3 offset = position - hit.point;
+            if (glm::dot(offset, hit.normal) >= 0.0f && hit.distance > 1e-6f)
+            {
+                if (hit.distance >= collisionThickness)
+                {
+                    continue;
+                }
+                normal = offset / hit.distance;
+                distance = hit.distance;
+            }
+            else
+            {
+                normal = hit.normal;
+                distance = glm::dot(offset, normal);
+            }
+
+            particle->SetPosition(position + normal * (collisionThickness - distance));
+
+            // remove the velocity going into the surface, coulomb friction takes off up to
+            // friction * (removed normal speed) of the sliding speed
+            glm::vec3 velocity = particle->GetVelocity();
+            float normalVelocity = glm::dot(velocity, normal);
+            if (normalVelocity < 0.0f)
+            {
+                glm::vec3 tangentVelocity = velocity - normalVelocity * normal;
+                float tangentSpeed = glm::length(tangentVelocity);
+                float scale = tangentSpeed > 0.0f ? glm::max(0.0f, 1.0f + collisionFriction * normalVelocity / tangentSpeed) : 0.0f;
+                particle->SetVelocity(tangentVelocity * scale);
+            }
+        }
+    });
+}
 
-    // bind EBO
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * triangleIndices.size(), triangleIndices.data(), GL_DYNAMIC_DRAW);
+WindField* Cloth::GetWindField()
+{
+    return windField;
+}
 
-    // spring VAO/VBO
-    glGenVertexArrays(1, &springVAO);
-    glGenBuffers(1, &springVBO);
+void Cloth::SetWindField(WindField* windField)
+{
+    this->windField = windField;
+    if (windField)
+    {
+        windField->Update(time);
+    }
+    WakeAll();
+}
 
-    // unbind
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+MeshBVH* Cloth::GetCollisionMesh()
+{
+    return collisionMesh;
 }
 
-void Cloth::UpdateBuffers()
+void Cloth::SetCollisionMesh(MeshBVH* collisionMesh)
 {
-    // update positions
-    for (int i = 0; i < particles.size(); i++)
+    this->collisionMesh = collisionMesh;
+    WakeAll();
+}
+
+float Cloth::GetCollisionThickness()
+{
+    return collisionThickness;
+}
+
+void Cloth::SetCollisionThickness(float collisionThickness)
+{
+    this->collisionThickness = collisionThickness;
+}
+
+ClothObstacles* Cloth::GetObstacles()
+{
+    return obstacles;
+}
+
+float Cloth::GetCollisionFriction()
+{
+    return collisionFriction;
+}
+
+void Cloth::SetCollisionFriction(float collisionFriction)
+{
+    this->collisionFriction = collisionFriction;
+}
+
+std::vector<Particle*>& Cloth::GetParticles()
+{
+    return particles;
+}
+
+std::vector<SpringDamper*>& Cloth::GetSprings()
+{
+    return springs;
+}
+
+std::vector<ClothTriangle*>& Cloth::GetTriangles()
+{
+    return triangles;
+}
+
+std::vector<glm::vec3>& Cloth::GetVertexNormals()
+{
+    return triangleBatch->GetVertexNormals();
+}
+
+unsigned int Cloth::GetVersion()
+{
+    return version;
+}
+
+ClothProfile& Cloth::GetProfile()
+{
+    return profile;
+}
+
+void Cloth::ResetProfile()
+{
+    profile.steps = 0;
+    profile.forces = 0.0;
+    profile.solver = 0.0;
+    profile.collision = 0.0;
+    profile.selfCollision = 0.0;
+}
+
+void Cloth::Tear()
+{
+    int first = numTornSprings;
+    int numParticles = particles.size();
+    springBatch->BreakOverstretched(tornSprings, numTornSprings);
+
+    for (int i = first; i < numTornSprings; i++)
+    {
+        int s = tornSprings[i];
+        springs[s]->Break();
+
+        // the cloth parts along the spring's edge where its ends come apart. without room to
+        // split them, the triangles along it are torn out so it still opens
+        if (springTriangleStart[s + 1] > springTriangleStart[s] && (!SplitParticle(springs[s]->GetIndexP1()) || !SplitParticle(springs[s]->GetIndexP2())))
+        {
+            for (int j = springTriangleStart[s]; j < springTriangleStart[s + 1]; j++)
+            {
+                RemoveTriangle(springTriangles[j]);
+            }
+        }
+    }
+
+    // the split off particles need their springs and triangles in the batches
+    if (particles.size() > numParticles)
     {
-        vertexPositions[i] = particles[i]->GetPosition();
+        UpdateActive();
     }
 
-    // reset normals
-    for (int i = 0; i < vertexNormals.size(); i++)
+    // the broken springs have no stiffness left, for when the solver is switched
+    projectiveDynamics->Invalidate();
+}
+
+bool Cloth::SplitParticle(int particle)
+{
+    // the triangles around the particle, by corner
+    int fan[MAX_SPLIT_TRIANGLES];
+    int numFan = 0;
+    for (int c = particleCorners[particle]; c >= 0; c = cornerNext[c])
     {
-        vertexNormals[i] = glm::vec3(0.0f);
+        if (numFan == MAX_SPLIT_TRIANGLES)
+        {
+            return false;
+        }
+        fan[numFan++] = c;
     }
 
-    // calculate normals by averaging triangle contributions
-    for (ClothTriangle* triangle : triangles)
+    // two triangles are in one piece when they share an edge at the particle whose spring still
+    // holds, merged until nothing changes (a fan is a handful of triangles)
+    int piece[MAX_SPLIT_TRIANGLES];
+    for (int i = 0; i < numFan; i++)
+    {
+        piece[i] = i;
+    }
+    bool merged = true;
+    while (merged)
+    {
+        merged = false;
+        for (int i = 0; i < numFan; i++)
+        {
+            for (int j = i + 1; j < numFan; j++)
+            {
+                if (piece[i] == piece[j])
+                {
+                    continue;
+                }
+
+                // the two edges at the particle are the ones after and before its corner
+                bool joined = false;
+                for (int a = 1; a <= 2 && !joined; a++)
+                {
+                    for (int b = 1; b <= 2 && !joined; b++)
+                    {
+                        int ti = fan[i] / 3, ki = (fan[i] % 3 + a) % 3;
+                        int tj = fan[j] / 3, kj = (fan[j] % 3 + b) % 3;
+                        int qi = ki == 0 ? triangles[ti]->GetIndexP1() : (ki == 1 ? triangles[ti]->GetIndexP2() : triangles[ti]->GetIndexP3());
+                        int qj = kj == 0 ? triangles[tj]->GetIndexP1() : (kj == 1 ? triangles[tj]->GetIndexP2() : triangles[tj]->GetIndexP3());
+                        int spring = triangleSprings[ti * 3 + (a == 1 ? fan[i] % 3 : ki)];
+                        joined = qi == qj && (spring < 0 || !springs[spring]->IsBroken());
+                    }
+                }
+                if (joined)
+                {
+                    int from = std::max(piece[i], piece[j]);
+                    int to = std::min(piece[i], piece[j]);
+                    for (int k = 0; k < numFan; k++)
+                    {
+                        piece[k] = piece[k] == from ? to : piece[k];
+                    }
+                    merged = true;
+                }
+            }
+        }
+    }
+
+    // the biggest piece keeps the particle
+    int pieceSize[MAX_SPLIT_TRIANGLES] = { 0 };
+    int numPieces = 0;
+    int keep = piece[0];
+    for (int i = 0; i < numFan; i++)
+    {
+        numPieces += pieceSize[piece[i]]++ == 0;
+    }
+    for (int i = 0; i < numFan; i++)
+    {
+        keep = pieceSize[piece[i]] > pieceSize[keep] ? piece[i] : keep;
+    }
+    if (numPieces < 2)
+    {
+        return true;
+    }
+
+    // which piece each spring goes with: the one with a triangle along it, or for a spring that
+    // isn't a triangle edge, the one whose triangle it points into. broken ones stay put
+    glm::vec3 position = particles[particle]->GetPosition();
+    int ends[MAX_SPLIT_SPRINGS];
+    int endPiece[MAX_SPLIT_SPRINGS];
+    int numEnds = 0;
+    int movedEnds = 0;
+    for (int e = particleSpringEnds[particle]; e >= 0; e = springEndNext[e])
+    {
+        SpringDamper* spring = springs[e / 2];
+        if (numEnds == MAX_SPLIT_SPRINGS)
+        {
+            return false;
+        }
+        if (spring->IsBroken())
+        {
+            ends[numEnds] = e;
+            endPiece[numEnds++] = keep;
+            continue;
+        }
+        int other = e % 2 == 0 ? spring->GetIndexP2() : spring->GetIndexP1();
+        glm::vec3 direction = particles[other]->GetPosition() - position;
+
+        int best = keep;
+        float bestScore = -FLT_MAX;
+        for (int i = 0; i < numFan; i++)
+        {
+            int t = fan[i] / 3;
+            int k = fan[i] % 3;
+            int corners[3] = { triangles[t]->GetIndexP1(), triangles[t]->GetIndexP2(), triangles[t]->GetIndexP3() };
+            if (corners[(k + 1) % 3] == other || corners[(k + 2) % 3] == other)
+            {
+                best = piece[i];
+                break;
+            }
+
+            // direction = alpha * e1 + beta * e2 in the triangle's plane, inside the corner
+            // when both are positive
+            glm::vec3 e1 = particles[corners[(k + 1) % 3]]->GetPosition() - position;
+            glm::vec3 e2 = particles[corners[(k + 2) % 3]]->GetPosition() - position;
+            float e11 = glm::dot(e1, e1);
+            float e12 = glm::dot(e1, e2);
+            float e22 = glm::dot(e2, e2);
+            float determinant = e11 * e22 - e12 * e12;
+            if (determinant <= 0.0f)
+            {
+                continue;
+            }
+            float alpha = (glm::dot(e1, direction) * e22 - glm::dot(e2, direction) * e12) / determinant;
+            float beta = (glm::dot(e2, direction) * e11 - glm::dot(e1, direction) * e12) / determinant;
+            if (glm::min(alpha, beta) > bestScore)
+            {
+                bestScore = glm::min(alpha, beta);
+                best = piece[i];
+            }
+        }
+        ends[numEnds] = e;
+        endPiece[numEnds++] = best;
+        movedEnds += best != keep;
+    }
+
+    // enough spares and room in the logs for every piece that moves
+    int movedCorners = numFan - pieceSize[keep];
+    if ((int)spareParticles.size() < numPieces - 1 || numSplitCorners + movedCorners > (int)splitCorners.size() || numSplitSpringEnds + movedEnds > (int)splitSpringEnds.size())
+    {
+        return false;
+    }
+
+    // mass and the forces of this step are shared out by triangles, so every piece keeps
+    // accelerating as the particle did
+    Particle* original = particles[particle];
+    float mass = original->GetMass();
+    glm::vec3 force = original->GetForce();
+
+    for (int p = 0; p < numFan; p++)
     {
-        // get triangle particle indices
-        int indexP1 = triangle->GetIndexP1();
-        int indexP2 = triangle->GetIndexP2();
-        int indexP3 = triangle->GetIndexP3();
+        if (p != piece[p] || p == keep)
+        {
+            continue;
+        }
+
+        float share = (float)pieceSize[p] / numFan;
+        int index = particles.size();
+        Particle* copy = spareParticles.back();
+        spareParticles.pop_back();
+        copy->SetPosition(original->GetPosition());
+        copy->SetVelocity(original->GetVelocity());
+        copy->SetMass(mass * share);
+        copy->SetForce(force * share);
+        copy->SetFixed(original->IsFixed());
+        particles.push_back(copy);
+        particleOrigin[index] = particleOrigin[particle];
+
+        // the piece's corners move onto the copy
+        int moved[MAX_SPLIT_TRIANGLES];
+        int numMoved = 0;
+        for (int i = 0; i < numFan; i++)
+        {
+            if (piece[i] != p)
+            {
+                continue;
+            }
+            int t = fan[i] / 3;
+            triangles[t]->SetCorner(fan[i] % 3, copy, index);
+            cornerNext[fan[i]] = particleCorners[index];
+            particleCorners[index] = fan[i];
+            splitCorners[numSplitCorners++] = glm::ivec2(fan[i], index);
+            moved[numMoved++] = t;
+        }
+        triangleBatch->SplitVertex(particle, index, moved, numMoved);
+        selfCollision->SplitParticle(particle, index, moved, numMoved);
 
-        // calculate triangle face normal
-        glm::vec3 normal = triangle->ComputeNormal();
+        // and so do the springs on its side
+        for (int i = 0; i < numEnds; i++)
+        {
+            if (endPiece[i] != p)
+            {
+                continue;
+            }
+            int e = ends[i];
+            SpringDamper* spring = springs[e / 2];
+            if (e % 2 == 0)
+            {
+                spring->SetP1(copy, index);
+            }
+            else
+            {
+                spring->SetP2(copy, index);
+            }
+            springBatch->SetEnds(e / 2, spring->GetIndexP1(), spring->GetIndexP2());
+            springEndNext[e] = particleSpringEnds[index];
+            particleSpringEnds[index] = e;
+            splitSpringEnds[numSplitSpringEnds++] = glm::ivec2(e, index);
+        }
 
-        // add to vertex normals
-        vertexNormals[indexP1] += normal;
-        vertexNormals[indexP2] += normal;
-        vertexNormals[indexP3] += normal;
+        patches->AddParticle(index, particle);
     }
 
-    // normalise vertex normals
-    for (int i = 0; i < vertexNormals.size(); i++)
+    // what is left stays on the particle
+    particleCorners[particle] = -1;
+    for (int i = numFan - 1; i >= 0; i--)
     {
-        vertexNormals[i] = glm::normalize(vertexNormals[i]);
+        if (piece[i] == keep)
+        {
+            cornerNext[fan[i]] = particleCorners[particle];
+            particleCorners[particle] = fan[i];
+        }
     }
+    particleSpringEnds[particle] = -1;
+    for (int i = numEnds - 1; i >= 0; i--)
+    {
+        if (endPiece[i] == keep)
+        {
+            springEndNext[ends[i]] = particleSpringEnds[particle];
+            particleSpringEnds[particle] = ends[i];
+        }
+    }
+
+    // the particle keeps its share
+    float share = (float)pieceSize[keep] / numFan;
+    original->SetMass(mass * share);
+    original->SetForce(force * share);
+    return true;
+}
 
-    // update VBOs
-    glBindBuffer(GL_ARRAY_BUFFER, VBO_positions);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(glm::vec3) * vertexPositions.size(), vertexPositions.data());
+void Cloth::RemoveTriangle(int triangle)
+{
+    if (triangleTorn[triangle])
+    {
+        return;
+    }
+    triangleTorn[triangle] = 1;
+    triangleBatch->RemoveTriangle(triangle);
+    selfCollision->RemoveTriangle(triangle);
+    tornTriangles[numTornTriangles++] = triangle;
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO_normals);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(glm::vec3) * vertexNormals.size(), vertexNormals.data());
+    // its corners are off the particles, so later splits don't count it
+    int corners[3] = { triangles[triangle]->GetIndexP1(), triangles[triangle]->GetIndexP2(), triangles[triangle]->GetIndexP3() };
+    for (int k = 0; k < 3; k++)
+    {
+        int* link = &particleCorners[corners[k]];
+        while (*link >= 0 && *link != triangle * 3 + k)
+        {
+            link = &cornerNext[*link];
+        }
+        if (*link >= 0)
+        {
+            *link = cornerNext[*link];
+        }
+    }
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+bool Cloth::IsTearingEnabled()
+{
+    return tearingEnabled;
 }
 
-void Cloth::Translate(glm::vec3 translation)
+void Cloth::SetTearingEnabled(bool enabled)
 {
-    for (Particle* particle : particles)
+    tearingEnabled = enabled;
+
+    // the particles tears split off, made once so tearing never allocates mid step
+    if (enabled)
     {
-        if (particle->IsFixed())
+        int missing = maxParticles - particles.size() - spareParticles.size();
+        for (int i = 0; i < missing; i++)
         {
-            particle->SetPosition(particle->GetPosition() + translation);
+            spareParticles.push_back(new Particle(glm::vec3(0.0f), 0.0f));
         }
     }
+    springBatch->SetTearStretch(enabled ? tearStretch : 0.0f);
+}
+
+float Cloth::GetTearStretch()
+{
+    return tearStretch;
+}
+
+void Cloth::SetTearStretch(float tearStretch)
+{
+    this->tearStretch = tearStretch;
+    springBatch->SetTearStretch(tearingEnabled ? tearStretch : 0.0f);
+}
+
+std::vector<int>& Cloth::GetTornSprings()
+{
+    return tornSprings;
+}
+
+int Cloth::GetNumTornSprings()
+{
+    return numTornSprings;
+}
+
+std::vector<int>& Cloth::GetTornTriangles()
+{
+    return tornTriangles;
+}
+
+int Cloth::GetNumTornTriangles()
+{
+    return numTornTriangles;
+}
+
+std::vector<glm::ivec2>& Cloth::GetSplitCorners()
+{
+    return splitCorners;
+}
+
+int Cloth::GetNumSplitCorners()
+{
+    return numSplitCorners;
+}
+
+std::vector<glm::ivec2>& Cloth::GetSplitSpringEnds()
+{
+    return splitSpringEnds;
+}
+
+int Cloth::GetNumSplitSpringEnds()
+{
+    return numSplitSpringEnds;
+}
+
+int Cloth::GetNumSplitParticles()
+{
+    return particles.size() - firstSplitParticle;
+}
+
+int Cloth::GetMaxParticles()
+{
+    return maxParticles;
+}
+
+void Cloth::WakeAll()
+{
+    patches->WakeAll();
+    UpdateActive();
+    triangleBatchCurrent = false;
+}
+
+void Cloth::UpdateActive()
+{
+    triangleBatch->SetActive(patches->GetParticleAwake());
+    springBatch->SetActive(patches->GetParticleAwake());
+}
+
+bool Cloth::IsSleepingEnabled()
+{
+    return sleepingEnabled;
+}
+
+void Cloth::SetSleepingEnabled(bool enabled)
+{
+    sleepingEnabled = enabled;
+    if (!enabled)
+    {
+        WakeAll();
+    }
+}
 
-    UpdateBuffers();
-}
\ No newline at end of file
+ClothPatches* Cloth::GetPatches()
+{
+    return patches;
+}
@@ -0,0 +1,379 @@
+#include "ClothCache.h"
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char CACHE_MAGIC[4] = { 'C', 'L', 'C', 'H' };
+static const uint32_t CACHE_VERSION = 1;
+
+// small magnitudes of either sign -> small unsigned numbers: 0, -1, 1, -2, 2 ... -> 0, 1, 2, 3, 4 ...
+static uint64_t ZigZag(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t UnZigZag(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+// 7 bits per byte, high bit set on every byte but the last
+static void WriteVarint(std::vector<uint8_t>& buffer, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        buffer.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back((uint8_t)value);
+}
+
+static bool ReadVarint(const uint8_t*& read, const uint8_t* end, uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64 && read < end; shift += 7)
+    {
+        uint8_t byte = *read++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// what a particle's grid position is predicted to be, the file stores the difference to it.
+// keyframes predict from the previous particle, the frame after a keyframe from the frame before
+// and the rest continue the motion of the last two frames
+static int64_t Predict(int phase, int i, const std::vector<int32_t>& current, const std::vector<int32_t>& previous, const std::vector<int32_t>& beforePrevious)
+{
+    if (phase == 0)
+    {
+        return i > 0 ? current[i - 1] : 0;
+    }
+    if (phase == 1)
+    {
+        return previous[i];
+    }
+    return 2 * (int64_t)previous[i] - beforePrevious[i];
+}
+
+ClothCacheWriter::ClothCacheWriter()
+{
+    file = nullptr;
+    memset(&header, 0, sizeof(header));
+}
+
+ClothCacheWriter::~ClothCacheWriter()
+{
+    Close();
+}
+
+bool ClothCacheWriter::Open(const char* filename, Cloth* cloth, float frameTime, float quantum, int keyframeInterval)
+{
+    Close();
+
+    // only positions are stored, a torn cloth would replay with its torn triangles back
+    if (cloth->IsTearingEnabled() || cloth->GetNumTornSprings() > 0)
+    {
+        printf("ClothCacheWriter::Open - can't record a cloth that tears\n");
+        return false;
+    }
+
+    file = fopen(filename, "wb");
+    if (!file)
+    {
+        printf("ClothCacheWriter::Open - failed to open %s\n", filename);
+        return false;
+    }
+
+    memcpy(header.magic, CACHE_MAGIC, 4);
+    header.version = CACHE_VERSION;
+    header.numParticles = cloth->GetParticles().size();
+    header.numTriangles = cloth->GetTriangles().size();
+    header.numFrames = 0;
+    header.keyframeInterval = keyframeInterval > 0 ? keyframeInterval : 1;
+    header.quantum = quantum;
+    header.frameTime = frameTime;
+    header.indexOffset = 0;
+
+    // rewritten with the real counts by Close
+    fwrite(&header, sizeof(header), 1, file);
+
+    frameOffsets.clear();
+    for (int c = 0; c < 3; c++)
+    {
+        previous[c].assign(header.numParticles, 0);
+        beforePrevious[c].assign(header.numParticles, 0);
+        current[c].assign(header.numParticles, 0);
+    }
+    return true;
+}
+
+bool ClothCacheWriter::AddFrame(Cloth* cloth)
+{
+    std::vector<Particle*>& particles = cloth->GetParticles();
+    if (!file || particles.size() != header.numParticles)
+    {
+        printf("ClothCacheWriter::AddFrame - cache not open or the cloth changed\n");
+        return false;
+    }
+    if (cloth->GetNumTornSprings() > 0)
+    {
+        printf("ClothCacheWriter::AddFrame - the cloth tore, the cache can't hold that\n");
+        return false;
+    }
+
+    // snap to the grid
+    float scale = 1.0f / header.quantum;
+    for (int i = 0; i < particles.size(); i++)
+    {
+        glm::vec3 position = particles[i]->GetPosition();
+        for (int c = 0; c < 3; c++)
+        {
+            current[c][i] = (int32_t)lrintf(position[c] * scale);
+        }
+    }
+
+    // residuals plane by plane
+    int phase = header.numFrames % header.keyframeInterval;
+    buffer.clear();
+    for (int c = 0; c < 3; c++)
+    {
+        for (int i = 0; i < particles.size(); i++)
+        {
+            int64_t predicted = Predict(phase, i, current[c], previous[c], beforePrevious[c]);
+            WriteVarint(buffer, ZigZag(current[c][i] - predicted));
+        }
+    }
+
+    frameOffsets.push_back(ftell(file));
+    if (fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size())
+    {
+        printf("ClothCacheWriter::AddFrame - write failed\n");
+        return false;
+    }
+    header.numFrames++;
+
+    // this frame becomes the previous one, no copies
+    for (int c = 0; c < 3; c++)
+    {
+        beforePrevious[c].swap(previous[c]);
+        previous[c].swap(current[c]);
+    }
+    return true;
+}
+
+bool ClothCacheWriter::Close()
+{
+    if (!file)
+    {
+        return false;
+    }
+
+    header.indexOffset = ftell(file);
+    fwrite(frameOffsets.data(), sizeof(uint64_t), frameOffsets.size(), file);
+
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, file);
+
+    bool ok = !ferror(file);
+    fclose(file);
+    file = nullptr;
+    return ok;
+}
+
+bool ClothCacheWriter::IsOpen()
+{
+    return file != nullptr;
+}
+
+int ClothCacheWriter::GetNumFrames()
+{
+    return header.numFrames;
+}
+
+uint64_t ClothCacheWriter::GetSize()
+{
+    return file ? (uint64_t)ftell(file) : 0;
+}
+
+ClothCacheReader::ClothCacheReader()
+{
+    data = nullptr;
+    size = 0;
+    decodedFrame = -1;
+    memset(&header, 0, sizeof(header));
+}
+
+ClothCacheReader::~ClothCacheReader()
+{
+    Close();
+}
+
+bool ClothCacheReader::Open(const char* filename)
+{
+    Close();
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        printf("ClothCacheReader::Open - failed to open %s\n", filename);
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(ClothCacheHeader))
+    {
+        printf("ClothCacheReader::Open - %s is not a cloth cache\n", filename);
+        close(fd);
+        return false;
+    }
+
+    // the mapping stays valid after the descriptor is closed
+    void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        printf("ClothCacheReader::Open - failed to map %s\n", filename);
+        return false;
+    }
+    data = (const uint8_t*)mapping;
+    size = info.st_size;
+
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, CACHE_MAGIC, 4) != 0 || header.version != CACHE_VERSION || header.keyframeInterval == 0 ||
+        header.indexOffset < sizeof(header) || header.indexOffset > size ||
+        (uint64_t)header.numFrames * sizeof(uint64_t) > size - header.indexOffset || 3 * (uint64_t)header.numParticles > size)
+    {
+        printf("ClothCacheReader::Open - %s is not a cloth cache or was not closed\n", filename);
+        Close();
+        return false;
+    }
+
+    // copied out, the table sits wherever the last frame ended and may not be aligned. every
+    // frame has to lie between the header and the table, after the one before it, and hold at
+    // least a byte per value
+    frameOffsets.resize(header.numFrames);
+    if (header.numFrames > 0)
+    {
+        memcpy(frameOffsets.data(), data + header.indexOffset, header.numFrames * sizeof(uint64_t));
+    }
+    for (int f = 0; f < (int)header.numFrames; f++)
+    {
+        uint64_t end = f + 1 < (int)header.numFrames ? frameOffsets[f + 1] : header.indexOffset;
+        if (frameOffsets[f] < sizeof(header) || frameOffsets[f] > end || end > header.indexOffset ||
+            end - frameOffsets[f] < 3 * (uint64_t)header.numParticles)
+        {
+            printf("ClothCacheReader::Open - %s has a bad offset for frame %d\n", filename, f);
+            Close();
+            return false;
+        }
+    }
+
+    for (int c = 0; c < 3; c++)
+    {
+        previous[c].assign(header.numParticles, 0);
+        beforePrevious[c].assign(header.numParticles, 0);
+        current[c].assign(header.numParticles, 0);
+    }
+    decodedFrame = -1;
+    return true;
+}
+
+void ClothCacheReader::Close()
+{
+    if (data)
+    {
+        munmap((void*)data, size);
+    }
+    data = nullptr;
+    size = 0;
+    frameOffsets.clear();
+    decodedFrame = -1;
+}
+
+bool ClothCacheReader::DecodeFrame(int frame)
+{
+    // anything but the next frame starts over from the keyframe
+    int interval = header.keyframeInterval;
+    int start = frame - frame % interval;
+    if (decodedFrame >= start && decodedFrame < frame)
+    {
+        start = decodedFrame + 1;
+    }
+
+    for (int f = start; f <= frame; f++)
+    {
+        const uint8_t* read = data + frameOffsets[f];
+        const uint8_t* end = data + (f + 1 < header.numFrames ? frameOffsets[f + 1] : header.indexOffset);
+        int phase = f % interval;
+
+        for (int c = 0; c < 3; c++)
+        {
+            for (int i = 0; i < header.numParticles; i++)
+            {
+                uint64_t value;
+                if (!ReadVarint(read, end, value))
+                {
+                    printf("ClothCacheReader::DecodeFrame - frame %d is truncated\n", f);
+                    decodedFrame = -1;
+                    return false;
+                }
+                current[c][i] = (int32_t)(Predict(phase, i, current[c], previous[c], beforePrevious[c]) + UnZigZag(value));
+            }
+        }
+
+        for (int c = 0; c < 3; c++)
+        {
+            beforePrevious[c].swap(previous[c]);
+            previous[c].swap(current[c]);
+        }
+        decodedFrame = f;
+    }
+    return true;
+}
+
+bool ClothCacheReader::ReadFrame(int frame, std::vector<glm::vec3>& positions)
+{
+    if (!data || frame < 0 || frame >= header.numFrames)
+    {
+        return false;
+    }
+
+    if (frame != decodedFrame && !DecodeFrame(frame))
+    {
+        return false;
+    }
+
+    positions.resize(header.numParticles);
+    for (int i = 0; i < header.numParticles; i++)
+    {
+        positions[i] = glm::vec3(previous[0][i], previous[1][i], previous[2][i]) * header.quantum;
+    }
+    return true;
+}
+
+int ClothCacheReader::GetNumFrames()
+{
+    return header.numFrames;
+}
+
+int ClothCacheReader::GetNumParticles()
+{
+    return header.numParticles;
+}
+
+int ClothCacheReader::GetNumTriangles()
+{
+    return header.numTriangles;
+}
+
+float ClothCacheReader::GetFrameTime()
+{
+    return header.frameTime;
+}
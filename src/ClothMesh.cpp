@@ -0,0 +1,341 @@
+#include "ClothMesh.h"
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+ClothMesh::ClothMesh()
+{
+}
+
+bool ClothMesh::Load(const char* filename)
+{
+    std::string name = filename;
+    if (name.size() >= 4 && name.compare(name.size() - 4, 4, ".obj") == 0)
+    {
+        return LoadOBJ(filename);
+    }
+
+    return LoadSkin(filename);
+}
+
+bool ClothMesh::LoadSkin(const char* filename)
+{
+    printf("ClothMesh::LoadSkin - loading mesh from file: %s\n", filename);
+
+    Tokenizer token;
+    if (!token.Open(filename))
+    {
+        printf("ClothMesh::LoadSkin - failed to open %s\n", filename);
+        return false;
+    }
+
+    std::vector<glm::vec3> positions;
+    std::vector<glm::ivec3> triangles;
+
+    // only the positions and triangles blocks matter, skinning data is skipped
+    while (true)
+    {
+        char temp[256];
+        token.GetToken(temp);
+
+        if (temp[0] == '\0')
+        {
+            break;
+        }
+        else if (strcmp(temp, "positions") == 0)
+        {
+            int numPositions = token.GetInt();
+            token.FindToken("{");
+            positions.resize(numPositions);
+
+            for (int i = 0; i < numPositions; i++)
+            {
+                positions[i].x = token.GetFloat();
+                positions[i].y = token.GetFloat();
+                positions[i].z = token.GetFloat();
+            }
+            token.FindToken("}");
+        }
+        else if (strcmp(temp, "triangles") == 0)
+        {
+            int numTriangles = token.GetInt();
+            token.FindToken("{");
+            triangles.resize(numTriangles);
+
+            for (int i = 0; i < numTriangles; i++)
+            {
+                triangles[i].x = token.GetInt();
+                triangles[i].y = token.GetInt();
+                triangles[i].z = token.GetInt();
+            }
+            token.FindToken("}");
+
+            // bindings come after the triangles and aren't needed
+            break;
+        }
+        else
+        {
+            // skip the contents of any other block
+            token.FindToken("{");
+            token.FindToken("}");
+        }
+    }
+
+    token.Close();
+    return Build(positions, triangles);
+}
+
+bool ClothMesh::LoadOBJ(const char* filename)
+{
+    printf("ClothMesh::LoadOBJ - loading mesh from file: %s\n", filename);
+
+    FILE* file = fopen(filename, "r");
+    if (!file)
+    {
+        printf("ClothMesh::LoadOBJ - failed to open %s\n", filename);
+        return false;
+    }
+
+    std::vector<glm::vec3> positions;
+    std::vector<glm::ivec3> triangles;
+    std::vector<int> face;
+
+    char line[1024];
+    while (fgets(line, sizeof(line), file))
+    {
+        if (line[0] == 'v' && line[1] == ' ')
+        {
+            glm::vec3 position;
+            sscanf(line + 2, "%f %f %f", &position.x, &position.y, &position.z);
+            positions.push_back(position);
+        }
+        else if (line[0] == 'f' && line[1] == ' ')
+        {
+            // corners look like "v", "v/vt", "v//vn" or "v/vt/vn", only v is used
+            face.clear();
+            char* cursor = line + 2;
+            while (true)
+            {
+                char* end;
+                long index = strtol(cursor, &end, 10);
+                if (end == cursor)
+                {
+                    break;
+                }
+
+                // indices are 1-based, negative ones count back from the last vertex
+                face.push_back(index > 0 ? (int)index - 1 : (int)positions.size() + (int)index);
+
+                cursor = end;
+                while (*cursor != '\0' && !isspace(*cursor))
+                {
+                    cursor++;
+                }
+            }
+
+            // fan triangulate polygons
+            for (int i = 1; i + 1 < (int)face.size(); i++)
+            {
+                triangles.push_back(glm::ivec3(face[0], face[i], face[i + 1]));
+            }
+        }
+    }
+
+    fclose(file);
+    return Build(positions, triangles);
+}
+
+bool ClothMesh::Build(const std::vector<glm::vec3>& positions, const std::vector<glm::ivec3>& triangles)
+{
+    this->positions = positions;
+    this->triangles = triangles;
+
+    for (const glm::ivec3& triangle : triangles)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            if (triangle[k] < 0 || triangle[k] >= (int)positions.size())
+            {
+                printf("ClothMesh::Build - triangle index %d out of range\n", triangle[k]);
+                this->triangles.clear();
+                edges.clear();
+                bendingPairs.clear();
+                return false;
+            }
+        }
+    }
+
+    return BuildTopology();
+}
+
+bool ClothMesh::BuildTopology()
+{
+    int numVertices = positions.size();
+    int numHalfEdges = triangles.size() * 3;
+
+    // bucket half-edges by their lower vertex (counting sort, O(V + E))
+    std::vector<int> bucketStart(numVertices + 1, 0);
+    for (int h = 0; h < numHalfEdges; h++)
+    {
+        int a = triangles[h / 3][h % 3];
+        int b = triangles[h / 3][(h + 1) % 3];
+        bucketStart[glm::min(a, b) + 1]++;
+    }
+    for (int v = 0; v < numVertices; v++)
+    {
+        bucketStart[v + 1] += bucketStart[v];
+    }
+
+    std::vector<int> bucketFill(bucketStart.begin(), bucketStart.end() - 1);
+    std::vector<int> bucketed(numHalfEdges);
+    for (int h = 0; h < numHalfEdges; h++)
+    {
+        int a = triangles[h / 3][h % 3];
+        int b = triangles[h / 3][(h + 1) % 3];
+        bucketed[bucketFill[glm::min(a, b)]++] = h;
+    }
+
+    // match twins inside each bucket, buckets are about the vertex valence so this is cheap.
+    // non-manifold edges (more than two faces) pair up the first two, every further face's
+    // half-edge points at the first one without being pointed back at, so the edge still
+    // becomes one spring and isn't counted as boundary
+    twins.assign(numHalfEdges, -1);
+    for (int v = 0; v < numVertices; v++)
+    {
+        for (int i = bucketStart[v]; i < bucketStart[v + 1]; i++)
+        {
+            int h = bucketed[i];
+            if (twins[h] >= 0)
+            {
+                continue;
+            }
+
+            int from = triangles[h / 3][h % 3];
+            int to = triangles[h / 3][(h + 1) % 3];
+
+            // the bucket is in half-edge order, an earlier half-edge on the same two vertices
+            // means this edge already has its pair
+            int first = -1;
+            for (int j = bucketStart[v]; j < i && first < 0; j++)
+            {
+                int other = bucketed[j];
+                int otherFrom = triangles[other / 3][other % 3];
+                int otherTo = triangles[other / 3][(other + 1) % 3];
+                if ((otherFrom == to && otherTo == from) || (otherFrom == from && otherTo == to))
+                {
+                    first = other;
+                }
+            }
+            if (first >= 0)
+            {
+                twins[h] = first;
+                continue;
+            }
+
+            for (int j = i + 1; j < bucketStart[v + 1]; j++)
+            {
+                int other = bucketed[j];
+                // also accept the same direction, so badly wound faces still get connected
+                int otherFrom = triangles[other / 3][other % 3];
+                int otherTo = triangles[other / 3][(other + 1) % 3];
+                if (twins[other] < 0 && ((otherFrom == to && otherTo == from) || (otherFrom == from && otherTo == to)))
+                {
+                    twins[h] = other;
+                    twins[other] = h;
+                    break;
+                }
+            }
+        }
+    }
+
+    // one structural spring per edge, one bending spring across every interior edge
+    edges.clear();
+    bendingPairs.clear();
+    for (int h = 0; h < numHalfEdges; h++)
+    {
+        int twin = twins[h];
+        int from = triangles[h / 3][h % 3];
+        int to = triangles[h / 3][(h + 1) % 3];
+        if (from == to)
+        {
+            continue;
+        }
+
+        if (twin >= 0 && twin < h)
+        {
+            // an extra face on a non-manifold edge only bends against the first face
+            if (twins[twin] != h)
+            {
+                int opposite = triangles[h / 3][(h + 2) % 3];
+                int twinOpposite = triangles[twin / 3][(twin + 2) % 3];
+                if (opposite != twinOpposite)
+                {
+                    bendingPairs.push_back(glm::ivec2(opposite, twinOpposite));
+                }
+            }
+            continue;
+        }
+        edges.push_back(glm::ivec2(from, to));
+
+        if (twin >= 0)
+        {
+            int opposite = triangles[h / 3][(h + 2) % 3];
+            int twinOpposite = triangles[twin / 3][(twin + 2) % 3];
+            if (opposite != twinOpposite)
+            {
+                bendingPairs.push_back(glm::ivec2(opposite, twinOpposite));
+            }
+        }
+    }
+
+    printf("ClothMesh::BuildTopology - %d vertices, %d triangles, %d edges (%d boundary), %d bending pairs\n",
+        numVertices, (int)triangles.size(), (int)edges.size(), GetNumBoundaryEdges(), (int)bendingPairs.size());
+    return true;
+}
+
+std::vector<glm::vec3>& ClothMesh::GetPositions()
+{
+    return positions;
+}
+
+std::vector<glm::ivec3>& ClothMesh::GetTriangles()
+{
+    return triangles;
+}
+
+std::vector<glm::ivec2>& ClothMesh::GetEdges()
+{
+    return edges;
+}
+
+std::vector<glm::ivec2>& ClothMesh::GetBendingPairs()
+{
+    return bendingPairs;
+}
+
+int ClothMesh::GetNumBoundaryEdges()
+{
+    int count = 0;
+    for (int twin : twins)
+    {
+        count += twin < 0;
+    }
+    return count;
+}
+
+float ClothMesh::GetAverageEdgeLength()
+{
+    if (edges.empty())
+    {
+        return 0.0f;
+    }
+
+    double total = 0.0;
+    for (const glm::ivec2& edge : edges)
+    {
+        total += glm::length(positions[edge.x] - positions[edge.y]);
+    }
+    return (float)(total / edges.size());
+}
@@ -0,0 +1,348 @@
+#include "ClothObstacles.h"
+#include <cfloat>
+
+ClothObstacles::ClothObstacles()
+{
+    version = 0;
+}
+
+int ClothObstacles::AddPlane(glm::vec3 normal, float offset, float friction, float restitution)
+{
+    ClothObstacle plane;
+    plane.type = ClothObstacleType::Plane;
+    plane.p0 = glm::normalize(normal);
+    plane.p1 = glm::vec3(0.0f);
+    plane.radius = offset;
+    plane.rotation = glm::mat3(1.0f);
+    plane.friction = friction;
+    plane.restitution = restitution;
+
+    obstacles.push_back(plane);
+    boundsMin.push_back(glm::vec3(0.0f));
+    boundsMax.push_back(glm::vec3(0.0f));
+    SetObstacle(obstacles.size() - 1, plane);
+    return obstacles.size() - 1;
+}
+
+int ClothObstacles::AddSphere(glm::vec3 centre, float radius, float friction, float restitution)
+{
+    return AddCapsule(centre, centre, radius, friction, restitution);
+}
+
+int ClothObstacles::AddCapsule(glm::vec3 end0, glm::vec3 end1, float radius, float friction, float restitution)
+{
+    ClothObstacle capsule;
+    capsule.type = end0 == end1 ? ClothObstacleType::Sphere : ClothObstacleType::Capsule;
+    capsule.p0 = end0;
+    capsule.p1 = end1;
+    capsule.radius = radius;
+    capsule.rotation = glm::mat3(1.0f);
+    capsule.friction = friction;
+    capsule.restitution = restitution;
+
+    obstacles.push_back(capsule);
+    boundsMin.push_back(glm::vec3(0.0f));
+    boundsMax.push_back(glm::vec3(0.0f));
+    SetObstacle(obstacles.size() - 1, capsule);
+    return obstacles.size() - 1;
+}
+
+int ClothObstacles::AddBox(glm::vec3 centre, glm::vec3 halfExtents, glm::mat3 rotation, float friction, float restitution)
+{
+    ClothObstacle box;
+    box.type = ClothObstacleType::Box;
+    box.p0 = centre;
+    box.p1 = halfExtents;
+    box.radius = 0.0f;
+    box.rotation = rotation;
+    box.friction = friction;
+    box.restitution = restitution;
+
+    obstacles.push_back(box);
+    boundsMin.push_back(glm::vec3(0.0f));
+    boundsMax.push_back(glm::vec3(0.0f));
+    SetObstacle(obstacles.size() - 1, box);
+    return obstacles.size() - 1;
+}
+
+ClothObstacle ClothObstacles::GetObstacle(int obstacle)
+{
+    return obstacles[obstacle];
+}
+
+void ClothObstacles::SetObstacle(int obstacle, const ClothObstacle& shape)
+{
+    obstacles[obstacle] = shape;
+    UpdateBounds(obstacle);
+    version++;
+}
+
+void ClothObstacles::Remove(int obstacle)
+{
+    obstacles.erase(obstacles.begin() + obstacle);
+    boundsMin.erase(boundsMin.begin() + obstacle);
+    boundsMax.erase(boundsMax.begin() + obstacle);
+    version++;
+}
+
+void ClothObstacles::Clear()
+{
+    obstacles.clear();
+    boundsMin.clear();
+    boundsMax.clear();
+    version++;
+}
+
+int ClothObstacles::GetNumObstacles()
+{
+    return obstacles.size();
+}
+
+unsigned int ClothObstacles::GetVersion()
+{
+    return version;
+}
+
+void ClothObstacles::UpdateBounds(int obstacle)
+{
+    const ClothObstacle& shape = obstacles[obstacle];
+    switch (shape.type)
+    {
+    case ClothObstacleType::Plane:
+        // unbounded, Overlaps tests planes on their own
+        boundsMin[obstacle] = glm::vec3(-FLT_MAX);
+        boundsMax[obstacle] = glm::vec3(FLT_MAX);
+        break;
+    case ClothObstacleType::Sphere:
+    case ClothObstacleType::Capsule:
+        boundsMin[obstacle] = glm::min(shape.p0, shape.p1) - shape.radius;
+        boundsMax[obstacle] = glm::max(shape.p0, shape.p1) + shape.radius;
+        break;
+    case ClothObstacleType::Box:
+    {
+        // reach of the rotated box along each world axis
+        glm::vec3 extent(0.0f);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            extent += glm::abs(shape.rotation[axis]) * shape.p1[axis];
+        }
+        boundsMin[obstacle] = shape.p0 - extent;
+        boundsMax[obstacle] = shape.p0 + extent;
+        break;
+    }
+    }
+}
+
+bool ClothObstacles::Overlaps(int obstacle, glm::vec3 lower, glm::vec3 upper, float thickness)
+{
+    if (obstacles[obstacle].type == ClothObstacleType::Plane)
+    {
+        // the corner of the box furthest behind the plane
+        glm::vec3 normal = obstacles[obstacle].p0;
+        glm::vec3 corner(normal.x > 0.0f ? lower.x : upper.x, normal.y > 0.0f ? lower.y : upper.y, normal.z > 0.0f ? lower.z : upper.z);
+        return glm::dot(normal, corner) - obstacles[obstacle].radius < thickness;
+    }
+
+    return glm::all(glm::lessThanEqual(boundsMin[obstacle] - thickness, upper)) && glm::all(glm::lessThanEqual(lower, boundsMax[obstacle] + thickness));
+}
+
+void ClothObstacles::Collide(std::vector<Particle*>& particles, std::vector<char>& awake, float thickness)
+{
+    int numParticles = particles.size();
+    if (obstacles.empty() || numParticles == 0)
+    {
+        return;
+    }
+
+    // sized on the first pass, reused after that
+    positionX.resize(numParticles);
+    positionY.resize(numParticles);
+    positionZ.resize(numParticles);
+
+    int numChunks = (numParticles + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    chunkMin.resize(numChunks);
+    chunkMax.resize(numChunks);
+
+    ThreadPool* pool = ThreadPool::GetShared();
+
+    // gather the positions and the bounds of each chunk
+    pool->ParallelFor(numChunks, 1, [&](int begin, int end)
+    {
+        for (int c = begin; c < end; c++)
+        {
+            glm::vec3 lower(FLT_MAX);
+            glm::vec3 upper(-FLT_MAX);
+            int last = glm::min((c + 1) * CHUNK_SIZE, numParticles);
+            for (int i = c * CHUNK_SIZE; i < last; i++)
+            {
+                glm::vec3 position = particles[i]->GetPosition();
+                positionX[i] = position.x;
+                positionY[i] = position.y;
+                positionZ[i] = position.z;
+
+                lower = glm::min(lower, position);
+                upper = glm::max(upper, position);
+            }
+            chunkMin[c] = lower;
+            chunkMax[c] = upper;
+        }
+    });
+
+    // broadphase against the whole cloth
+    glm::vec3 lower(FLT_MAX);
+    glm::vec3 upper(-FLT_MAX);
+    for (int c = 0; c < numChunks; c++)
+    {
+        lower = glm::min(lower, chunkMin[c]);
+        upper = glm::max(upper, chunkMax[c]);
+    }
+
+    candidates.clear();
+    for (int o = 0; o < obstacles.size(); o++)
+    {
+        if (Overlaps(o, lower, upper, thickness))
+        {
+            candidates.push_back(o);
+        }
+    }
+    if (candidates.empty())
+    {
+        return;
+    }
+
+    // then per chunk, each chunk only ever writes its own particles
+    pool->ParallelFor(numChunks, 1, [&](int begin, int end)
+    {
+        for (int c = begin; c < end; c++)
+        {
+            int first = c * CHUNK_SIZE;
+            int last = glm::min(first + CHUNK_SIZE, numParticles);
+            for (int o : candidates)
+            {
+                if (Overlaps(o, chunkMin[c], chunkMax[c], thickness))
+                {
+                    CollideRange(particles, awake, obstacles[o], first, last, thickness);
+                }
+            }
+        }
+    });
+}
+
+void ClothObstacles::CollideRange(std::vector<Particle*>& particles, std::vector<char>& awake, const ClothObstacle& shape, int begin, int end, float thickness)
+{
+    float* __restrict px = positionX.data();
+    float* __restrict py = positionY.data();
+    float* __restrict pz = positionZ.data();
+    const char* __restrict canMove = awake.data();
+
+    float friction = shape.friction;
+    float restitution = shape.restitution;
+
+    // push particle i out along normal by depth, then take out the velocity into the surface
+    // (bouncing with restitution) and up to friction * that of the sliding velocity. the gathered
+    // position moves too, so the next obstacle sees where the particle is now. pinned particles stay
+    auto respond = [&](int i, glm::vec3 normal, float depth)
+    {
+        if (particles[i]->IsFixed())
+        {
+            return;
+        }
+
+        px[i] += normal.x * depth;
+        py[i] += normal.y * depth;
+        pz[i] += normal.z * depth;
+        particles[i]->SetPosition(glm::vec3(px[i], py[i], pz[i]));
+
+        glm::vec3 velocity = particles[i]->GetVelocity();
+        float normalVelocity = glm::dot(velocity, normal);
+        if (normalVelocity < 0.0f)
+        {
+            glm::vec3 tangentVelocity = velocity - normalVelocity * normal;
+            float tangentSpeed = glm::length(tangentVelocity);
+            float scale = tangentSpeed > 0.0f ? glm::max(0.0f, 1.0f + friction * normalVelocity / tangentSpeed) : 0.0f;
+            particles[i]->SetVelocity(tangentVelocity * scale - restitution * normalVelocity * normal);
+        }
+    };
+
+    switch (shape.type)
+    {
+    case ClothObstacleType::Plane:
+    {
+        glm::vec3 normal = shape.p0;
+        float offset = shape.radius + thickness;
+        for (int i = begin; i < end; i++)
+        {
+            float distance = normal.x * px[i] + normal.y * py[i] + normal.z * pz[i] - offset;
+            if (canMove[i] && distance < 0.0f)
+            {
+                respond(i, normal, -distance);
+            }
+        }
+        break;
+    }
+    case ClothObstacleType::Sphere:
+    case ClothObstacleType::Capsule:
+    {
+        // a sphere is a capsule with both ends in the same place
+        glm::vec3 axis = shape.p1 - shape.p0;
+        float axisLengthSquared = glm::dot(axis, axis);
+        float inverseAxisLengthSquared = axisLengthSquared > 0.0f ? 1.0f / axisLengthSquared : 0.0f;
+        float reach = shape.radius + thickness;
+        for (int i = begin; i < end; i++)
+        {
+            // offset from the closest point on the axis
+            glm::vec3 position(px[i], py[i], pz[i]);
+            float t = glm::clamp(glm::dot(position - shape.p0, axis) * inverseAxisLengthSquared, 0.0f, 1.0f);
+            glm::vec3 offset = position - (shape.p0 + axis * t);
+            float distanceSquared = glm::dot(offset, offset);
+            if (canMove[i] && distanceSquared < reach * reach)
+            {
+                float distance = sqrtf(distanceSquared);
+                glm::vec3 normal = distance > 0.0f ? offset / distance : glm::vec3(0.0f, 1.0f, 0.0f);
+                respond(i, normal, reach - distance);
+            }
+        }
+        break;
+    }
+    case ClothObstacleType::Box:
+    {
+        glm::mat3 toLocal = glm::transpose(shape.rotation);
+        glm::vec3 halfExtents = shape.p1;
+        for (int i = begin; i < end; i++)
+        {
+            if (!canMove[i])
+            {
+                continue;
+            }
+
+            glm::vec3 local = toLocal * (glm::vec3(px[i], py[i], pz[i]) - shape.p0);
+            glm::vec3 outside = glm::abs(local) - halfExtents;
+            float largest = glm::max(outside.x, glm::max(outside.y, outside.z));
+
+            glm::vec3 normal;
+            float distance;
+            if (largest > 0.0f)
+            {
+                // outside: away from the closest point on the surface
+                glm::vec3 beyond = glm::max(outside, glm::vec3(0.0f));
+                distance = glm::length(beyond);
+                if (distance >= thickness)
+                {
+                    continue;
+                }
+                normal = glm::sign(local) * beyond / distance;
+            }
+            else
+            {
+                // inside: out through the closest face
+                int face = outside.x == largest ? 0 : (outside.y == largest ? 1 : 2);
+                normal = glm::vec3(0.0f);
+                normal[face] = local[face] < 0.0f ? -1.0f : 1.0f;
+                distance = largest;
+            }
+            respond(i, shape.rotation * normal, thickness - distance);
+        }
+        break;
+    }
+    }
+}
@@ -0,0 +1,290 @@
+#include "ClothPatches.h"
+#include <algorithm>
+
+// particles per patch, about an 8x8 piece of a grid cloth
+static const int PATCH_SIZE = 64;
+
+ClothPatches::ClothPatches(std::vector<Particle*>& particles, std::vector<SpringDamper*>& springs, int maxParticles)
+{
+    int numParticles = particles.size();
+
+    // spring graph as adjacency lists
+    std::vector<int> adjacencyStart(numParticles + 1, 0);
+    for (SpringDamper* spring : springs)
+    {
+        adjacencyStart[spring->GetIndexP1() + 1]++;
+        adjacencyStart[spring->GetIndexP2() + 1]++;
+    }
+    for (int i = 0; i < numParticles; i++)
+    {
+        adjacencyStart[i + 1] += adjacencyStart[i];
+    }
+
+    std::vector<int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+    std::vector<int> adjacency(springs.size() * 2);
+    for (SpringDamper* spring : springs)
+    {
+        adjacency[fill[spring->GetIndexP1()]++] = spring->GetIndexP2();
+        adjacency[fill[spring->GetIndexP2()]++] = spring->GetIndexP1();
+    }
+
+    // grow patches breadth-first from the lowest unassigned particle
+    patchOfParticle.assign(numParticles, -1);
+    patchStart.push_back(0);
+    std::vector<int> queue;
+    for (int seed = 0; seed < numParticles; seed++)
+    {
+        if (patchOfParticle[seed] >= 0)
+        {
+            continue;
+        }
+
+        int patch = patchStart.size() - 1;
+        int size = 0;
+        queue.clear();
+        queue.push_back(seed);
+        patchOfParticle[seed] = patch;
+
+        for (int head = 0; head < queue.size() && size < PATCH_SIZE; head++)
+        {
+            int particle = queue[head];
+            patchParticles.push_back(particle);
+            size++;
+
+            for (int i = adjacencyStart[particle]; i < adjacencyStart[particle + 1]; i++)
+            {
+                int next = adjacency[i];
+                if (patchOfParticle[next] < 0)
+                {
+                    patchOfParticle[next] = patch;
+                    queue.push_back(next);
+                }
+            }
+        }
+
+        // whatever was queued but didn't fit goes back to be picked up by a later patch
+        for (int i = size; i < queue.size(); i++)
+        {
+            patchOfParticle[queue[i]] = -1;
+        }
+
+        patchStart.push_back(patchParticles.size());
+    }
+
+    int numPatches = patchStart.size() - 1;
+
+    // patch adjacency from the springs that cross patch borders
+    std::vector<std::vector<int>> patchNeighbours(numPatches);
+    for (SpringDamper* spring : springs)
+    {
+        int a = patchOfParticle[spring->GetIndexP1()];
+        int b = patchOfParticle[spring->GetIndexP2()];
+        if (a != b)
+        {
+            patchNeighbours[a].push_back(b);
+            patchNeighbours[b].push_back(a);
+        }
+    }
+
+    neighbourStart.push_back(0);
+    for (std::vector<int>& list : patchNeighbours)
+    {
+        std::sort(list.begin(), list.end());
+        list.erase(std::unique(list.begin(), list.end()), list.end());
+        neighbours.insert(neighbours.end(), list.begin(), list.end());
+        neighbourStart.push_back(neighbours.size());
+    }
+
+    awake.assign(numPatches, 1);
+    moving.assign(numPatches, 1);
+    restTime.assign(numPatches, 0.0f);
+    particleAwake.assign(numParticles, 1);
+    numAwakePatches = numPatches;
+
+    // room for the particles tearing adds, so AddParticle never reallocates
+    patchParticles.reserve(maxParticles);
+    patchOfParticle.reserve(maxParticles);
+    particleAwake.reserve(maxParticles);
+
+    sleepSpeed = 0.01f;
+    sleepDelay = 0.5f;
+}
+
+bool ClothPatches::Update(std::vector<Particle*>& particles, float dt, bool together)
+{
+    int numPatches = awake.size();
+    float sleepSpeedSquared = sleepSpeed * sleepSpeed;
+
+    // fastest particle of every awake patch
+    ThreadPool::GetShared()->ParallelFor(numPatches, 64, [&](int begin, int end)
+    {
+        for (int p = begin; p < end; p++)
+        {
+            if (!awake[p])
+            {
+                continue;
+            }
+
+            float maxSpeedSquared = 0.0f;
+            for (int i = patchStart[p]; i < patchStart[p + 1]; i++)
+            {
+                glm::vec3 velocity = particles[patchParticles[i]]->GetVelocity();
+                maxSpeedSquared = glm::max(maxSpeedSquared, glm::dot(velocity, velocity));
+            }
+
+            moving[p] = maxSpeedSquared > sleepSpeedSquared;
+            restTime[p] = moving[p] ? 0.0f : restTime[p] + dt;
+        }
+    });
+
+    bool changed = false;
+
+    // moving patches wake their sleeping neighbours
+    for (int p = 0; p < numPatches; p++)
+    {
+        if (!awake[p] || !moving[p])
+        {
+            continue;
+        }
+
+        for (int i = neighbourStart[p]; i < neighbourStart[p + 1]; i++)
+        {
+            if (!awake[neighbours[i]])
+            {
+                SetAwake(neighbours[i], true);
+                changed = true;
+            }
+        }
+    }
+
+    if (together)
+    {
+        for (int p = 0; p < numPatches; p++)
+        {
+            if (awake[p] && restTime[p] < sleepDelay)
+            {
+                return changed;
+            }
+        }
+    }
+
+    // resting patches with no moving neighbour go to sleep
+    for (int p = 0; p < numPatches; p++)
+    {
+        if (!awake[p] || restTime[p] < sleepDelay)
+        {
+            continue;
+        }
+
+        bool neighbourMoving = false;
+        for (int i = neighbourStart[p]; i < neighbourStart[p + 1]; i++)
+        {
+            int neighbour = neighbours[i];
+            neighbourMoving = neighbourMoving || (awake[neighbour] && moving[neighbour]);
+        }
+        if (neighbourMoving)
+        {
+            continue;
+        }
+
+        SetAwake(p, false);
+        for (int i = patchStart[p]; i < patchStart[p + 1]; i++)
+        {
+            Particle* particle = particles[patchParticles[i]];
+            particle->SetVelocity(glm::vec3(0.0f));
+            particle->SetForce(glm::vec3(0.0f));
+        }
+        changed = true;
+    }
+
+    return changed;
+}
+
+void ClothPatches::SetAwake(int patch, bool isAwake)
+{
+    if (awake[patch] == isAwake)
+    {
+        return;
+    }
+
+    awake[patch] = isAwake;
+    moving[patch] = false;
+    restTime[patch] = 0.0f;
+    numAwakePatches += isAwake ? 1 : -1;
+
+    for (int i = patchStart[patch]; i < patchStart[patch + 1]; i++)
+    {
+        particleAwake[patchParticles[i]] = isAwake;
+    }
+}
+
+void ClothPatches::AddParticle(int particle, int copyOf)
+{
+    // the copy joins its original's patch, the patches after it shift up by one
+    int patch = patchOfParticle[copyOf];
+    patchParticles.insert(patchParticles.begin() + patchStart[patch + 1], particle);
+    for (int p = patch + 1; p < (int)patchStart.size(); p++)
+    {
+        patchStart[p]++;
+    }
+    patchOfParticle.push_back(patch);
+    particleAwake.push_back(awake[patch]);
+}
+
+void ClothPatches::WakeAll()
+{
+    for (int p = 0; p < awake.size(); p++)
+    {
+        SetAwake(p, true);
+    }
+}
+
+void ClothPatches::WakePatchOf(int particle)
+{
+    SetAwake(patchOfParticle[particle], true);
+}
+
+bool ClothPatches::IsParticleAwake(int particle)
+{
+    return particleAwake[particle];
+}
+
+std::vector<char>& ClothPatches::GetParticleAwake()
+{
+    return particleAwake;
+}
+
+bool ClothPatches::IsAllAsleep()
+{
+    return numAwakePatches == 0;
+}
+
+int ClothPatches::GetNumPatches()
+{
+    return awake.size();
+}
+
+int ClothPatches::GetNumAwakePatches()
+{
+    return numAwakePatches;
+}
+
+float ClothPatches::GetSleepSpeed()
+{
+    return sleepSpeed;
+}
+
+void ClothPatches::SetSleepSpeed(float sleepSpeed)
+{
+    this->sleepSpeed = sleepSpeed;
+}
+
+float ClothPatches::GetSleepDelay()
+{
+    return sleepDelay;
+}
+
+void ClothPatches::SetSleepDelay(float sleepDelay)
+{
+    this->sleepDelay = sleepDelay;
+}
@@ -0,0 +1,281 @@
+#include "ClothRenderer.h"
+
+ClothRenderer::ClothRenderer(Cloth* cloth)
+{
+    this->cloth = cloth;
+    simulationThread = nullptr;
+
+    model = glm::mat4(1.0f);
+    color = glm::vec3(0.7f, 0.7f, 0.9f);
+    drawTriangles = true;
+    drawSprings = true;
+
+    SetupBuffers();
+}
+
+ClothRenderer::~ClothRenderer()
+{
+    // clean up OpenGL stuff
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO_positions);
+    glDeleteBuffers(1, &VBO_normals);
+    glDeleteBuffers(1, &EBO);
+    glDeleteVertexArrays(1, &springVAO);
+    glDeleteBuffers(1, &springEBO);
+}
+
+void ClothRenderer::Draw(glm::mat4 viewProjMtx, GLuint shader)
+{
+    // one upload of the particle state, both draws below index into it
+    if (simulationThread)
+    {
+        // the cloth belongs to the simulation thread, only its published frames may be read
+        if (simulationThread->AcquireFrame())
+        {
+            ClothFrame& frame = simulationThread->GetFrame();
+            Upload(frame.positions, frame.normals);
+            PatchTorn(frame.numTornSprings, frame.numTornTriangles, frame.numSplitCorners, frame.numSplitSpringEnds);
+        }
+    }
+    else if (uploadedVersion != cloth->GetVersion())
+    {
+        UpdateBuffers();
+        PatchTorn(cloth->GetNumTornSprings(), cloth->GetNumTornTriangles(), cloth->GetNumSplitCorners(), cloth->GetNumSplitSpringEnds());
+    }
+
+    glUseProgram(shader);
+
+    glUniformMatrix4fv(glGetUniformLocation(shader, "viewProj"), 1, false, (float*)&viewProjMtx);
+    glUniformMatrix4fv(glGetUniformLocation(shader, "model"), 1, GL_FALSE, (float*)&model);
+
+    // triangles
+    if (drawTriangles)
+    {
+        glUniform3fv(glGetUniformLocation(shader, "DiffuseColor"), 1, &color[0]);
+        glBindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, triangleIndices.size(), GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+    }
+
+    // springs
+    if (drawSprings)
+    {
+        glm::vec3 springColor = glm::vec3(0.0f, 0.5f, 1.0f);
+        glUniform3fv(glGetUniformLocation(shader, "DiffuseColor"), 1, &springColor[0]);
+
+        glLineWidth(1.5f);
+        glBindVertexArray(springVAO);
+        glDrawElements(GL_LINES, springIndices.size(), GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+    }
+
+    // reset line width
+    glLineWidth(1.0f);
+
+    // unbind shader
+    glUseProgram(0);
+}
+
+void ClothRenderer::SetupBuffers()
+{
+    std::vector<Particle*>& particles = cloth->GetParticles();
+
+    // for each particle, store position (normals come straight from the cloth). sized for the
+    // particles tears can split off so the buffer never has to grow
+    vertexPositions.assign(cloth->GetMaxParticles(), glm::vec3(0.0f));
+    for (int i = 0; i < particles.size(); i++)
+    {
+        vertexPositions[i] = particles[i]->GetPosition();
+    }
+
+    // for each triangle, store indices of particles
+    triangleIndices.clear();
+    for (ClothTriangle* triangle : cloth->GetTriangles())
+    {
+        triangleIndices.push_back(triangle->GetIndexP1());
+        triangleIndices.push_back(triangle->GetIndexP2());
+        triangleIndices.push_back(triangle->GetIndexP3());
+    }
+
+    // two indices per spring, the topology never changes so this is uploaded once
+    springIndices.clear();
+    for (SpringDamper* spring : cloth->GetSprings())
+    {
+        springIndices.push_back(spring->GetIndexP1());
+        springIndices.push_back(spring->GetIndexP2());
+    }
+
+    // generate VAO and VBOs for triangles
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO_positions);
+    glGenBuffers(1, &VBO_normals);
+    glGenBuffers(1, &EBO);
+
+    // bind VAO
+    glBindVertexArray(VAO);
+
+    // bind VBO_positions
+    glBindBuffer(GL_ARRAY_BUFFER, VBO_positions);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * vertexPositions.size(), vertexPositions.data(), GL_DYNAMIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
+
+    // bind VBO_normals
+    glBindBuffer(GL_ARRAY_BUFFER, VBO_normals);
+    std::vector<glm::vec3>& normals = cloth->GetVertexNormals();
+    glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * normals.size(), normals.data(), GL_DYNAMIC_DRAW);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
+
+    // bind EBO
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * triangleIndices.size(), triangleIndices.data(), GL_STATIC_DRAW);
+
+    // spring VAO shares the particle positions, only the index buffer is its own
+    glGenVertexArrays(1, &springVAO);
+    glGenBuffers(1, &springEBO);
+
+    glBindVertexArray(springVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO_positions);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, springEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * springIndices.size(), springIndices.data(), GL_STATIC_DRAW);
+
+    // unbind
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    uploadedVersion = cloth->GetVersion();
+
+    // the index buffers start out whole, anything torn before now gets patched on top
+    patchedTornSprings = 0;
+    patchedTornTriangles = 0;
+    patchedSplitCorners = 0;
+    patchedSplitSpringEnds = 0;
+    PatchTorn(cloth->GetNumTornSprings(), cloth->GetNumTornTriangles(), cloth->GetNumSplitCorners(), cloth->GetNumSplitSpringEnds());
+}
+
+void ClothRenderer::UpdateBuffers()
+{
+    std::vector<Particle*>& particles = cloth->GetParticles();
+
+    // update positions
+    for (int i = 0; i < particles.size(); i++)
+    {
+        vertexPositions[i] = particles[i]->GetPosition();
+    }
+
+    // normals come from the cloth's triangle pass, which already ran on these positions
+    Upload(vertexPositions, cloth->GetVertexNormals());
+
+    uploadedVersion = cloth->GetVersion();
+}
+
+void ClothRenderer::Upload(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, VBO_positions);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(glm::vec3) * positions.size(), positions.data());
+
+    glBindBuffer(GL_ARRAY_BUFFER, VBO_normals);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(glm::vec3) * normals.size(), normals.data());
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void ClothRenderer::PatchTorn(int numTornSprings, int numTornTriangles, int numSplitCorners, int numSplitSpringEnds)
+{
+    if (numTornSprings == patchedTornSprings && numTornTriangles == patchedTornTriangles && numSplitCorners == patchedSplitCorners && numSplitSpringEnds == patchedSplitSpringEnds)
+    {
+        return;
+    }
+
+    // corners and spring ends moved onto split off particles go first, a torn triangle or spring
+    // is collapsed onto whatever corner it had last
+    std::vector<glm::ivec2>& splitCorners = cloth->GetSplitCorners();
+    glBindVertexArray(VAO);
+    for (; patchedSplitCorners < numSplitCorners; patchedSplitCorners++)
+    {
+        glm::ivec2 split = splitCorners[patchedSplitCorners];
+        triangleIndices[split.x] = split.y;
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * split.x, sizeof(unsigned int), &triangleIndices[split.x]);
+    }
+
+    std::vector<glm::ivec2>& splitSpringEnds = cloth->GetSplitSpringEnds();
+    glBindVertexArray(springVAO);
+    for (; patchedSplitSpringEnds < numSplitSpringEnds; patchedSplitSpringEnds++)
+    {
+        glm::ivec2 split = splitSpringEnds[patchedSplitSpringEnds];
+        springIndices[split.x] = split.y;
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * split.x, sizeof(unsigned int), &springIndices[split.x]);
+    }
+
+    // a torn triangle becomes three copies of one index, which draws nothing
+    std::vector<int>& tornTriangles = cloth->GetTornTriangles();
+    glBindVertexArray(VAO);
+    for (; patchedTornTriangles < numTornTriangles; patchedTornTriangles++)
+    {
+        int t = tornTriangles[patchedTornTriangles];
+        unsigned int* indices = &triangleIndices[t * 3];
+        indices[1] = indices[0];
+        indices[2] = indices[0];
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * t * 3, sizeof(unsigned int) * 3, indices);
+    }
+
+    // and a torn spring a line from a point to itself
+    std::vector<int>& tornSprings = cloth->GetTornSprings();
+    glBindVertexArray(springVAO);
+    for (; patchedTornSprings < numTornSprings; patchedTornSprings++)
+    {
+        int s = tornSprings[patchedTornSprings];
+        unsigned int* indices = &springIndices[s * 2];
+        indices[1] = indices[0];
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * s * 2, sizeof(unsigned int) * 2, indices);
+    }
+
+    glBindVertexArray(0);
+}
+
+void ClothRenderer::SetSimulationThread(ClothSimulationThread* simulationThread)
+{
+    this->simulationThread = simulationThread;
+
+    // the cloth moved on the other thread since the last upload, get back in sync
+    if (simulationThread)
+    {
+        ClothFrame& frame = simulationThread->GetFrame();
+        Upload(frame.positions, frame.normals);
+        PatchTorn(frame.numTornSprings, frame.numTornTriangles, frame.numSplitCorners, frame.numSplitSpringEnds);
+    }
+    else
+    {
+        UpdateBuffers();
+        PatchTorn(cloth->GetNumTornSprings(), cloth->GetNumTornTriangles(), cloth->GetNumSplitCorners(), cloth->GetNumSplitSpringEnds());
+    }
+}
+
+Cloth* ClothRenderer::GetCloth()
+{
+    return cloth;
+}
+
+bool ClothRenderer::GetDrawTriangles()
+{
+    return drawTriangles;
+}
+
+void ClothRenderer::SetDrawTriangles(bool drawTriangles)
+{
+    this->drawTriangles = drawTriangles;
+}
+
+bool ClothRenderer::GetDrawSprings()
+{
+    return drawSprings;
+}
+
+void ClothRenderer::SetDrawSprings(bool drawSprings)
+{
+    this->drawSprings = drawSprings;
+}
@@ -0,0 +1,218 @@
+#include "ClothSimulationThread.h"
+#include <chrono>
+#include <cstdio>
+
+// set on middleFrame when it holds a frame the renderer hasn't seen
+static const int FRESH_FRAME = 4;
+
+// commands the ui can queue up between two simulation wake-ups
+static const int COMMAND_CAPACITY = 256;
+
+// most steps taken in one wake-up, any backlog beyond that is dropped rather than chased
+static const int MAX_STEPS_PER_WAKE = 8;
+
+ClothSimulationThread::ClothSimulationThread(Cloth* cloth, float timestep)
+{
+    this->cloth = cloth;
+    this->timestep = timestep;
+    queuedWind = glm::vec3(0.0f);
+    running = true;
+    paused = false;
+    stepRate = 0.0f;
+
+    // every frame starts out as the current state, so the renderer has something before the first publish
+    for (int i = 0; i < 3; i++)
+    {
+        Capture(frames[i]);
+    }
+    frontFrame = 0;
+    middleFrame = 1;
+    backFrame = 2;
+
+    commands.resize(COMMAND_CAPACITY);
+    commandHead = 0;
+    commandTail = 0;
+
+    thread = std::thread(&ClothSimulationThread::Run, this);
+}
+
+ClothSimulationThread::~ClothSimulationThread()
+{
+    running = false;
+    thread.join();
+
+    // inputs that were still queued shouldn't get lost
+    ProcessCommands();
+}
+
+void ClothSimulationThread::Run()
+{
+    typedef std::chrono::steady_clock Clock;
+
+    Clock::time_point nextStep = Clock::now();
+    Clock::time_point rateStart = nextStep;
+    int rateSteps = 0;
+
+    while (running)
+    {
+        int numCommands = ProcessCommands();
+
+        Clock::time_point now = Clock::now();
+        if (paused)
+        {
+            // a translation should still show up while paused
+            if (numCommands > 0)
+            {
+                Publish();
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            nextStep = Clock::now();
+            continue;
+        }
+
+        // take the steps that are due
+        Clock::duration stepDuration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(timestep));
+        int steps = 0;
+        while (nextStep <= now && steps < MAX_STEPS_PER_WAKE)
+        {
+            cloth->Simulate(timestep);
+            nextStep += stepDuration;
+            steps++;
+        }
+
+        // too slow to keep up, run behind real time instead of spiralling
+        if (steps == MAX_STEPS_PER_WAKE)
+        {
+            nextStep = Clock::now();
+        }
+
+        if (steps > 0)
+        {
+            Publish();
+        }
+
+        rateSteps += steps;
+        float rateSeconds = std::chrono::duration<float>(now - rateStart).count();
+        if (rateSeconds >= 0.5f)
+        {
+            stepRate = rateSteps / rateSeconds;
+            rateSteps = 0;
+            rateStart = now;
+        }
+
+        std::this_thread::sleep_until(nextStep);
+    }
+}
+
+int ClothSimulationThread::ProcessCommands()
+{
+    unsigned int head = commandHead.load(std::memory_order_relaxed);
+    unsigned int tail = commandTail.load(std::memory_order_acquire);
+
+    for (; head != tail; head++)
+    {
+        ClothCommand& command = commands[head % COMMAND_CAPACITY];
+        switch (command.type)
+        {
+            case ClothCommand::SetWind:
+                cloth->SetWind(command.value);
+                break;
+            case ClothCommand::Translate:
+                cloth->Translate(command.value);
+                break;
+            case ClothCommand::SetTimestep:
+                timestep = command.value.x;
+                break;
+        }
+    }
+
+    int numCommands = tail - commandHead.load(std::memory_order_relaxed);
+    commandHead.store(head, std::memory_order_release);
+    return numCommands;
+}
+
+void ClothSimulationThread::Capture(ClothFrame& frame)
+{
+    std::vector<Particle*>& particles = cloth->GetParticles();
+    std::vector<glm::vec3>& normals = cloth->GetVertexNormals();
+
+    frame.positions.resize(particles.size());
+    for (int i = 0; i < particles.size(); i++)
+    {
+        frame.positions[i] = particles[i]->GetPosition();
+    }
+    frame.normals = normals;
+    frame.version = cloth->GetVersion();
+    frame.numTornSprings = cloth->GetNumTornSprings();
+    frame.numTornTriangles = cloth->GetNumTornTriangles();
+    frame.numSplitCorners = cloth->GetNumSplitCorners();
+    frame.numSplitSpringEnds = cloth->GetNumSplitSpringEnds();
+}
+
+void ClothSimulationThread::Publish()
+{
+    Capture(frames[backFrame]);
+
+    // hand the filled frame over and take whichever one was waiting in the middle
+    backFrame = middleFrame.exchange(backFrame | FRESH_FRAME, std::memory_order_acq_rel) & ~FRESH_FRAME;
+}
+
+bool ClothSimulationThread::Push(ClothCommand::Type type, glm::vec3 value)
+{
+    unsigned int tail = commandTail.load(std::memory_order_relaxed);
+    if (tail - commandHead.load(std::memory_order_acquire) >= COMMAND_CAPACITY)
+    {
+        printf("ClothSimulationThread::Push - command queue full, dropping command\n");
+        return false;
+    }
+
+    commands[tail % COMMAND_CAPACITY].type = type;
+    commands[tail % COMMAND_CAPACITY].value = value;
+    commandTail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+void ClothSimulationThread::SetWind(glm::vec3 wind)
+{
+    // the ui sets the wind every frame, only queue actual changes
+    if (wind != queuedWind && Push(ClothCommand::SetWind, wind))
+    {
+        queuedWind = wind;
+    }
+}
+
+void ClothSimulationThread::Translate(glm::vec3 translation)
+{
+    Push(ClothCommand::Translate, translation);
+}
+
+void ClothSimulationThread::SetTimestep(float timestep)
+{
+    Push(ClothCommand::SetTimestep, glm::vec3(timestep, 0.0f, 0.0f));
+}
+
+void ClothSimulationThread::SetPaused(bool paused)
+{
+    this->paused = paused;
+}
+
+bool ClothSimulationThread::AcquireFrame()
+{
+    if (!(middleFrame.load(std::memory_order_relaxed) & FRESH_FRAME))
+    {
+        return false;
+    }
+
+    frontFrame = middleFrame.exchange(frontFrame, std::memory_order_acq_rel) & ~FRESH_FRAME;
+    return true;
+}
+
+ClothFrame& ClothSimulationThread::GetFrame()
+{
+    return frames[frontFrame];
+}
+
+float ClothSimulationThread::GetStepRate()
+{
+    return stepRate;
+}
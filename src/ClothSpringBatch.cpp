@@ -0,0 +1,392 @@
+#include "ClothSpringBatch.h"
+#include <algorithm>
+#include <cfloat>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+ClothSpringBatch::ClothSpringBatch(std::vector<SpringDamper*>& springs, int maxParticles)
+{
+    int numSprings = springs.size();
+
+    indexP1.resize(numSprings);
+    indexP2.resize(numSprings);
+    restLength.resize(numSprings);
+    springConstant.resize(numSprings);
+    dampingConstant.resize(numSprings);
+    for (int s = 0; s < numSprings; s++)
+    {
+        indexP1[s] = springs[s]->GetIndexP1();
+        indexP2[s] = springs[s]->GetIndexP2();
+        restLength[s] = springs[s]->GetRestLength();
+        springConstant[s] = springs[s]->GetSpringConstant();
+        dampingConstant[s] = springs[s]->GetDampingConstant();
+    }
+
+    broken.assign(numSprings, 0);
+    overstretched.assign(numSprings, 0);
+    numOverstretched = 0;
+    tearStretch = 0.0f;
+    numTombstones = 0;
+
+    // sized once for every spring, Pack only ever shrinks what is in use
+    activeP1.reserve(numSprings);
+    activeP2.reserve(numSprings);
+    activeRestLength.reserve(numSprings);
+    activeSpringConstant.reserve(numSprings);
+    activeDampingConstant.reserve(numSprings);
+    activeSpring.reserve(numSprings);
+    forceX.resize(numSprings);
+    forceY.resize(numSprings);
+    forceZ.resize(numSprings);
+    particleSprings.resize(numSprings * 2);
+    activeParticles.reserve(maxParticles);
+
+    positionX.resize(maxParticles);
+    positionY.resize(maxParticles);
+    positionZ.resize(maxParticles);
+    velocityX.resize(maxParticles);
+    velocityY.resize(maxParticles);
+    velocityZ.resize(maxParticles);
+
+    // everything starts out active, particles without springs never are
+    particleAwake.assign(maxParticles, 1);
+    Pack();
+}
+
+void ClothSpringBatch::Pack()
+{
+    int numSprings = indexP1.size();
+    int numParticles = particleAwake.size();
+
+    activeP1.clear();
+    activeP2.clear();
+    activeRestLength.clear();
+    activeSpringConstant.clear();
+    activeDampingConstant.clear();
+    activeSpring.clear();
+    for (int s = 0; s < numSprings; s++)
+    {
+        if (!broken[s] && (particleAwake[indexP1[s]] || particleAwake[indexP2[s]]))
+        {
+            activeP1.push_back(indexP1[s]);
+            activeP2.push_back(indexP2[s]);
+            activeRestLength.push_back(restLength[s]);
+            activeSpringConstant.push_back(springConstant[s]);
+            activeDampingConstant.push_back(dampingConstant[s]);
+            activeSpring.push_back(s);
+        }
+    }
+
+    int numActive = activeP1.size();
+    numTombstones = 0;
+
+    // particle -> spring table by counting sort, in spring order so the sums are always the same
+    particleSpringStart.assign(numParticles + 1, 0);
+    for (int s = 0; s < numActive; s++)
+    {
+        particleSpringStart[activeP1[s] + 1]++;
+        particleSpringStart[activeP2[s] + 1]++;
+    }
+    for (int p = 0; p < numParticles; p++)
+    {
+        particleSpringStart[p + 1] += particleSpringStart[p];
+    }
+
+    fill.assign(particleSpringStart.begin(), particleSpringStart.end() - 1);
+    for (int s = 0; s < numActive; s++)
+    {
+        particleSprings[fill[activeP1[s]]++] = s + 1;
+        particleSprings[fill[activeP2[s]]++] = -(s + 1);
+    }
+
+    activeParticles.clear();
+    for (int p = 0; p < numParticles; p++)
+    {
+        if (particleSpringStart[p + 1] > particleSpringStart[p])
+        {
+            activeParticles.push_back(p);
+        }
+    }
+}
+
+#if defined(__AVX2__)
+// forces of 8 springs, both ends gathered through the index arrays. returns a mask of the springs
+// longer than limit times their rest length
+static int ComputeSprings8(const int* i1, const int* i2, const float* l0, const float* ks, const float* kd,
+    const float* px, const float* py, const float* pz, const float* vx, const float* vy, const float* vz,
+    float* fx, float* fy, float* fz, __m256 limit)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+
+    __m256i a = _mm256_loadu_si256((const __m256i*)i1);
+    __m256i b = _mm256_loadu_si256((const __m256i*)i2);
+
+    // current length (l) and unit vector (e)
+    __m256 dx = _mm256_sub_ps(_mm256_i32gather_ps(px, b, 4), _mm256_i32gather_ps(px, a, 4));
+    __m256 dy = _mm256_sub_ps(_mm256_i32gather_ps(py, b, 4), _mm256_i32gather_ps(py, a, 4));
+    __m256 dz = _mm256_sub_ps(_mm256_i32gather_ps(pz, b, 4), _mm256_i32gather_ps(pz, a, 4));
+    __m256 lengthSquared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+    __m256 length = _mm256_sqrt_ps(lengthSquared);
+    // zero for collapsed springs instead of a division by zero
+    __m256 inverseLength = _mm256_and_ps(_mm256_div_ps(one, length), _mm256_cmp_ps(length, zero, _CMP_GT_OQ));
+    __m256 ex = _mm256_mul_ps(dx, inverseLength);
+    __m256 ey = _mm256_mul_ps(dy, inverseLength);
+    __m256 ez = _mm256_mul_ps(dz, inverseLength);
+
+    // closing velocity (vclose)
+    __m256 wx = _mm256_sub_ps(_mm256_i32gather_ps(vx, a, 4), _mm256_i32gather_ps(vx, b, 4));
+    __m256 wy = _mm256_sub_ps(_mm256_i32gather_ps(vy, a, 4), _mm256_i32gather_ps(vy, b, 4));
+    __m256 wz = _mm256_sub_ps(_mm256_i32gather_ps(vz, a, 4), _mm256_i32gather_ps(vz, b, 4));
+    __m256 closingVelocity = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(wx, ex), _mm256_mul_ps(wy, ey)), _mm256_mul_ps(wz, ez));
+
+    // -ks * (l0 - l) - kd * vclose
+    __m256 rest = _mm256_loadu_ps(l0);
+    __m256 springForce = _mm256_mul_ps(_mm256_loadu_ps(ks), _mm256_sub_ps(length, rest));
+    __m256 dampingForce = _mm256_mul_ps(_mm256_loadu_ps(kd), closingVelocity);
+    __m256 force = _mm256_sub_ps(springForce, dampingForce);
+
+    _mm256_storeu_ps(fx, _mm256_mul_ps(force, ex));
+    _mm256_storeu_ps(fy, _mm256_mul_ps(force, ey));
+    _mm256_storeu_ps(fz, _mm256_mul_ps(force, ez));
+
+    return _mm256_movemask_ps(_mm256_cmp_ps(length, _mm256_mul_ps(rest, limit), _CMP_GT_OQ));
+}
+#endif
+
+int ClothSpringBatch::ComputeSprings(int begin, int end)
+{
+    const int* __restrict i1 = activeP1.data();
+    const int* __restrict i2 = activeP2.data();
+    const float* __restrict l0 = activeRestLength.data();
+    const float* __restrict ks = activeSpringConstant.data();
+    const float* __restrict kd = activeDampingConstant.data();
+    const float* __restrict px = positionX.data();
+    const float* __restrict py = positionY.data();
+    const float* __restrict pz = positionZ.data();
+    const float* __restrict vx = velocityX.data();
+    const float* __restrict vy = velocityY.data();
+    const float* __restrict vz = velocityZ.data();
+    float* __restrict fx = forceX.data();
+    float* __restrict fy = forceY.data();
+    float* __restrict fz = forceZ.data();
+    char* __restrict over = overstretched.data();
+
+    // past this length / rest length a spring tears
+    float tearLimit = tearStretch > 0.0f ? tearStretch : FLT_MAX;
+    int numOver = 0;
+
+    int s = begin;
+
+#if defined(__AVX2__)
+    // 8 springs at a time
+    const __m256 limit = _mm256_set1_ps(tearLimit);
+    for (; s + 8 <= end; s += 8)
+    {
+        // tearing is rare, only look at single lanes when one of them went too far
+        int tearing = ComputeSprings8(i1 + s, i2 + s, l0 + s, ks + s, kd + s, px, py, pz, vx, vy, vz, fx + s, fy + s, fz + s, limit);
+        if (tearing)
+        {
+            for (int lane = 0; lane < 8; lane++)
+            {
+                if (tearing & (1 << lane))
+                {
+                    over[s + lane] = 1;
+                    numOver++;
+                }
+            }
+        }
+    }
+
+    // the tail goes through the same kernel, padded with copies of its last spring. the scalar
+    // loop rounds differently (fused multiply-adds), and which springs end up in the tail
+    // depends on how many springs there are, so a ClothWorld and separate cloths would drift
+    if (s < end)
+    {
+        int tailP1[8], tailP2[8];
+        float tailRest[8], tailKs[8], tailKd[8], tailX[8], tailY[8], tailZ[8];
+        for (int lane = 0; lane < 8; lane++)
+        {
+            int k = std::min(s + lane, end - 1);
+            tailP1[lane] = i1[k];
+            tailP2[lane] = i2[k];
+            tailRest[lane] = l0[k];
+            tailKs[lane] = ks[k];
+            tailKd[lane] = kd[k];
+        }
+
+        int tearing = ComputeSprings8(tailP1, tailP2, tailRest, tailKs, tailKd, px, py, pz, vx, vy, vz, tailX, tailY, tailZ, limit);
+        for (int lane = 0; s + lane < end; lane++)
+        {
+            fx[s + lane] = tailX[lane];
+            fy[s + lane] = tailY[lane];
+            fz[s + lane] = tailZ[lane];
+            if (tearing & (1 << lane))
+            {
+                over[s + lane] = 1;
+                numOver++;
+            }
+        }
+        s = end;
+    }
+#endif
+
+    // the same per spring, without AVX2
+    for (; s < end; s++)
+    {
+        int a = i1[s];
+        int b = i2[s];
+
+        float dx = px[b] - px[a];
+        float dy = py[b] - py[a];
+        float dz = pz[b] - pz[a];
+        float length = sqrtf(dx * dx + dy * dy + dz * dz);
+        float inverseLength = length > 0.0f ? 1.0f / length : 0.0f;
+        float ex = dx * inverseLength;
+        float ey = dy * inverseLength;
+        float ez = dz * inverseLength;
+
+        float closingVelocity = (vx[a] - vx[b]) * ex + (vy[a] - vy[b]) * ey + (vz[a] - vz[b]) * ez;
+
+        float force = ks[s] * (length - l0[s]) - kd[s] * closingVelocity;
+
+        fx[s] = force * ex;
+        fy[s] = force * ey;
+        fz[s] = force * ez;
+
+        // a plain store, no branch. flags are cleared by BreakOverstretched right after the pass
+        int tearing = length > l0[s] * tearLimit;
+        over[s] = tearing;
+        numOver += tearing;
+    }
+
+    return numOver;
+}
+
+void ClothSpringBatch::ApplyForces(std::vector<Particle*>& particles)
+{
+    ThreadPool* pool = ThreadPool::GetShared();
+    int numParticles = activeParticles.size();
+
+    // gather
+    pool->ParallelFor(numParticles, 2048, [&](int begin, int end)
+    {
+        for (int k = begin; k < end; k++)
+        {
+            int i = activeParticles[k];
+            glm::vec3 position = particles[i]->GetPosition();
+            glm::vec3 velocity = particles[i]->GetVelocity();
+            positionX[i] = position.x;
+            positionY[i] = position.y;
+            positionZ[i] = position.z;
+            velocityX[i] = velocity.x;
+            velocityY[i] = velocity.y;
+            velocityZ[i] = velocity.z;
+        }
+    });
+
+    // chunks are a multiple of 8 so only the last one has a scalar tail
+    numOverstretched = 0;
+    pool->ParallelFor(activeP1.size(), 2048, [&](int begin, int end)
+    {
+        int numOver = ComputeSprings(begin, end);
+        if (numOver > 0)
+        {
+            numOverstretched += numOver;
+        }
+    });
+
+    // f1 = f, f2 = -f, each particle is owned by exactly one thread
+    pool->ParallelFor(numParticles, 1024, [&](int begin, int end)
+    {
+        for (int k = begin; k < end; k++)
+        {
+            int p = activeParticles[k];
+            glm::vec3 force(0.0f);
+            for (int i = particleSpringStart[p]; i < particleSpringStart[p + 1]; i++)
+            {
+                int slot = particleSprings[i];
+                if (slot > 0)
+                {
+                    force += glm::vec3(forceX[slot - 1], forceY[slot - 1], forceZ[slot - 1]);
+                }
+                else
+                {
+                    force -= glm::vec3(forceX[-slot - 1], forceY[-slot - 1], forceZ[-slot - 1]);
+                }
+            }
+            particles[p]->ApplyForce(force);
+        }
+    });
+}
+
+void ClothSpringBatch::SetActive(std::vector<char>& particleAwake)
+{
+    this->particleAwake = particleAwake;
+    Pack();
+}
+
+void ClothSpringBatch::SetSpringConstants(std::vector<SpringDamper*>& springs)
+{
+    for (int s = 0; s < springs.size(); s++)
+    {
+        springConstant[s] = springs[s]->GetSpringConstant();
+    }
+    Pack();
+}
+
+float ClothSpringBatch::GetTearStretch()
+{
+    return tearStretch;
+}
+
+void ClothSpringBatch::SetTearStretch(float tearStretch)
+{
+    this->tearStretch = tearStretch;
+}
+
+int ClothSpringBatch::GetNumOverstretched()
+{
+    return numOverstretched;
+}
+
+void ClothSpringBatch::BreakOverstretched(std::vector<int>& brokenSprings, int& numBroken)
+{
+    if (numOverstretched == 0)
+    {
+        return;
+    }
+
+    int numActive = activeP1.size();
+    for (int s = 0; s < numActive; s++)
+    {
+        if (!overstretched[s])
+        {
+            continue;
+        }
+        overstretched[s] = 0;
+
+        // tombstone: no force, and an infinite rest length never counts as stretched again
+        activeSpringConstant[s] = 0.0f;
+        activeDampingConstant[s] = 0.0f;
+        activeRestLength[s] = FLT_MAX;
+        broken[activeSpring[s]] = 1;
+        brokenSprings[numBroken++] = activeSpring[s];
+        numTombstones++;
+    }
+    numOverstretched = 0;
+
+    // compact once an eighth of the pass is dead weight
+    if (numTombstones * 8 > numActive)
+    {
+        Pack();
+    }
+}
+
+void ClothSpringBatch::SetEnds(int spring, int indexP1, int indexP2)
+{
+    this->indexP1[spring] = indexP1;
+    this->indexP2[spring] = indexP2;
+}
@@ -73,6 +73,25 @@ int ClothTriangle::GetIndexP3()
     return indexP3;
 }
 
+void ClothTriangle::SetCorner(int corner, Particle* particle, int index)
+{
+    if (corner == 0)
+    {
+        p1 = particle;
+        indexP1 = index;
+    }
+    else if (corner == 1)
+    {
+        p2 = particle;
+        indexP2 = index;
+    }
+    else
+    {
+        p3 = particle;
+        indexP3 = index;
+    }
+}
+
 glm::vec3 ClothTriangle::ComputeNormal()
 {
     glm::vec3 position1 = p1->GetPosition();
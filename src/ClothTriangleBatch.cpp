@@ -0,0 +1,333 @@
+#include "ClothTriangleBatch.h"
+#include <algorithm>
+
+ClothTriangleBatch::ClothTriangleBatch(std::vector<ClothTriangle*>& triangles, int maxParticles)
+{
+    int numTriangles = triangles.size();
+
+    indexP1.resize(numTriangles);
+    indexP2.resize(numTriangles);
+    indexP3.resize(numTriangles);
+    for (int t = 0; t < numTriangles; t++)
+    {
+        indexP1[t] = triangles[t]->GetIndexP1();
+        indexP2[t] = triangles[t]->GetIndexP2();
+        indexP3[t] = triangles[t]->GetIndexP3();
+    }
+
+    positionX.resize(maxParticles);
+    positionY.resize(maxParticles);
+    positionZ.resize(maxParticles);
+    velocityX.resize(maxParticles);
+    velocityY.resize(maxParticles);
+    velocityZ.resize(maxParticles);
+
+    forceX.resize(numTriangles);
+    forceY.resize(numTriangles);
+    forceZ.resize(numTriangles);
+    normalX.resize(numTriangles);
+    normalY.resize(numTriangles);
+    normalZ.resize(numTriangles);
+
+    centroidX.resize(numTriangles);
+    centroidY.resize(numTriangles);
+    centroidZ.resize(numTriangles);
+    airX.resize(numTriangles);
+    airY.resize(numTriangles);
+    airZ.resize(numTriangles);
+
+    vertexTriangleStart.resize(maxParticles + 1);
+    vertexFill.resize(maxParticles);
+    vertexTriangles.resize(numTriangles * 3);
+    BuildVertexTable();
+
+    // everything starts out active, particles without triangles never are
+    alive.assign(numTriangles, 1.0f);
+    numTombstones = 0;
+    particleAwake.assign(maxParticles, 1);
+    touched.resize(maxParticles);
+    activeTriangles.reserve(numTriangles);
+    activeVertices.reserve(maxParticles);
+    Pack();
+
+    vertexForces.assign(maxParticles, glm::vec3(0.0f));
+    vertexNormals.assign(maxParticles, glm::vec3(0.0f, 1.0f, 0.0f));
+
+    dragCoefficient = 1.28f;
+    fluidDensity = 1.225f;
+}
+
+void ClothTriangleBatch::BuildVertexTable()
+{
+    int numTriangles = indexP1.size();
+    int numVertices = vertexFill.size();
+
+    // vertex -> triangle table by counting sort
+    std::fill(vertexTriangleStart.begin(), vertexTriangleStart.end(), 0);
+    for (int t = 0; t < numTriangles; t++)
+    {
+        vertexTriangleStart[indexP1[t] + 1]++;
+        vertexTriangleStart[indexP2[t] + 1]++;
+        vertexTriangleStart[indexP3[t] + 1]++;
+    }
+    for (int v = 0; v < numVertices; v++)
+    {
+        vertexTriangleStart[v + 1] += vertexTriangleStart[v];
+    }
+
+    std::copy(vertexTriangleStart.begin(), vertexTriangleStart.end() - 1, vertexFill.begin());
+    for (int t = 0; t < numTriangles; t++)
+    {
+        vertexTriangles[vertexFill[indexP1[t]]++] = t;
+        vertexTriangles[vertexFill[indexP2[t]]++] = t;
+        vertexTriangles[vertexFill[indexP3[t]]++] = t;
+    }
+}
+
+void ClothTriangleBatch::Compute(std::vector<Particle*>& particles, glm::vec3 wind, WindField* windField)
+{
+    ThreadPool* pool = ThreadPool::GetShared();
+    int numVertices = activeVertices.size();
+    int numTriangles = activeTriangles.size();
+
+    // gather
+    pool->ParallelFor(numVertices, 2048, [&](int begin, int end)
+    {
+        for (int k = begin; k < end; k++)
+        {
+            int i = activeVertices[k];
+            glm::vec3 position = particles[i]->GetPosition();
+            glm::vec3 velocity = particles[i]->GetVelocity();
+            positionX[i] = position.x;
+            positionY[i] = position.y;
+            positionZ[i] = position.z;
+            velocityX[i] = velocity.x;
+            velocityY[i] = velocity.y;
+            velocityZ[i] = velocity.z;
+        }
+    });
+
+    // with c = (p2 - p1) x (p3 - p1), area * n = c / 2 and |v|^2 * cos(theta) = |v| * (v . c) / |c|, so
+    // aerodynamicForce = (-1/2) * rho * |v|^2 * cd * a * n = (-1/4) * rho * cd * |v| * max(v . c, 0) / |c| * c
+    // needs no normalize of the velocity. a third of it goes to each corner
+    float dragScale = -0.25f * fluidDensity * dragCoefficient / 3.0f;
+
+    pool->ParallelFor(numTriangles, 1024, [&](int begin, int end)
+    {
+        const int* __restrict active = activeTriangles.data();
+        const int* __restrict i1 = indexP1.data();
+        const int* __restrict i2 = indexP2.data();
+        const int* __restrict i3 = indexP3.data();
+        const float* __restrict px = positionX.data();
+        const float* __restrict py = positionY.data();
+        const float* __restrict pz = positionZ.data();
+        const float* __restrict vx = velocityX.data();
+        const float* __restrict vy = velocityY.data();
+        const float* __restrict vz = velocityZ.data();
+        float* __restrict fx = forceX.data();
+        float* __restrict fy = forceY.data();
+        float* __restrict fz = forceZ.data();
+        float* __restrict nx = normalX.data();
+        float* __restrict ny = normalY.data();
+        float* __restrict nz = normalZ.data();
+        const float* __restrict live = alive.data();
+
+        // the field's wind at every centroid of the chunk in one call
+        const float* __restrict ax = nullptr;
+        const float* __restrict ay = nullptr;
+        const float* __restrict az = nullptr;
+        if (windField)
+        {
+            for (int k = begin; k < end; k++)
+            {
+                int t = active[k];
+                centroidX[k] = (px[i1[t]] + px[i2[t]] + px[i3[t]]) * (1.0f / 3.0f);
+                centroidY[k] = (py[i1[t]] + py[i2[t]] + py[i3[t]]) * (1.0f / 3.0f);
+                centroidZ[k] = (pz[i1[t]] + pz[i2[t]] + pz[i3[t]]) * (1.0f / 3.0f);
+            }
+            windField->Sample(&centroidX[begin], &centroidY[begin], &centroidZ[begin], end - begin, &airX[begin], &airY[begin], &airZ[begin]);
+            ax = airX.data();
+            ay = airY.data();
+            az = airZ.data();
+        }
+
+        for (int k = begin; k < end; k++)
+        {
+            int t = active[k];
+            int a = i1[t];
+            int b = i2[t];
+            int c = i3[t];
+
+            // edges from the first corner
+            float e1x = px[b] - px[a];
+            float e1y = py[b] - py[a];
+            float e1z = pz[b] - pz[a];
+            float e2x = px[c] - px[a];
+            float e2y = py[c] - py[a];
+            float e2z = pz[c] - pz[a];
+
+            // the one cross product
+            float cx = e1y * e2z - e1z * e2y;
+            float cy = e1z * e2x - e1x * e2z;
+            float cz = e1x * e2y - e1y * e2x;
+            float lengthSquared = cx * cx + cy * cy + cz * cz;
+            // torn triangles come out as zero drag and a zero normal
+            float inverseLength = lengthSquared > 0.0f ? live[t] / sqrtf(lengthSquared) : 0.0f;
+
+            // average surface velocity relative to the air
+            float wx = (vx[a] + vx[b] + vx[c]) * (1.0f / 3.0f) - wind.x;
+            float wy = (vy[a] + vy[b] + vy[c]) * (1.0f / 3.0f) - wind.y;
+            float wz = (vz[a] + vz[b] + vz[c]) * (1.0f / 3.0f) - wind.z;
+            if (ax)
+            {
+                wx -= ax[k];
+                wy -= ay[k];
+                wz -= az[k];
+            }
+            float speed = sqrtf(wx * wx + wy * wy + wz * wz);
+
+            // only the side facing into the flow catches air
+            float facing = glm::max(wx * cx + wy * cy + wz * cz, 0.0f);
+            float scale = dragScale * speed * facing * inverseLength;
+
+            fx[t] = scale * cx;
+            fy[t] = scale * cy;
+            fz[t] = scale * cz;
+            nx[t] = cx * inverseLength;
+            ny[t] = cy * inverseLength;
+            nz[t] = cz * inverseLength;
+        }
+    });
+
+    // sum per vertex, each vertex is owned by exactly one thread
+    pool->ParallelFor(numVertices, 1024, [&](int begin, int end)
+    {
+        for (int k = begin; k < end; k++)
+        {
+            int v = activeVertices[k];
+            glm::vec3 force(0.0f);
+            glm::vec3 normal(0.0f);
+            for (int i = vertexTriangleStart[v]; i < vertexTriangleStart[v + 1]; i++)
+            {
+                int t = vertexTriangles[i];
+                force += glm::vec3(forceX[t], forceY[t], forceZ[t]);
+                normal += glm::vec3(normalX[t], normalY[t], normalZ[t]);
+            }
+
+            // crumpled cloth can cancel a normal out completely
+            float length = glm::length(normal);
+            vertexForces[v] = force;
+            vertexNormals[v] = length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+        }
+    });
+}
+
+void ClothTriangleBatch::SetActive(std::vector<char>& particleAwake)
+{
+    this->particleAwake = particleAwake;
+    Pack();
+}
+
+void ClothTriangleBatch::Pack()
+{
+    int numTriangles = indexP1.size();
+    int numParticles = particleAwake.size();
+
+    activeTriangles.clear();
+    for (int t = 0; t < numTriangles; t++)
+    {
+        if (alive[t] > 0.0f && (particleAwake[indexP1[t]] || particleAwake[indexP2[t]] || particleAwake[indexP3[t]]))
+        {
+            activeTriangles.push_back(t);
+        }
+    }
+    numTombstones = 0;
+
+    // every corner of an active triangle, the per-vertex sums read all triangles around them
+    std::fill(touched.begin(), touched.end(), 0);
+    for (int t : activeTriangles)
+    {
+        touched[indexP1[t]] = 1;
+        touched[indexP2[t]] = 1;
+        touched[indexP3[t]] = 1;
+    }
+
+    activeVertices.clear();
+    for (int v = 0; v < numParticles; v++)
+    {
+        if (touched[v])
+        {
+            activeVertices.push_back(v);
+        }
+    }
+}
+
+void ClothTriangleBatch::RemoveTriangle(int triangle)
+{
+    if (alive[triangle] == 0.0f)
+    {
+        return;
+    }
+
+    // a tombstone until the next compaction. its corners are still active, so the next
+    // Compute drops it from their sums
+    alive[triangle] = 0.0f;
+    forceX[triangle] = forceY[triangle] = forceZ[triangle] = 0.0f;
+    normalX[triangle] = normalY[triangle] = normalZ[triangle] = 0.0f;
+    numTombstones++;
+
+    // a corner left with no triangle at all drops out of Compute, so clear what it had
+    int corners[3] = { indexP1[triangle], indexP2[triangle], indexP3[triangle] };
+    for (int v : corners)
+    {
+        bool attached = false;
+        for (int i = vertexTriangleStart[v]; i < vertexTriangleStart[v + 1]; i++)
+        {
+            attached = attached || alive[vertexTriangles[i]] > 0.0f;
+        }
+        if (!attached)
+        {
+            vertexForces[v] = glm::vec3(0.0f);
+            vertexNormals[v] = glm::vec3(0.0f, 1.0f, 0.0f);
+        }
+    }
+
+    if (numTombstones * 8 > (int)activeTriangles.size())
+    {
+        Pack();
+    }
+}
+
+void ClothTriangleBatch::SplitVertex(int vertex, int copy, const int* triangles, int numTriangles)
+{
+    for (int i = 0; i < numTriangles; i++)
+    {
+        int t = triangles[i];
+        indexP1[t] = indexP1[t] == vertex ? copy : indexP1[t];
+        indexP2[t] = indexP2[t] == vertex ? copy : indexP2[t];
+        indexP3[t] = indexP3[t] == vertex ? copy : indexP3[t];
+    }
+
+    // the table keeps its size, only which vertex each entry sits under changes
+    BuildVertexTable();
+
+    // the copy shows the same shading until the next Compute
+    vertexForces[copy] = glm::vec3(0.0f);
+    vertexNormals[copy] = vertexNormals[vertex];
+}
+
+void ClothTriangleBatch::ApplyForces(std::vector<Particle*>& particles)
+{
+    ThreadPool::GetShared()->ParallelFor(particles.size(), 2048, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            particles[i]->ApplyForce(vertexForces[i]);
+        }
+    });
+}
+
+std::vector<glm::vec3>& ClothTriangleBatch::GetVertexNormals()
+{
+    return vertexNormals;
+}
@@ -0,0 +1,105 @@
+#include "ClothWorld.h"
+
+ClothWorld::ClothWorld()
+{
+    std::vector<Cloth*> none;
+    cloth = new Cloth(none);
+}
+
+ClothWorld::~ClothWorld()
+{
+    delete cloth;
+}
+
+int ClothWorld::Add(Cloth* instance, glm::vec3 offset)
+{
+    std::vector<Cloth*> added(1, instance);
+    std::vector<glm::vec3> offsets(1, offset);
+    return Add(added, offsets);
+}
+
+int ClothWorld::Add(std::vector<Cloth*>& added, std::vector<glm::vec3>& offsets)
+{
+    int first = instances.size();
+
+    // the current world goes first so the existing instances keep their offsets
+    std::vector<Cloth*> cloths;
+    cloths.push_back(cloth);
+
+    ClothInstance next;
+    next.particleOffset = cloth->GetParticles().size();
+    next.springOffset = cloth->GetSprings().size();
+    next.triangleOffset = cloth->GetTriangles().size();
+
+    for (int i = 0; i < added.size(); i++)
+    {
+        // placed before merging, every particle moves (not just the pinned ones like Translate)
+        for (Particle* particle : added[i]->GetParticles())
+        {
+            particle->SetPosition(particle->GetPosition() + offsets[i]);
+        }
+
+        next.numParticles = added[i]->GetParticles().size();
+        next.numSprings = added[i]->GetSprings().size();
+        next.numTriangles = added[i]->GetTriangles().size();
+        instances.push_back(next);
+
+        next.particleOffset += next.numParticles;
+        next.springOffset += next.numSprings;
+        next.triangleOffset += next.numTriangles;
+
+        cloths.push_back(added[i]);
+    }
+
+    // an empty world has no settings of its own yet, the first instance brings them
+    if (first == 0)
+    {
+        cloths.erase(cloths.begin());
+        delete cloth;
+    }
+
+    Cloth* merged = new Cloth(cloths);
+    for (Cloth* old : cloths)
+    {
+        delete old;
+    }
+    cloth = merged;
+
+    return first;
+}
+
+void ClothWorld::SetWind(glm::vec3 wind)
+{
+    cloth->SetWind(wind);
+}
+
+void ClothWorld::SetWindField(WindField* windField)
+{
+    cloth->SetWindField(windField);
+}
+
+void ClothWorld::Simulate(float dt)
+{
+    cloth->Simulate(dt);
+}
+
+void ClothWorld::Translate(int instance, glm::vec3 translation)
+{
+    ClothInstance& range = instances[instance];
+    cloth->Translate(translation, range.particleOffset, range.particleOffset + range.numParticles);
+}
+
+Cloth* ClothWorld::GetCloth()
+{
+    return cloth;
+}
+
+int ClothWorld::GetNumInstances()
+{
+    return instances.size();
+}
+
+ClothInstance& ClothWorld::GetInstance(int instance)
+{
+    return instances[instance];
+}
@@ -30,10 +30,19 @@ bool Joint::Load(Tokenizer& token)
     // get joint name for imgui
     char nameBuffer[256];
     token.GetToken(nameBuffer);
-    name = std::string(nameBuffer);
-    
-    // find '{' token
-    token.FindToken("{");
+
+    // some exporters leave the name out (balljoint {), then the brace is already read
+    if (strcmp(nameBuffer, "{") == 0)
+    {
+        name = "";
+    }
+    else
+    {
+        name = std::string(nameBuffer);
+
+        // find '{' token
+        token.FindToken("{");
+    }
 
     // loop through tokens until '}' token
     while (true)
@@ -0,0 +1,283 @@
+#include "MeshBVH.h"
+#include <algorithm>
+#include <cfloat>
+
+// triangles per leaf before splitting stops
+static const int MAX_LEAF_SIZE = 4;
+
+// closest point on triangle abc to p (ericson, real-time collision detection 5.1.5)
+static glm::vec3 ClosestPointOnTriangle(glm::vec3 p, glm::vec3 a, glm::vec3 b, glm::vec3 c)
+{
+    glm::vec3 ab = b - a;
+    glm::vec3 ac = c - a;
+    glm::vec3 ap = p - a;
+
+    // vertex region a
+    float d1 = glm::dot(ab, ap);
+    float d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f)
+    {
+        return a;
+    }
+
+    // vertex region b
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp);
+    float d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3)
+    {
+        return b;
+    }
+
+    // edge region ab
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+    {
+        return a + (d1 / (d1 - d3)) * ab;
+    }
+
+    // vertex region c
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp);
+    float d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6)
+    {
+        return c;
+    }
+
+    // edge region ac
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+    {
+        return a + (d2 / (d2 - d6)) * ac;
+    }
+
+    // edge region bc
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+    {
+        return b + ((d4 - d3) / ((d4 - d3) + (d5 - d6))) * (c - b);
+    }
+
+    // face region
+    float denominator = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+// squared distance from p to a box, 0 inside
+static float DistanceToBoxSquared(glm::vec3 p, glm::vec3 boxMin, glm::vec3 boxMax)
+{
+    glm::vec3 d = glm::max(glm::max(boxMin - p, p - boxMax), glm::vec3(0.0f));
+    return glm::dot(d, d);
+}
+
+MeshBVH::MeshBVH()
+{
+    positions = nullptr;
+}
+
+void MeshBVH::Build(const std::vector<glm::vec3>& positions, const std::vector<glm::ivec3>& triangles)
+{
+    this->positions = &positions;
+    this->triangles = triangles;
+
+    nodes.clear();
+    triangleOrder.resize(triangles.size());
+    if (triangles.empty())
+    {
+        return;
+    }
+
+    std::vector<glm::vec3> centroids(triangles.size());
+    for (int t = 0; t < (int)triangles.size(); t++)
+    {
+        triangleOrder[t] = t;
+        centroids[t] = (positions[triangles[t].x] + positions[triangles[t].y] + positions[triangles[t].z]) / 3.0f;
+    }
+
+    // a binary tree with leaves of at least one triangle has fewer than 2n nodes
+    nodes.reserve(2 * triangles.size());
+    nodes.push_back(Node());
+    BuildNode(0, 0, triangles.size(), centroids);
+
+    printf("MeshBVH::Build - %d triangles, %d nodes\n", (int)triangles.size(), (int)nodes.size());
+}
+
+void MeshBVH::BuildNode(int node, int first, int count, std::vector<glm::vec3>& centroids)
+{
+    if (count <= MAX_LEAF_SIZE)
+    {
+        nodes[node].firstOrChild = first;
+        nodes[node].count = count;
+        ComputeLeafBox(nodes[node]);
+        return;
+    }
+
+    // split at the median centroid along the longest axis of the centroid bounds
+    glm::vec3 centroidMin = centroids[triangleOrder[first]];
+    glm::vec3 centroidMax = centroidMin;
+    for (int i = first + 1; i < first + count; i++)
+    {
+        centroidMin = glm::min(centroidMin, centroids[triangleOrder[i]]);
+        centroidMax = glm::max(centroidMax, centroids[triangleOrder[i]]);
+    }
+
+    glm::vec3 extent = centroidMax - centroidMin;
+    int axis = 0;
+    if (extent.y > extent[axis])
+    {
+        axis = 1;
+    }
+    if (extent.z > extent[axis])
+    {
+        axis = 2;
+    }
+
+    int half = count / 2;
+    std::nth_element(triangleOrder.begin() + first, triangleOrder.begin() + first + half, triangleOrder.begin() + first + count, [&](int a, int b)
+    {
+        return centroids[a][axis] < centroids[b][axis];
+    });
+
+    // children are allocated together, always after the parent
+    int left = nodes.size();
+    nodes.push_back(Node());
+    nodes.push_back(Node());
+    nodes[node].firstOrChild = left;
+    nodes[node].count = 0;
+
+    BuildNode(left, first, half, centroids);
+    BuildNode(left + 1, first + half, count - half, centroids);
+
+    nodes[node].boxMin = glm::min(nodes[left].boxMin, nodes[left + 1].boxMin);
+    nodes[node].boxMax = glm::max(nodes[left].boxMax, nodes[left + 1].boxMax);
+}
+
+void MeshBVH::ComputeLeafBox(Node& node)
+{
+    const std::vector<glm::vec3>& p = *positions;
+
+    node.boxMin = glm::vec3(FLT_MAX);
+    node.boxMax = glm::vec3(-FLT_MAX);
+    for (int i = node.firstOrChild; i < node.firstOrChild + node.count; i++)
+    {
+        glm::ivec3 triangle = triangles[triangleOrder[i]];
+        node.boxMin = glm::min(node.boxMin, glm::min(p[triangle.x], glm::min(p[triangle.y], p[triangle.z])));
+        node.boxMax = glm::max(node.boxMax, glm::max(p[triangle.x], glm::max(p[triangle.y], p[triangle.z])));
+    }
+}
+
+void MeshBVH::Refit(const std::vector<glm::vec3>& positions)
+{
+    this->positions = &positions;
+
+    int numNodes = nodes.size();
+
+    // leaves touch the vertices, do them in parallel
+    ThreadPool::GetShared()->ParallelFor(numNodes, 1024, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            if (nodes[i].count > 0)
+            {
+                ComputeLeafBox(nodes[i]);
+            }
+        }
+    });
+
+    // then merge boxes bottom-up
+    for (int i = numNodes - 1; i >= 0; i--)
+    {
+        if (nodes[i].count == 0)
+        {
+            int left = nodes[i].firstOrChild;
+            nodes[i].boxMin = glm::min(nodes[left].boxMin, nodes[left + 1].boxMin);
+            nodes[i].boxMax = glm::max(nodes[left].boxMax, nodes[left + 1].boxMax);
+        }
+    }
+}
+
+bool MeshBVH::FindClosest(glm::vec3 point, float maxDistance, MeshHit& hit)
+{
+    if (nodes.empty())
+    {
+        return false;
+    }
+
+    const std::vector<glm::vec3>& p = *positions;
+    float bestSquared = maxDistance * maxDistance;
+    int bestTriangle = -1;
+    glm::vec3 bestPoint;
+
+    // depth is about log2(n / MAX_LEAF_SIZE), 64 is plenty
+    int stack[64];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0)
+    {
+        Node& node = nodes[stack[--stackSize]];
+        if (DistanceToBoxSquared(point, node.boxMin, node.boxMax) > bestSquared)
+        {
+            continue;
+        }
+
+        if (node.count > 0)
+        {
+            for (int i = node.firstOrChild; i < node.firstOrChild + node.count; i++)
+            {
+                glm::ivec3 triangle = triangles[triangleOrder[i]];
+                glm::vec3 closest = ClosestPointOnTriangle(point, p[triangle.x], p[triangle.y], p[triangle.z]);
+                glm::vec3 difference = point - closest;
+                float distanceSquared = glm::dot(difference, difference);
+                if (distanceSquared <= bestSquared)
+                {
+                    bestSquared = distanceSquared;
+                    bestTriangle = triangleOrder[i];
+                    bestPoint = closest;
+                }
+            }
+            continue;
+        }
+
+        // visit the nearer child first so the search radius shrinks sooner
+        int left = node.firstOrChild;
+        float leftDistance = DistanceToBoxSquared(point, nodes[left].boxMin, nodes[left].boxMax);
+        float rightDistance = DistanceToBoxSquared(point, nodes[left + 1].boxMin, nodes[left + 1].boxMax);
+        if (leftDistance < rightDistance)
+        {
+            stack[stackSize++] = left + 1;
+            stack[stackSize++] = left;
+        }
+        else
+        {
+            stack[stackSize++] = left;
+            stack[stackSize++] = left + 1;
+        }
+    }
+
+    if (bestTriangle < 0)
+    {
+        return false;
+    }
+
+    glm::ivec3 triangle = triangles[bestTriangle];
+    glm::vec3 normal = glm::cross(p[triangle.y] - p[triangle.x], p[triangle.z] - p[triangle.x]);
+    float length = glm::length(normal);
+
+    hit.triangle = bestTriangle;
+    hit.point = bestPoint;
+    hit.normal = length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+    hit.distance = sqrtf(bestSquared);
+    return true;
+}
+
+int MeshBVH::GetNumTriangles()
+{
+    return triangles.size();
+}
+
+int MeshBVH::GetNumNodes()
+{
+    return nodes.size();
+}
@@ -0,0 +1,217 @@
+#include "MorphTargets.h"
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__SSE2__)
+// x, y, z of a 3 float input, nothing past the 3 floats is read
+static inline __m128 Load3(const float* input)
+{
+    __m128 xy = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*)input);
+    return _mm_movelh_ps(xy, _mm_load_ss(input + 2));
+}
+
+// x, y, z of v to a 3 float output
+static inline void Store3(float* output, __m128 v)
+{
+    _mm_storel_pi((__m64*)output, v);
+    _mm_store_ss(output + 2, _mm_movehl_ps(v, v));
+}
+#endif
+
+MorphTargets::MorphTargets(int numVertices)
+{
+    this->numVertices = numVertices;
+    targetStart.push_back(0);
+    deltas.resize(2, 0.0f);
+    marks.assign(numVertices, 0);
+}
+
+void MorphTargets::AddTarget(const std::string& name, const std::vector<int>& vertices, const std::vector<glm::vec3>& positionDeltas, const std::vector<glm::vec3>& normalDeltas)
+{
+    // sorted by vertex, so applying a target walks the mesh forwards
+    std::vector<int> order(vertices.size());
+    for (int k = 0; k < order.size(); k++)
+    {
+        order[k] = k;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b)
+    {
+        return vertices[a] < vertices[b];
+    });
+
+    // drop the padding, append, and pad again
+    deltas.resize(deltas.size() - 2);
+    for (int k = 0; k < order.size(); k++)
+    {
+        int entry = order[k];
+        if (vertices[entry] < 0 || vertices[entry] >= numVertices)
+        {
+            printf("MorphTargets::AddTarget - %s: vertex %d out of range, skipped\n", name.c_str(), vertices[entry]);
+            continue;
+        }
+        indices.push_back(vertices[entry]);
+        deltas.push_back(positionDeltas[entry].x);
+        deltas.push_back(positionDeltas[entry].y);
+        deltas.push_back(positionDeltas[entry].z);
+        deltas.push_back(normalDeltas[entry].x);
+        deltas.push_back(normalDeltas[entry].y);
+        deltas.push_back(normalDeltas[entry].z);
+    }
+    deltas.resize(deltas.size() + 2, 0.0f);
+
+    names.push_back(name);
+    targetStart.push_back(indices.size());
+    weights.push_back(0.0f);
+    appliedWeights.push_back(0.0f);
+}
+
+int MorphTargets::GetNumTargets()
+{
+    return names.size();
+}
+
+const std::string& MorphTargets::GetName(int target)
+{
+    return names[target];
+}
+
+int MorphTargets::FindTarget(const std::string& name)
+{
+    for (int t = 0; t < names.size(); t++)
+    {
+        if (names[t] == name)
+        {
+            return t;
+        }
+    }
+    return -1;
+}
+
+float MorphTargets::GetWeight(int target)
+{
+    return weights[target];
+}
+
+void MorphTargets::SetWeight(int target, float weight)
+{
+    weights[target] = weight;
+}
+
+void MorphTargets::Accumulate(int begin, int end, float weight, bool masked, glm::vec3* positions, glm::vec3* normals)
+{
+    const int* vertex = indices.data();
+    const float* delta = deltas.data();
+#if defined(__AVX2__)
+    // [dx dy dz dnx | dny dnz . .] from the 8 float load spread to [dx dy dz . | dnx dny dnz .]
+    // to line up with [x y z . | nx ny nz .], the 4th lanes are never stored
+    const __m256i spread = _mm256_setr_epi32(0, 1, 2, 2, 3, 4, 5, 5);
+    __m256 w = _mm256_set1_ps(weight);
+    for (int e = begin; e < end; e++)
+    {
+        int v = vertex[e];
+        if (masked && !marks[v])
+        {
+            continue;
+        }
+        __m256 d = _mm256_permutevar8x32_ps(_mm256_loadu_ps(delta + e * DELTA_STRIDE), spread);
+        __m256 current = _mm256_insertf128_ps(_mm256_castps128_ps256(Load3(&positions[v].x)), Load3(&normals[v].x), 1);
+        current = _mm256_fmadd_ps(w, d, current);
+        Store3(&positions[v].x, _mm256_castps256_ps128(current));
+        Store3(&normals[v].x, _mm256_extractf128_ps(current, 1));
+    }
+#elif defined(__SSE2__)
+    __m128 w = _mm_set1_ps(weight);
+    for (int e = begin; e < end; e++)
+    {
+        int v = vertex[e];
+        if (masked && !marks[v])
+        {
+            continue;
+        }
+        // the 4th lane of both loads belongs to the next delta and is never stored
+        const float* d = delta + e * DELTA_STRIDE;
+        Store3(&positions[v].x, _mm_add_ps(Load3(&positions[v].x), _mm_mul_ps(w, _mm_loadu_ps(d))));
+        Store3(&normals[v].x, _mm_add_ps(Load3(&normals[v].x), _mm_mul_ps(w, _mm_loadu_ps(d + 3))));
+    }
+#else
+    for (int e = begin; e < end; e++)
+    {
+        int v = vertex[e];
+        if (masked && !marks[v])
+        {
+            continue;
+        }
+        const float* d = delta + e * DELTA_STRIDE;
+        positions[v] += weight * glm::vec3(d[0], d[1], d[2]);
+        normals[v] += weight * glm::vec3(d[3], d[4], d[5]);
+    }
+#endif
+}
+
+bool MorphTargets::Apply(const glm::vec3* basePositions, const glm::vec3* baseNormals, glm::vec3* positions, glm::vec3* normals)
+{
+    changedVertices.clear();
+
+    // the vertices of every target whose weight changed go back to the base
+    for (int t = 0; t < names.size(); t++)
+    {
+        if (weights[t] == appliedWeights[t])
+        {
+            continue;
+        }
+        for (int e = targetStart[t]; e < targetStart[t + 1]; e++)
+        {
+            int v = indices[e];
+            if (!marks[v])
+            {
+                marks[v] = 1;
+                changedVertices.push_back(v);
+                positions[v] = basePositions[v];
+                normals[v] = baseNormals[v];
+            }
+        }
+    }
+    if (changedVertices.empty())
+    {
+        // nothing changed, or only targets without entries
+        appliedWeights = weights;
+        return false;
+    }
+
+    // and get every target that is on added back. a changed target covers only reset vertices,
+    // an unchanged one only adds where its vertices were reset by another
+    for (int t = 0; t < names.size(); t++)
+    {
+        if (weights[t] != 0.0f)
+        {
+            Accumulate(targetStart[t], targetStart[t + 1], weights[t], weights[t] == appliedWeights[t], positions, normals);
+        }
+    }
+
+    for (int k = 0; k < changedVertices.size(); k++)
+    {
+        marks[changedVertices[k]] = 0;
+    }
+    appliedWeights = weights;
+    return true;
+}
+
+const std::vector<int>& MorphTargets::GetChangedVertices()
+{
+    return changedVertices;
+}
+
+int MorphTargets::GetNumDeltas()
+{
+    return indices.size();
+}
+
+int MorphTargets::GetBytes()
+{
+    return indices.size() * sizeof(int) + deltas.size() * sizeof(float) + targetStart.size() * sizeof(int);
+}
@@ -113,4 +113,9 @@ void Particle::SetPressure(float pressure)
 bool Particle::IsFixed()
 {
     return fixed;
+}
+
+void Particle::SetFixed(bool fixed)
+{
+    this->fixed = fixed;
 }
\ No newline at end of file
@@ -0,0 +1,899 @@
+#include "ProjectiveDynamics.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// pieces of the dissection this small are ordered as they come
+static const int DISSECTION_LEAF = 8;
+// supernodes narrower than this take explicit zeros to grow, wider ones only while the zeros stay
+// under an eighth of the block
+static const int RELAXED_WIDTH = 8;
+
+ProjectiveDynamics::ProjectiveDynamics()
+{
+    // the exact global solve leaves little error for the local step to feed back, so a low
+    // spectral radius estimate and a few iterations track the converged answer closer than
+    // many iterations with an aggressive one
+    numIterations = 4;
+    chebyshevRho = 0.3f;
+    chebyshevGamma = 0.9f;
+    chebyshevDelay = 2;
+    damping = 0.002f;
+
+    needsFactorization = true;
+    factoredTimestep = 0.0f;
+    numRows = 0;
+}
+
+void ProjectiveDynamics::Invalidate()
+{
+    needsFactorization = true;
+}
+
+void ProjectiveDynamics::ComputeOrdering(std::vector<Particle*>& particles, std::vector<SpringDamper*>& springs)
+{
+    int numParticles = particles.size();
+
+    // adjacency between free particles (compressed rows)
+    std::vector<int> degree(numParticles, 0);
+    for (SpringDamper* spring : springs)
+    {
+        int a = spring->GetIndexP1();
+        int b = spring->GetIndexP2();
+        if (particles[a]->IsFixed() || particles[b]->IsFixed())
+        {
+            continue;
+        }
+        degree[a]++;
+        degree[b]++;
+    }
+
+    std::vector<int> adjacencyStart(numParticles + 1, 0);
+    for (int i = 0; i < numParticles; i++)
+    {
+        adjacencyStart[i + 1] = adjacencyStart[i] + degree[i];
+    }
+
+    std::vector<int> adjacency(adjacencyStart[numParticles]);
+    std::vector<int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+    for (SpringDamper* spring : springs)
+    {
+        int a = spring->GetIndexP1();
+        int b = spring->GetIndexP2();
+        if (particles[a]->IsFixed() || particles[b]->IsFixed())
+        {
+            continue;
+        }
+        adjacency[fill[a]++] = b;
+        adjacency[fill[b]++] = a;
+    }
+
+    std::vector<int> nodes;
+    for (int i = 0; i < numParticles; i++)
+    {
+        if (!particles[i]->IsFixed())
+        {
+            nodes.push_back(i);
+        }
+    }
+
+    std::vector<glm::vec3> positions(numParticles);
+    for (int i = 0; i < numParticles; i++)
+    {
+        positions[i] = particles[i]->GetPosition();
+    }
+
+    // label[i] marks the upper half of the piece being split
+    std::vector<int> label(numParticles, -1);
+    int nextLabel = 0;
+
+    std::vector<int> order;
+    order.reserve(numParticles);
+    Dissect(nodes, positions, adjacencyStart, adjacency, label, nextLabel, order);
+
+    // fixed particles go after the free ones
+    numRows = order.size();
+    for (int i = 0; i < numParticles; i++)
+    {
+        if (particles[i]->IsFixed())
+        {
+            order.push_back(i);
+        }
+    }
+
+    rowToParticle = order;
+    particleToRow.resize(numParticles);
+    for (int row = 0; row < numParticles; row++)
+    {
+        particleToRow[rowToParticle[row]] = row;
+    }
+}
+
+void ProjectiveDynamics::Dissect(std::vector<int>& nodes, const std::vector<glm::vec3>& positions, const std::vector<int>& adjacencyStart,
+                                 const std::vector<int>& adjacency, std::vector<int>& label, int& nextLabel, std::vector<int>& order)
+{
+    if ((int)nodes.size() <= DISSECTION_LEAF)
+    {
+        order.insert(order.end(), nodes.begin(), nodes.end());
+        return;
+    }
+
+    // split at the median along the longest side of the bounding box. any split is correct, the
+    // positions only decide how small the separator is, and a sheet is cut straight across
+    glm::vec3 minCorner(FLT_MAX);
+    glm::vec3 maxCorner(-FLT_MAX);
+    for (int node : nodes)
+    {
+        minCorner = glm::min(minCorner, positions[node]);
+        maxCorner = glm::max(maxCorner, positions[node]);
+    }
+    glm::vec3 extent = maxCorner - minCorner;
+    int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+    int middle = nodes.size() / 2;
+    std::nth_element(nodes.begin(), nodes.begin() + middle, nodes.end(), [&positions, axis](int a, int b)
+    {
+        return positions[a][axis] < positions[b][axis];
+    });
+
+    // particles of the lower half with a spring into the upper half separate the two
+    int upperLabel = nextLabel++;
+    for (int i = middle; i < (int)nodes.size(); i++)
+    {
+        label[nodes[i]] = upperLabel;
+    }
+
+    std::vector<int> lower;
+    std::vector<int> separator;
+    for (int i = 0; i < middle; i++)
+    {
+        int node = nodes[i];
+        bool separating = false;
+        for (int k = adjacencyStart[node]; k < adjacencyStart[node + 1] && !separating; k++)
+        {
+            separating = label[adjacency[k]] == upperLabel;
+        }
+
+        if (separating)
+        {
+            separator.push_back(node);
+        }
+        else
+        {
+            lower.push_back(node);
+        }
+    }
+    std::vector<int> upper(nodes.begin() + middle, nodes.end());
+
+    // both halves first, the separator last so eliminating one half never fills into the other
+    Dissect(lower, positions, adjacencyStart, adjacency, label, nextLabel, order);
+    Dissect(upper, positions, adjacencyStart, adjacency, label, nextLabel, order);
+    order.insert(order.end(), separator.begin(), separator.end());
+}
+
+void ProjectiveDynamics::Factorize(std::vector<Particle*>& particles, std::vector<SpringDamper*>& springs, float dt)
+{
+    ComputeOrdering(particles, springs);
+
+    int numParticles = particles.size();
+    int numSprings = springs.size();
+
+    // flatten the springs
+    springRow1.resize(numSprings);
+    springRow2.resize(numSprings);
+    springRestLength.resize(numSprings);
+    springStiffness.resize(numSprings);
+    fixedSprings.clear();
+    for (int s = 0; s < numSprings; s++)
+    {
+        springRow1[s] = particleToRow[springs[s]->GetIndexP1()];
+        springRow2[s] = particleToRow[springs[s]->GetIndexP2()];
+        springRestLength[s] = springs[s]->GetRestLength();
+        springStiffness[s] = springs[s]->GetSpringConstant();
+
+        if ((springRow1[s] >= numRows) != (springRow2[s] >= numRows))
+        {
+            fixedSprings.push_back(s);
+        }
+    }
+
+    // springs at each free row
+    rowSpringStart.assign(numRows + 1, 0);
+    for (int s = 0; s < numSprings; s++)
+    {
+        if (springRow1[s] < numRows)
+        {
+            rowSpringStart[springRow1[s] + 1]++;
+        }
+        if (springRow2[s] < numRows)
+        {
+            rowSpringStart[springRow2[s] + 1]++;
+        }
+    }
+    for (int row = 0; row < numRows; row++)
+    {
+        rowSpringStart[row + 1] += rowSpringStart[row];
+    }
+
+    rowSprings.resize(rowSpringStart[numRows]);
+    std::vector<int> fill(rowSpringStart.begin(), rowSpringStart.end() - 1);
+    // first ends before second ends, so the sign test in the gather flips once per row
+    for (int s = 0; s < numSprings; s++)
+    {
+        if (springRow1[s] < numRows)
+        {
+            rowSprings[fill[springRow1[s]]++] = s + 1;
+        }
+    }
+    for (int s = 0; s < numSprings; s++)
+    {
+        if (springRow2[s] < numRows)
+        {
+            rowSprings[fill[springRow2[s]]++] = -(s + 1);
+        }
+    }
+
+    // assemble M/h^2 + Σ k * A * A^T. the strictly upper part goes into compressed columns (row < column),
+    // duplicates are fine since they are summed when scattered. springs to fixed particles only add to the diagonal
+    double invDt2 = 1.0 / (double(dt) * double(dt));
+    rowInertia.resize(numRows);
+    std::vector<double> diagonal(numRows);
+    for (int row = 0; row < numRows; row++)
+    {
+        rowInertia[row] = particles[rowToParticle[row]]->GetMass() * invDt2;
+        diagonal[row] = rowInertia[row];
+    }
+
+    std::vector<int> upperStart(numRows + 1, 0);
+    for (int s = 0; s < numSprings; s++)
+    {
+        if (springRow1[s] < numRows && springRow2[s] < numRows)
+        {
+            upperStart[std::max(springRow1[s], springRow2[s]) + 1]++;
+        }
+    }
+    for (int row = 0; row < numRows; row++)
+    {
+        upperStart[row + 1] += upperStart[row];
+    }
+
+    std::vector<int> upperRow(upperStart[numRows]);
+    std::vector<double> upperValue(upperStart[numRows]);
+    std::vector<int> next(upperStart.begin(), upperStart.end() - 1);
+    for (int s = 0; s < numSprings; s++)
+    {
+        int rowA = springRow1[s];
+        int rowB = springRow2[s];
+        double k = springStiffness[s];
+
+        if (rowA < numRows)
+        {
+            diagonal[rowA] += k;
+        }
+        if (rowB < numRows)
+        {
+            diagonal[rowB] += k;
+        }
+        if (rowA < numRows && rowB < numRows)
+        {
+            int p = next[std::max(rowA, rowB)]++;
+            upperRow[p] = std::min(rowA, rowB);
+            upperValue[p] = -k;
+        }
+    }
+
+    // elimination tree, with path compression through ancestor
+    std::vector<int> parent(numRows, -1);
+    std::vector<int> ancestor(numRows, -1);
+    for (int k = 0; k < numRows; k++)
+    {
+        for (int p = upperStart[k]; p < upperStart[k + 1]; p++)
+        {
+            int i = upperRow[p];
+            while (i != -1 && i < k)
+            {
+                int nextAncestor = ancestor[i];
+                ancestor[i] = k;
+                if (nextAncestor == -1)
+                {
+                    parent[i] = k;
+                }
+                i = nextAncestor;
+            }
+        }
+    }
+
+    // the pattern of row k of L is every node on the tree paths from the entries of column k up to k.
+    // the paths are written in topological order to reach[top..numRows)
+    std::vector<int> mark(numRows, -1);
+    std::vector<int> reach(numRows);
+    std::vector<int> path(numRows);
+    auto RowPattern = [&](int k) -> int
+    {
+        int top = numRows;
+        mark[k] = k;
+        for (int p = upperStart[k]; p < upperStart[k + 1]; p++)
+        {
+            int length = 0;
+            for (int i = upperRow[p]; mark[i] != k; i = parent[i])
+            {
+                path[length++] = i;
+                mark[i] = k;
+            }
+            while (length > 0)
+            {
+                reach[--top] = path[--length];
+            }
+        }
+        return top;
+    };
+
+    // symbolic pass: column counts
+    std::vector<int> count(numRows, 1);
+    for (int k = 0; k < numRows; k++)
+    {
+        for (int top = RowPattern(k); top < numRows; top++)
+        {
+            count[reach[top]]++;
+        }
+    }
+
+    std::vector<int> columnStart(numRows + 1);
+    columnStart[0] = 0;
+    for (int j = 0; j < numRows; j++)
+    {
+        columnStart[j + 1] = columnStart[j] + count[j];
+    }
+    std::vector<int> factorRow(columnStart[numRows]);
+    std::vector<double> factor(columnStart[numRows]);
+
+    // numeric pass, up-looking: row k of L comes from a sparse triangular solve against the rows above it
+    std::fill(mark.begin(), mark.end(), -1);
+    std::vector<int> end(columnStart.begin(), columnStart.end() - 1);
+    std::vector<double> x(numRows, 0.0);
+    for (int k = 0; k < numRows; k++)
+    {
+        int top = RowPattern(k);
+        for (int p = upperStart[k]; p < upperStart[k + 1]; p++)
+        {
+            x[upperRow[p]] += upperValue[p];
+        }
+
+        double d = diagonal[k];
+        for (; top < numRows; top++)
+        {
+            int i = reach[top];
+            double value = x[i] / factor[columnStart[i]];
+            x[i] = 0.0;
+            for (int p = columnStart[i] + 1; p < end[i]; p++)
+            {
+                x[factorRow[p]] -= factor[p] * value;
+            }
+            d -= value * value;
+
+            int p = end[i]++;
+            factorRow[p] = k;
+            factor[p] = value;
+        }
+
+        if (d <= 0.0)
+        {
+            printf("ProjectiveDynamics::Factorize - warning: matrix not positive definite at row %d\n", k);
+            d = 1e-12;
+        }
+
+        int p = end[k]++;
+        factorRow[p] = k;
+        factor[p] = sqrt(d);
+    }
+
+    // supernodes: column j joins the run of column j - 1 when j is j - 1's parent. the pattern of
+    // j - 1 below itself is then inside j's pattern plus j, so the run's rows are its own columns
+    // followed by the pattern of its last column. columns whose pattern is smaller get explicit
+    // zeros, which is allowed while the run stays narrow or the zeros stay a small part of it
+    supernodeStart.clear();
+    supernodeStart.push_back(0);
+    int zeros = 0;
+    for (int j = 1; j < numRows; j++)
+    {
+        int first = supernodeStart.back();
+        int extra = (j - first) * (count[j] - count[j - 1] + 1);
+        int size = (j - first) * (j - first + 1) / 2 + (j - first) * count[j];
+        if (parent[j - 1] == j && (j - first < RELAXED_WIDTH || 8 * (zeros + extra) <= size))
+        {
+            zeros += extra;
+            continue;
+        }
+        supernodeStart.push_back(j);
+        zeros = 0;
+    }
+    supernodeStart.push_back(numRows);
+
+    int numSupernodes = supernodeStart.size() - 1;
+    rowStart.resize(numSupernodes + 1);
+    valueStart.resize(numSupernodes + 1);
+    rowStart[0] = 0;
+    valueStart[0] = 0;
+    int maxColumns = 0;
+    for (int s = 0; s < numSupernodes; s++)
+    {
+        int n = supernodeStart[s + 1] - supernodeStart[s];
+        int m = n - 1 + count[supernodeStart[s + 1] - 1];
+        rowStart[s + 1] = rowStart[s] + m;
+        valueStart[s + 1] = valueStart[s] + m * n;
+        maxColumns = std::max(maxColumns, n);
+    }
+
+    supernodeRows.resize(rowStart[numSupernodes]);
+    supernodeValues.assign(valueStart[numSupernodes], 0.0);
+    std::vector<int> position(numRows);
+    for (int s = 0; s < numSupernodes; s++)
+    {
+        int first = supernodeStart[s];
+        int last = supernodeStart[s + 1] - 1;
+        int n = last - first + 1;
+        int m = rowStart[s + 1] - rowStart[s];
+
+        // rows: the columns, then the pattern of the last column below itself
+        int* rows = &supernodeRows[rowStart[s]];
+        for (int i = 0; i < n; i++)
+        {
+            rows[i] = first + i;
+        }
+        std::copy(&factorRow[columnStart[last] + 1], &factorRow[columnStart[last + 1]], rows + n);
+        for (int i = 0; i < m; i++)
+        {
+            position[rows[i]] = i;
+        }
+
+        // the block is stored by rows, diagonal entries hold 1 / L_jj
+        double* block = &supernodeValues[valueStart[s]];
+        for (int c = 0; c < n; c++)
+        {
+            int column = first + c;
+            block[n * c + c] = 1.0 / factor[columnStart[column]];
+            for (int p = columnStart[column] + 1; p < columnStart[column + 1]; p++)
+            {
+                block[n * position[factorRow[p]] + c] = factor[p];
+            }
+        }
+    }
+
+    // size the work arrays
+    iterate.resize(numParticles);
+    previousIterate.resize(numParticles);
+    projectionX.resize(numSprings);
+    projectionY.resize(numSprings);
+    projectionZ.resize(numSprings);
+    constantRhs.resize(4 * numRows);
+    rhs.resize(4 * numRows);
+    work.resize(4 * maxColumns);
+
+    needsFactorization = false;
+    factoredTimestep = dt;
+}
+
+void ProjectiveDynamics::Solve()
+{
+    int numSupernodes = supernodeStart.size() - 1;
+    double* values = rhs.data();
+    double* w = work.data();
+
+#if defined(__AVX2__)
+    // forward substitution: L * z = b. the columns of a supernode are consecutive rows, so its
+    // diagonal block is a dense triangle, then each row below takes one dot product with them.
+    // two sums so the adds of a dot product don't all wait on each other
+    for (int s = 0; s < numSupernodes; s++)
+    {
+        int first = supernodeStart[s];
+        int n = supernodeStart[s + 1] - first;
+        int m = rowStart[s + 1] - rowStart[s];
+        const int* rows = &supernodeRows[rowStart[s]];
+        const double* block = &supernodeValues[valueStart[s]];
+        double* own = values + 4 * first;
+
+        for (int i = 0; i < n; i++)
+        {
+            const double* row = block + n * i;
+            __m256d sum = _mm256_loadu_pd(own + 4 * i);
+            __m256d sum2 = _mm256_setzero_pd();
+            int c = 0;
+            for (; c + 1 < i; c += 2)
+            {
+                sum = _mm256_fnmadd_pd(_mm256_set1_pd(row[c]), _mm256_loadu_pd(own + 4 * c), sum);
+                sum2 = _mm256_fnmadd_pd(_mm256_set1_pd(row[c + 1]), _mm256_loadu_pd(own + 4 * c + 4), sum2);
+            }
+            if (c < i)
+            {
+                sum = _mm256_fnmadd_pd(_mm256_set1_pd(row[c]), _mm256_loadu_pd(own + 4 * c), sum);
+            }
+            _mm256_storeu_pd(own + 4 * i, _mm256_mul_pd(_mm256_add_pd(sum, sum2), _mm256_set1_pd(row[i])));
+        }
+
+        // rows below, four at a time so each column value is loaded once for all four and the four
+        // sums are independent
+        int i = n;
+        for (; i + 3 < m; i += 4)
+        {
+            const double* row = block + n * i;
+            __m256d sum0 = _mm256_setzero_pd();
+            __m256d sum1 = _mm256_setzero_pd();
+            __m256d sum2 = _mm256_setzero_pd();
+            __m256d sum3 = _mm256_setzero_pd();
+            for (int c = 0; c < n; c++)
+            {
+                __m256d x = _mm256_loadu_pd(own + 4 * c);
+                sum0 = _mm256_fmadd_pd(_mm256_set1_pd(row[c]), x, sum0);
+                sum1 = _mm256_fmadd_pd(_mm256_set1_pd(row[n + c]), x, sum1);
+                sum2 = _mm256_fmadd_pd(_mm256_set1_pd(row[2 * n + c]), x, sum2);
+                sum3 = _mm256_fmadd_pd(_mm256_set1_pd(row[3 * n + c]), x, sum3);
+            }
+
+            double* target = values + 4 * rows[i];
+            _mm256_storeu_pd(target, _mm256_sub_pd(_mm256_loadu_pd(target), sum0));
+            target = values + 4 * rows[i + 1];
+            _mm256_storeu_pd(target, _mm256_sub_pd(_mm256_loadu_pd(target), sum1));
+            target = values + 4 * rows[i + 2];
+            _mm256_storeu_pd(target, _mm256_sub_pd(_mm256_loadu_pd(target), sum2));
+            target = values + 4 * rows[i + 3];
+            _mm256_storeu_pd(target, _mm256_sub_pd(_mm256_loadu_pd(target), sum3));
+        }
+        for (; i < m; i++)
+        {
+            const double* row = block + n * i;
+            __m256d sum = _mm256_setzero_pd();
+            for (int c = 0; c < n; c++)
+            {
+                sum = _mm256_fmadd_pd(_mm256_set1_pd(row[c]), _mm256_loadu_pd(own + 4 * c), sum);
+            }
+
+            double* target = values + 4 * rows[i];
+            _mm256_storeu_pd(target, _mm256_sub_pd(_mm256_loadu_pd(target), sum));
+        }
+    }
+
+    // back substitution: L^T * x = z. the rows below a supernode are already solved, their part is
+    // taken off its columns first and then the dense triangle is solved transposed
+    for (int s = numSupernodes - 1; s >= 0; s--)
+    {
+        int first = supernodeStart[s];
+        int n = supernodeStart[s + 1] - first;
+        int m = rowStart[s + 1] - rowStart[s];
+        const int* rows = &supernodeRows[rowStart[s]];
+        const double* block = &supernodeValues[valueStart[s]];
+        double* own = values + 4 * first;
+
+        // columns four at a time so each solved row below is loaded once for all four and the four
+        // sums are independent
+        int c = 0;
+        for (; c + 3 < n; c += 4)
+        {
+            __m256d sum0 = _mm256_loadu_pd(own + 4 * c);
+            __m256d sum1 = _mm256_loadu_pd(own + 4 * c + 4);
+            __m256d sum2 = _mm256_loadu_pd(own + 4 * c + 8);
+            __m256d sum3 = _mm256_loadu_pd(own + 4 * c + 12);
+            for (int i = n; i < m; i++)
+            {
+                const double* row = block + n * i + c;
+                __m256d x = _mm256_loadu_pd(values + 4 * rows[i]);
+                sum0 = _mm256_fnmadd_pd(_mm256_set1_pd(row[0]), x, sum0);
+                sum1 = _mm256_fnmadd_pd(_mm256_set1_pd(row[1]), x, sum1);
+                sum2 = _mm256_fnmadd_pd(_mm256_set1_pd(row[2]), x, sum2);
+                sum3 = _mm256_fnmadd_pd(_mm256_set1_pd(row[3]), x, sum3);
+            }
+            _mm256_storeu_pd(w + 4 * c, sum0);
+            _mm256_storeu_pd(w + 4 * c + 4, sum1);
+            _mm256_storeu_pd(w + 4 * c + 8, sum2);
+            _mm256_storeu_pd(w + 4 * c + 12, sum3);
+        }
+        for (; c < n; c++)
+        {
+            __m256d sum = _mm256_loadu_pd(own + 4 * c);
+            __m256d sum2 = _mm256_setzero_pd();
+            int i = n;
+            for (; i + 1 < m; i += 2)
+            {
+                sum = _mm256_fnmadd_pd(_mm256_set1_pd(block[n * i + c]), _mm256_loadu_pd(values + 4 * rows[i]), sum);
+                sum2 = _mm256_fnmadd_pd(_mm256_set1_pd(block[n * (i + 1) + c]), _mm256_loadu_pd(values + 4 * rows[i + 1]), sum2);
+            }
+            if (i < m)
+            {
+                sum = _mm256_fnmadd_pd(_mm256_set1_pd(block[n * i + c]), _mm256_loadu_pd(values + 4 * rows[i]), sum);
+            }
+            _mm256_storeu_pd(w + 4 * c, _mm256_add_pd(sum, sum2));
+        }
+
+        for (int i = n - 1; i >= 0; i--)
+        {
+            const double* row = block + n * i;
+            __m256d x = _mm256_mul_pd(_mm256_loadu_pd(w + 4 * i), _mm256_set1_pd(row[i]));
+            _mm256_storeu_pd(own + 4 * i, x);
+            for (int c = 0; c < i; c++)
+            {
+                _mm256_storeu_pd(w + 4 * c, _mm256_fnmadd_pd(_mm256_set1_pd(row[c]), x, _mm256_loadu_pd(w + 4 * c)));
+            }
+        }
+    }
+#else
+    for (int s = 0; s < numSupernodes; s++)
+    {
+        int first = supernodeStart[s];
+        int n = supernodeStart[s + 1] - first;
+        int m = rowStart[s + 1] - rowStart[s];
+        const int* rows = &supernodeRows[rowStart[s]];
+        const double* block = &supernodeValues[valueStart[s]];
+        double* own = values + 4 * first;
+
+        for (int i = 0; i < n; i++)
+        {
+            const double* row = block + n * i;
+            double x = own[4 * i];
+            double y = own[4 * i + 1];
+            double z = own[4 * i + 2];
+            for (int c = 0; c < i; c++)
+            {
+                x -= row[c] * own[4 * c];
+                y -= row[c] * own[4 * c + 1];
+                z -= row[c] * own[4 * c + 2];
+            }
+            own[4 * i] = x * row[i];
+            own[4 * i + 1] = y * row[i];
+            own[4 * i + 2] = z * row[i];
+        }
+
+        for (int i = n; i < m; i++)
+        {
+            const double* row = block + n * i;
+            double* target = values + 4 * rows[i];
+            for (int c = 0; c < n; c++)
+            {
+                target[0] -= row[c] * own[4 * c];
+                target[1] -= row[c] * own[4 * c + 1];
+                target[2] -= row[c] * own[4 * c + 2];
+            }
+        }
+    }
+
+    for (int s = numSupernodes - 1; s >= 0; s--)
+    {
+        int first = supernodeStart[s];
+        int n = supernodeStart[s + 1] - first;
+        int m = rowStart[s + 1] - rowStart[s];
+        const int* rows = &supernodeRows[rowStart[s]];
+        const double* block = &supernodeValues[valueStart[s]];
+        double* own = values + 4 * first;
+
+        std::copy(own, own + 4 * n, w);
+        for (int i = n; i < m; i++)
+        {
+            const double* row = block + n * i;
+            const double* source = values + 4 * rows[i];
+            for (int c = 0; c < n; c++)
+            {
+                w[4 * c] -= row[c] * source[0];
+                w[4 * c + 1] -= row[c] * source[1];
+                w[4 * c + 2] -= row[c] * source[2];
+            }
+        }
+
+        for (int i = n - 1; i >= 0; i--)
+        {
+            const double* row = block + n * i;
+            double x = w[4 * i] * row[i];
+            double y = w[4 * i + 1] * row[i];
+            double z = w[4 * i + 2] * row[i];
+            own[4 * i] = x;
+            own[4 * i + 1] = y;
+            own[4 * i + 2] = z;
+            for (int c = 0; c < i; c++)
+            {
+                w[4 * c] -= row[c] * x;
+                w[4 * c + 1] -= row[c] * y;
+                w[4 * c + 2] -= row[c] * z;
+            }
+        }
+    }
+#endif
+}
+
+#if defined(__AVX2__)
+// k * l0 * (xa - xb) / |xa - xb| of 8 springs, positions are gathered from packed x, y, z
+static void ComputeProjections8(const int* i1, const int* i2, const float* l0, const float* ks, const float* positions,
+    float* px, float* py, float* pz)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256i three = _mm256_set1_epi32(3);
+
+    __m256i a = _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)i1), three);
+    __m256i b = _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)i2), three);
+
+    __m256 dx = _mm256_sub_ps(_mm256_i32gather_ps(positions, a, 4), _mm256_i32gather_ps(positions, b, 4));
+    __m256 dy = _mm256_sub_ps(_mm256_i32gather_ps(positions + 1, a, 4), _mm256_i32gather_ps(positions + 1, b, 4));
+    __m256 dz = _mm256_sub_ps(_mm256_i32gather_ps(positions + 2, a, 4), _mm256_i32gather_ps(positions + 2, b, 4));
+    __m256 lengthSquared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+    __m256 length = _mm256_sqrt_ps(lengthSquared);
+
+    // zero for collapsed springs instead of a division by zero
+    __m256 scale = _mm256_div_ps(_mm256_mul_ps(_mm256_loadu_ps(ks), _mm256_loadu_ps(l0)), length);
+    scale = _mm256_and_ps(scale, _mm256_cmp_ps(length, _mm256_set1_ps(1e-8f), _CMP_GT_OQ));
+
+    _mm256_storeu_ps(px, _mm256_mul_ps(dx, scale));
+    _mm256_storeu_ps(py, _mm256_mul_ps(dy, scale));
+    _mm256_storeu_ps(pz, _mm256_mul_ps(dz, scale));
+}
+#endif
+
+void ProjectiveDynamics::ComputeProjections(int begin, int end)
+{
+    int s = begin;
+
+#if defined(__AVX2__)
+    // 8 springs at a time
+    const float* positions = &iterate[0].x;
+    for (; s + 8 <= end; s += 8)
+    {
+        ComputeProjections8(&springRow1[s], &springRow2[s], &springRestLength[s], &springStiffness[s], positions,
+            &projectionX[s], &projectionY[s], &projectionZ[s]);
+    }
+#endif
+
+    for (; s < end; s++)
+    {
+        glm::vec3 delta = iterate[springRow1[s]] - iterate[springRow2[s]];
+        float length = glm::length(delta);
+        glm::vec3 projection = length > 1e-8f ? delta * (springStiffness[s] * springRestLength[s] / length) : glm::vec3(0.0f);
+        projectionX[s] = projection.x;
+        projectionY[s] = projection.y;
+        projectionZ[s] = projection.z;
+    }
+}
+
+void ProjectiveDynamics::Step(std::vector<Particle*>& particles, std::vector<SpringDamper*>& springs, float dt)
+{
+    if (needsFactorization || dt != factoredTimestep || particleToRow.size() != particles.size() || springRow1.size() != springs.size())
+    {
+        Factorize(particles, springs, dt);
+    }
+
+    ThreadPool* pool = ThreadPool::GetShared();
+    int numParticles = particles.size();
+    int numSprings = springs.size();
+
+    // inertial target y = x + h * v + h^2 * f / m starts the iteration and gives the M * y / h^2 part
+    // of the right hand side. fixed particles just stay put
+    for (int row = 0; row < numParticles; row++)
+    {
+        Particle* particle = particles[rowToParticle[row]];
+        glm::vec3 position = particle->GetPosition();
+        if (row < numRows)
+        {
+            position += dt * particle->GetVelocity() + (dt * dt / particle->GetMass()) * particle->GetForce();
+            constantRhs[4 * row] = rowInertia[row] * position.x;
+            constantRhs[4 * row + 1] = rowInertia[row] * position.y;
+            constantRhs[4 * row + 2] = rowInertia[row] * position.z;
+        }
+        iterate[row] = position;
+        previousIterate[row] = position;
+    }
+
+    // springs to fixed particles pull with k * x_fixed, which doesn't change during the step
+    for (int s : fixedSprings)
+    {
+        int freeRow = springRow1[s] < numRows ? springRow1[s] : springRow2[s];
+        int fixedRow = springRow1[s] < numRows ? springRow2[s] : springRow1[s];
+        glm::vec3 term = springStiffness[s] * iterate[fixedRow];
+        constantRhs[4 * freeRow] += term.x;
+        constantRhs[4 * freeRow + 1] += term.y;
+        constantRhs[4 * freeRow + 2] += term.z;
+    }
+
+    float omega = 1.0f;
+
+    for (int iteration = 0; iteration < numIterations; iteration++)
+    {
+        // local step: project every spring onto its rest length, scaled by its stiffness
+        pool->ParallelFor(numSprings, 1024, [&](int begin, int end)
+        {
+            ComputeProjections(begin, end);
+        });
+
+        // right hand side: M * y / h^2 + J * d, each row adds k * d of the springs it is the first end
+        // of and takes off the ones it is the second end of
+        pool->ParallelFor(numRows, 256, [&](int begin, int end)
+        {
+            for (int row = begin; row < end; row++)
+            {
+                glm::vec3 sum(0.0f);
+                for (int i = rowSpringStart[row]; i < rowSpringStart[row + 1]; i++)
+                {
+                    int slot = rowSprings[i];
+                    if (slot > 0)
+                    {
+                        sum += glm::vec3(projectionX[slot - 1], projectionY[slot - 1], projectionZ[slot - 1]);
+                    }
+                    else
+                    {
+                        sum -= glm::vec3(projectionX[-slot - 1], projectionY[-slot - 1], projectionZ[-slot - 1]);
+                    }
+                }
+                rhs[4 * row] = constantRhs[4 * row] + sum.x;
+                rhs[4 * row + 1] = constantRhs[4 * row + 1] + sum.y;
+                rhs[4 * row + 2] = constantRhs[4 * row + 2] + sum.z;
+                rhs[4 * row + 3] = 0.0;
+            }
+        });
+
+        // global step: x, y and z share the factor so they are solved in one pass over it
+        Solve();
+
+        // chebyshev semi-iterative update
+        if (iteration < chebyshevDelay)
+        {
+            omega = 1.0f;
+        }
+        else if (iteration == chebyshevDelay)
+        {
+            omega = 2.0f / (2.0f - chebyshevRho * chebyshevRho);
+        }
+        else
+        {
+            omega = 4.0f / (4.0f - chebyshevRho * chebyshevRho * omega);
+        }
+
+        for (int row = 0; row < numRows; row++)
+        {
+            glm::vec3 solved = glm::vec3(rhs[4 * row], rhs[4 * row + 1], rhs[4 * row + 2]);
+            glm::vec3 current = iterate[row];
+            glm::vec3 next = omega * (chebyshevGamma * (solved - current) + current - previousIterate[row]) + previousIterate[row];
+            previousIterate[row] = current;
+            iterate[row] = next;
+        }
+    }
+
+    // velocities from the position change, then commit
+    float velocityScale = (1.0f - damping) / dt;
+    for (int row = 0; row < numParticles; row++)
+    {
+        Particle* particle = particles[rowToParticle[row]];
+        if (row < numRows)
+        {
+            particle->SetVelocity((iterate[row] - particle->GetPosition()) * velocityScale);
+            particle->SetPosition(iterate[row]);
+        }
+        particle->SetForce(glm::vec3(0.0f));
+    }
+}
+
+int ProjectiveDynamics::GetNumIterations()
+{
+    return numIterations;
+}
+
+void ProjectiveDynamics::SetNumIterations(int numIterations)
+{
+    this->numIterations = numIterations;
+}
+
+float ProjectiveDynamics::GetChebyshevRho()
+{
+    return chebyshevRho;
+}
+
+void ProjectiveDynamics::SetChebyshevRho(float chebyshevRho)
+{
+    this->chebyshevRho = chebyshevRho;
+}
+
+float ProjectiveDynamics::GetDamping()
+{
+    return damping;
+}
+
+void ProjectiveDynamics::SetDamping(float damping)
+{
+    this->damping = damping;
+}
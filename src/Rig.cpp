@@ -30,7 +30,34 @@ void Rig::ApplyPose(Pose& pose)
         printf("Rig::ApplyPose - skeleton is null\n");
         return;
     }
-    
+
+    PoseSkeleton(pose);
+
+    // any channels after the joints' drive the skin's morph targets, one weight each in order
+    MorphTargets* morphs = skin ? skin->GetMorphTargets() : nullptr;
+    if (morphs)
+    {
+        int first = skeleton->GetJointList().size() * 3 + 3;
+        for (int t = 0; t < morphs->GetNumTargets() && first + t < pose.GetNumDOFs(); t++)
+        {
+            morphs->SetWeight(t, pose.GetDOF(first + t).GetValue());
+        }
+    }
+
+    if (skin)
+    {
+        skin->Update();
+    }
+}
+
+void Rig::PoseSkeleton(Pose& pose)
+{
+    if (!skeleton)
+    {
+        printf("Rig::PoseSkeleton - skeleton is null\n");
+        return;
+    }
+
     std::vector<Joint*> jointList = skeleton->GetJointList();
 
     // first three channels are root translation (x, y, z)
@@ -48,7 +75,7 @@ void Rig::ApplyPose(Pose& pose)
     {
         if (!jointList[i])
         {
-            printf("Rig::ApplyPose - jointList[%d] is null\n", i);
+            printf("Rig::PoseSkeleton - jointList[%d] is null\n", i);
             continue;
         }
         
@@ -64,8 +91,4 @@ void Rig::ApplyPose(Pose& pose)
     }
 
     skeleton->Update();
-    if (skin)
-    {
-        skin->Update();
-    }
 }
\ No newline at end of file
@@ -0,0 +1,1624 @@
+#include "SelfCollision.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <map>
+
+SelfCollision::SelfCollision(std::vector<ClothTriangle*>& triangles, float thickness, float cellSize)
+{
+    this->thickness = thickness;
+    this->margin = thickness;
+    this->cellSize = cellSize;
+
+    // copy triangle indices and build the unique edge list
+    std::map<std::pair<int, int>, int> edgeIds;
+    triangleIndices.resize(triangles.size());
+    triangleEdges.resize(triangles.size());
+
+    for (int t = 0; t < (int)triangles.size(); t++)
+    {
+        glm::ivec3 indices = glm::ivec3(triangles[t]->GetIndexP1(), triangles[t]->GetIndexP2(), triangles[t]->GetIndexP3());
+        triangleIndices[t] = indices;
+
+        for (int e = 0; e < 3; e++)
+        {
+            int a = indices[e];
+            int b = indices[(e + 1) % 3];
+            std::pair<int, int> key = std::make_pair(std::min(a, b), std::max(a, b));
+
+            if (edgeIds.find(key) == edgeIds.end())
+            {
+                edgeIds[key] = edges.size();
+                edges.push_back(glm::ivec2(key.first, key.second));
+                edgeTriangles.push_back(0);
+            }
+            triangleEdges[t][e] = edgeIds[key];
+            edgeTriangles[edgeIds[key]]++;
+        }
+    }
+    triangleTorn.assign(triangles.size(), 0);
+
+    // a tear adds an edge where it splits one, room for a new edge on every fourth
+    int maxEdges = edges.size() + edges.size() / 4;
+    edges.reserve(maxEdges);
+    edgeTriangles.reserve(maxEdges);
+    splitEdges.reserve(64);
+
+    // about two buckets per triangle, rounded up to a power of two
+    int tableSize = 1;
+    while (tableSize < 2 * (int)std::max(triangleIndices.size(), edges.size()))
+    {
+        tableSize *= 2;
+    }
+    bucketMask = tableSize - 1;
+
+    triangleHash.resize(tableSize);
+    edgeHash.resize(tableSize);
+    particleHash.resize(tableSize);
+    triangleMin.resize(triangleIndices.size());
+    triangleMax.resize(triangleIndices.size());
+    edgeMin.resize(edges.size());
+    edgeMax.resize(edges.size());
+    edgeMin.reserve(maxEdges);
+    edgeMax.reserve(maxEdges);
+    edgeCells.reserve(maxEdges);
+    edgeSlots.reserve(maxEdges);
+    edgeGroups.reserve(maxEdges);
+
+    Reset();
+}
+
+void SelfCollision::Reset()
+{
+    searched = false;
+    numSearches = 0;
+    numFullSearches = 0;
+    pointTriangleCandidates.clear();
+    edgeEdgeCandidates.clear();
+    pointTriangleContacts.clear();
+    edgeEdgeContacts.clear();
+}
+
+glm::ivec3 SelfCollision::CellOf(glm::vec3 position)
+{
+    return glm::ivec3(glm::floor(position / cellSize));
+}
+
+int SelfCollision::BucketOf(glm::ivec3 cell)
+{
+    // teschner et al. 2003, in unsigned arithmetic so the products wrap instead of overflowing
+    uint32_t hash = ((uint32_t)cell.x * 73856093u) ^ ((uint32_t)cell.y * 19349663u) ^ ((uint32_t)cell.z * 83492791u);
+    return (int)(hash & (uint32_t)bucketMask);
+}
+
+int SelfCollision::BucketsOf(glm::ivec3 low, glm::ivec3 high, int* buckets)
+{
+    int numBuckets = 0;
+    glm::ivec3 cell;
+    for (cell.z = low.z; cell.z <= high.z; cell.z++)
+    for (cell.y = low.y; cell.y <= high.y; cell.y++)
+    for (cell.x = low.x; cell.x <= high.x; cell.x++)
+    {
+        int bucket = BucketOf(cell);
+        if (std::find(buckets, buckets + numBuckets, bucket) == buckets + numBuckets)
+        {
+            buckets[numBuckets++] = bucket;
+        }
+    }
+    return numBuckets;
+}
+
+// a lower bound on the distance from p to the triangle abc: its distance from the plane and
+// how far outside the edges its projection lands, 0 for a degenerate triangle
+static float TriangleDistanceBound(glm::vec3 p, glm::vec3 a, glm::vec3 b, glm::vec3 c)
+{
+    glm::vec3 normal = glm::cross(b - a, c - a);
+    float doubleArea = glm::length(normal);
+    if (doubleArea < 1e-12f)
+    {
+        return 0.0f;
+    }
+    normal /= doubleArea;
+
+    // signed distance of the projection from each edge line, negative outside
+    glm::vec3 q = p - glm::dot(p - a, normal) * normal;
+    float outside = 0.0f;
+    outside = glm::max(outside, -glm::dot(glm::cross(b - q, c - q), normal) / glm::length(c - b));
+    outside = glm::max(outside, -glm::dot(glm::cross(c - q, a - q), normal) / glm::length(a - c));
+    outside = glm::max(outside, -glm::dot(glm::cross(a - q, b - q), normal) / glm::length(b - a));
+
+    float distance = glm::dot(p - a, normal);
+    return sqrtf(distance * distance + outside * outside);
+}
+
+// distance between the segments p1 p2 and q1 q2 (ericson, real-time collision detection 5.1.9)
+static float SegmentDistance(glm::vec3 p1, glm::vec3 p2, glm::vec3 q1, glm::vec3 q2)
+{
+    glm::vec3 d1 = p2 - p1;
+    glm::vec3 d2 = q2 - q1;
+    glm::vec3 r = p1 - q1;
+    float a = glm::dot(d1, d1);
+    float e = glm::dot(d2, d2);
+    float f = glm::dot(d2, r);
+
+    float s = 0.0f;
+    float t = 0.0f;
+    if (a < 1e-12f && e < 1e-12f)
+    {
+        return glm::length(r);
+    }
+    if (a < 1e-12f)
+    {
+        t = glm::clamp(f / e, 0.0f, 1.0f);
+    }
+    else
+    {
+        float c = glm::dot(d1, r);
+        if (e < 1e-12f)
+        {
+            s = glm::clamp(-c / a, 0.0f, 1.0f);
+        }
+        else
+        {
+            float b = glm::dot(d1, d2);
+            float denominator = a * e - b * b;
+            s = denominator > 0.0f ? glm::clamp((b * f - c * e) / denominator, 0.0f, 1.0f) : 0.0f;
+            t = (b * s + f) / e;
+            if (t < 0.0f)
+            {
+                t = 0.0f;
+                s = glm::clamp(-c / a, 0.0f, 1.0f);
+            }
+            else if (t > 1.0f)
+            {
+                t = 1.0f;
+                s = glm::clamp((b - c) / a, 0.0f, 1.0f);
+            }
+        }
+    }
+    return glm::length((p1 + s * d1) - (q1 + t * d2));
+}
+
+// diagonal of the bounds of two boxes together, and the distance between them
+static float Diagonal(glm::vec3 minA, glm::vec3 maxA, glm::vec3 minB, glm::vec3 maxB)
+{
+    return glm::length(glm::max(maxA, maxB) - glm::min(minA, minB));
+}
+
+static float Gap(glm::vec3 minA, glm::vec3 maxA, glm::vec3 minB, glm::vec3 maxB)
+{
+    return glm::length(glm::max(glm::vec3(0.0f), glm::max(minA - maxB, minB - maxA)));
+}
+
+static bool CompareCandidate(const glm::ivec2& a, const glm::ivec2& b)
+{
+    return a.x != b.x ? a.x < b.x : a.y < b.y;
+}
+
+bool SelfCollision::NeedsSearch(ThreadPool* pool)
+{
+    int numParticles = positions.size();
+    if (!searched || (int)searchPositions.size() != numParticles)
+    {
+        return true;
+    }
+
+    // bounds of the displacements of each group since the search
+    int numGroups = groupMin.size();
+    pool->ParallelFor(numGroups, 16, [&](int begin, int end)
+    {
+        for (int g = begin; g < end; g++)
+        {
+            glm::vec3 lower(FLT_MAX);
+            glm::vec3 upper(-FLT_MAX);
+            for (int k = groupStart[g]; k < groupStart[g + 1]; k++)
+            {
+                int i = groupParticles[k];
+                glm::vec3 displacement = positions[i] - searchPositions[i];
+                lower = glm::min(lower, displacement);
+                upper = glm::max(upper, displacement);
+            }
+            displacementMin[g] = lower;
+            displacementMax[g] = upper;
+        }
+    });
+
+    // two particles of two groups have moved closer by at most the diagonal of both groups'
+    // displacement bounds. a group that moved against a near group (itself included) by more
+    // than the pair allows is dirty
+    pool->ParallelFor(numGroups, 16, [&](int begin, int end)
+    {
+        for (int g1 = begin; g1 < end; g1++)
+        {
+            groupDirty[g1] = 0;
+            for (int k = nearStart[g1]; k < nearStart[g1 + 1] && !groupDirty[g1]; k++)
+            {
+                int g2 = nearGroups[k];
+                float moved = Diagonal(displacementMin[g1], displacementMax[g1], displacementMin[g2], displacementMax[g2]);
+                groupDirty[g1] = moved >= nearAllowance[k];
+            }
+        }
+    });
+
+    // groups that weren't near are far enough apart as long as they stay further apart than the
+    // reach of two triangles and the thickness, which they do unless the displacements spread
+    // over the near distance. otherwise the ones that came closer are dirty
+    glm::vec3 lower(FLT_MAX);
+    glm::vec3 upper(-FLT_MAX);
+    for (int g = 0; g < numGroups; g++)
+    {
+        lower = glm::min(lower, displacementMin[g]);
+        upper = glm::max(upper, displacementMax[g]);
+    }
+    if (glm::length(upper - lower) < NEAR_GROUPS * groupSize)
+    {
+        groupPairs.clear();
+    }
+    else
+    {
+        for (int g = 0; g < numGroups; g++)
+        {
+            sweepMin[g] = groupMin[g] + displacementMin[g];
+            sweepMax[g] = groupMax[g] + displacementMax[g];
+        }
+        FindGroupPairs(2.0f * largestTriangle + thickness, groupPairs);
+    }
+    for (glm::ivec2 pair : groupPairs)
+    {
+        std::vector<int>::iterator rowEnd = nearGroups.begin() + nearStart[pair.x + 1];
+        if (std::find(nearGroups.begin() + nearStart[pair.x], rowEnd, pair.y) == rowEnd)
+        {
+            groupDirty[pair.x] = 1;
+            groupDirty[pair.y] = 1;
+        }
+    }
+
+    bool dirty = false;
+    for (int g = 0; g < numGroups; g++)
+    {
+        dirty |= groupDirty[g] != 0;
+    }
+    if (!dirty)
+    {
+        return false;
+    }
+
+    // the groups that have moved half of what a pair allows would be dirty again a few steps
+    // later, so they are searched along while the boxes and hashes are being updated anyway
+    pool->ParallelFor(numGroups, 16, [&](int begin, int end)
+    {
+        for (int g1 = begin; g1 < end; g1++)
+        {
+            for (int k = nearStart[g1]; k < nearStart[g1 + 1] && !groupDirty[g1]; k++)
+            {
+                int g2 = nearGroups[k];
+                float moved = Diagonal(displacementMin[g1], displacementMax[g1], displacementMin[g2], displacementMax[g2]);
+                groupDirty[g1] = moved >= 0.5f * nearAllowance[k];
+            }
+        }
+    });
+    return true;
+}
+
+void SelfCollision::GroupParticles(ThreadPool* pool)
+{
+    int numParticles = positions.size();
+
+    // the occupied coarse cells become the groups, cells are doubled until there are few enough
+    // for the near lists to be built from every two of them
+    groupSize = GROUP_CELLS * cellSize;
+    particleKeys.resize(numParticles);
+    while (true)
+    {
+        // a key per coarse cell, 21 bits an axis
+        pool->ParallelFor(numParticles, 1024, [&](int begin, int end)
+        {
+            for (int i = begin; i < end; i++)
+            {
+                glm::ivec3 cell = glm::ivec3(glm::floor(positions[i] / groupSize)) + glm::ivec3(1 << 20);
+                particleKeys[i] = ((long long)(cell.x & 0x1fffff) << 42) | ((long long)(cell.y & 0x1fffff) << 21) | (long long)(cell.z & 0x1fffff);
+            }
+        });
+
+        groupKeys = particleKeys;
+        std::sort(groupKeys.begin(), groupKeys.end());
+        groupKeys.erase(std::unique(groupKeys.begin(), groupKeys.end()), groupKeys.end());
+        if (groupKeys.size() <= MAX_GROUPS)
+        {
+            break;
+        }
+        groupSize *= 2.0f;
+    }
+    int numGroups = groupKeys.size();
+
+    particleGroups.resize(numParticles);
+    pool->ParallelFor(numParticles, 1024, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            particleGroups[i] = std::lower_bound(groupKeys.begin(), groupKeys.end(), particleKeys[i]) - groupKeys.begin();
+        }
+    });
+
+    // counting sort the particles by group
+    groupStart.assign(numGroups + 1, 0);
+    for (int i = 0; i < numParticles; i++)
+    {
+        groupStart[particleGroups[i] + 1]++;
+    }
+    for (int g = 0; g < numGroups; g++)
+    {
+        groupStart[g + 1] += groupStart[g];
+    }
+    groupParticles.resize(numParticles);
+    for (int i = 0; i < numParticles; i++)
+    {
+        groupParticles[groupStart[particleGroups[i]]++] = i;
+    }
+    for (int g = numGroups; g > 0; g--)
+    {
+        groupStart[g] = groupStart[g - 1];
+    }
+    groupStart[0] = 0;
+
+    groupMin.resize(numGroups);
+    groupMax.resize(numGroups);
+    displacementMin.resize(numGroups);
+    displacementMax.resize(numGroups);
+    // triangles and edges go with the group of their first particle
+    triangleGroups.resize(triangleIndices.size());
+    for (int t = 0; t < (int)triangleIndices.size(); t++)
+    {
+        triangleGroups[t] = particleGroups[triangleIndices[t].x];
+    }
+    edgeGroups.resize(edges.size());
+    for (int e = 0; e < (int)edges.size(); e++)
+    {
+        edgeGroups[e] = particleGroups[edges[e].x];
+    }
+
+    groupDirty.assign(numGroups, 0);
+    sweepMin.resize(numGroups);
+    sweepMax.resize(numGroups);
+    nearStart.assign(numGroups + 1, 0);
+    nearGroups.clear();
+    nearSlack.clear();
+}
+
+void SelfCollision::FindGroupPairs(float distance, std::vector<glm::ivec2>& pairs)
+{
+    // sweep over the bounds in sweepMin and sweepMax along the axis they spread out the most on
+    // (a sheet of cloth is thin on the others), each pair once with the lower group first, a
+    // group with itself too
+    int numGroups = sweepMin.size();
+    glm::vec3 lower(FLT_MAX);
+    glm::vec3 upper(-FLT_MAX);
+    sweepOrder.resize(numGroups);
+    for (int g = 0; g < numGroups; g++)
+    {
+        sweepOrder[g] = g;
+        lower = glm::min(lower, sweepMin[g]);
+        upper = glm::max(upper, sweepMin[g]);
+    }
+    glm::vec3 spread = upper - lower;
+    int axis = spread.x >= spread.y && spread.x >= spread.z ? 0 : (spread.y >= spread.z ? 1 : 2);
+    std::sort(sweepOrder.begin(), sweepOrder.end(), [&](int a, int b)
+    {
+        return sweepMin[a][axis] < sweepMin[b][axis];
+    });
+
+    // the bounds in that order, so the sweep reads them one after another
+    sortedMin.resize(numGroups);
+    sortedMax.resize(numGroups);
+    for (int a = 0; a < numGroups; a++)
+    {
+        sortedMin[a] = sweepMin[sweepOrder[a]];
+        sortedMax[a] = sweepMax[sweepOrder[a]];
+    }
+
+    pairs.clear();
+    for (int a = 0; a < numGroups; a++)
+    {
+        glm::vec3 min1 = sortedMin[a];
+        glm::vec3 max1 = sortedMax[a];
+        float limit = max1[axis] + distance;
+        for (int b = a; b < numGroups && sortedMin[b][axis] < limit; b++)
+        {
+            // most are as far apart on another axis alone
+            glm::vec3 gap = glm::max(glm::vec3(0.0f), glm::max(min1 - sortedMax[b], sortedMin[b] - max1));
+            if (glm::any(glm::greaterThanEqual(gap, glm::vec3(distance))) || glm::length(gap) >= distance)
+            {
+                continue;
+            }
+            int g1 = sweepOrder[a];
+            int g2 = sweepOrder[b];
+            pairs.push_back(glm::ivec2(glm::min(g1, g2), glm::max(g1, g2)));
+        }
+    }
+}
+
+void SelfCollision::UpdateGroups(ThreadPool* pool, bool full, float slack)
+{
+    int numGroups = groupMin.size();
+
+    // pairs of groups that were searched again get the whole slack back, the others keep what
+    // is left of theirs after how much they moved since
+    if (!full)
+    {
+        pool->ParallelFor(numGroups, 16, [&](int begin, int end)
+        {
+            for (int g1 = begin; g1 < end; g1++)
+            {
+                for (int k = nearStart[g1]; k < nearStart[g1 + 1]; k++)
+                {
+                    int g2 = nearGroups[k];
+                    if (groupDirty[g1] || groupDirty[g2])
+                    {
+                        nearSlack[k] = slack;
+                    }
+                    else
+                    {
+                        nearSlack[k] -= Diagonal(displacementMin[g1], displacementMax[g1], displacementMin[g2], displacementMax[g2]);
+                    }
+                }
+            }
+        });
+    }
+
+    pool->ParallelFor(numGroups, 16, [&](int begin, int end)
+    {
+        for (int g = begin; g < end; g++)
+        {
+            glm::vec3 lower(FLT_MAX);
+            glm::vec3 upper(-FLT_MAX);
+            for (int k = groupStart[g]; k < groupStart[g + 1]; k++)
+            {
+                lower = glm::min(lower, positions[groupParticles[k]]);
+                upper = glm::max(upper, positions[groupParticles[k]]);
+            }
+            groupMin[g] = lower;
+            groupMax[g] = upper;
+        }
+    });
+
+    // the groups closer than the reach plus NEAR_GROUPS group sizes are near now. a pair that
+    // was near keeps its slack, one that wasn't was at least the near distance further apart
+    // than the reach at the last search and keeps that less how much it moved since. a pair
+    // searched again has the slack either way
+    float reach = 2.0f * largestTriangle + thickness;
+    float nearDistance = NEAR_GROUPS * groupSize;
+    sweepMin = groupMin;
+    sweepMax = groupMax;
+    FindGroupPairs(reach + nearDistance, groupPairs);
+
+    // both ways round, a row per group
+    newNearStart.assign(numGroups + 1, 0);
+    for (glm::ivec2 pair : groupPairs)
+    {
+        newNearStart[pair.x + 1]++;
+        newNearStart[pair.y + 1] += pair.x != pair.y;
+    }
+    for (int g = 0; g < numGroups; g++)
+    {
+        newNearStart[g + 1] += newNearStart[g];
+    }
+    newNearGroups.resize(newNearStart[numGroups]);
+    for (glm::ivec2 pair : groupPairs)
+    {
+        newNearGroups[newNearStart[pair.x]++] = pair.y;
+        if (pair.x != pair.y)
+        {
+            newNearGroups[newNearStart[pair.y]++] = pair.x;
+        }
+    }
+    for (int g = numGroups; g > 0; g--)
+    {
+        newNearStart[g] = newNearStart[g - 1];
+    }
+    newNearStart[0] = 0;
+
+    // the old row of each group is spread over nearIndex to look the pairs up in
+    newNearSlack.resize(newNearGroups.size());
+    nearIndex.assign(numGroups, -1);
+    for (int g1 = 0; g1 < numGroups; g1++)
+    {
+        if (!full)
+        {
+            for (int k = nearStart[g1]; k < nearStart[g1 + 1]; k++)
+            {
+                nearIndex[nearGroups[k]] = k;
+            }
+        }
+        for (int k = newNearStart[g1]; k < newNearStart[g1 + 1]; k++)
+        {
+            int g2 = newNearGroups[k];
+            if (full || groupDirty[g1] || groupDirty[g2])
+            {
+                newNearSlack[k] = slack;
+            }
+            else if (nearIndex[g2] >= 0)
+            {
+                newNearSlack[k] = nearSlack[nearIndex[g2]];
+            }
+            else
+            {
+                newNearSlack[k] = nearDistance - Diagonal(displacementMin[g1], displacementMax[g1], displacementMin[g2], displacementMax[g2]);
+            }
+        }
+        if (!full)
+        {
+            for (int k = nearStart[g1]; k < nearStart[g1 + 1]; k++)
+            {
+                nearIndex[nearGroups[k]] = -1;
+            }
+        }
+    }
+    nearStart.swap(newNearStart);
+    nearGroups.swap(newNearGroups);
+    nearSlack.swap(newNearSlack);
+
+    // a near miss gets closer by at most how far one of its particles moves against another, so
+    // the groups of every two of them are left no more slack than it has
+    for (NearMiss miss : pointTriangleMisses)
+    {
+        glm::ivec3 indices = triangleIndices[miss.pair.y];
+        int group = particleGroups[miss.pair.x];
+        LowerSlack(group, particleGroups[indices.x], miss.slack);
+        LowerSlack(group, particleGroups[indices.y], miss.slack);
+        LowerSlack(group, particleGroups[indices.z], miss.slack);
+    }
+    for (NearMiss miss : edgeEdgeMisses)
+    {
+        glm::ivec2 endsA = edges[miss.pair.x];
+        glm::ivec2 endsB = edges[miss.pair.y];
+        LowerSlack(particleGroups[endsA.x], particleGroups[endsB.x], miss.slack);
+        LowerSlack(particleGroups[endsA.x], particleGroups[endsB.y], miss.slack);
+        LowerSlack(particleGroups[endsA.y], particleGroups[endsB.x], miss.slack);
+        LowerSlack(particleGroups[endsA.y], particleGroups[endsB.y], miss.slack);
+    }
+
+    // a pair of triangles or edges with particles in two groups is at least the groups' distance
+    // less two triangles apart, and if it isn't a candidate at least the thickness plus the
+    // slack the two groups have left
+    nearAllowance.resize(nearGroups.size());
+    pool->ParallelFor(numGroups, 16, [&](int begin, int end)
+    {
+        for (int g1 = begin; g1 < end; g1++)
+        {
+            for (int k = nearStart[g1]; k < nearStart[g1 + 1]; k++)
+            {
+                int g2 = nearGroups[k];
+                float gap = Gap(groupMin[g1], groupMax[g1], groupMin[g2], groupMax[g2]);
+                nearAllowance[k] = glm::max(nearSlack[k], gap - reach);
+            }
+        }
+    });
+}
+
+void SelfCollision::LowerSlack(int group1, int group2, float slack)
+{
+    // both ways round. the groups of a miss are always near, its particles are closer than two
+    // triangles and the search distance
+    for (int k = nearStart[group1]; k < nearStart[group1 + 1]; k++)
+    {
+        if (nearGroups[k] == group2)
+        {
+            nearSlack[k] = glm::min(nearSlack[k], slack);
+            break;
+        }
+    }
+    for (int k = nearStart[group2]; k < nearStart[group2 + 1] && group1 != group2; k++)
+    {
+        if (nearGroups[k] == group1)
+        {
+            nearSlack[k] = glm::min(nearSlack[k], slack);
+            break;
+        }
+    }
+}
+
+void SelfCollision::ComputeBoxes(ThreadPool* pool, float distance)
+{
+    int numTriangles = triangleIndices.size();
+    int numEdges = edges.size();
+
+    // triangle boxes are queried with points, so they take the whole distance. edge boxes are
+    // queried with each other and take half each
+    pool->ParallelFor(numTriangles, 512, [&](int begin, int end)
+    {
+        for (int t = begin; t < end; t++)
+        {
+            glm::vec3 a = positions[triangleIndices[t].x];
+            glm::vec3 b = positions[triangleIndices[t].y];
+            glm::vec3 c = positions[triangleIndices[t].z];
+
+            triangleMin[t] = glm::min(a, glm::min(b, c)) - glm::vec3(distance);
+            triangleMax[t] = glm::max(a, glm::max(b, c)) + glm::vec3(distance);
+        }
+    });
+    pool->ParallelFor(numEdges, 512, [&](int begin, int end)
+    {
+        for (int e = begin; e < end; e++)
+        {
+            glm::vec3 a = positions[edges[e].x];
+            glm::vec3 b = positions[edges[e].y];
+
+            edgeMin[e] = glm::min(a, b) - glm::vec3(0.5f * distance);
+            edgeMax[e] = glm::max(a, b) + glm::vec3(0.5f * distance);
+        }
+    });
+
+    // queries look this far around a box for the centres of other boxes
+    largestTriangleHalfExtent = glm::vec3(0.0f);
+    for (int t = 0; t < numTriangles; t++)
+    {
+        largestTriangleHalfExtent = glm::max(largestTriangleHalfExtent, 0.5f * (triangleMax[t] - triangleMin[t]));
+    }
+    largestEdgeHalfExtent = glm::vec3(0.0f);
+    for (int e = 0; e < numEdges; e++)
+    {
+        largestEdgeHalfExtent = glm::max(largestEdgeHalfExtent, 0.5f * (edgeMax[e] - edgeMin[e]));
+    }
+
+    // keep cells at least as big as any box so a query never spans more than a few cells
+    glm::vec3 largest = 2.0f * glm::max(largestTriangleHalfExtent, largestEdgeHalfExtent);
+    float largestBox = glm::max(largest.x, glm::max(largest.y, largest.z));
+    if (largestBox > cellSize)
+    {
+        // every cell changes, so the hashes start over
+        cellSize = largestBox * 1.25f;
+        ClearHash(triangleCells, triangleSlots, triangleHash);
+        ClearHash(edgeCells, edgeSlots, edgeHash);
+        ClearHash(particleCells, particleSlots, particleHash);
+    }
+}
+
+void SelfCollision::ClearHash(std::vector<glm::ivec3>& cells, std::vector<int>& slots, std::vector<std::vector<HashEntry>>& hash)
+{
+    for (int b = 0; b <= bucketMask; b++)
+    {
+        hash[b].clear();
+    }
+    slots.assign(cells.size(), -1);
+}
+
+void SelfCollision::UpdateHash(const std::vector<glm::vec3>& boxMin, const std::vector<glm::vec3>& boxMax, const std::vector<int>& groups, bool all, std::vector<glm::ivec3>& cells, std::vector<int>& slots, std::vector<std::vector<HashEntry>>& hash)
+{
+    int numItems = boxMin.size();
+    cells.resize(numItems);
+    slots.resize(numItems, -1);
+
+    // only the items the search can find have to be where they are now, the others stay where
+    // they were last put (queries check the box again). of those only the items whose cell
+    // changed move to another bucket, the rest get the new box in place
+    for (int i = 0; i < numItems; i++)
+    {
+        if (!all && !groupInRegion[groups[i]])
+        {
+            continue;
+        }
+
+        glm::ivec3 cell = CellOf(0.5f * (boxMin[i] + boxMax[i]));
+        if (slots[i] >= 0 && cell == cells[i])
+        {
+            HashEntry& entry = hash[BucketOf(cell)][slots[i]];
+            entry.boxMin = boxMin[i];
+            entry.boxMax = boxMax[i];
+            continue;
+        }
+
+        // the last entry of the old bucket takes the place of this one
+        if (slots[i] >= 0)
+        {
+            std::vector<HashEntry>& bucket = hash[BucketOf(cells[i])];
+            bucket[slots[i]] = bucket.back();
+            slots[bucket.back().item] = slots[i];
+            bucket.pop_back();
+        }
+
+        HashEntry entry;
+        entry.item = i;
+        entry.boxMin = boxMin[i];
+        entry.boxMax = boxMax[i];
+        std::vector<HashEntry>& bucket = hash[BucketOf(cell)];
+        slots[i] = bucket.size();
+        bucket.push_back(entry);
+        cells[i] = cell;
+    }
+}
+
+void SelfCollision::JoinCandidates(int numChunks, std::vector<glm::ivec2>& candidates, std::vector<NearMiss>& misses)
+{
+    misses.clear();
+    for (int c = 0; c < numChunks; c++)
+    {
+        candidates.insert(candidates.end(), chunkCandidates[c].begin(), chunkCandidates[c].end());
+        misses.insert(misses.end(), chunkMisses[c].begin(), chunkMisses[c].end());
+    }
+
+    // sorted, so a partial search ends up with the same lists as a full one
+    std::sort(candidates.begin(), candidates.end(), CompareCandidate);
+}
+
+void SelfCollision::FindPointTriangleCandidates(ThreadPool* pool, float distance, float searchDistance, bool full)
+{
+    int numParticles = positions.size();
+    int numTriangles = triangleIndices.size();
+    int numParticleChunks = (numParticles + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    int numTriangleChunks = full ? 0 : (numTriangles + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    chunkCandidates.resize(std::max((int)chunkCandidates.size(), numParticleChunks + numTriangleChunks));
+    chunkMisses.resize(chunkCandidates.size());
+
+    // dirty particles look for the triangles around them, dirty triangles for the clean particles
+    // around them (dirty ones already found them)
+    pool->ParallelFor(numParticleChunks + numTriangleChunks, 1, [&](int begin, int end)
+    {
+        for (int chunk = begin; chunk < end; chunk++)
+        {
+            std::vector<glm::ivec2>& found = chunkCandidates[chunk];
+            std::vector<NearMiss>& missed = chunkMisses[chunk];
+            found.clear();
+            missed.clear();
+
+            if (chunk < numParticleChunks)
+            {
+                int last = glm::min((chunk + 1) * CHUNK_SIZE, numParticles);
+                for (int i = chunk * CHUNK_SIZE; i < last; i++)
+                {
+                    if (!particleDirty[i])
+                    {
+                        continue;
+                    }
+                    glm::vec3 p = positions[i];
+                    int origin = particleOrigin[i];
+
+                    // a box containing the particle has its centre within the largest half extent
+                    int buckets[QUERY_BUCKETS];
+                    int numBuckets = BucketsOf(CellOf(p - largestTriangleHalfExtent), CellOf(p + largestTriangleHalfExtent), buckets);
+                    for (int b = 0; b < numBuckets; b++)
+                    {
+                        for (const HashEntry& entry : triangleHash[buckets[b]])
+                        {
+                            // reject against the thickened box before any cross products. the box
+                            // of an entry outside the region may be old, so it is checked again
+                            if (glm::any(glm::lessThan(p, entry.boxMin)) || glm::any(glm::greaterThan(p, entry.boxMax)))
+                            {
+                                continue;
+                            }
+                            int t = entry.item;
+                            if (glm::any(glm::lessThan(p, triangleMin[t])) || glm::any(glm::greaterThan(p, triangleMax[t])))
+                            {
+                                continue;
+                            }
+
+                            // a particle can't collide with a triangle it (or a particle split off
+                            // the same one) belongs to, or a torn one
+                            glm::ivec3 indices = triangleIndices[t];
+                            if (triangleTorn[t] || particleOrigin[indices.x] == origin || particleOrigin[indices.y] == origin || particleOrigin[indices.z] == origin)
+                            {
+                                continue;
+                            }
+
+                            float bound = TriangleDistanceBound(p, positions[indices.x], positions[indices.y], positions[indices.z]);
+                            if (bound < distance)
+                            {
+                                found.push_back(glm::ivec2(i, t));
+                            }
+                            else if (bound < searchDistance)
+                            {
+                                missed.push_back({ glm::ivec2(i, t), bound - thickness });
+                            }
+                        }
+                    }
+                }
+            }
+            else
+            {
+                int first = (chunk - numParticleChunks) * CHUNK_SIZE;
+                int last = glm::min(first + CHUNK_SIZE, numTriangles);
+                for (int t = first; t < last; t++)
+                {
+                    glm::ivec3 indices = triangleIndices[t];
+                    if (triangleTorn[t] || (!particleDirty[indices.x] && !particleDirty[indices.y] && !particleDirty[indices.z]))
+                    {
+                        continue;
+                    }
+                    glm::ivec3 origins(particleOrigin[indices.x], particleOrigin[indices.y], particleOrigin[indices.z]);
+
+                    // particles are points, so only the cells the box covers
+                    glm::vec3 boxMin = triangleMin[t];
+                    glm::vec3 boxMax = triangleMax[t];
+                    int buckets[QUERY_BUCKETS];
+                    int numBuckets = BucketsOf(CellOf(boxMin), CellOf(boxMax), buckets);
+                    for (int b = 0; b < numBuckets; b++)
+                    {
+                        for (const HashEntry& entry : particleHash[buckets[b]])
+                        {
+                            if (glm::any(glm::lessThan(entry.boxMin, boxMin)) || glm::any(glm::greaterThan(entry.boxMin, boxMax)))
+                            {
+                                continue;
+                            }
+                            int i = entry.item;
+                            glm::vec3 p = positions[i];
+                            if (particleDirty[i] || glm::any(glm::lessThan(p, boxMin)) || glm::any(glm::greaterThan(p, boxMax)))
+                            {
+                                continue;
+                            }
+                            int origin = particleOrigin[i];
+                            if (origins.x == origin || origins.y == origin || origins.z == origin)
+                            {
+                                continue;
+                            }
+
+                            float bound = TriangleDistanceBound(p, positions[indices.x], positions[indices.y], positions[indices.z]);
+                            if (bound < distance)
+                            {
+                                found.push_back(glm::ivec2(i, t));
+                            }
+                            else if (bound < searchDistance)
+                            {
+                                missed.push_back({ glm::ivec2(i, t), bound - thickness });
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    // keep what was found between clean particles and clean triangles
+    int kept = 0;
+    if (!full)
+    {
+        for (int k = 0; k < (int)pointTriangleCandidates.size(); k++)
+        {
+            glm::ivec2 candidate = pointTriangleCandidates[k];
+            glm::ivec3 indices = triangleIndices[candidate.y];
+            if (!particleDirty[candidate.x] && !particleDirty[indices.x] && !particleDirty[indices.y] && !particleDirty[indices.z])
+            {
+                pointTriangleCandidates[kept++] = candidate;
+            }
+        }
+    }
+    pointTriangleCandidates.resize(kept);
+    JoinCandidates(numParticleChunks + numTriangleChunks, pointTriangleCandidates, pointTriangleMisses);
+}
+
+void SelfCollision::FindEdgeEdgeCandidates(ThreadPool* pool, float distance, float searchDistance, bool full)
+{
+    int numEdges = edges.size();
+    int numChunks = (numEdges + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    chunkCandidates.resize(std::max((int)chunkCandidates.size(), numChunks));
+    chunkMisses.resize(chunkCandidates.size());
+
+    // edges of torn triangles only are gone, the others are dirty with a dirty particle
+    edgeDirty.resize(numEdges);
+    pool->ParallelFor(numEdges, 1024, [&](int begin, int end)
+    {
+        for (int e = begin; e < end; e++)
+        {
+            edgeDirty[e] = edgeTriangles[e] != 0 && (particleDirty[edges[e].x] || particleDirty[edges[e].y]);
+        }
+    });
+
+    pool->ParallelFor(numChunks, 1, [&](int begin, int end)
+    {
+        for (int chunk = begin; chunk < end; chunk++)
+        {
+            std::vector<glm::ivec2>& found = chunkCandidates[chunk];
+            std::vector<NearMiss>& missed = chunkMisses[chunk];
+            found.clear();
+            missed.clear();
+
+            int last = glm::min((chunk + 1) * CHUNK_SIZE, numEdges);
+            for (int e1 = chunk * CHUNK_SIZE; e1 < last; e1++)
+            {
+                if (!edgeDirty[e1])
+                {
+                    continue;
+                }
+                glm::ivec2 ends1 = edges[e1];
+                glm::ivec2 origins1(particleOrigin[ends1.x], particleOrigin[ends1.y]);
+                glm::vec3 box1Min = edgeMin[e1];
+                glm::vec3 box1Max = edgeMax[e1];
+
+                // a box overlapping this one has its centre within the largest half extent of it
+                int buckets[QUERY_BUCKETS];
+                int numBuckets = BucketsOf(CellOf(box1Min - largestEdgeHalfExtent), CellOf(box1Max + largestEdgeHalfExtent), buckets);
+                for (int b = 0; b < numBuckets; b++)
+                {
+                    for (const HashEntry& entry : edgeHash[buckets[b]])
+                    {
+                        // only edges with an overlapping box, before anything else about the edge
+                        // is looked up (and the box again if it is old)
+                        if (glm::any(glm::greaterThan(box1Min, entry.boxMax)) || glm::any(glm::greaterThan(entry.boxMin, box1Max)))
+                        {
+                            continue;
+                        }
+                        // a pair of dirty edges is found from its lower edge
+                        int e2 = entry.item;
+                        if (e2 == e1 || (e2 < e1 && edgeDirty[e2]) || edgeTriangles[e2] == 0 || glm::any(glm::greaterThan(box1Min, edgeMax[e2])) || glm::any(glm::greaterThan(edgeMin[e2], box1Max)))
+                        {
+                            continue;
+                        }
+
+                        // edges meeting at a particle (or at two split off the same one) are adjacent
+                        glm::ivec2 ends2 = edges[e2];
+                        glm::ivec2 origins2(particleOrigin[ends2.x], particleOrigin[ends2.y]);
+                        if (origins1.x == origins2.x || origins1.x == origins2.y || origins1.y == origins2.x || origins1.y == origins2.y)
+                        {
+                            continue;
+                        }
+
+                        float between = SegmentDistance(positions[ends1.x], positions[ends1.y], positions[ends2.x], positions[ends2.y]);
+                        if (between < distance)
+                        {
+                            found.push_back(glm::ivec2(glm::min(e1, e2), glm::max(e1, e2)));
+                        }
+                        else if (between < searchDistance)
+                        {
+                            missed.push_back({ glm::ivec2(glm::min(e1, e2), glm::max(e1, e2)), between - thickness });
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    // keep what was found between clean edges
+    int kept = 0;
+    if (!full)
+    {
+        for (int k = 0; k < (int)edgeEdgeCandidates.size(); k++)
+        {
+            glm::ivec2 candidate = edgeEdgeCandidates[k];
+            glm::ivec2 endsA = edges[candidate.x];
+            glm::ivec2 endsB = edges[candidate.y];
+            if (!particleDirty[endsA.x] && !particleDirty[endsA.y] && !particleDirty[endsB.x] && !particleDirty[endsB.y])
+            {
+                edgeEdgeCandidates[kept++] = candidate;
+            }
+        }
+    }
+    edgeEdgeCandidates.resize(kept);
+    JoinCandidates(numChunks, edgeEdgeCandidates, edgeEdgeMisses);
+}
+
+void SelfCollision::Search(ThreadPool* pool)
+{
+    int numParticles = positions.size();
+    float distance = thickness + margin;
+    // the search looks further than the candidates go, the pairs it finds in between tell how
+    // much slack the groups really have. flat cloth usually has none that close, then the groups
+    // get more than the margin and are searched less often
+    float searchDistance = thickness + 2.5f * margin;
+
+    // everything is searched the first time, after the particles changed and once most of the
+    // cloth is dirty. otherwise only the pairs with a particle in a dirty group
+    bool full = !searched || (int)searchPositions.size() != numParticles;
+    particleDirty.resize(numParticles);
+    if (!full)
+    {
+        int numDirty = 0;
+        for (int g = 0; g < (int)groupMin.size(); g++)
+        {
+            for (int k = groupStart[g]; k < groupStart[g + 1]; k++)
+            {
+                particleDirty[groupParticles[k]] = groupDirty[g];
+            }
+            numDirty += groupDirty[g] ? groupStart[g + 1] - groupStart[g] : 0;
+        }
+        full = 2 * numDirty > numParticles;
+    }
+    if (full)
+    {
+        particleDirty.assign(numParticles, 1);
+    }
+
+    ComputeBoxes(pool, searchDistance);
+
+    // a partial search only looks around the dirty particles: the dirty triangles and edges are
+    // within a box of a dirty group, what they find within another and its centre within half a
+    // box more. every item has its centre within half a box of its particles, so only the items
+    // of groups that close to a dirty one have to be in the hashes where they are now
+    if (!full)
+    {
+        glm::vec3 reach = 4.0f * glm::max(largestTriangleHalfExtent, largestEdgeHalfExtent);
+        int numGroups = groupMin.size();
+        groupInRegion.assign(numGroups, 0);
+        for (int d = 0; d < numGroups; d++)
+        {
+            if (!groupDirty[d])
+            {
+                continue;
+            }
+            glm::vec3 regionMin = groupMin[d] + displacementMin[d] - reach;
+            glm::vec3 regionMax = groupMax[d] + displacementMax[d] + reach;
+            for (int g = 0; g < numGroups; g++)
+            {
+                groupInRegion[g] |= !glm::any(glm::greaterThan(groupMin[g] + displacementMin[g], regionMax)) && !glm::any(glm::greaterThan(regionMin, groupMax[g] + displacementMax[g]));
+            }
+        }
+    }
+
+    UpdateHash(triangleMin, triangleMax, triangleGroups, full, triangleCells, triangleSlots, triangleHash);
+    UpdateHash(edgeMin, edgeMax, edgeGroups, full, edgeCells, edgeSlots, edgeHash);
+    if (!full)
+    {
+        // the particles as points, for the dirty triangles to find the clean ones
+        UpdateHash(positions, positions, particleGroups, full, particleCells, particleSlots, particleHash);
+    }
+
+    FindPointTriangleCandidates(pool, distance, searchDistance, full);
+    FindEdgeEdgeCandidates(pool, distance, searchDistance, full);
+
+    // the boxes are thickened by the search distance on every side
+    largestTriangle = glm::length(glm::max(2.0f * largestTriangleHalfExtent - glm::vec3(2.0f * searchDistance), glm::vec3(0.0f)));
+    if (full)
+    {
+        GroupParticles(pool);
+    }
+    UpdateGroups(pool, full, searchDistance - thickness);
+
+    searchPositions = positions;
+    searched = true;
+    numSearches++;
+    numFullSearches += full;
+}
+
+bool SelfCollision::TestPointTriangle(int particle, int triangle, PointTriangleContact& contact)
+{
+    glm::ivec3 indices = triangleIndices[triangle];
+    glm::vec3 p = positions[particle];
+    glm::vec3 a = positions[indices.x];
+    glm::vec3 b = positions[indices.y];
+    glm::vec3 c = positions[indices.z];
+
+    glm::vec3 normal = glm::cross(b - a, c - a);
+    float doubleArea = glm::length(normal);
+    if (doubleArea < 1e-12f)
+    {
+        return false;
+    }
+    normal /= doubleArea;
+
+    float distance = glm::dot(p - a, normal);
+    if (fabs(distance) >= thickness)
+    {
+        return false;
+    }
+
+    // barycentric coordinates of the projected point
+    glm::vec3 q = p - distance * normal;
+    float wa = glm::dot(glm::cross(b - q, c - q), normal) / doubleArea;
+    float wb = glm::dot(glm::cross(c - q, a - q), normal) / doubleArea;
+    float wc = 1.0f - wa - wb;
+    if (wa < 0.0f || wb < 0.0f || wc < 0.0f)
+    {
+        return false;
+    }
+
+    contact.particle = particle;
+    contact.triangle = triangle;
+    contact.barycentric = glm::vec3(wa, wb, wc);
+    // push the particle out on the side it is already on
+    contact.normal = distance >= 0.0f ? normal : -normal;
+    return true;
+}
+
+bool SelfCollision::TestEdges(int edgeA, int edgeB, EdgeEdgeContact& contact)
+{
+    glm::vec3 p1 = positions[edges[edgeA].x];
+    glm::vec3 p2 = positions[edges[edgeA].y];
+    glm::vec3 q1 = positions[edges[edgeB].x];
+    glm::vec3 q2 = positions[edges[edgeB].y];
+
+    // boxes further apart than the thickness can't touch
+    glm::vec3 gap = glm::max(glm::min(p1, p2) - glm::max(q1, q2), glm::min(q1, q2) - glm::max(p1, p2));
+    if (glm::any(glm::greaterThanEqual(gap, glm::vec3(thickness))))
+    {
+        return false;
+    }
+
+    // closest points between the two segments
+    glm::vec3 d1 = p2 - p1;
+    glm::vec3 d2 = q2 - q1;
+    glm::vec3 r = p1 - q1;
+    float a = glm::dot(d1, d1);
+    float b = glm::dot(d1, d2);
+    float c = glm::dot(d2, d2);
+    float d = glm::dot(d1, r);
+    float f = glm::dot(d2, r);
+    float denominator = a * c - b * b;
+
+    // parallel edges are left to the point-triangle tests
+    if (denominator < 1e-12f * a * c)
+    {
+        return false;
+    }
+
+    float s = glm::clamp((b * f - c * d) / denominator, 0.0f, 1.0f);
+    float t = glm::clamp((b * s + f) / c, 0.0f, 1.0f);
+    s = glm::clamp((b * t - d) / a, 0.0f, 1.0f);
+
+    // endpoint cases are covered by the point-triangle tests
+    if (s <= 0.0f || s >= 1.0f || t <= 0.0f || t >= 1.0f)
+    {
+        return false;
+    }
+
+    glm::vec3 difference = (p1 + s * d1) - (q1 + t * d2);
+    float distance = glm::length(difference);
+    if (distance >= thickness || distance < 1e-9f)
+    {
+        return false;
+    }
+
+    contact.edgeA = edgeA;
+    contact.edgeB = edgeB;
+    contact.s = s;
+    contact.t = t;
+    contact.normal = difference / distance;
+    return true;
+}
+
+void SelfCollision::FindContacts(ThreadPool* pool)
+{
+    int numPointTriangle = pointTriangleCandidates.size();
+    int numEdgeEdge = edgeEdgeCandidates.size();
+    int numChunks = (numPointTriangle + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    int numEdgeChunks = (numEdgeEdge + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    chunkPointTriangleContacts.resize(std::max((int)chunkPointTriangleContacts.size(), numChunks));
+    chunkEdgeEdgeContacts.resize(std::max((int)chunkEdgeEdgeContacts.size(), numEdgeChunks));
+
+    // both lists in one loop, the point-triangle chunks first. a pair of sleeping particles only
+    // was resolved before they fell asleep
+    pool->ParallelFor(numChunks + numEdgeChunks, 1, [&](int begin, int end)
+    {
+        for (int chunk = begin; chunk < end; chunk++)
+        {
+            if (chunk < numChunks)
+            {
+                std::vector<PointTriangleContact>& found = chunkPointTriangleContacts[chunk];
+                found.clear();
+
+                int last = glm::min((chunk + 1) * CHUNK_SIZE, numPointTriangle);
+                for (int k = chunk * CHUNK_SIZE; k < last; k++)
+                {
+                    glm::ivec2 candidate = pointTriangleCandidates[k];
+                    glm::ivec3 indices = triangleIndices[candidate.y];
+                    if (!active[candidate.x] && !active[indices.x] && !active[indices.y] && !active[indices.z])
+                    {
+                        continue;
+                    }
+
+                    PointTriangleContact contact;
+                    if (TestPointTriangle(candidate.x, candidate.y, contact))
+                    {
+                        found.push_back(contact);
+                    }
+                }
+            }
+            else
+            {
+                std::vector<EdgeEdgeContact>& found = chunkEdgeEdgeContacts[chunk - numChunks];
+                found.clear();
+
+                int last = glm::min((chunk - numChunks + 1) * CHUNK_SIZE, numEdgeEdge);
+                for (int k = (chunk - numChunks) * CHUNK_SIZE; k < last; k++)
+                {
+                    glm::ivec2 candidate = edgeEdgeCandidates[k];
+                    glm::ivec2 endsA = edges[candidate.x];
+                    glm::ivec2 endsB = edges[candidate.y];
+                    if (!active[endsA.x] && !active[endsA.y] && !active[endsB.x] && !active[endsB.y])
+                    {
+                        continue;
+                    }
+
+                    EdgeEdgeContact contact;
+                    if (TestEdges(candidate.x, candidate.y, contact))
+                    {
+                        found.push_back(contact);
+                    }
+                }
+            }
+        }
+    });
+
+    pointTriangleContacts.clear();
+    for (int c = 0; c < numChunks; c++)
+    {
+        pointTriangleContacts.insert(pointTriangleContacts.end(), chunkPointTriangleContacts[c].begin(), chunkPointTriangleContacts[c].end());
+    }
+    edgeEdgeContacts.clear();
+    for (int c = 0; c < numEdgeChunks; c++)
+    {
+        edgeEdgeContacts.insert(edgeEdgeContacts.end(), chunkEdgeEdgeContacts[c].begin(), chunkEdgeEdgeContacts[c].end());
+    }
+}
+
+void SelfCollision::GetContact(int c, int* index, float* weight, glm::vec3& normal)
+{
+    // each contact is a constraint C = n . (Σ wi * xi) - thickness >= 0 over 4 particles
+    if (c < (int)pointTriangleContacts.size())
+    {
+        PointTriangleContact& contact = pointTriangleContacts[c];
+        glm::ivec3 indices = triangleIndices[contact.triangle];
+        index[0] = contact.particle;
+        index[1] = indices.x;
+        index[2] = indices.y;
+        index[3] = indices.z;
+        weight[0] = 1.0f;
+        weight[1] = -contact.barycentric.x;
+        weight[2] = -contact.barycentric.y;
+        weight[3] = -contact.barycentric.z;
+        normal = contact.normal;
+    }
+    else
+    {
+        EdgeEdgeContact& contact = edgeEdgeContacts[c - pointTriangleContacts.size()];
+        index[0] = edges[contact.edgeA].x;
+        index[1] = edges[contact.edgeA].y;
+        index[2] = edges[contact.edgeB].x;
+        index[3] = edges[contact.edgeB].y;
+        weight[0] = 1.0f - contact.s;
+        weight[1] = contact.s;
+        weight[2] = -(1.0f - contact.t);
+        weight[3] = -contact.t;
+        normal = contact.normal;
+    }
+}
+
+void SelfCollision::ResolveContact(int c)
+{
+    // projected with inverse mass weighting (fixed and sleeping particles don't move)
+    int index[4];
+    float weight[4];
+    glm::vec3 normal;
+    GetContact(c, index, weight, normal);
+
+    float separation = 0.0f;
+    float relativeVelocity = 0.0f;
+    float denominator = 0.0f;
+    for (int k = 0; k < 4; k++)
+    {
+        separation += weight[k] * glm::dot(normal, positions[index[k]]);
+        relativeVelocity += weight[k] * glm::dot(normal, velocities[index[k]]);
+        denominator += weight[k] * weight[k] * inverseMasses[index[k]];
+    }
+
+    if (denominator <= 0.0f)
+    {
+        return;
+    }
+
+    // push apart to the thickness (earlier corrections may already have done it)
+    float positionScale = separation < thickness ? (thickness - separation) / denominator : 0.0f;
+    // inelastic: remove approaching normal velocity
+    float velocityScale = relativeVelocity < 0.0f ? -relativeVelocity / denominator : 0.0f;
+
+    for (int k = 0; k < 4; k++)
+    {
+        // particles that don't move are only read, so other batches can share them
+        if (inverseMasses[index[k]] > 0.0f)
+        {
+            float w = weight[k] * inverseMasses[index[k]];
+            positions[index[k]] += (positionScale * w) * normal;
+            velocities[index[k]] += (velocityScale * w) * normal;
+        }
+    }
+}
+
+void SelfCollision::ResolveContacts(ThreadPool* pool)
+{
+    int numContacts = pointTriangleContacts.size() + edgeEdgeContacts.size();
+
+    // every contact goes in the batch after the last one that moved any of its particles, so
+    // contacts sharing a particle still run in the order they were found
+    particleBatch.assign(positions.size(), -1);
+    contactBatches.resize(numContacts);
+    int numBatches = 0;
+    for (int c = 0; c < numContacts; c++)
+    {
+        int index[4];
+        float weight[4];
+        glm::vec3 normal;
+        GetContact(c, index, weight, normal);
+
+        int batch = 0;
+        for (int k = 0; k < 4; k++)
+        {
+            if (inverseMasses[index[k]] > 0.0f)
+            {
+                batch = std::max(batch, particleBatch[index[k]] + 1);
+            }
+        }
+        for (int k = 0; k < 4; k++)
+        {
+            if (inverseMasses[index[k]] > 0.0f)
+            {
+                particleBatch[index[k]] = batch;
+            }
+        }
+        contactBatches[c] = batch;
+        numBatches = std::max(numBatches, batch + 1);
+    }
+
+    // counting sort the contacts by batch
+    batchStart.assign(numBatches + 1, 0);
+    for (int c = 0; c < numContacts; c++)
+    {
+        batchStart[contactBatches[c] + 1]++;
+    }
+    for (int b = 0; b < numBatches; b++)
+    {
+        batchStart[b + 1] += batchStart[b];
+    }
+    batchContacts.resize(numContacts);
+    for (int c = 0; c < numContacts; c++)
+    {
+        batchContacts[batchStart[contactBatches[c]]++] = c;
+    }
+    for (int b = numBatches; b > 0; b--)
+    {
+        batchStart[b] = batchStart[b - 1];
+    }
+    batchStart[0] = 0;
+
+    for (int b = 0; b < numBatches; b++)
+    {
+        int first = batchStart[b];
+        pool->ParallelFor(batchStart[b + 1] - first, 64, [&](int begin, int end)
+        {
+            for (int k = begin; k < end; k++)
+            {
+                ResolveContact(batchContacts[first + k]);
+            }
+        });
+    }
+}
+
+void SelfCollision::Resolve(std::vector<Particle*>& particles, std::vector<char>& awake)
+{
+    ThreadPool* pool = ThreadPool::GetShared();
+    int numParticles = particles.size();
+
+    positions.resize(numParticles);
+    velocities.resize(numParticles);
+    inverseMasses.resize(numParticles);
+    active.resize(numParticles);
+    while ((int)particleOrigin.size() < numParticles)
+    {
+        particleOrigin.push_back(particleOrigin.size());
+    }
+    for (int i = 0; i < numParticles; i++)
+    {
+        positions[i] = particles[i]->GetPosition();
+        velocities[i] = particles[i]->GetVelocity();
+        active[i] = awake[i];
+        inverseMasses[i] = particles[i]->IsFixed() || !awake[i] ? 0.0f : 1.0f / particles[i]->GetMass();
+    }
+
+    // broad phase, only once the candidates may have gone stale
+    if (NeedsSearch(pool))
+    {
+        Search(pool);
+    }
+
+    // narrow phase
+    FindContacts(pool);
+    if (pointTriangleContacts.empty() && edgeEdgeContacts.empty())
+    {
+        return;
+    }
+
+    ResolveContacts(pool);
+
+    for (int i = 0; i < numParticles; i++)
+    {
+        if (inverseMasses[i] > 0.0f)
+        {
+            particles[i]->SetPosition(positions[i]);
+            particles[i]->SetVelocity(velocities[i]);
+        }
+    }
+}
+
+void SelfCollision::RemoveTriangle(int triangle)
+{
+    if (triangleTorn[triangle])
+    {
+        return;
+    }
+    triangleTorn[triangle] = 1;
+    for (int e = 0; e < 3; e++)
+    {
+        edgeTriangles[triangleEdges[triangle][e]]--;
+    }
+
+    // drop the pairs with the triangle or an edge it left without a triangle, in place so the
+    // lists stay sorted. everything else is still as close as when it was searched
+    int kept = 0;
+    for (int k = 0; k < (int)pointTriangleCandidates.size(); k++)
+    {
+        if (pointTriangleCandidates[k].y != triangle)
+        {
+            pointTriangleCandidates[kept++] = pointTriangleCandidates[k];
+        }
+    }
+    pointTriangleCandidates.resize(kept);
+
+    kept = 0;
+    for (int k = 0; k < (int)edgeEdgeCandidates.size(); k++)
+    {
+        glm::ivec2 candidate = edgeEdgeCandidates[k];
+        if (edgeTriangles[candidate.x] > 0 && edgeTriangles[candidate.y] > 0)
+        {
+            edgeEdgeCandidates[kept++] = candidate;
+        }
+    }
+    edgeEdgeCandidates.resize(kept);
+}
+
+void SelfCollision::SplitParticle(int particle, int copy, const int* triangles, int numTriangles)
+{
+    // particles that haven't been through Resolve yet are their own origin
+    while ((int)particleOrigin.size() < copy)
+    {
+        particleOrigin.push_back(particleOrigin.size());
+    }
+    particleOrigin.push_back(particleOrigin[particle]);
+
+    // the edges at the particle the moving triangles have, and how many of them each one has
+    splitEdges.clear();
+    for (int i = 0; i < numTriangles; i++)
+    {
+        int t = triangles[i];
+        for (int k = 0; k < 3; k++)
+        {
+            int e = triangleEdges[t][k];
+            if (edges[e].x != particle && edges[e].y != particle)
+            {
+                continue;
+            }
+            int j = 0;
+            while (j < (int)splitEdges.size() && splitEdges[j].x != e)
+            {
+                j++;
+            }
+            if (j == (int)splitEdges.size())
+            {
+                splitEdges.push_back(glm::ivec2(e, 0));
+            }
+            splitEdges[j].y++;
+        }
+    }
+
+    int numPointTriangle = pointTriangleCandidates.size();
+    int numEdgeEdge = edgeEdgeCandidates.size();
+    for (glm::ivec2 split : splitEdges)
+    {
+        int e = split.x;
+        int other = edges[e].x == particle ? edges[e].y : edges[e].x;
+        glm::ivec2 ends(glm::min(other, copy), glm::max(other, copy));
+
+        // an edge only the moving triangles have goes with them, it stays where it is
+        if (split.y == edgeTriangles[e])
+        {
+            edges[e] = ends;
+            continue;
+        }
+
+        // one both sides of the tear still have (the torn one) is copied for the moving side,
+        // with the box and the candidates of the original
+        int n = edges.size();
+        edges.push_back(ends);
+        edgeTriangles[e] -= split.y;
+        edgeTriangles.push_back(split.y);
+        edgeMin.push_back(edgeMin[e]);
+        edgeMax.push_back(edgeMax[e]);
+        edgeCells.push_back(edgeCells[e]);
+        edgeSlots.push_back(-1);
+        if ((int)edgeGroups.size() == n)
+        {
+            edgeGroups.push_back(edgeGroups[e]);
+        }
+        for (int i = 0; i < numTriangles; i++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                if (triangleEdges[triangles[i]][k] == e)
+                {
+                    triangleEdges[triangles[i]][k] = n;
+                }
+            }
+        }
+        for (int k = 0; k < numEdgeEdge; k++)
+        {
+            glm::ivec2 candidate = edgeEdgeCandidates[k];
+            if (candidate.x == e || candidate.y == e)
+            {
+                int paired = candidate.x == e ? candidate.y : candidate.x;
+                edgeEdgeCandidates.push_back(glm::ivec2(glm::min(n, paired), glm::max(n, paired)));
+            }
+        }
+    }
+
+    for (int i = 0; i < numTriangles; i++)
+    {
+        glm::ivec3& indices = triangleIndices[triangles[i]];
+        for (int k = 0; k < 3; k++)
+        {
+            indices[k] = indices[k] == particle ? copy : indices[k];
+        }
+    }
+
+    // the copy is where the particle is, so it is close to the same triangles
+    for (int k = 0; k < numPointTriangle; k++)
+    {
+        if (pointTriangleCandidates[k].x == particle)
+        {
+            pointTriangleCandidates.push_back(glm::ivec2(copy, pointTriangleCandidates[k].y));
+        }
+    }
+    std::sort(pointTriangleCandidates.begin(), pointTriangleCandidates.end(), CompareCandidate);
+    std::sort(edgeEdgeCandidates.begin(), edgeEdgeCandidates.end(), CompareCandidate);
+
+    // and it moved as far since the last search, in the same group
+    if (searched && (int)searchPositions.size() == copy)
+    {
+        int group = particleGroups[particle];
+        searchPositions.push_back(searchPositions[particle]);
+        particleGroups.push_back(group);
+        groupParticles.insert(groupParticles.begin() + groupStart[group + 1], copy);
+        for (int g = group + 1; g < (int)groupStart.size(); g++)
+        {
+            groupStart[g]++;
+        }
+    }
+}
+
+float SelfCollision::GetThickness()
+{
+    return thickness;
+}
+
+void SelfCollision::SetThickness(float thickness)
+{
+    this->thickness = thickness;
+
+    // the candidates were searched with the old thickness
+    Reset();
+}
+
+float SelfCollision::GetMargin()
+{
+    return margin;
+}
+
+void SelfCollision::SetMargin(float margin)
+{
+    this->margin = margin;
+    Reset();
+}
+
+int SelfCollision::GetNumContacts()
+{
+    return pointTriangleContacts.size() + edgeEdgeContacts.size();
+}
+
+int SelfCollision::GetNumCandidates()
+{
+    return pointTriangleCandidates.size() + edgeEdgeCandidates.size();
+}
+
+int SelfCollision::GetNumSearches()
+{
+    return numSearches;
+}
+
+int SelfCollision::GetNumFullSearches()
+{
+    return numFullSearches;
+}
@@ -109,3 +109,40 @@ GLuint LoadShaders(const char* vertexFilePath, const char* fragmentFilePath)
 
     return programID;
 }
+
+GLuint LoadFeedbackShader(const char* vertexFilePath, const char* const* varyings, int numVaryings)
+{
+    GLuint vertexShaderID = LoadSingleShader(vertexFilePath, vertex);
+    if (vertexShaderID == 0) return 0;
+
+    GLint Result = GL_FALSE;
+    int InfoLogLength;
+
+    // The outputs to capture have to be named before linking.
+    printf("Linking feedback program\n");
+    GLuint programID = glCreateProgram();
+    glAttachShader(programID, vertexShaderID);
+    glTransformFeedbackVaryings(programID, numVaryings, varyings, GL_SEPARATE_ATTRIBS);
+    glLinkProgram(programID);
+
+    glGetProgramiv(programID, GL_LINK_STATUS, &Result);
+    if (Result != GL_TRUE)
+    {
+        glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+        std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
+        glGetProgramInfoLog(programID, InfoLogLength, NULL, ProgramErrorMessage.data());
+        std::string msg(ProgramErrorMessage.begin(), ProgramErrorMessage.end());
+        std::cerr << msg << std::endl;
+        glDeleteProgram(programID);
+        return 0;
+    }
+    else
+    {
+        printf("Successfully linked feedback program!\n");
+    }
+
+    glDetachShader(programID, vertexShaderID);
+    glDeleteShader(vertexShaderID);
+
+    return programID;
+}
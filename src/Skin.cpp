@@ -1,8 +1,32 @@
 #include "Skin.h"
+#include "Shader.h"
+#include <cstddef>
 
 Skin::Skin()
 {
     skeleton = nullptr;
+    batch = nullptr;
+    morphs = nullptr;
+    bvh = nullptr;
+
+    skinningMode = SkinningMode::Linear;
+    parallelEnabled = true;
+    chunkSize = 2048;
+
+    paletteValid = false;
+    paletteUploaded = false;
+    meshValid = false;
+    numSkinnedVertices = 0;
+
+    // no buffers until SetupBuffers
+    VAO = 0;
+    gpuVAO = 0;
+    packedVAO = 0;
+    packedOutputEnabled = false;
+
+    gpuSkinningEnabled = false;
+    skinningShader = 0;
+    feedbackShader = 0;
 
     model = glm::mat4(1.0f);
 
@@ -12,6 +36,35 @@ Skin::Skin()
 Skin::~Skin()
 {
     delete skeleton;
+    delete batch;
+    delete morphs;
+    delete bvh;
+
+    if (VAO != 0)
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO_positions);
+        glDeleteBuffers(1, &VBO_normals);
+        glDeleteBuffers(1, &EBO);
+        glDeleteVertexArrays(1, &packedVAO);
+        glDeleteBuffers(1, &VBO_packed);
+    }
+    if (gpuVAO != 0)
+    {
+        glDeleteVertexArrays(1, &gpuVAO);
+        glDeleteBuffers(1, &VBO_restPositions);
+        glDeleteBuffers(1, &VBO_restNormals);
+        glDeleteBuffers(1, &VBO_joints);
+        glDeleteBuffers(1, &VBO_weights);
+        glDeleteTextures(1, &paletteTexture);
+        glDeleteBuffers(1, &paletteBuffer);
+    }
+    if (feedbackShader != 0)
+    {
+        glDeleteProgram(feedbackShader);
+        glDeleteBuffers(1, &feedbackPositions);
+        glDeleteBuffers(1, &feedbackNormals);
+    }
 }
 
 bool Skin::Load(const char* filename, Skeleton* skeleton)
@@ -30,11 +83,27 @@ bool Skin::Load(const char* filename, Skeleton* skeleton)
     Tokenizer token;
     token.Open(filename);
 
+    // skin weights, kept until the skinning streams are built
+    std::vector<int> counts;
+    std::vector<int> jointIndices;
+    std::vector<float> jointWeights;
+    // morph targets, in file order until the mesh is reordered
+    std::vector<std::string> targetNames;
+    std::vector<std::vector<int>> targetIndices;
+    std::vector<std::vector<glm::vec3>> targetPositions;
+    std::vector<std::vector<glm::vec3>> targetNormals;
+
     while (true)
     {
         char temp[256];
         token.GetToken(temp);
 
+        // end of file
+        if (temp[0] == '\0')
+        {
+            break;
+        }
+
         if (strcmp(temp, "positions") == 0)
         {
             int numPositions = token.GetInt();
@@ -76,21 +145,19 @@ bool Skin::Load(const char* filename, Skeleton* skeleton)
         {
             int numSkinweights = token.GetInt();
             token.FindToken("{");
-            // theoretically, positions, normals, vertices should all be the same size
-            vertices.resize(numSkinweights);
+            // theoretically, positions, normals, skinweights should all be the same size
+            counts.resize(numSkinweights);
 
             for (int i = 0; i < numSkinweights; i++)
             {
                 int numAttachments = token.GetInt();
-                std::vector<int> jointIndices;
-                std::vector<float> weights;
+                counts[i] = numAttachments;
 
                 for (int j = 0; j < numAttachments; j++)
                 {
                     jointIndices.push_back(token.GetInt());
-                    weights.push_back(token.GetFloat());
+                    jointWeights.push_back(token.GetFloat());
                 }
-                vertices[i] = Vertex(positions[i], normals[i], numAttachments, jointIndices, weights);
                 // printf("Skin::Load - vertex %d: %f, %f, %f with %d attachments\n", i, positions[i].x, positions[i].y, positions[i].z, numAttachments);
             }
             token.FindToken("}");
@@ -150,7 +217,34 @@ bool Skin::Load(const char* filename, Skeleton* skeleton)
                 token.FindToken("}");
             }
             token.FindToken("}");
-            break;
+
+        }
+        else if (strcmp(temp, "morphtarget") == 0)
+        {
+            // morphtarget name count {
+            //     index dx dy dz dnx dny dnz
+            // }
+            // only the vertices the target moves, by their index in positions
+            char name[256];
+            token.GetToken(name);
+            int numDeltas = token.GetInt();
+            token.FindToken("{");
+            targetNames.push_back(name);
+            targetIndices.push_back(std::vector<int>(numDeltas));
+            targetPositions.push_back(std::vector<glm::vec3>(numDeltas));
+            targetNormals.push_back(std::vector<glm::vec3>(numDeltas));
+
+            for (int i = 0; i < numDeltas; i++)
+            {
+                targetIndices.back()[i] = token.GetInt();
+                targetPositions.back()[i].x = token.GetFloat();
+                targetPositions.back()[i].y = token.GetFloat();
+                targetPositions.back()[i].z = token.GetFloat();
+                targetNormals.back()[i].x = token.GetFloat();
+                targetNormals.back()[i].y = token.GetFloat();
+                targetNormals.back()[i].z = token.GetFloat();
+            }
+            token.FindToken("}");
 
         }
         else
@@ -160,17 +254,88 @@ bool Skin::Load(const char* filename, Skeleton* skeleton)
         }
     }
 
-    // working copies that get modified during skinning
-    transformedPositions = positions;
-    transformedNormals = normals;
+    // binding matrices never change, so invert them here rather than every frame
+    inverseBindings.resize(bindings.size());
+    for (int i = 0; i < bindings.size(); i++)
+    {
+        if (glm::determinant(bindings[i]) == 0.0f)
+        {
+            printf("Skin::Load - warning: binding matrix %d is singular, using identity matrix instead\n", i);
+            inverseBindings[i] = glm::mat4(1.0f);
+        }
+        else
+        {
+            inverseBindings[i] = glm::inverse(bindings[i]);
+        }
+    }
 
     // allocate skinning matrices if skeleton is provided
     if (this->skeleton)
     {
         skinningMatrices.resize(bindings.size());
+        normalMatrices.resize(bindings.size());
+        palette.resize(bindings.size() * SkinBatch::PALETTE_STRIDE);
+        worldMatrices.resize(bindings.size());
+        counts.resize(positions.size(), 0);
+        batch = new SkinBatch(counts, jointIndices, jointWeights);
+
+        // put the mesh in the batch's order so every group of vertices is one contiguous range
+        const std::vector<int>& order = batch->GetOrder();
+        std::vector<int> remap(order.size());
+        std::vector<glm::vec3> orderedPositions(order.size());
+        std::vector<glm::vec3> orderedNormals(order.size());
+        for (int i = 0; i < order.size(); i++)
+        {
+            remap[order[i]] = i;
+            orderedPositions[i] = positions[order[i]];
+            orderedNormals[i] = normals[order[i]];
+        }
+        positions.swap(orderedPositions);
+        normals.swap(orderedNormals);
+        for (int i = 0; i < triangles.size(); i++)
+        {
+            Triangle& triangle = triangles[i];
+            triangle = Triangle(remap[triangle.GetVertexIndex1()], remap[triangle.GetVertexIndex2()], remap[triangle.GetVertexIndex3()]);
+        }
+
+        if (!targetNames.empty())
+        {
+            morphs = new MorphTargets(positions.size());
+            for (int t = 0; t < targetNames.size(); t++)
+            {
+                std::vector<int>& indices = targetIndices[t];
+                for (int i = 0; i < indices.size(); i++)
+                {
+                    indices[i] = indices[i] >= 0 && indices[i] < remap.size() ? remap[indices[i]] : -1;
+                }
+                morphs->AddTarget(targetNames[t], indices, targetPositions[t], targetNormals[t]);
+            }
+            printf("Skin::Load - %d morph targets, %d deltas\n", morphs->GetNumTargets(), morphs->GetNumDeltas());
+
+            // every weight starts at 0, so the morphed rest pose starts as the base
+            morphedPositions = positions;
+            morphedNormals = normals;
+            batch->SetRestPose(morphedPositions.data(), morphedNormals.data());
+        }
+        else
+        {
+            batch->SetRestPose(positions.data(), normals.data());
+        }
+    }
+    else if (!targetNames.empty())
+    {
+        printf("Skin::Load - no skeleton, morph targets ignored\n");
     }
 
-    this->SetupBuffers();
+    // working copies that get modified during skinning
+    transformedPositions = positions;
+    transformedNormals = normals;
+    packedVertices.resize(positions.size());
+    for (int i = 0; i < positions.size(); i++)
+    {
+        packedVertices[i].position = positions[i];
+        SkinBatch::EncodeNormal(normals[i], packedVertices[i].normal);
+    }
 
     token.Close();
     printf("Skin::Load - finished loading skin\n");
@@ -185,64 +350,218 @@ void Skin::Update()
         // printf("Skin::Update - no skeleton, staying in binding pose\n");
         return;
     }
-    // compute skinning matrix for each joint Mi = Wi * Bi^(-1)
-    // Mi = skinning matrix of joint i
-    // Wi = world matrix of joint i
-    // Bi = binding matrix for joint i
-    for (int i = 0; i < bindings.size(); i++)
+
+    if (VAO == 0)
     {
-        float det = glm::determinant(bindings[i]);
-        if (det == 0.0f)
+        SetupBuffers();
+    }
+
+    if (gpuSkinningEnabled)
+    {
+        // the vertex shader skins, but collisions need the deformed mesh on this side too
+        if (bvh)
         {
-            printf("Skin::Update - warning: Binding matrix %d is singular, using identity matrix instead\n", i);
-            skinningMatrices[i] = skeleton->GetWorldMatrix(i);
+            Deform();
         }
         else
         {
-            skinningMatrices[i] = skeleton->GetWorldMatrix(i) * glm::inverse(bindings[i]);
+            UpdatePalette();
+            bool morphed = UpdateMorphs();
+            if (!dirtyJoints.empty() || morphed)
+            {
+                meshValid = false;
+            }
+        }
+        // nothing to send when no joint moved since the last upload
+        if (!paletteUploaded)
+        {
+            UploadPalette();
         }
+        UploadRestPose();
+        return;
     }
+
+    Deform();
+    // the gpu's rest pose follows the morphs in this mode too, ready for switching over
+    UploadRestPose();
+
+    // only the vertices skinned since the buffers were last filled
+    for (int i = 0; i < uploadRanges.size(); i++)
+    {
+        if (packedOutputEnabled)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, VBO_packed);
+            glBufferSubData(GL_ARRAY_BUFFER, sizeof(SkinBatch::PackedVertex) * uploadRanges[i].x,
+                sizeof(SkinBatch::PackedVertex) * (uploadRanges[i].y - uploadRanges[i].x), &packedVertices[uploadRanges[i].x]);
+            continue;
+        }
+
+        int offset = sizeof(glm::vec3) * uploadRanges[i].x;
+        int size = sizeof(glm::vec3) * (uploadRanges[i].y - uploadRanges[i].x);
+
+        // bind and update the positions VBO with transformed positions
+        glBindBuffer(GL_ARRAY_BUFFER, VBO_positions);
+        glBufferSubData(GL_ARRAY_BUFFER, offset, size, &transformedPositions[uploadRanges[i].x]);
+
+        // bind and update the normals VBO with transformed normals
+        glBindBuffer(GL_ARRAY_BUFFER, VBO_normals);
+        glBufferSubData(GL_ARRAY_BUFFER, offset, size, &transformedNormals[uploadRanges[i].x]);
+    }
+    uploadRanges.clear();
+
+    // unbind the buffer to prevent accidental modifications
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Skin::Deform()
+{
+    if (!skeleton)
+    {
+        return;
+    }
+    UpdatePalette();
+    // the blend shapes go on the rest pose first
+    bool morphed = UpdateMorphs();
+
     // compute blended world space positions and normals
-    // transform each vertex position and normal
-    for (int i = 0; i < positions.size(); i++)
+    // v' = Σ wi * Wi * Bi^(-1) * v
+    // n' = Σ wi * (Wi * Bi^(-1))^(-1T) * n (normalisation done during storage) <- use this one "if there will be a scale and/or a shear in the transformations"
+    // written straight into the arrays the vertex buffers are filled from, every chunk to its own range
+    int numVertices = batch->GetNumVertices();
+    if (meshValid && dirtyJoints.empty() && !morphed)
+    {
+        // nothing moved, the mesh is already in this pose
+        numSkinnedVertices = 0;
+        return;
+    }
+
+    // just the vertices of the joints that moved and the ones a morph moved, unless that is most
+    // of the mesh anyway. gaps of a few clean vertices are skinned over, which gives the same
+    // result for them
+    static const std::vector<int> noVertices;
+    const std::vector<int>& morphedVertices = morphed ? morphs->GetChangedVertices() : noVertices;
+    numSkinnedVertices = meshValid ? batch->GetDirtyRanges(dirtyJoints, morphedVertices, 32, skinnedRanges) : numVertices;
+    bool everything = numSkinnedVertices > numVertices / 2;
+    if (everything)
     {
-        glm::vec4 position = glm::vec4(positions[i], 1.0f);
-        // use 0 as the 4th coordinate
-        glm::vec4 normal = glm::vec4(normals[i], 0.0f);
+        numSkinnedVertices = numVertices;
+        skinnedRanges.assign(1, glm::ivec2(0, numVertices));
+    }
 
-        glm::vec4 blendedPosition = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
-        glm::vec4 blendedNormal = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
+    bool dualQuaternion = skinningMode == SkinningMode::DualQuaternion;
+    auto skin = [&](int begin, int end)
+    {
+        if (packedOutputEnabled)
+        {
+            if (dualQuaternion)
+            {
+                batch->SkinDualQuaternionPacked(palette.data(), begin, end, packedVertices.data());
+            }
+            else
+            {
+                batch->SkinPacked(palette.data(), begin, end, packedVertices.data());
+            }
 
-        // apply weighted transformation from each attached joint
-        for (int j = 0; j < vertices[i].GetNumAttachments(); j++)
+            // the collision hierarchy still wants float positions
+            if (bvh)
+            {
+                for (int i = begin; i < end; i++)
+                {
+                    transformedPositions[i] = packedVertices[i].position;
+                }
+            }
+        }
+        else if (dualQuaternion)
         {
-            // conversion from byte to float handled in Vertex::GetWeight()
-            float weight = vertices[i].GetWeight(j);
-            int jointIndex = vertices[i].GetJointIndex(j);
-
-            // v' = Σ wi * Wi * Bi^(-1) * v
-            blendedPosition += weight * (skinningMatrices[jointIndex] * position);
-            // n' = Σ wi * (Wi * Bi^(-1))^(-1T) * n (normalisation done during storage) <- use this one "if there will be a scale and/or a shear in the transformations"
-            blendedNormal += weight * (glm::transpose(glm::inverse(skinningMatrices[jointIndex])) * normal);
-            // n' = Σ wi * Wi * Bi^(-1) * n
-            // blendedNormal += weight * (skinningMatrices[jointIndex] * normal);
+            batch->SkinDualQuaternion(palette.data(), begin, end, transformedPositions.data(), transformedNormals.data());
         }
+        else
+        {
+            batch->Skin(palette.data(), begin, end, transformedPositions.data(), transformedNormals.data());
+        }
+    };
+    if (everything && parallelEnabled)
+    {
+        ThreadPool::GetShared()->ParallelFor(numVertices, chunkSize, skin);
+    }
+    else
+    {
+        for (int i = 0; i < skinnedRanges.size(); i++)
+        {
+            skin(skinnedRanges[i].x, skinnedRanges[i].y);
+        }
+    }
+    meshValid = true;
+
+    // the vertex buffers catch up on the next Update, however many deforms that is from now
+    if (everything || uploadRanges.size() + skinnedRanges.size() > 256)
+    {
+        uploadRanges.assign(1, glm::ivec2(0, numVertices));
+    }
+    else
+    {
+        uploadRanges.insert(uploadRanges.end(), skinnedRanges.begin(), skinnedRanges.end());
+    }
 
-        // storage
-        transformedPositions[i] = glm::vec3(blendedPosition);
-        transformedNormals[i] = glm::normalize(glm::vec3(blendedNormal));
+    // keep the collision boxes in sync with the deformed mesh
+    if (bvh)
+    {
+        bvh->Refit(transformedPositions);
     }
+}
 
-    // bind and update the positions VBO with transformed positions
-    glBindBuffer(GL_ARRAY_BUFFER, VBO_positions);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(glm::vec3) * transformedPositions.size(), transformedPositions.data());
+void Skin::UpdatePalette()
+{
+    // compute skinning matrix for each joint Mi = Wi * Bi^(-1)
+    // Mi = skinning matrix of joint i
+    // Wi = world matrix of joint i
+    // Bi = binding matrix for joint i
+    // only for joints that moved since the palette was last built
+    dirtyJoints.clear();
+    for (int i = 0; i < bindings.size(); i++)
+    {
+        glm::mat4 world = skeleton->GetWorldMatrix(i);
+        if (paletteValid && world == worldMatrices[i])
+        {
+            continue;
+        }
+        worldMatrices[i] = world;
+        dirtyJoints.push_back(i);
+        paletteUploaded = false;
+
+        skinningMatrices[i] = world * inverseBindings[i];
+        if (skinningMode == SkinningMode::DualQuaternion)
+        {
+            // rotates normals itself, no normal matrix needed
+            SkinBatch::SetDualQuaternion(palette.data(), i, skinningMatrices[i]);
+            continue;
+        }
+        // the translation column never reaches a normal, so the upper 3x3 is all the normal needs
+        normalMatrices[i] = glm::transpose(glm::inverse(glm::mat3(skinningMatrices[i])));
+        SkinBatch::SetJoint(palette.data(), i, skinningMatrices[i], normalMatrices[i]);
+    }
+    paletteValid = true;
+}
 
-    // bind and update the normals VBO with transformed normals
-    glBindBuffer(GL_ARRAY_BUFFER, VBO_normals); 
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(glm::vec3) * transformedNormals.size(), transformedNormals.data());
+bool Skin::UpdateMorphs()
+{
+    if (!morphs || !morphs->Apply(positions.data(), normals.data(), morphedPositions.data(), morphedNormals.data()))
+    {
+        return false;
+    }
 
-    // unbind the buffer to prevent accidental modifications
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    // what the gpu skinning path reads has to catch up too, on the next Update
+    std::vector<glm::ivec2> ranges;
+    batch->GetDirtyRanges(std::vector<int>(), morphs->GetChangedVertices(), 32, ranges);
+    if (restUploadRanges.size() + ranges.size() > 256)
+    {
+        restUploadRanges.assign(1, glm::ivec2(0, (int)morphedPositions.size()));
+    }
+    else
+    {
+        restUploadRanges.insert(restUploadRanges.end(), ranges.begin(), ranges.end());
+    }
+    return true;
 }
 
 void Skin::Draw(const glm::mat4& viewProjMtx, GLuint shader, const glm::vec3& lightDirection1, const glm::vec3& lightColor1, const glm::vec3& lightDirection2, const glm::vec3& lightColor2)
@@ -250,6 +569,19 @@ void Skin::Draw(const glm::mat4& viewProjMtx, GLuint shader, const glm::vec3& li
     // draw triangles using transformed positions and normals
     // printf("Skin::Draw - %zu vertices, %zu triangles\n", transformedPositions.size(), triangleIndices.size());
 
+    if (VAO == 0)
+    {
+        SetupBuffers();
+    }
+
+    // same lighting, with the skinning variant of the vertex shader
+    bool gpu = gpuSkinningEnabled && gpuVAO != 0 && skinningShader != 0;
+    bool packed = !gpu && packedOutputEnabled;
+    if (gpu)
+    {
+        shader = skinningShader;
+    }
+
     // activate the shader program
     glUseProgram(shader);
     // printf("Skin::Draw - color being sent: %f, %f, %f\n", color.x, color.y, color.z);
@@ -265,16 +597,36 @@ void Skin::Draw(const glm::mat4& viewProjMtx, GLuint shader, const glm::vec3& li
     glUniform3fv(glGetUniformLocation(shader, "LightColor1"), 1, &lightColor1[0]);
     glUniform3fv(glGetUniformLocation(shader, "LightColor2"), 1, &lightColor2[0]);
 
+    if (gpu)
+    {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_BUFFER, paletteTexture);
+        glUniform1i(glGetUniformLocation(shader, "palette"), 0);
+        glUniform1i(glGetUniformLocation(shader, "dualQuaternion"), skinningMode == SkinningMode::DualQuaternion);
+    }
+    if (packed)
+    {
+        glUniform1i(glGetUniformLocation(shader, "packedNormal"), 1);
+    }
+
     // bind the VAO
-    glBindVertexArray(VAO);
+    glBindVertexArray(gpu ? gpuVAO : packed ? packedVAO : VAO);
 
     // draw the points using triangles, indexed with the EBO
     // printf("Skin::Draw - Drawing %zu indices\n", triangleIndices.size());
     glDrawElements(GL_TRIANGLES, triangleIndices.size(), GL_UNSIGNED_INT, 0);
 
-    // unbind the VAO and shader program
+    // unbind the VAO and shader program, the program is shared with everything else drawn
     glBindVertexArray(0);
+    if (packed)
+    {
+        glUniform1i(glGetUniformLocation(shader, "packedNormal"), 0);
+    }
     glUseProgram(0);
+    if (gpu)
+    {
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
 }
 
 void Skin::SetupBuffers()
@@ -320,8 +672,371 @@ void Skin::SetupBuffers()
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * triangleIndices.size(), triangleIndices.data(), GL_STATIC_DRAW);
     printf("Skin::SetupBuffers - EBO setup complete\n");
 
+    // the packed output in one interleaved buffer: the position as 3 floats, then the normal as
+    // 2 shorts read unconverted, shader.vert decodes them
+    glGenVertexArrays(1, &packedVAO);
+    glGenBuffers(1, &VBO_packed);
+    glBindVertexArray(packedVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO_packed);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(SkinBatch::PackedVertex) * packedVertices.size(), packedVertices.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SkinBatch::PackedVertex), 0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_FALSE, sizeof(SkinBatch::PackedVertex), (void*)offsetof(SkinBatch::PackedVertex, normal));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    printf("Skin::SetupBuffers - packed VBO setup complete\n");
+
     // unbind the VBOs.
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
+
+    // static streams for the skinning shader, only with a skeleton to skin against
+    if (batch)
+    {
+        // the same 16 bit joints and weights as SkinBatch, padded to 4 with weight 0 on joint 0.
+        // a vertex with more than 4 joints keeps its heaviest 4 here
+        int numVertices = batch->GetNumVertices();
+        std::vector<GLushort> jointIndices(numVertices * 4);
+        std::vector<GLushort> jointWeights(numVertices * 4);
+        for (int i = 0; i < numVertices; i++)
+        {
+            batch->GetInfluences(i, &jointIndices[i * 4], &jointWeights[i * 4]);
+        }
+
+        glGenVertexArrays(1, &gpuVAO);
+        glGenBuffers(1, &VBO_restPositions);
+        glGenBuffers(1, &VBO_restNormals);
+        glGenBuffers(1, &VBO_joints);
+        glGenBuffers(1, &VBO_weights);
+        glBindVertexArray(gpuVAO);
+
+        // the rest pose with the morphs applied so far, if there are any
+        const std::vector<glm::vec3>& restPositions = morphs ? morphedPositions : positions;
+        const std::vector<glm::vec3>& restNormals = morphs ? morphedNormals : normals;
+        restUploadRanges.clear();
+
+        glBindBuffer(GL_ARRAY_BUFFER, VBO_restPositions);
+        GLenum restUsage = morphs ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW;
+        glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * restPositions.size(), restPositions.data(), restUsage);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, VBO_restNormals);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * restNormals.size(), restNormals.data(), restUsage);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
+
+        // integer attribute, read as a uvec4 without conversion
+        glBindBuffer(GL_ARRAY_BUFFER, VBO_joints);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(GLushort) * jointIndices.size(), jointIndices.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(2);
+        glVertexAttribIPointer(2, 4, GL_UNSIGNED_SHORT, 4 * sizeof(GLushort), 0);
+
+        // normalised, 65535 reads as 1
+        glBindBuffer(GL_ARRAY_BUFFER, VBO_weights);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(GLushort) * jointWeights.size(), jointWeights.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_UNSIGNED_SHORT, GL_TRUE, 4 * sizeof(GLushort), 0);
+
+        // same triangles
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+
+        // the palette as 6 rgba texels per joint, refilled every Update
+        glGenBuffers(1, &paletteBuffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, paletteBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, sizeof(float) * palette.size(), palette.data(), GL_DYNAMIC_DRAW);
+        glGenTextures(1, &paletteTexture);
+        glBindTexture(GL_TEXTURE_BUFFER, paletteTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, paletteBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        printf("Skin::SetupBuffers - gpu skinning buffers setup complete\n");
+    }
     printf("Skin::SetupBuffers - finished setting up buffers\n");
-}
\ No newline at end of file
+}
+
+void Skin::UploadRestPose()
+{
+    if (gpuVAO == 0)
+    {
+        return;
+    }
+    for (int i = 0; i < restUploadRanges.size(); i++)
+    {
+        int offset = sizeof(glm::vec3) * restUploadRanges[i].x;
+        int size = sizeof(glm::vec3) * (restUploadRanges[i].y - restUploadRanges[i].x);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO_restPositions);
+        glBufferSubData(GL_ARRAY_BUFFER, offset, size, &morphedPositions[restUploadRanges[i].x]);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO_restNormals);
+        glBufferSubData(GL_ARRAY_BUFFER, offset, size, &morphedNormals[restUploadRanges[i].x]);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    restUploadRanges.clear();
+}
+
+void Skin::UploadPalette()
+{
+    glBindBuffer(GL_TEXTURE_BUFFER, paletteBuffer);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, sizeof(float) * palette.size(), palette.data());
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    paletteUploaded = true;
+}
+
+MeshBVH* Skin::GetBVH()
+{
+    if (!bvh)
+    {
+        std::vector<glm::ivec3> indices(triangles.size());
+        for (int i = 0; i < triangles.size(); i++)
+        {
+            indices[i] = glm::ivec3(triangles[i].GetVertexIndex1(), triangles[i].GetVertexIndex2(), triangles[i].GetVertexIndex3());
+        }
+
+        // the float positions are only kept up to date once there is a hierarchy to refit
+        if (packedOutputEnabled)
+        {
+            for (int i = 0; i < packedVertices.size(); i++)
+            {
+                transformedPositions[i] = packedVertices[i].position;
+            }
+        }
+
+        bvh = new MeshBVH();
+        bvh->Build(transformedPositions, indices);
+    }
+
+    return bvh;
+}
+
+MorphTargets* Skin::GetMorphTargets()
+{
+    return morphs;
+}
+
+SkinBatch* Skin::GetBatch()
+{
+    return batch;
+}
+
+std::vector<Triangle>& Skin::GetTriangles()
+{
+    return triangles;
+}
+
+const std::vector<glm::mat4>& Skin::GetBindings()
+{
+    return bindings;
+}
+
+const std::vector<glm::mat4>& Skin::GetInverseBindings()
+{
+    return inverseBindings;
+}
+
+SkinningMode Skin::GetSkinningMode()
+{
+    return skinningMode;
+}
+
+void Skin::SetSkinningMode(SkinningMode mode)
+{
+    // the palette holds something else in the other mode
+    if (mode != skinningMode)
+    {
+        paletteValid = false;
+    }
+    skinningMode = mode;
+}
+
+bool Skin::IsParallelEnabled()
+{
+    return parallelEnabled;
+}
+
+void Skin::SetParallelEnabled(bool enabled)
+{
+    parallelEnabled = enabled;
+}
+
+int Skin::GetChunkSize()
+{
+    return chunkSize;
+}
+
+void Skin::SetChunkSize(int chunkSize)
+{
+    this->chunkSize = glm::max(chunkSize, 1);
+}
+
+int Skin::GetNumVertices()
+{
+    return positions.size();
+}
+
+int Skin::GetNumSkinnedVertices()
+{
+    return numSkinnedVertices;
+}
+
+float Skin::GetBytesPerVertex()
+{
+    return batch ? batch->GetBytesPerVertex() : 0.0f;
+}
+
+std::vector<glm::vec3>& Skin::GetTransformedPositions()
+{
+    return transformedPositions;
+}
+
+std::vector<glm::vec3>& Skin::GetTransformedNormals()
+{
+    return transformedNormals;
+}
+
+bool Skin::IsPackedOutputEnabled()
+{
+    return packedOutputEnabled;
+}
+
+void Skin::SetPackedOutputEnabled(bool enabled)
+{
+    // the other output fell behind while this one was in use
+    if (enabled != packedOutputEnabled)
+    {
+        meshValid = false;
+    }
+    packedOutputEnabled = enabled;
+}
+
+std::vector<SkinBatch::PackedVertex>& Skin::GetPackedVertices()
+{
+    return packedVertices;
+}
+
+bool Skin::IsGPUSkinningEnabled()
+{
+    return gpuSkinningEnabled;
+}
+
+void Skin::SetGPUSkinningEnabled(bool enabled)
+{
+    gpuSkinningEnabled = enabled;
+}
+
+void Skin::SetSkinningShader(GLuint shader)
+{
+    skinningShader = shader;
+}
+
+bool Skin::ValidateGPU(float tolerance)
+{
+    if (!skeleton)
+    {
+        printf("Skin::ValidateGPU - no skeleton, nothing to skin\n");
+        return false;
+    }
+
+    if (VAO == 0)
+    {
+        SetupBuffers();
+    }
+
+    if (feedbackShader == 0)
+    {
+        const char* varyings[] = { "skinnedPosition", "skinnedNormal" };
+        feedbackShader = LoadFeedbackShader("shaders/skin.vert", varyings, 2);
+        if (feedbackShader == 0)
+        {
+            printf("Skin::ValidateGPU - failed to build the transform feedback shader\n");
+            return false;
+        }
+
+        glGenBuffers(1, &feedbackPositions);
+        glBindBuffer(GL_ARRAY_BUFFER, feedbackPositions);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * positions.size(), nullptr, GL_STREAM_READ);
+        glGenBuffers(1, &feedbackNormals);
+        glBindBuffer(GL_ARRAY_BUFFER, feedbackNormals);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * normals.size(), nullptr, GL_STREAM_READ);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // reference in full floats, and the palette both sides use
+    bool packed = packedOutputEnabled;
+    SetPackedOutputEnabled(false);
+    Deform();
+    SetPackedOutputEnabled(packed);
+    UploadPalette();
+    UploadRestPose();
+
+    // every vertex once as a point, nothing rasterised
+    glm::mat4 identity(1.0f);
+    glUseProgram(feedbackShader);
+    glUniformMatrix4fv(glGetUniformLocation(feedbackShader, "viewProj"), 1, GL_FALSE, (float*)&identity);
+    glUniformMatrix4fv(glGetUniformLocation(feedbackShader, "model"), 1, GL_FALSE, (float*)&identity);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, paletteTexture);
+    glUniform1i(glGetUniformLocation(feedbackShader, "palette"), 0);
+    glUniform1i(glGetUniformLocation(feedbackShader, "dualQuaternion"), skinningMode == SkinningMode::DualQuaternion);
+
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, feedbackPositions);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 1, feedbackNormals);
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(gpuVAO);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, positions.size());
+    glEndTransformFeedback();
+    glBindVertexArray(0);
+    glDisable(GL_RASTERIZER_DISCARD);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glUseProgram(0);
+
+    std::vector<glm::vec3> gpuPositions(positions.size());
+    std::vector<glm::vec3> gpuNormals(normals.size());
+    glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, feedbackPositions);
+    glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, sizeof(glm::vec3) * gpuPositions.size(), gpuPositions.data());
+    glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, feedbackNormals);
+    glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, sizeof(glm::vec3) * gpuNormals.size(), gpuNormals.data());
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 1, 0);
+
+    // positions relative to the size of the mesh, normals are unit length
+    float extent = 0.0f;
+    for (int i = 0; i < positions.size(); i++)
+    {
+        extent = glm::max(extent, glm::max(glm::abs(transformedPositions[i].x), glm::max(glm::abs(transformedPositions[i].y), glm::abs(transformedPositions[i].z))));
+    }
+    float positionError = 0.0f;
+    float normalError = 0.0f;
+    int worst = 0;
+    for (int i = 0; i < positions.size(); i++)
+    {
+        float error = glm::length(gpuPositions[i] - transformedPositions[i]) / glm::max(extent, 1.0f);
+        if (error > positionError)
+        {
+            positionError = error;
+            worst = i;
+        }
+        normalError = glm::max(normalError, glm::length(gpuNormals[i] - transformedNormals[i]));
+    }
+
+    bool passed = positionError <= tolerance && normalError <= tolerance;
+    printf("Skin::ValidateGPU - %d vertices, max position error %g (vertex %d), max normal error %g: %s\n",
+        (int)positions.size(), positionError, worst, normalError, passed ? "ok" : "FAILED");
+    return passed;
+}
+
+int Skin::GetUploadSize()
+{
+    if (gpuSkinningEnabled)
+    {
+        return sizeof(float) * palette.size();
+    }
+    if (packedOutputEnabled)
+    {
+        return sizeof(SkinBatch::PackedVertex) * packedVertices.size();
+    }
+    return sizeof(glm::vec3) * (transformedPositions.size() + transformedNormals.size());
+}
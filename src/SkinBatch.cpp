@@ -0,0 +1,708 @@
+#include "SkinBatch.h"
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// 16 bit weights are fractions of 65535
+static const float WEIGHT_SCALE = 1.0f / 65535.0f;
+
+// weights to fractions of 65535 that sum to exactly 65535, the rounding left over goes to the
+// first (heaviest) one. negative weights count as 0, and without any weight the first joint
+// gets everything
+static void Quantize(const float* weights, int count, uint16_t* quantized)
+{
+    float sum = 0.0f;
+    for (int k = 0; k < count; k++)
+    {
+        sum += glm::max(weights[k], 0.0f);
+    }
+
+    int total = 0;
+    for (int k = 0; k < count; k++)
+    {
+        quantized[k] = sum > 0.0f ? uint16_t(glm::max(weights[k], 0.0f) / sum * 65535.0f + 0.5f) : 0;
+        total += quantized[k];
+    }
+    quantized[0] = uint16_t(quantized[0] + 65535 - total);
+}
+
+SkinBatch::SkinBatch(const std::vector<int>& counts, const std::vector<int>& joints, const std::vector<float>& weights)
+{
+    numVertices = counts.size();
+    restPositions = nullptr;
+    restNormals = nullptr;
+
+    // a vertex without joints is put on joint 0 rather than collapsing to the origin
+    std::vector<int> inputStart(numVertices + 1, 0);
+    std::vector<int> group(numVertices);
+    int sizes[5] = { 0, 0, 0, 0, 0 };
+    for (int i = 0; i < numVertices; i++)
+    {
+        inputStart[i + 1] = inputStart[i] + counts[i];
+        group[i] = glm::clamp(counts[i], 1, MAX_GROUPED_INFLUENCES + 1) - 1;
+        sizes[group[i]]++;
+    }
+
+    // stable, each group keeps the input order of its vertices
+    groups[0] = 0;
+    for (int g = 0; g < 5; g++)
+    {
+        groups[g + 1] = groups[g] + sizes[g];
+    }
+    int next[5] = { groups[0], groups[1], groups[2], groups[3], groups[4] };
+    order.resize(numVertices);
+    for (int i = 0; i < numVertices; i++)
+    {
+        order[next[group[i]]++] = i;
+    }
+
+    std::vector<std::pair<float, int> > influences;
+    std::vector<float> sorted;
+    std::vector<uint16_t> quantized;
+    for (int g = 0; g < 5; g++)
+    {
+        jointStart[g] = this->joints.size();
+        weightStart[g] = this->weights.size();
+        if (g == MAX_GROUPED_INFLUENCES)
+        {
+            offsets.push_back(0);
+        }
+
+        for (int i = groups[g]; i < groups[g + 1]; i++)
+        {
+            int input = order[i];
+            influences.clear();
+            for (int k = inputStart[input]; k < inputStart[input + 1]; k++)
+            {
+                influences.push_back(std::make_pair(weights[k], joints[k]));
+            }
+            if (influences.empty())
+            {
+                influences.push_back(std::make_pair(1.0f, 0));
+            }
+
+            // heaviest first, the single joint group keeps only that one
+            std::stable_sort(influences.begin(), influences.end(), [](const std::pair<float, int>& a, const std::pair<float, int>& b)
+            {
+                return a.first > b.first;
+            });
+            for (int k = 0; k < influences.size(); k++)
+            {
+                this->joints.push_back(uint16_t(influences[k].second));
+            }
+            if (g == 0)
+            {
+                continue;
+            }
+
+            sorted.resize(influences.size());
+            quantized.resize(influences.size());
+            for (int k = 0; k < influences.size(); k++)
+            {
+                sorted[k] = influences[k].first;
+            }
+            Quantize(sorted.data(), sorted.size(), quantized.data());
+            this->weights.insert(this->weights.end(), quantized.begin(), quantized.end());
+
+            if (g == MAX_GROUPED_INFLUENCES)
+            {
+                offsets.push_back(this->joints.size() - jointStart[g]);
+            }
+        }
+    }
+
+    // reverse index for partial re-skinning, counted first and then filled in skin order
+    int numJoints = 0;
+    for (int k = 0; k < this->joints.size(); k++)
+    {
+        numJoints = std::max(numJoints, this->joints[k] + 1);
+    }
+    jointVertexStart.assign(numJoints + 1, 0);
+    for (int k = 0; k < this->joints.size(); k++)
+    {
+        jointVertexStart[this->joints[k] + 1]++;
+    }
+    for (int j = 0; j < numJoints; j++)
+    {
+        jointVertexStart[j + 1] += jointVertexStart[j];
+    }
+    jointVertices.resize(this->joints.size());
+    std::vector<int> fill(jointVertexStart.begin(), jointVertexStart.end() - 1);
+    for (int g = 0; g < 5; g++)
+    {
+        for (int i = groups[g]; i < groups[g + 1]; i++)
+        {
+            int first = g < MAX_GROUPED_INFLUENCES ? (i - groups[g]) * (g + 1) : offsets[i - groups[g]];
+            int count = g < MAX_GROUPED_INFLUENCES ? g + 1 : offsets[i - groups[g] + 1] - first;
+            for (int k = 0; k < count; k++)
+            {
+                jointVertices[fill[this->joints[jointStart[g] + first + k]]++] = i;
+            }
+        }
+    }
+    marks.resize(numVertices);
+}
+
+const std::vector<int>& SkinBatch::GetOrder()
+{
+    return order;
+}
+
+void SkinBatch::SetRestPose(const glm::vec3* positions, const glm::vec3* normals)
+{
+    restPositions = positions;
+    restNormals = normals;
+}
+
+void SkinBatch::SetJoint(float* palette, int joint, const glm::mat4& skinningMatrix, const glm::mat3& normalMatrix)
+{
+    float* rows = palette + joint * PALETTE_STRIDE;
+    for (int row = 0; row < 3; row++)
+    {
+        // glm is column major, m[column][row]
+        rows[row * 8 + 0] = skinningMatrix[0][row];
+        rows[row * 8 + 1] = skinningMatrix[1][row];
+        rows[row * 8 + 2] = skinningMatrix[2][row];
+        rows[row * 8 + 3] = skinningMatrix[3][row];
+
+        rows[row * 8 + 4] = normalMatrix[0][row];
+        rows[row * 8 + 5] = normalMatrix[1][row];
+        rows[row * 8 + 6] = normalMatrix[2][row];
+        rows[row * 8 + 7] = 0.0f;
+    }
+}
+
+void SkinBatch::SetDualQuaternion(float* palette, int joint, const glm::mat4& skinningMatrix)
+{
+    // normalise the columns so the quaternion comes from a pure rotation
+    glm::mat3 rotation(skinningMatrix);
+    rotation[0] = glm::normalize(rotation[0]);
+    rotation[1] = glm::normalize(rotation[1]);
+    rotation[2] = glm::normalize(rotation[2]);
+    glm::quat real = glm::normalize(glm::quat_cast(rotation));
+
+    // dual part = 1/2 * t * real, with the translation t as a pure quaternion
+    glm::vec3 translation(skinningMatrix[3]);
+    glm::quat dual = 0.5f * (glm::quat(0.0f, translation.x, translation.y, translation.z) * real);
+
+    float* q = palette + joint * PALETTE_STRIDE;
+    q[0] = real.x;
+    q[1] = real.y;
+    q[2] = real.z;
+    q[3] = real.w;
+    q[4] = dual.x;
+    q[5] = dual.y;
+    q[6] = dual.z;
+    q[7] = dual.w;
+}
+
+#if defined(__SSE2__)
+// x, y, z of a 3 float input with w in the 4th lane, nothing past the 3 floats is read
+static inline __m128 Load3(const float* input, __m128 w)
+{
+    __m128 xy = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*)input);
+    return _mm_movelh_ps(xy, _mm_unpacklo_ps(_mm_load_ss(input + 2), w));
+}
+
+// x, y, z of v to a 3 float output. a 4 float store would spill into the next vertex, which
+// belongs to another thread at the end of a chunk
+static inline void Store3(float* output, __m128 v)
+{
+    _mm_storel_pi((__m64*)output, v);
+    _mm_store_ss(output + 2, _mm_movehl_ps(v, v));
+}
+
+// dot product of all 4 lanes, in every lane
+static inline __m128 Dot4(__m128 a, __m128 b)
+{
+    __m128 product = _mm_mul_ps(a, b);
+    product = _mm_add_ps(product, _mm_shuffle_ps(product, product, 0x4e));
+    return _mm_add_ps(product, _mm_shuffle_ps(product, product, 0xb1));
+}
+
+// cross product of the x, y, z lanes, 0 in w: (a * b.yzx - a.yzx * b).yzx
+static inline __m128 Cross(__m128 a, __m128 b)
+{
+    __m128 c = _mm_sub_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1))), _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1)), b));
+    return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+#endif
+
+#if defined(__AVX2__)
+// the same on both halves
+static inline __m256 Cross(__m256 a, __m256 b)
+{
+    __m256 c = _mm256_fmsub_ps(a, _mm256_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1)), _mm256_mul_ps(_mm256_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1)), b));
+    return _mm256_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+#endif
+
+// where the kernels put vertex i. Write gets the skinned position and the normal before it is
+// normalised, the packed output doesn't need it normalised
+struct SkinBatch::SplitOutput
+{
+    glm::vec3* positions;
+    glm::vec3* normals;
+
+#if defined(__SSE2__)
+    inline void Write(int i, __m128 position, __m128 normal) const
+    {
+        Store3(&positions[i].x, position);
+        Store3(&normals[i].x, _mm_div_ps(normal, _mm_sqrt_ps(Dot4(normal, normal))));
+    }
+#else
+    inline void Write(int i, const glm::vec3& position, const glm::vec3& normal) const
+    {
+        positions[i] = position;
+        normals[i] = glm::normalize(normal);
+    }
+#endif
+};
+
+struct SkinBatch::PackedOutput
+{
+    PackedVertex* vertices;
+
+#if defined(__SSE2__)
+    inline void Write(int i, __m128 position, __m128 normal) const
+    {
+        // onto the octahedron |x| + |y| + |z| = 32767 (snorm16 one), with the lower half folded
+        // out over the corners: (32767 - |y|, 32767 - |x|) with the signs of x and y
+        const __m128 signBit = _mm_set1_ps(-0.0f);
+        const __m128 one = _mm_set1_ps(32767.0f);
+        __m128 length = _mm_andnot_ps(signBit, normal);
+        length = _mm_add_ps(length, _mm_shuffle_ps(length, length, 0x4e));
+        length = _mm_add_ps(length, _mm_shuffle_ps(length, length, 0xb1));
+        __m128 octahedron = _mm_div_ps(_mm_mul_ps(normal, one), length);
+        __m128 yx = _mm_shuffle_ps(octahedron, octahedron, _MM_SHUFFLE(3, 2, 0, 1));
+        __m128 folded = _mm_or_ps(_mm_sub_ps(one, _mm_andnot_ps(signBit, yx)), _mm_and_ps(signBit, octahedron));
+        __m128 z = _mm_shuffle_ps(octahedron, octahedron, 0xaa);
+#if defined(__AVX2__)
+        // picks by the sign bit of z
+        octahedron = _mm_blendv_ps(octahedron, folded, z);
+#else
+        __m128 lower = _mm_cmplt_ps(z, _mm_setzero_ps());
+        octahedron = _mm_or_ps(_mm_and_ps(lower, folded), _mm_andnot_ps(lower, octahedron));
+#endif
+
+        // x and y rounded to shorts, both in the low 32 bits, then written with the position's
+        // x, y, z as one 16 byte store
+        __m128i snorm = _mm_cvtps_epi32(octahedron);
+        __m128 packed = _mm_castsi128_ps(_mm_packs_epi32(snorm, snorm));
+        __m128 zn = _mm_shuffle_ps(position, packed, _MM_SHUFFLE(0, 0, 2, 2));
+        _mm_storeu_ps(&vertices[i].position.x, _mm_shuffle_ps(position, zn, _MM_SHUFFLE(2, 0, 1, 0)));
+    }
+#else
+    inline void Write(int i, const glm::vec3& position, const glm::vec3& normal) const
+    {
+        vertices[i].position = position;
+        SkinBatch::EncodeNormal(normal, vertices[i].normal);
+    }
+#endif
+};
+
+// one vertex with count joints, count is a constant wherever this is inlined into a group's loop
+// so the influence loop unrolls and the single joint case drops its weights
+template <typename Output>
+static inline void LinearVertex(const float* palette, const uint16_t* j, const uint16_t* w, int count,
+    const float* restPosition, const float* restNormal, const Output& output, int i)
+{
+#if defined(__AVX2__)
+    // blended [skinning row | normal row] for each of the 3 rows
+    const float* m = palette + j[0] * SkinBatch::PALETTE_STRIDE;
+    __m256 row0 = _mm256_loadu_ps(m);
+    __m256 row1 = _mm256_loadu_ps(m + 8);
+    __m256 row2 = _mm256_loadu_ps(m + 16);
+    if (count > 1)
+    {
+        __m256 weight = _mm256_set1_ps(w[0] * WEIGHT_SCALE);
+        row0 = _mm256_mul_ps(weight, row0);
+        row1 = _mm256_mul_ps(weight, row1);
+        row2 = _mm256_mul_ps(weight, row2);
+        for (int k = 1; k < count; k++)
+        {
+            weight = _mm256_set1_ps(w[k] * WEIGHT_SCALE);
+            m = palette + j[k] * SkinBatch::PALETTE_STRIDE;
+            row0 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(m), row0);
+            row1 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(m + 8), row1);
+            row2 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(m + 16), row2);
+        }
+    }
+
+    // [x y z 1 | nx ny nz 0] against each row, then the 4 products of each row summed by
+    // transposing within both halves and adding
+    __m256 vertex = _mm256_insertf128_ps(_mm256_castps128_ps256(Load3(restPosition, _mm_set_ss(1.0f))), Load3(restNormal, _mm_setzero_ps()), 1);
+    __m256 p0 = _mm256_mul_ps(row0, vertex);
+    __m256 p1 = _mm256_mul_ps(row1, vertex);
+    __m256 p2 = _mm256_mul_ps(row2, vertex);
+    __m256 zero = _mm256_setzero_ps();
+    __m256 t0 = _mm256_unpacklo_ps(p0, p1);
+    __m256 t1 = _mm256_unpackhi_ps(p0, p1);
+    __m256 t2 = _mm256_unpacklo_ps(p2, zero);
+    __m256 t3 = _mm256_unpackhi_ps(p2, zero);
+    __m256 sum = _mm256_add_ps(_mm256_add_ps(_mm256_shuffle_ps(t0, t2, 0x44), _mm256_shuffle_ps(t0, t2, 0xee)),
+                               _mm256_add_ps(_mm256_shuffle_ps(t1, t3, 0x44), _mm256_shuffle_ps(t1, t3, 0xee)));
+
+    output.Write(i, _mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+#elif defined(__SSE2__)
+    // blended skinning rows and normal rows
+    __m128 rows[6];
+    const float* m = palette + j[0] * SkinBatch::PALETTE_STRIDE;
+    for (int row = 0; row < 3; row++)
+    {
+        rows[row] = _mm_loadu_ps(m + row * 8);
+        rows[3 + row] = _mm_loadu_ps(m + row * 8 + 4);
+    }
+    if (count > 1)
+    {
+        __m128 weight = _mm_set1_ps(w[0] * WEIGHT_SCALE);
+        for (int row = 0; row < 6; row++)
+        {
+            rows[row] = _mm_mul_ps(weight, rows[row]);
+        }
+        for (int k = 1; k < count; k++)
+        {
+            weight = _mm_set1_ps(w[k] * WEIGHT_SCALE);
+            m = palette + j[k] * SkinBatch::PALETTE_STRIDE;
+            for (int row = 0; row < 3; row++)
+            {
+                rows[row] = _mm_add_ps(rows[row], _mm_mul_ps(weight, _mm_loadu_ps(m + row * 8)));
+                rows[3 + row] = _mm_add_ps(rows[3 + row], _mm_mul_ps(weight, _mm_loadu_ps(m + row * 8 + 4)));
+            }
+        }
+    }
+
+    // products of each row with the vertex, transposed so the columns add up to the result
+    __m128 vertex = Load3(restPosition, _mm_set_ss(1.0f));
+    __m128 p0 = _mm_mul_ps(rows[0], vertex);
+    __m128 p1 = _mm_mul_ps(rows[1], vertex);
+    __m128 p2 = _mm_mul_ps(rows[2], vertex);
+    __m128 p3 = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+    __m128 blendedPosition = _mm_add_ps(_mm_add_ps(p0, p1), _mm_add_ps(p2, p3));
+
+    __m128 n = Load3(restNormal, _mm_setzero_ps());
+    __m128 n0 = _mm_mul_ps(rows[3], n);
+    __m128 n1 = _mm_mul_ps(rows[4], n);
+    __m128 n2 = _mm_mul_ps(rows[5], n);
+    __m128 n3 = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(n0, n1, n2, n3);
+    __m128 blendedNormal = _mm_add_ps(_mm_add_ps(n0, n1), _mm_add_ps(n2, n3));
+
+    output.Write(i, blendedPosition, blendedNormal);
+#else
+    // the same without SIMD
+    float blended[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    const float* p = restPosition;
+    const float* n = restNormal;
+    for (int k = 0; k < count; k++)
+    {
+        float weight = count > 1 ? w[k] * WEIGHT_SCALE : 1.0f;
+        const float* m = palette + j[k] * SkinBatch::PALETTE_STRIDE;
+        for (int row = 0; row < 3; row++)
+        {
+            const float* r = m + row * 8;
+            blended[row] += weight * (r[0] * p[0] + r[1] * p[1] + r[2] * p[2] + r[3]);
+            blended[3 + row] += weight * (r[4] * n[0] + r[5] * n[1] + r[6] * n[2]);
+        }
+    }
+
+    output.Write(i, glm::vec3(blended[0], blended[1], blended[2]), glm::vec3(blended[3], blended[4], blended[5]));
+#endif
+}
+
+// dual quaternion version of LinearVertex
+template <typename Output>
+static inline void DualQuaternionVertex(const float* palette, const uint16_t* j, const uint16_t* w, int count,
+    const float* restPosition, const float* restNormal, const Output& output, int i)
+{
+#if defined(__SSE2__)
+    // a single joint is already a unit dual quaternion in its own hemisphere. otherwise the
+    // first joint's rotation decides the hemisphere, and a joint whose rotation points the other
+    // way gets its weight negated through the sign bit of the dot product instead of a branch
+    const float* q = palette + j[0] * SkinBatch::PALETTE_STRIDE;
+    const __m128 two = _mm_set1_ps(2.0f);
+#if defined(__AVX2__)
+    __m256 blend = _mm256_loadu_ps(q);
+    if (count > 1)
+    {
+        __m128 pivot = _mm256_castps256_ps128(blend);
+        blend = _mm256_mul_ps(_mm256_set1_ps(w[0] * WEIGHT_SCALE), blend);
+        for (int k = 1; k < count; k++)
+        {
+            __m256 dq = _mm256_loadu_ps(palette + j[k] * SkinBatch::PALETTE_STRIDE);
+            __m128 sign = _mm_and_ps(Dot4(_mm256_castps256_ps128(dq), pivot), _mm_set1_ps(-0.0f));
+            __m128 weight = _mm_xor_ps(_mm_set1_ps(w[k] * WEIGHT_SCALE), sign);
+            blend = _mm256_fmadd_ps(_mm256_insertf128_ps(_mm256_castps128_ps256(weight), weight, 1), dq, blend);
+        }
+    }
+    __m128 real = _mm256_castps256_ps128(blend);
+    __m128 dual = _mm256_extractf128_ps(blend, 1);
+#else
+    __m128 real = _mm_loadu_ps(q);
+    __m128 dual = _mm_loadu_ps(q + 4);
+    if (count > 1)
+    {
+        __m128 pivot = real;
+        __m128 weight = _mm_set1_ps(w[0] * WEIGHT_SCALE);
+        real = _mm_mul_ps(weight, real);
+        dual = _mm_mul_ps(weight, dual);
+        for (int k = 1; k < count; k++)
+        {
+            q = palette + j[k] * SkinBatch::PALETTE_STRIDE;
+            __m128 qReal = _mm_loadu_ps(q);
+            __m128 sign = _mm_and_ps(Dot4(qReal, pivot), _mm_set1_ps(-0.0f));
+            weight = _mm_xor_ps(_mm_set1_ps(w[k] * WEIGHT_SCALE), sign);
+            real = _mm_add_ps(real, _mm_mul_ps(weight, qReal));
+            dual = _mm_add_ps(dual, _mm_mul_ps(weight, _mm_loadu_ps(q + 4)));
+        }
+    }
+#endif
+
+    // the blend is no longer unit length. rather than normalising it first, the rotation and
+    // translation are scaled by 2 / |r|^2, which comes out the same and keeps the square root
+    // and division off the path to the result
+    __m128 scale = _mm_div_ps(two, Dot4(real, real));
+    __m128 realW = _mm_shuffle_ps(real, real, 0xff);
+    __m128 dualW = _mm_shuffle_ps(dual, dual, 0xff);
+    __m128 translation = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(realW, dual), _mm_mul_ps(dualW, real)), Cross(real, dual));
+
+#if defined(__AVX2__)
+    // [x y z 1 | nx ny nz 0] rotated in one go: v' = v + 2 r x (r x v + w v) / |r|^2, and the
+    // position translated by 2 (w d - dw r + r x d) / |r|^2
+    __m256 vertex = _mm256_insertf128_ps(_mm256_castps128_ps256(Load3(restPosition, _mm_set_ss(1.0f))), Load3(restNormal, _mm_setzero_ps()), 1);
+    __m256 r = _mm256_insertf128_ps(_mm256_castps128_ps256(real), real, 1);
+    __m256 rw = _mm256_insertf128_ps(_mm256_castps128_ps256(realW), realW, 1);
+    __m256 s = _mm256_insertf128_ps(_mm256_castps128_ps256(scale), scale, 1);
+    __m256 rotated = _mm256_fmadd_ps(s, Cross(r, _mm256_fmadd_ps(rw, vertex, Cross(r, vertex))), vertex);
+
+    __m128 moved = _mm_fmadd_ps(scale, translation, _mm256_castps256_ps128(rotated));
+    __m128 rotatedNormal = _mm256_extractf128_ps(rotated, 1);
+#else
+    // v' = v + 2 r x (r x v + w v) / |r|^2, plus the translation 2 (w d - dw r + r x d) / |r|^2 for positions
+    __m128 p = Load3(restPosition, _mm_set_ss(1.0f));
+    __m128 moved = _mm_add_ps(p, _mm_mul_ps(scale, _mm_add_ps(Cross(real, _mm_add_ps(Cross(real, p), _mm_mul_ps(realW, p))), translation)));
+    __m128 n = Load3(restNormal, _mm_setzero_ps());
+    __m128 rotatedNormal = _mm_add_ps(n, _mm_mul_ps(scale, Cross(real, _mm_add_ps(Cross(real, n), _mm_mul_ps(realW, n)))));
+#endif
+
+    output.Write(i, moved, rotatedNormal);
+#else
+    // the same without SIMD
+    const float* pivot = palette + j[0] * SkinBatch::PALETTE_STRIDE;
+    float blend[8] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int k = 0; k < count; k++)
+    {
+        const float* q = palette + j[k] * SkinBatch::PALETTE_STRIDE;
+        float weight = count > 1 ? w[k] * WEIGHT_SCALE : 1.0f;
+        if (q[0] * pivot[0] + q[1] * pivot[1] + q[2] * pivot[2] + q[3] * pivot[3] < 0.0f)
+        {
+            weight = -weight;
+        }
+        for (int c = 0; c < 8; c++)
+        {
+            blend[c] += weight * q[c];
+        }
+    }
+
+    glm::vec3 real = glm::vec3(blend[0], blend[1], blend[2]);
+    float realW = blend[3];
+    glm::vec3 dual = glm::vec3(blend[4], blend[5], blend[6]);
+    float dualW = blend[7];
+    float scale = 2.0f / (glm::dot(real, real) + realW * realW);
+
+    glm::vec3 p = glm::vec3(restPosition[0], restPosition[1], restPosition[2]);
+    glm::vec3 n = glm::vec3(restNormal[0], restNormal[1], restNormal[2]);
+    glm::vec3 moved = p + scale * glm::cross(real, glm::cross(real, p) + realW * p) + scale * (realW * dual - dualW * real + glm::cross(real, dual));
+    output.Write(i, moved, n + scale * glm::cross(real, glm::cross(real, n) + realW * n));
+#endif
+}
+
+template <bool DualQuaternion, int K, typename Output>
+void SkinBatch::SkinGroup(const float* palette, int begin, int end, const Output& output)
+{
+    // K joints per vertex, K = 0 for the group with more than MAX_GROUPED_INFLUENCES
+    int g = K > 0 ? K - 1 : MAX_GROUPED_INFLUENCES;
+    begin = std::max(begin, groups[g]);
+    end = std::min(end, groups[g + 1]);
+
+    const uint16_t* j = joints.data() + jointStart[g];
+    const uint16_t* w = weights.data() + weightStart[g];
+    for (int i = begin; i < end; i++)
+    {
+        int first = K > 0 ? (i - groups[g]) * K : offsets[i - groups[g]];
+        int count = K > 0 ? K : offsets[i - groups[g] + 1] - first;
+        if (DualQuaternion)
+        {
+            DualQuaternionVertex(palette, j + first, K == 1 ? w : w + first, count, &restPositions[i].x, &restNormals[i].x, output, i);
+        }
+        else
+        {
+            LinearVertex(palette, j + first, K == 1 ? w : w + first, count, &restPositions[i].x, &restNormals[i].x, output, i);
+        }
+    }
+}
+
+template <bool DualQuaternion, typename Output>
+void SkinBatch::SkinGroups(const float* palette, int begin, int end, const Output& output)
+{
+    SkinGroup<DualQuaternion, 1>(palette, begin, end, output);
+    SkinGroup<DualQuaternion, 2>(palette, begin, end, output);
+    SkinGroup<DualQuaternion, 3>(palette, begin, end, output);
+    SkinGroup<DualQuaternion, 4>(palette, begin, end, output);
+    SkinGroup<DualQuaternion, 0>(palette, begin, end, output);
+}
+
+void SkinBatch::Skin(const float* palette, int begin, int end, glm::vec3* positions, glm::vec3* normals)
+{
+    SplitOutput output = { positions, normals };
+    SkinGroups<false>(palette, begin, end, output);
+}
+
+void SkinBatch::SkinDualQuaternion(const float* palette, int begin, int end, glm::vec3* positions, glm::vec3* normals)
+{
+    SplitOutput output = { positions, normals };
+    SkinGroups<true>(palette, begin, end, output);
+}
+
+void SkinBatch::SkinPacked(const float* palette, int begin, int end, PackedVertex* vertices)
+{
+    PackedOutput output = { vertices };
+    SkinGroups<false>(palette, begin, end, output);
+}
+
+void SkinBatch::SkinDualQuaternionPacked(const float* palette, int begin, int end, PackedVertex* vertices)
+{
+    PackedOutput output = { vertices };
+    SkinGroups<true>(palette, begin, end, output);
+}
+
+void SkinBatch::EncodeNormal(const glm::vec3& normal, int16_t encoded[2])
+{
+    // the same as PackedOutput::Write
+    glm::vec2 octahedron = glm::vec2(normal) / (glm::abs(normal.x) + glm::abs(normal.y) + glm::abs(normal.z));
+    if (normal.z < 0.0f)
+    {
+        glm::vec2 sign = glm::vec2(octahedron.x < 0.0f ? -1.0f : 1.0f, octahedron.y < 0.0f ? -1.0f : 1.0f);
+        octahedron = (1.0f - glm::abs(glm::vec2(octahedron.y, octahedron.x))) * sign;
+    }
+    encoded[0] = int16_t(glm::round(glm::clamp(octahedron.x, -1.0f, 1.0f) * 32767.0f));
+    encoded[1] = int16_t(glm::round(glm::clamp(octahedron.y, -1.0f, 1.0f) * 32767.0f));
+}
+
+glm::vec3 SkinBatch::DecodeNormal(const int16_t encoded[2])
+{
+    glm::vec2 octahedron = glm::clamp(glm::vec2(encoded[0], encoded[1]) / 32767.0f, -1.0f, 1.0f);
+    glm::vec3 normal = glm::vec3(octahedron, 1.0f - glm::abs(octahedron.x) - glm::abs(octahedron.y));
+    if (normal.z < 0.0f)
+    {
+        glm::vec2 sign = glm::vec2(octahedron.x < 0.0f ? -1.0f : 1.0f, octahedron.y < 0.0f ? -1.0f : 1.0f);
+        normal.x = (1.0f - glm::abs(octahedron.y)) * sign.x;
+        normal.y = (1.0f - glm::abs(octahedron.x)) * sign.y;
+    }
+    return glm::normalize(normal);
+}
+
+void SkinBatch::GetInfluences(int vertex, uint16_t joints[4], uint16_t weights[4])
+{
+    int g = 0;
+    while (vertex >= groups[g + 1])
+    {
+        g++;
+    }
+    int first = g < MAX_GROUPED_INFLUENCES ? (vertex - groups[g]) * (g + 1) : offsets[vertex - groups[g]];
+    int count = g < MAX_GROUPED_INFLUENCES ? g + 1 : offsets[vertex - groups[g] + 1] - first;
+
+    for (int k = 0; k < 4; k++)
+    {
+        joints[k] = k < count ? this->joints[jointStart[g] + first + k] : 0;
+        weights[k] = 0;
+    }
+
+    if (count == 1)
+    {
+        weights[0] = 65535;
+    }
+    else if (count <= 4)
+    {
+        for (int k = 0; k < count; k++)
+        {
+            weights[k] = this->weights[weightStart[g] + first + k];
+        }
+    }
+    else
+    {
+        // the heaviest 4 shared out again
+        float heaviest[4];
+        for (int k = 0; k < 4; k++)
+        {
+            heaviest[k] = this->weights[weightStart[g] + first + k];
+        }
+        Quantize(heaviest, 4, weights);
+    }
+}
+
+int SkinBatch::GetDirtyRanges(const std::vector<int>& joints, const std::vector<int>& vertices, int maxGap, std::vector<glm::ivec2>& ranges)
+{
+    ranges.clear();
+    std::fill(marks.begin(), marks.end(), 0);
+    int numJoints = jointVertexStart.size() - 1;
+    for (int k = 0; k < joints.size(); k++)
+    {
+        if (joints[k] < 0 || joints[k] >= numJoints)
+        {
+            continue;
+        }
+        for (int v = jointVertexStart[joints[k]]; v < jointVertexStart[joints[k] + 1]; v++)
+        {
+            marks[jointVertices[v]] = 1;
+        }
+    }
+    for (int k = 0; k < vertices.size(); k++)
+    {
+        if (vertices[k] >= 0 && vertices[k] < numVertices)
+        {
+            marks[vertices[k]] = 1;
+        }
+    }
+
+    int count = 0;
+    for (int i = 0; i < numVertices; i++)
+    {
+        if (!marks[i])
+        {
+            continue;
+        }
+        if (!ranges.empty() && i - ranges.back().y < maxGap)
+        {
+            count += i + 1 - ranges.back().y;
+            ranges.back().y = i + 1;
+        }
+        else
+        {
+            count++;
+            ranges.push_back(glm::ivec2(i, i + 1));
+        }
+    }
+    return count;
+}
+
+int SkinBatch::GetNumVertices()
+{
+    return numVertices;
+}
+
+float SkinBatch::GetBytesPerVertex()
+{
+    if (numVertices == 0)
+    {
+        return 0.0f;
+    }
+    size_t bytes = joints.size() * sizeof(uint16_t) + weights.size() * sizeof(uint16_t) + offsets.size() * sizeof(int)
+                 + numVertices * 2 * sizeof(glm::vec3);
+    return float(bytes) / numVertices;
+}
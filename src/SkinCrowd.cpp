@@ -0,0 +1,355 @@
+#include "SkinCrowd.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+SkinCrowd::SkinCrowd(Skin* skin)
+{
+    this->skin = skin;
+    batch = skin->GetBatch();
+    numVertices = batch ? batch->GetNumVertices() : 0;
+    numJoints = batch ? skin->GetInverseBindings().size() : 0;
+    skinningMode = skin->GetSkinningMode();
+    if (!batch)
+    {
+        printf("SkinCrowd::SkinCrowd - skin has no skeleton, nothing to skin\n");
+    }
+
+    numSkinnedVertices = 0;
+    modelsChanged = false;
+    chunkSize = 2048;
+
+    // no buffers until SetupBuffers
+    shader = 0;
+    VAO = 0;
+    numIndices = 0;
+    capacity = 0;
+    maxInstances = 0;
+
+    color = glm::vec3(0.8f, 0.8f, 0.8f);
+}
+
+SkinCrowd::~SkinCrowd()
+{
+    if (VAO != 0)
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &EBO);
+        glDeleteBuffers(1, &VBO_models);
+        glDeleteTextures(1, &arenaTexture);
+        glDeleteBuffers(1, &arenaBuffer);
+    }
+}
+
+int SkinCrowd::AddInstance(const glm::mat4& model)
+{
+    // the bind pose, where every skinning matrix is the identity
+    const std::vector<glm::mat4>& bindings = skin->GetBindings();
+    worldMatrices.insert(worldMatrices.end(), bindings.begin(), bindings.begin() + numJoints);
+    palettes.resize(palettes.size() + numJoints * SkinBatch::PALETTE_STRIDE);
+    arena.resize(arena.size() + numVertices);
+    models.push_back(model);
+    posed.push_back(1);
+    skinned.push_back(0);
+    modelsChanged = true;
+    return models.size() - 1;
+}
+
+void SkinCrowd::Clear()
+{
+    models.clear();
+    worldMatrices.clear();
+    palettes.clear();
+    arena.clear();
+    posed.clear();
+    skinned.clear();
+    modelsChanged = true;
+}
+
+int SkinCrowd::GetNumInstances()
+{
+    return models.size();
+}
+
+const glm::mat4& SkinCrowd::GetModel(int instance)
+{
+    return models[instance];
+}
+
+void SkinCrowd::SetModel(int instance, const glm::mat4& model)
+{
+    // applied in the shader, the skinned vertices don't change
+    models[instance] = model;
+    modelsChanged = true;
+}
+
+void SkinCrowd::SetPose(int instance, Skeleton* skeleton)
+{
+    glm::mat4* world = &worldMatrices[instance * numJoints];
+    for (int j = 0; j < numJoints; j++)
+    {
+        glm::mat4 matrix = skeleton->GetWorldMatrix(j);
+        if (matrix != world[j])
+        {
+            world[j] = matrix;
+            posed[instance] = 1;
+        }
+    }
+}
+
+SkinningMode SkinCrowd::GetSkinningMode()
+{
+    return skinningMode;
+}
+
+void SkinCrowd::SetSkinningMode(SkinningMode mode)
+{
+    // every palette holds something else in the other mode
+    if (mode != skinningMode)
+    {
+        std::fill(posed.begin(), posed.end(), 1);
+    }
+    skinningMode = mode;
+}
+
+int SkinCrowd::GetChunkSize()
+{
+    return chunkSize;
+}
+
+void SkinCrowd::SetChunkSize(int chunkSize)
+{
+    this->chunkSize = glm::max(chunkSize, 1);
+}
+
+void SkinCrowd::BuildPalette(int instance)
+{
+    // Mi = Wi * Bi^(-1) per joint, as in Skin::UpdatePalette but for every joint at once
+    const std::vector<glm::mat4>& inverseBindings = skin->GetInverseBindings();
+    const glm::mat4* world = &worldMatrices[instance * numJoints];
+    float* palette = &palettes[instance * numJoints * SkinBatch::PALETTE_STRIDE];
+    for (int j = 0; j < numJoints; j++)
+    {
+        glm::mat4 skinningMatrix = world[j] * inverseBindings[j];
+        if (skinningMode == SkinningMode::DualQuaternion)
+        {
+            SkinBatch::SetDualQuaternion(palette, j, skinningMatrix);
+            continue;
+        }
+        SkinBatch::SetJoint(palette, j, skinningMatrix, glm::transpose(glm::inverse(glm::mat3(skinningMatrix))));
+    }
+}
+
+void SkinCrowd::Deform()
+{
+    posedInstances.clear();
+    for (int i = 0; i < posed.size(); i++)
+    {
+        if (posed[i])
+        {
+            posedInstances.push_back(i);
+        }
+    }
+    numSkinnedVertices = posedInstances.size() * numVertices;
+    if (!batch || posedInstances.empty())
+    {
+        return;
+    }
+
+    ThreadPool* pool = ThreadPool::GetShared();
+    pool->ParallelFor(posedInstances.size(), 1, [&](int begin, int end)
+    {
+        for (int k = begin; k < end; k++)
+        {
+            BuildPalette(posedInstances[k]);
+        }
+    });
+
+    // the vertices of every posed instance as one job, in chunks that never span two instances
+    // so each chunk is one kernel call with one palette
+    int chunksPerInstance = (numVertices + chunkSize - 1) / chunkSize;
+    bool dualQuaternion = skinningMode == SkinningMode::DualQuaternion;
+    pool->ParallelFor(posedInstances.size() * chunksPerInstance, 1, [&](int begin, int end)
+    {
+        for (int chunk = begin; chunk < end; chunk++)
+        {
+            int instance = posedInstances[chunk / chunksPerInstance];
+            int first = (chunk % chunksPerInstance) * chunkSize;
+            int last = glm::min(first + chunkSize, numVertices);
+            const float* palette = &palettes[instance * numJoints * SkinBatch::PALETTE_STRIDE];
+            SkinBatch::PackedVertex* vertices = &arena[instance * numVertices];
+            if (dualQuaternion)
+            {
+                batch->SkinDualQuaternionPacked(palette, first, last, vertices);
+            }
+            else
+            {
+                batch->SkinPacked(palette, first, last, vertices);
+            }
+        }
+    });
+
+    for (int k = 0; k < posedInstances.size(); k++)
+    {
+        posed[posedInstances[k]] = 0;
+        skinned[posedInstances[k]] = 1;
+    }
+}
+
+void SkinCrowd::Update()
+{
+    if (VAO == 0)
+    {
+        SetupBuffers();
+    }
+
+    Deform();
+
+    int numInstances = models.size();
+    if (numInstances > capacity)
+    {
+        // out of room, everything goes up again into buffers with some to spare
+        capacity = glm::max(numInstances, capacity * 2);
+        glBindBuffer(GL_TEXTURE_BUFFER, arenaBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, sizeof(SkinBatch::PackedVertex) * numVertices * capacity, nullptr, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, sizeof(SkinBatch::PackedVertex) * arena.size(), arena.data());
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO_models);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(glm::mat4) * capacity, nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        std::fill(skinned.begin(), skinned.end(), 0);
+        modelsChanged = true;
+    }
+
+    // only the instances skinned since the last upload, a run of neighbours in one call
+    glBindBuffer(GL_TEXTURE_BUFFER, arenaBuffer);
+    for (int i = 0; i < numInstances; i++)
+    {
+        if (!skinned[i])
+        {
+            continue;
+        }
+        int end = i;
+        while (end < numInstances && skinned[end])
+        {
+            skinned[end++] = 0;
+        }
+        glBufferSubData(GL_TEXTURE_BUFFER, sizeof(SkinBatch::PackedVertex) * numVertices * i,
+            sizeof(SkinBatch::PackedVertex) * numVertices * (end - i), &arena[i * numVertices]);
+        i = end;
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    if (modelsChanged)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, VBO_models);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(glm::mat4) * numInstances, models.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        modelsChanged = false;
+    }
+}
+
+void SkinCrowd::SetShader(GLuint shader)
+{
+    this->shader = shader;
+}
+
+void SkinCrowd::Draw(const glm::mat4& viewProjMtx, const glm::vec3& lightDirection1, const glm::vec3& lightColor1, const glm::vec3& lightDirection2, const glm::vec3& lightColor2)
+{
+    if (VAO == 0)
+    {
+        SetupBuffers();
+    }
+
+    // only what has been uploaded, and no more than the buffer texture reaches
+    int numInstances = glm::min(glm::min((int)models.size(), capacity), maxInstances);
+    if (shader == 0 || numInstances == 0 || numIndices == 0)
+    {
+        return;
+    }
+
+    glUseProgram(shader);
+
+    // the same uniforms as Skin::Draw, minus the model matrix which comes per instance
+    glUniformMatrix4fv(glGetUniformLocation(shader, "viewProj"), 1, false, (float*)&viewProjMtx);
+    glUniform3fv(glGetUniformLocation(shader, "DiffuseColor"), 1, &color[0]);
+    glUniform3fv(glGetUniformLocation(shader, "LightDirection1"), 1, &lightDirection1[0]);
+    glUniform3fv(glGetUniformLocation(shader, "LightDirection2"), 1, &lightDirection2[0]);
+    glUniform3fv(glGetUniformLocation(shader, "LightColor1"), 1, &lightColor1[0]);
+    glUniform3fv(glGetUniformLocation(shader, "LightColor2"), 1, &lightColor2[0]);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, arenaTexture);
+    glUniform1i(glGetUniformLocation(shader, "vertices"), 0);
+    glUniform1i(glGetUniformLocation(shader, "numVertices"), numVertices);
+
+    glBindVertexArray(VAO);
+    glDrawElementsInstanced(GL_TRIANGLES, numIndices, GL_UNSIGNED_INT, 0, numInstances);
+    glBindVertexArray(0);
+
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glUseProgram(0);
+}
+
+void SkinCrowd::SetupBuffers()
+{
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &EBO);
+    glGenBuffers(1, &VBO_models);
+    glBindVertexArray(VAO);
+
+    // the skin's triangles, already in the batch's vertex order
+    std::vector<Triangle>& triangles = skin->GetTriangles();
+    std::vector<unsigned int> indices;
+    indices.reserve(triangles.size() * 3);
+    for (int i = 0; i < triangles.size(); i++)
+    {
+        indices.push_back(triangles[i].GetVertexIndex1());
+        indices.push_back(triangles[i].GetVertexIndex2());
+        indices.push_back(triangles[i].GetVertexIndex3());
+    }
+    numIndices = batch ? indices.size() : 0;
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(), indices.data(), GL_STATIC_DRAW);
+
+    // a mat4 attribute takes 4 locations, one column each, and moves on once per instance
+    glBindBuffer(GL_ARRAY_BUFFER, VBO_models);
+    for (int column = 0; column < 4; column++)
+    {
+        glEnableVertexAttribArray(column);
+        glVertexAttribPointer(column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(sizeof(glm::vec4) * column));
+        glVertexAttribDivisor(column, 1);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+    // PackedVertex is 4 32 bit words, read as one rgba32ui texel so the position's float bits
+    // and the normal's shorts come through untouched. sized by the first Update
+    glGenBuffers(1, &arenaBuffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, arenaBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, 0, nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glGenTextures(1, &arenaTexture);
+    glBindTexture(GL_TEXTURE_BUFFER, arenaTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32UI, arenaBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    GLint maxTexels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    maxInstances = numVertices > 0 ? maxTexels / numVertices : 0;
+    printf("SkinCrowd::SetupBuffers - %d vertices per instance, at most %d instances drawn\n", numVertices, maxInstances);
+}
+
+const SkinBatch::PackedVertex* SkinCrowd::GetVertices(int instance)
+{
+    return &arena[instance * numVertices];
+}
+
+int SkinCrowd::GetNumVertices()
+{
+    return numVertices;
+}
+
+int SkinCrowd::GetNumSkinnedVertices()
+{
+    return numSkinnedVertices;
+}
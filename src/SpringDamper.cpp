@@ -1,12 +1,15 @@
 #include "SpringDamper.h"
 
-SpringDamper::SpringDamper(Particle* p1, Particle* p2, float springConstant, float dampingConstant, float restLength)
+SpringDamper::SpringDamper(Particle* p1, Particle* p2, int indexP1, int indexP2, float springConstant, float dampingConstant, float restLength)
 {
     this->p1 = p1;
     this->p2 = p2;
+    this->indexP1 = indexP1;
+    this->indexP2 = indexP2;
     this->springConstant = springConstant;
     this->dampingConstant = dampingConstant;
     this->restLength = restLength;
+    broken = false;
 }
 
 void SpringDamper::ComputeForce()
@@ -42,4 +45,58 @@ Particle* SpringDamper::GetP1()
 Particle* SpringDamper::GetP2()
 {
     return p2;
+}
+
+int SpringDamper::GetIndexP1()
+{
+    return indexP1;
+}
+
+int SpringDamper::GetIndexP2()
+{
+    return indexP2;
+}
+
+float SpringDamper::GetSpringConstant()
+{
+    return springConstant;
+}
+
+float SpringDamper::GetDampingConstant()
+{
+    return dampingConstant;
+}
+
+float SpringDamper::GetRestLength()
+{
+    return restLength;
+}
+
+void SpringDamper::SetSpringConstant(float springConstant)
+{
+    this->springConstant = springConstant;
+}
+
+void SpringDamper::SetP1(Particle* p1, int indexP1)
+{
+    this->p1 = p1;
+    this->indexP1 = indexP1;
+}
+
+void SpringDamper::SetP2(Particle* p2, int indexP2)
+{
+    this->p2 = p2;
+    this->indexP2 = indexP2;
+}
+
+void SpringDamper::Break()
+{
+    springConstant = 0.0f;
+    dampingConstant = 0.0f;
+    broken = true;
+}
+
+bool SpringDamper::IsBroken()
+{
+    return broken;
 }
\ No newline at end of file
@@ -0,0 +1,137 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(int numThreads)
+{
+    if (numThreads <= 0)
+    {
+        numThreads = (int)std::thread::hardware_concurrency();
+    }
+    if (numThreads <= 0)
+    {
+        numThreads = 1;
+    }
+
+    task = nullptr;
+    count = 0;
+    grainSize = 1;
+    nextIndex = 0;
+    busyWorkers = 0;
+    generation = 0;
+    stopping = false;
+
+    // caller is the first thread, so only spawn numThreads - 1 workers
+    for (int i = 0; i < numThreads - 1; i++)
+    {
+        workers.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeCondition.notify_all();
+
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::ParallelFor(int count, int grainSize, const std::function<void(int, int)>& task)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+
+    if (grainSize < 1)
+    {
+        grainSize = 1;
+    }
+
+    // not worth waking anyone up for a single chunk
+    if (workers.empty() || count <= grainSize)
+    {
+        task(0, count);
+        return;
+    }
+
+    std::lock_guard<std::mutex> submitLock(submitMutex);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->task = &task;
+        this->count = count;
+        this->grainSize = grainSize;
+        nextIndex = 0;
+        busyWorkers = (int)workers.size();
+        generation++;
+    }
+    wakeCondition.notify_all();
+
+    // caller helps out
+    RunChunks();
+
+    // wait for every worker to finish its last chunk
+    std::unique_lock<std::mutex> lock(mutex);
+    doneCondition.wait(lock, [this] { return busyWorkers == 0; });
+    this->task = nullptr;
+}
+
+int ThreadPool::GetNumThreads()
+{
+    return (int)workers.size() + 1;
+}
+
+ThreadPool* ThreadPool::GetShared()
+{
+    static ThreadPool sharedPool;
+    return &sharedPool;
+}
+
+void ThreadPool::WorkerLoop()
+{
+    unsigned int lastGeneration = 0;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeCondition.wait(lock, [this, lastGeneration] { return stopping || generation != lastGeneration; });
+
+            if (stopping)
+            {
+                return;
+            }
+
+            lastGeneration = generation;
+        }
+
+        RunChunks();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busyWorkers--;
+        }
+        doneCondition.notify_one();
+    }
+}
+
+void ThreadPool::RunChunks()
+{
+    // grab chunks until the range is used up
+    while (true)
+    {
+        int begin = nextIndex.fetch_add(grainSize);
+        if (begin >= count)
+        {
+            break;
+        }
+
+        int end = begin + grainSize < count ? begin + grainSize : count;
+        (*task)(begin, end);
+    }
+}
@@ -49,9 +49,10 @@ Vertex::Vertex(glm::vec3 position, glm::vec3 normal, int numAttachments, const s
     // calculate bitangent by crossing normal with tangent and normalise
     this->bitangent = glm::normalize(glm::cross(normal, tangent));
 
-    this->numAttachments = numAttachments;
+    // only room for 4, any further attachments are dropped
+    this->numAttachments = glm::min(numAttachments, 4);
 
-    for (int i = 0; i < numAttachments; i++)
+    for (int i = 0; i < this->numAttachments; i++)
     {
         // cast as uint8_t
         // this->jointIndices[i] = uint8_t(jointIndices[i]);
@@ -0,0 +1,402 @@
+#include "WindField.h"
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// pseudo-random value in [-1, 1] for a lattice point
+static float Hash(int x, int y, int z, int seed)
+{
+    uint32_t h = (uint32_t)x * 374761393u + (uint32_t)y * 668265263u + (uint32_t)z * 2246822519u + (uint32_t)seed * 3266489917u;
+    h = (h ^ (h >> 13)) * 1274126177u;
+    h ^= h >> 16;
+    return h * (2.0f / 4294967295.0f) - 1.0f;
+}
+
+// the curl of value noise of unit amplitude over turbulenceScale has an rms of about 1 / (0.6 * turbulenceScale)
+static const float CURL_SCALE = 0.6f;
+
+// three incommensurate swells so the pattern never visibly repeats, in [-1, 1]
+static float Gust(float time, float period)
+{
+    float phase = 6.2831853f * time / period;
+    return (sinf(phase) + 0.5f * sinf(2.3f * phase + 1.7f) + 0.25f * sinf(5.1f * phase + 0.4f)) / 1.75f;
+}
+
+WindField::WindField(glm::vec3 minCorner, glm::vec3 maxCorner, float cellSize)
+{
+    this->minCorner = minCorner;
+    this->cellSize = cellSize;
+
+    glm::vec3 extent = glm::max(maxCorner - minCorner, glm::vec3(0.0f));
+    sizeX = glm::max((int)ceilf(extent.x / cellSize) + 1, 2);
+    sizeY = glm::max((int)ceilf(extent.y / cellSize) + 1, 2);
+    sizeZ = glm::max((int)ceilf(extent.z / cellSize) + 1, 2);
+
+    int numNodes = sizeX * sizeY * sizeZ;
+    nodeVelocities.assign(numNodes, glm::vec3(0.0f));
+    velocityX.assign(numNodes, 0.0f);
+    velocityY.assign(numNodes, 0.0f);
+    velocityZ.assign(numNodes, 0.0f);
+    potential.assign(numNodes, glm::vec3(0.0f));
+
+    meanWind = glm::vec3(0.0f);
+    gustStrength = 0.5f;
+    gustPeriod = 4.0f;
+    turbulenceStrength = 1.0f;
+    turbulenceScale = 2.0f;
+
+    // 60 bakes per simulated second, the wind barely moves in between
+    refreshInterval = 1.0f / 60.0f;
+    bakedTime = 0.0f;
+    dirty = true;
+}
+
+int WindField::NodeIndex(int x, int y, int z)
+{
+    return x + sizeX * (y + sizeY * z);
+}
+
+void WindField::Update(float time)
+{
+    if (dirty || time >= bakedTime + refreshInterval || time < bakedTime)
+    {
+        Bake(time);
+    }
+}
+
+void WindField::Bake(float time)
+{
+    ThreadPool* pool = ThreadPool::GetShared();
+
+    // the turbulence pattern is carried along by the mean wind
+    glm::vec3 drift = meanWind * time;
+    bool turbulent = turbulenceStrength > 0.0f && turbulenceScale > 0.0f;
+    if (turbulent)
+    {
+        // value noise: random vectors on a lattice turbulenceScale apart, blended with smoothstep
+        // weights. the lattice points under the box are hashed once, then each node just blends
+        glm::vec3 first = glm::floor((minCorner - drift) / turbulenceScale);
+        glm::vec3 last = glm::floor((minCorner + glm::vec3(sizeX - 1, sizeY - 1, sizeZ - 1) * cellSize - drift) / turbulenceScale) + 1.0f;
+        int latticeX = (int)(last.x - first.x) + 1;
+        int latticeY = (int)(last.y - first.y) + 1;
+        int latticeZ = (int)(last.z - first.z) + 1;
+        lattice.resize(latticeX * latticeY * latticeZ);
+        for (int z = 0; z < latticeZ; z++)
+        {
+            for (int y = 0; y < latticeY; y++)
+            {
+                for (int x = 0; x < latticeX; x++)
+                {
+                    int lx = (int)first.x + x;
+                    int ly = (int)first.y + y;
+                    int lz = (int)first.z + z;
+                    lattice[x + latticeX * (y + latticeY * z)] = glm::vec3(Hash(lx, ly, lz, 0), Hash(lx, ly, lz, 1), Hash(lx, ly, lz, 2));
+                }
+            }
+        }
+
+        pool->ParallelFor(sizeZ, 1, [&](int begin, int end)
+        {
+            for (int z = begin; z < end; z++)
+            {
+                for (int y = 0; y < sizeY; y++)
+                {
+                    for (int x = 0; x < sizeX; x++)
+                    {
+                        glm::vec3 p = (minCorner + glm::vec3(x, y, z) * cellSize - drift) / turbulenceScale - first;
+                        glm::vec3 cell = glm::clamp(glm::floor(p), glm::vec3(0.0f), glm::vec3(latticeX - 2, latticeY - 2, latticeZ - 2));
+                        glm::vec3 f = p - cell;
+                        glm::vec3 w = f * f * (3.0f - 2.0f * f);
+
+                        int l = (int)cell.x + latticeX * ((int)cell.y + latticeY * (int)cell.z);
+                        int ly = latticeX;
+                        int lz = latticeX * latticeY;
+                        glm::vec3 x00 = glm::mix(lattice[l], lattice[l + 1], w.x);
+                        glm::vec3 x10 = glm::mix(lattice[l + ly], lattice[l + ly + 1], w.x);
+                        glm::vec3 x01 = glm::mix(lattice[l + lz], lattice[l + lz + 1], w.x);
+                        glm::vec3 x11 = glm::mix(lattice[l + ly + lz], lattice[l + ly + lz + 1], w.x);
+                        potential[NodeIndex(x, y, z)] = glm::mix(glm::mix(x00, x10, w.y), glm::mix(x01, x11, w.y), w.z);
+                    }
+                }
+            }
+        });
+    }
+
+    // gusts travel downwind at the speed of the mean wind
+    float speed = glm::length(meanWind);
+    glm::vec3 direction = speed > 0.0f ? meanWind / speed : glm::vec3(0.0f);
+
+    // turbulence with an rms speed of turbulenceStrength (a bit less on a grid too coarse for the scale)
+    float curlScale = turbulenceStrength * turbulenceScale * CURL_SCALE;
+
+    pool->ParallelFor(sizeZ, 1, [&](int begin, int end)
+    {
+        for (int z = begin; z < end; z++)
+        {
+            for (int y = 0; y < sizeY; y++)
+            {
+                for (int x = 0; x < sizeX; x++)
+                {
+                    int node = NodeIndex(x, y, z);
+                    glm::vec3 position = minCorner + glm::vec3(x, y, z) * cellSize;
+                    glm::vec3 velocity = nodeVelocities[node];
+
+                    if (speed > 0.0f)
+                    {
+                        float arrival = time - glm::dot(position, direction) / speed;
+                        velocity += meanWind * (1.0f + gustStrength * Gust(arrival, gustPeriod));
+                    }
+
+                    if (turbulent)
+                    {
+                        // central differences inside, one-sided on the faces of the box
+                        int x0 = glm::max(x - 1, 0), x1 = glm::min(x + 1, sizeX - 1);
+                        int y0 = glm::max(y - 1, 0), y1 = glm::min(y + 1, sizeY - 1);
+                        int z0 = glm::max(z - 1, 0), z1 = glm::min(z + 1, sizeZ - 1);
+                        glm::vec3 dx = (potential[NodeIndex(x1, y, z)] - potential[NodeIndex(x0, y, z)]) / ((x1 - x0) * cellSize);
+                        glm::vec3 dy = (potential[NodeIndex(x, y1, z)] - potential[NodeIndex(x, y0, z)]) / ((y1 - y0) * cellSize);
+                        glm::vec3 dz = (potential[NodeIndex(x, y, z1)] - potential[NodeIndex(x, y, z0)]) / ((z1 - z0) * cellSize);
+
+                        glm::vec3 curl(dy.z - dz.y, dz.x - dx.z, dx.y - dy.x);
+                        velocity += curl * curlScale;
+                    }
+
+                    velocityX[node] = velocity.x;
+                    velocityY[node] = velocity.y;
+                    velocityZ[node] = velocity.z;
+                }
+            }
+        }
+    });
+
+    bakedTime = time;
+    dirty = false;
+}
+
+glm::vec3 WindField::Sample(glm::vec3 position)
+{
+    glm::vec3 wind;
+    Sample(&position.x, &position.y, &position.z, 1, &wind.x, &wind.y, &wind.z);
+    return wind;
+}
+
+void WindField::Sample(const float* x, const float* y, const float* z, int count, float* windX, float* windY, float* windZ)
+{
+    const float* __restrict vx = velocityX.data();
+    const float* __restrict vy = velocityY.data();
+    const float* __restrict vz = velocityZ.data();
+    float inverseCellSize = 1.0f / cellSize;
+    int sliceSize = sizeX * sizeY;
+
+    int i = 0;
+
+#if defined(__AVX2__)
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 inverse = _mm256_set1_ps(inverseCellSize);
+    const __m256 originX = _mm256_set1_ps(minCorner.x);
+    const __m256 originY = _mm256_set1_ps(minCorner.y);
+    const __m256 originZ = _mm256_set1_ps(minCorner.z);
+    const __m256 lastX = _mm256_set1_ps((float)(sizeX - 1));
+    const __m256 lastY = _mm256_set1_ps((float)(sizeY - 1));
+    const __m256 lastZ = _mm256_set1_ps((float)(sizeZ - 1));
+    const __m256i lastCellX = _mm256_set1_epi32(sizeX - 2);
+    const __m256i lastCellY = _mm256_set1_epi32(sizeY - 2);
+    const __m256i lastCellZ = _mm256_set1_epi32(sizeZ - 2);
+    const __m256i strideY = _mm256_set1_epi32(sizeX);
+    const __m256i strideZ = _mm256_set1_epi32(sliceSize);
+    const __m256i cornerX = _mm256_set1_epi32(1);
+
+    for (; i + 8 <= count; i += 8)
+    {
+        // grid coordinates clamped into the box (max_ps returns the second operand for nan)
+        __m256 gx = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(x + i), originX), inverse), zero), lastX);
+        __m256 gy = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(y + i), originY), inverse), zero), lastY);
+        __m256 gz = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(z + i), originZ), inverse), zero), lastZ);
+
+        // cell and position inside it, the last node belongs to the cell before it
+        __m256i cx = _mm256_min_epi32(_mm256_cvttps_epi32(gx), lastCellX);
+        __m256i cy = _mm256_min_epi32(_mm256_cvttps_epi32(gy), lastCellY);
+        __m256i cz = _mm256_min_epi32(_mm256_cvttps_epi32(gz), lastCellZ);
+        __m256 fx = _mm256_sub_ps(gx, _mm256_cvtepi32_ps(cx));
+        __m256 fy = _mm256_sub_ps(gy, _mm256_cvtepi32_ps(cy));
+        __m256 fz = _mm256_sub_ps(gz, _mm256_cvtepi32_ps(cz));
+
+        // the 8 corner nodes
+        __m256i n000 = _mm256_add_epi32(_mm256_add_epi32(cx, _mm256_mullo_epi32(cy, strideY)), _mm256_mullo_epi32(cz, strideZ));
+        __m256i n100 = _mm256_add_epi32(n000, cornerX);
+        __m256i n010 = _mm256_add_epi32(n000, strideY);
+        __m256i n110 = _mm256_add_epi32(n010, cornerX);
+        __m256i n001 = _mm256_add_epi32(n000, strideZ);
+        __m256i n101 = _mm256_add_epi32(n001, cornerX);
+        __m256i n011 = _mm256_add_epi32(n001, strideY);
+        __m256i n111 = _mm256_add_epi32(n011, cornerX);
+
+        const float* planes[3] = { vx, vy, vz };
+        float* outputs[3] = { windX, windY, windZ };
+        for (int c = 0; c < 3; c++)
+        {
+            const float* v = planes[c];
+            __m256 v000 = _mm256_i32gather_ps(v, n000, 4);
+            __m256 v100 = _mm256_i32gather_ps(v, n100, 4);
+            __m256 v010 = _mm256_i32gather_ps(v, n010, 4);
+            __m256 v110 = _mm256_i32gather_ps(v, n110, 4);
+            __m256 v001 = _mm256_i32gather_ps(v, n001, 4);
+            __m256 v101 = _mm256_i32gather_ps(v, n101, 4);
+            __m256 v011 = _mm256_i32gather_ps(v, n011, 4);
+            __m256 v111 = _mm256_i32gather_ps(v, n111, 4);
+
+            // along x, then y, then z
+            __m256 v00 = _mm256_add_ps(v000, _mm256_mul_ps(fx, _mm256_sub_ps(v100, v000)));
+            __m256 v10 = _mm256_add_ps(v010, _mm256_mul_ps(fx, _mm256_sub_ps(v110, v010)));
+            __m256 v01 = _mm256_add_ps(v001, _mm256_mul_ps(fx, _mm256_sub_ps(v101, v001)));
+            __m256 v11 = _mm256_add_ps(v011, _mm256_mul_ps(fx, _mm256_sub_ps(v111, v011)));
+            __m256 v0 = _mm256_add_ps(v00, _mm256_mul_ps(fy, _mm256_sub_ps(v10, v00)));
+            __m256 v1 = _mm256_add_ps(v01, _mm256_mul_ps(fy, _mm256_sub_ps(v11, v01)));
+            _mm256_storeu_ps(outputs[c] + i, _mm256_add_ps(v0, _mm256_mul_ps(fz, _mm256_sub_ps(v1, v0))));
+        }
+    }
+#endif
+
+    // the same per point, for the tail (or everything without AVX2)
+    for (; i < count; i++)
+    {
+        float gx = (x[i] - minCorner.x) * inverseCellSize;
+        float gy = (y[i] - minCorner.y) * inverseCellSize;
+        float gz = (z[i] - minCorner.z) * inverseCellSize;
+        gx = glm::min(gx > 0.0f ? gx : 0.0f, (float)(sizeX - 1));
+        gy = glm::min(gy > 0.0f ? gy : 0.0f, (float)(sizeY - 1));
+        gz = glm::min(gz > 0.0f ? gz : 0.0f, (float)(sizeZ - 1));
+
+        int cx = glm::min((int)gx, sizeX - 2);
+        int cy = glm::min((int)gy, sizeY - 2);
+        int cz = glm::min((int)gz, sizeZ - 2);
+        float fx = gx - cx;
+        float fy = gy - cy;
+        float fz = gz - cz;
+
+        int n000 = cx + cy * sizeX + cz * sliceSize;
+        int n010 = n000 + sizeX;
+        int n001 = n000 + sliceSize;
+        int n011 = n001 + sizeX;
+
+        const float* planes[3] = { vx, vy, vz };
+        float* outputs[3] = { windX, windY, windZ };
+        for (int c = 0; c < 3; c++)
+        {
+            const float* v = planes[c];
+            float v00 = v[n000] + fx * (v[n000 + 1] - v[n000]);
+            float v10 = v[n010] + fx * (v[n010 + 1] - v[n010]);
+            float v01 = v[n001] + fx * (v[n001 + 1] - v[n001]);
+            float v11 = v[n011] + fx * (v[n011 + 1] - v[n011]);
+            float v0 = v00 + fy * (v10 - v00);
+            float v1 = v01 + fy * (v11 - v01);
+            outputs[c][i] = v0 + fz * (v1 - v0);
+        }
+    }
+}
+
+int WindField::GetSizeX()
+{
+    return sizeX;
+}
+
+int WindField::GetSizeY()
+{
+    return sizeY;
+}
+
+int WindField::GetSizeZ()
+{
+    return sizeZ;
+}
+
+glm::vec3 WindField::GetMinCorner()
+{
+    return minCorner;
+}
+
+float WindField::GetCellSize()
+{
+    return cellSize;
+}
+
+glm::vec3 WindField::GetNodeVelocity(int x, int y, int z)
+{
+    return nodeVelocities[NodeIndex(x, y, z)];
+}
+
+void WindField::SetNodeVelocity(int x, int y, int z, glm::vec3 velocity)
+{
+    nodeVelocities[NodeIndex(x, y, z)] = velocity;
+    dirty = true;
+}
+
+glm::vec3 WindField::GetMeanWind()
+{
+    return meanWind;
+}
+
+void WindField::SetMeanWind(glm::vec3 meanWind)
+{
+    if (meanWind != this->meanWind)
+    {
+        this->meanWind = meanWind;
+        dirty = true;
+    }
+}
+
+float WindField::GetGustStrength()
+{
+    return gustStrength;
+}
+
+void WindField::SetGustStrength(float gustStrength)
+{
+    this->gustStrength = gustStrength;
+    dirty = true;
+}
+
+float WindField::GetGustPeriod()
+{
+    return gustPeriod;
+}
+
+void WindField::SetGustPeriod(float gustPeriod)
+{
+    this->gustPeriod = glm::max(gustPeriod, 0.01f);
+    dirty = true;
+}
+
+float WindField::GetTurbulenceStrength()
+{
+    return turbulenceStrength;
+}
+
+void WindField::SetTurbulenceStrength(float turbulenceStrength)
+{
+    this->turbulenceStrength = turbulenceStrength;
+    dirty = true;
+}
+
+float WindField::GetTurbulenceScale()
+{
+    return turbulenceScale;
+}
+
+void WindField::SetTurbulenceScale(float turbulenceScale)
+{
+    this->turbulenceScale = turbulenceScale;
+    dirty = true;
+}
+
+float WindField::GetRefreshInterval()
+{
+    return refreshInterval;
+}
+
+void WindField::SetRefreshInterval(float refreshInterval)
+{
+    this->refreshInterval = refreshInterval;
+}
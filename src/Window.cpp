@@ -1,4 +1,5 @@
 #include "Window.h"
+#include <cfloat>
 
 // Window Properties
 int Window::width;
@@ -14,6 +15,7 @@ Skeleton* Window::skeleton;
 
 #ifdef INCLUDE_SKIN
 Skin* Window::skin;
+SkinCrowd* Window::crowd;
 #endif
 
 #ifdef INCLUDE_ANIMATION
@@ -44,6 +46,10 @@ int MouseX, MouseY;
 // The shader program id
 GLuint Window::shaderProgram;
 GLuint Window::ptShaderProgram;
+#ifdef INCLUDE_SKIN
+GLuint Window::skinShaderProgram;
+GLuint Window::crowdShaderProgram;
+#endif
 
 // imgui stuff
 #ifdef INCLUDE_SKELETON
@@ -51,10 +57,24 @@ static Joint* selectedJoint = nullptr;
 static int currentJointIndex = 0;
 #endif
 
+#ifdef INCLUDE_ANIMATION
+// scratch for posing the crowd
+static Pose crowdPose;
+#endif
+
 #ifdef INCLUDE_CLOTH
 Cloth* Window::cloth;
+ClothWorld* Window::clothWorld;
+ClothRenderer* Window::clothRenderer;
+ClothSimulationThread* Window::clothThread;
 glm::vec3 Window::wind = glm::vec3(0.0f, 0.0f, 0.0f);
+WindField* Window::windField;
 bool Window::pauseSimulation = false;
+float Window::timestep = 0.002f;
+ClothCacheWriter* Window::cacheWriter;
+ClothCacheReader* Window::cacheReader;
+int Window::cacheFrame = 0;
+static std::vector<glm::vec3> cachePositions;
 #endif
 
 #ifdef INCLUDE_SPH
@@ -67,6 +87,10 @@ bool Window::initializeProgram(GLFWwindow* window) {
     // Create a shader program with a vertex shader and a fragment shader.
     shaderProgram = LoadShaders("shaders/shader.vert", "shaders/shader.frag");
     ptShaderProgram = LoadShaders("shaders/point.vert", "shaders/point.frag");
+    #ifdef INCLUDE_SKIN
+    skinShaderProgram = LoadShaders("shaders/skin.vert", "shaders/shader.frag");
+    crowdShaderProgram = LoadShaders("shaders/crowd.vert", "shaders/shader.frag");
+    #endif
 
     // project 2 lighting stuff
     #ifdef INCLUDE_SKIN
@@ -94,9 +118,22 @@ bool Window::initializeProgram(GLFWwindow* window) {
         return false;
     }
 
+    #ifdef INCLUDE_SKIN
+    if (!skinShaderProgram) {
+        std::cerr << "Failed to initialize skinning shader program" << std::endl;
+        return false;
+    }
+
+    if (!crowdShaderProgram) {
+        std::cerr << "Failed to initialize crowd shader program" << std::endl;
+        return false;
+    }
+    #endif
+
     #ifdef INCLUDE_CLOTH
     wind = glm::vec3(0.0f, 0.0f, 0.0f);
     pauseSimulation = false;
+    timestep = 0.002f;
     #endif
 
     return true;
@@ -113,6 +150,8 @@ bool Window::initializeObjects() {
 
     #ifdef INCLUDE_SKIN
     skin = new Skin();
+    skin->SetSkinningShader(skinShaderProgram);
+    crowd = nullptr;
     #endif
 
     #ifdef INCLUDE_ANIMATION
@@ -135,6 +174,12 @@ bool Window::initializeObjects() {
 
     #ifdef INCLUDE_CLOTH
     cloth = nullptr;
+    clothWorld = nullptr;
+    clothRenderer = nullptr;
+    clothThread = nullptr;
+    cacheWriter = nullptr;
+    cacheReader = nullptr;
+    windField = nullptr;
     #endif
 
     #ifdef INCLUDE_SPH
@@ -153,6 +198,8 @@ void Window::cleanUp() {
     #endif
 
     #ifdef INCLUDE_SKIN
+    // reads the skin's mesh
+    delete crowd;
     delete skin;
     #endif
 
@@ -163,7 +210,17 @@ void Window::cleanUp() {
     #endif
 
     #ifdef INCLUDE_CLOTH
-    delete cloth;
+    delete clothThread;
+    // closing writes the frame table
+    delete cacheWriter;
+    delete cacheReader;
+    delete clothRenderer;
+    delete windField;
+    if (clothWorld) {
+        delete clothWorld;
+    } else {
+        delete cloth;
+    }
     #endif
 
     #ifdef INCLUDE_SPH
@@ -173,6 +230,9 @@ void Window::cleanUp() {
     // Delete the shader program.
     glDeleteProgram(shaderProgram);
     glDeleteProgram(ptShaderProgram);
+    #ifdef INCLUDE_SKIN
+    glDeleteProgram(skinShaderProgram);
+    #endif
 
     // imgui stuff
     ImGui_ImplOpenGL3_Shutdown();
@@ -255,6 +315,13 @@ void Window::idleCallback() {
 
     // cube->update();
 
+    // before the skin's own update, which leaves the skeleton in its pose
+    #ifdef INCLUDE_SKIN
+    if (crowd) {
+        UpdateCrowd();
+    }
+    #endif
+
     #ifdef INCLUDE_ANIMATION
     if (player && clip) {
         player->Update(deltaTime);
@@ -295,9 +362,28 @@ void Window::idleCallback() {
     #endif
 
     #ifdef INCLUDE_CLOTH
-    if (cloth && !pauseSimulation) {
-        cloth->SetWind(wind);
-        cloth->Simulate(0.002);
+    if (clothThread) {
+        // the simulation thread keeps its own pace, just forward the inputs
+        clothThread->SetWind(wind);
+        clothThread->SetPaused(pauseSimulation);
+    } else if (cacheReader) {
+        // replaying, one recorded step per frame like when it was recorded
+        if (!pauseSimulation) {
+            cacheFrame = (cacheFrame + 1) % cacheReader->GetNumFrames();
+            ShowCacheFrame();
+        }
+    } else if (cloth && !pauseSimulation) {
+        if (windField) {
+            windField->SetMeanWind(wind);
+        } else {
+            cloth->SetWind(wind);
+        }
+        cloth->Simulate(timestep);
+        if (cacheWriter && !cacheWriter->AddFrame(cloth)) {
+            // keeps what was recorded so far
+            delete cacheWriter;
+            cacheWriter = nullptr;
+        }
     }
     #endif
 
@@ -331,6 +417,9 @@ void Window::displayCallback(GLFWwindow* window) {
     if (skin) {
         skin->Draw(Cam->GetViewProjectMtx(), Window::shaderProgram, lightDirection1, lightColor1, lightDirection2, lightColor2);
     }
+    if (crowd) {
+        crowd->Draw(Cam->GetViewProjectMtx(), lightDirection1, lightColor1, lightDirection2, lightColor2);
+    }
     #endif
 
     // create imgui window
@@ -342,7 +431,10 @@ void Window::displayCallback(GLFWwindow* window) {
 
     #ifdef INCLUDE_CLOTH
     if (cloth) {
-        cloth->Draw(Cam->GetViewProjectMtx(), Window::shaderProgram);
+        if (!clothRenderer) {
+            clothRenderer = new ClothRenderer(cloth);
+        }
+        clothRenderer->Draw(Cam->GetViewProjectMtx(), Window::shaderProgram);
     }
     #endif
 
@@ -407,32 +499,32 @@ void Window::keyCallback(GLFWwindow* window, int key, int scancode, int action,
             // fixed particle control
             case GLFW_KEY_W: // move north (-z)
                 if (cloth) {
-                    cloth->Translate(glm::vec3(0.0f, 0.0f, -0.1f));
+                    TranslateCloth(glm::vec3(0.0f, 0.0f, -0.1f));
                 }
                 break;
             case GLFW_KEY_S: // move south (+z)
                 if (cloth) {
-                    cloth->Translate(glm::vec3(0.0f, 0.0f, 0.1f));
+                    TranslateCloth(glm::vec3(0.0f, 0.0f, 0.1f));
                 }
                 break;
             case GLFW_KEY_A: // move west (-x)
                 if (cloth) {
-                    cloth->Translate(glm::vec3(-0.1f, 0.0f, 0.0f));
+                    TranslateCloth(glm::vec3(-0.1f, 0.0f, 0.0f));
                 }
                 break;
             case GLFW_KEY_D: // move east (+x)
                 if (cloth) {
-                    cloth->Translate(glm::vec3(0.1f, 0.0f, 0.0f));
+                    TranslateCloth(glm::vec3(0.1f, 0.0f, 0.0f));
                 }
                 break;
             case GLFW_KEY_Q: // move up (+y)
                 if (cloth) {
-                    cloth->Translate(glm::vec3(0.0f, 0.1f, 0.0f));
+                    TranslateCloth(glm::vec3(0.0f, 0.1f, 0.0f));
                 }
                 break;
             case GLFW_KEY_E: // move down (-y)
                 if (cloth) {
-                    cloth->Translate(glm::vec3(0.0f, -0.1f, 0.0f));
+                    TranslateCloth(glm::vec3(0.0f, -0.1f, 0.0f));
                 }
                 break;
             #endif
@@ -551,10 +643,124 @@ void Window::RenderJointControls() {
             selectedJoint->GetDOF(2).SetValue(z);
         }
     }
+
+    #ifdef INCLUDE_SKIN
+    if (skin) {
+        bool parallel = skin->IsParallelEnabled();
+        if (ImGui::Checkbox("parallel skinning", &parallel)) {
+            skin->SetParallelEnabled(parallel);
+        }
+        if (parallel) {
+            int chunkSize = skin->GetChunkSize();
+            if (ImGui::InputInt("vertices per chunk", &chunkSize, 256, 1024)) {
+                skin->SetChunkSize(chunkSize);
+            }
+        }
+
+        bool dualQuaternion = skin->GetSkinningMode() == SkinningMode::DualQuaternion;
+        if (ImGui::Checkbox("dual quaternion skinning", &dualQuaternion)) {
+            skin->SetSkinningMode(dualQuaternion ? SkinningMode::DualQuaternion : SkinningMode::Linear);
+        }
+
+        bool packed = skin->IsPackedOutputEnabled();
+        if (ImGui::Checkbox("packed vertex output", &packed)) {
+            skin->SetPackedOutputEnabled(packed);
+        }
+
+        bool gpu = skin->IsGPUSkinningEnabled();
+        if (ImGui::Checkbox("gpu skinning", &gpu)) {
+            skin->SetGPUSkinningEnabled(gpu);
+        }
+        if (ImGui::Button("check gpu against cpu")) {
+            skin->ValidateGPU();
+        }
+        ImGui::Text("re-skinned %d of %d vertices", skin->GetNumSkinnedVertices(), skin->GetNumVertices());
+
+        int crowdSize = crowd ? crowd->GetNumInstances() : 0;
+        if (ImGui::InputInt("crowd", &crowdSize, 1, 16)) {
+            SetCrowdSize(crowdSize);
+        }
+        if (crowd) {
+            ImGui::Text("crowd re-skinned %d vertices", crowd->GetNumSkinnedVertices());
+        }
+
+        MorphTargets* morphs = skin->GetMorphTargets();
+        if (morphs) {
+            for (int t = 0; t < morphs->GetNumTargets(); t++) {
+                float weight = morphs->GetWeight(t);
+                if (ImGui::SliderFloat(morphs->GetName(t).c_str(), &weight, 0.0f, 1.0f)) {
+                    morphs->SetWeight(t, weight);
+                }
+            }
+        }
+    }
+    #endif
+}
+#endif
+
+#ifdef INCLUDE_SKIN
+void Window::SetCrowdSize(int size) {
+    if (!crowd) {
+        crowd = new SkinCrowd(skin);
+        crowd->SetShader(crowdShaderProgram);
+    }
+
+    // rows of 8 behind the skin, spaced by its size
+    glm::vec3 lo(FLT_MAX);
+    glm::vec3 hi(-FLT_MAX);
+    for (const glm::vec3& position : skin->GetTransformedPositions()) {
+        lo = glm::min(lo, position);
+        hi = glm::max(hi, position);
+    }
+    glm::vec3 extent = hi - lo;
+    float spacing = 1.2f * glm::max(extent.x, glm::max(extent.y, extent.z));
+
+    crowd->Clear();
+    for (int i = 0; i < glm::max(size, 0); i++) {
+        crowd->AddInstance(glm::translate(glm::vec3(((i % 8) - 3.5f) * spacing, 0.0f, -(i / 8 + 1) * spacing)));
+    }
+}
+
+void Window::UpdateCrowd() {
+    crowd->SetSkinningMode(skin->GetSkinningMode());
+
+    #ifdef INCLUDE_ANIMATION
+    // each instance trails the one in front of it by a quarter of a second, so they aren't in step
+    int numChannels = clip ? clip->GetChannels().size() : 0;
+    bool animated = player && numChannels >= 3 + 3 * (int)skeleton->GetJointList().size();
+    if (animated) {
+        crowdPose.Resize(numChannels);
+    }
+    #endif
+
+    for (int i = 0; i < crowd->GetNumInstances(); i++) {
+        #ifdef INCLUDE_ANIMATION
+        if (animated) {
+            clip->Evaluate(player->GetTime() - 0.25f * (i + 1), crowdPose);
+            rig->PoseSkeleton(crowdPose);
+        }
+        #endif
+        crowd->SetPose(i, skeleton);
+    }
+    crowd->Update();
 }
 #endif
 
 #ifdef INCLUDE_CLOTH
+void Window::TranslateCloth(glm::vec3 translation) {
+    if (clothThread) {
+        clothThread->Translate(translation);
+    } else if (cloth) {
+        cloth->Translate(translation);
+    }
+}
+
+void Window::ShowCacheFrame() {
+    if (cacheReader->ReadFrame(cacheFrame, cachePositions)) {
+        cloth->SetPositions(cachePositions);
+    }
+}
+
 void Window::RenderClothControls() {
 
     ImGui::Text("wind");
@@ -573,5 +779,266 @@ void Window::RenderClothControls() {
     ImGui::Separator();
 
     ImGui::Checkbox("pause simulation", &pauseSimulation);
+
+    if (!cloth) {
+        return;
+    }
+
+    if (clothWorld) {
+        ImGui::Text("%d cloths, %d particles", clothWorld->GetNumInstances(), cloth->GetNumParticles());
+    }
+
+    if (clothRenderer) {
+        bool drawTriangles = clothRenderer->GetDrawTriangles();
+        if (ImGui::Checkbox("draw triangles", &drawTriangles)) {
+            clothRenderer->SetDrawTriangles(drawTriangles);
+        }
+
+        bool drawSprings = clothRenderer->GetDrawSprings();
+        if (ImGui::Checkbox("draw springs", &drawSprings)) {
+            clothRenderer->SetDrawSprings(drawSprings);
+        }
+    }
+
+    ImGui::Separator();
+
+    ImGui::Text("solver");
+
+    // explicit needs ~0.002, projective dynamics is happy at 1/60
+    if (ImGui::InputFloat("timestep", &timestep, 0.0f, 0.0f, "%.4f")) {
+        timestep = glm::clamp(timestep, 0.0001f, 0.05f);
+        if (clothThread) {
+            clothThread->SetTimestep(timestep);
+        }
+    }
+
+    // the skin's collision mesh is refit on this thread, so a draped cloth has to stay here too
+    if (clothRenderer && !cloth->GetCollisionMesh() && !cacheWriter && !cacheReader && !windField) {
+        bool threaded = clothThread != nullptr;
+        if (ImGui::Checkbox("simulation thread", &threaded)) {
+            if (threaded) {
+                clothThread = new ClothSimulationThread(cloth, timestep);
+                clothThread->SetPaused(pauseSimulation);
+                clothRenderer->SetSimulationThread(clothThread);
+            } else {
+                delete clothThread;
+                clothThread = nullptr;
+                clothRenderer->SetSimulationThread(nullptr);
+            }
+        }
+    }
+
+    // recording happens on this thread, one frame per step
+    if (!clothThread) {
+        if (cacheReader) {
+            if (ImGui::SliderInt("cache frame", &cacheFrame, 0, cacheReader->GetNumFrames() - 1)) {
+                ShowCacheFrame();
+            }
+            if (ImGui::Button("stop playing")) {
+                delete cacheReader;
+                cacheReader = nullptr;
+            }
+            // the solver settings below would not do anything while replaying
+            return;
+        } else if (cacheWriter) {
+            ImGui::Text("recorded %d frames, %.1f KB", cacheWriter->GetNumFrames(), cacheWriter->GetSize() / 1024.0f);
+            if (ImGui::Button("stop recording")) {
+                delete cacheWriter;
+                cacheWriter = nullptr;
+            }
+        } else {
+            if (ImGui::Button("record cache")) {
+                cacheWriter = new ClothCacheWriter();
+                if (!cacheWriter->Open("cloth.cache", cloth, timestep)) {
+                    delete cacheWriter;
+                    cacheWriter = nullptr;
+                }
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("play cache")) {
+                cacheReader = new ClothCacheReader();
+                // a torn cloth would show its holes over the recorded one
+                if (!cacheReader->Open("cloth.cache") || cacheReader->GetNumFrames() == 0 ||
+                    cacheReader->GetNumParticles() != cloth->GetNumParticles() ||
+                    cacheReader->GetNumTriangles() != (int)cloth->GetTriangles().size() || cloth->GetNumTornSprings() > 0) {
+                    printf("Window::RenderClothControls - cloth.cache does not match this cloth\n");
+                    delete cacheReader;
+                    cacheReader = nullptr;
+                } else {
+                    cacheFrame = 0;
+                    ShowCacheFrame();
+                }
+            }
+        }
+    }
+
+    if (clothThread) {
+        ImGui::Text("steps per second: %.0f", clothThread->GetStepRate());
+        ImGui::Text("stop the simulation thread to change\nsolver and collision settings");
+        return;
+    }
+
+    // gusts and turbulence on top of the wind, baked into a grid around the cloth
+    bool useWindField = windField != nullptr;
+    if (ImGui::Checkbox("wind field", &useWindField)) {
+        if (useWindField) {
+            glm::vec3 minCorner(FLT_MAX);
+            glm::vec3 maxCorner(-FLT_MAX);
+            for (Particle* particle : cloth->GetParticles()) {
+                minCorner = glm::min(minCorner, particle->GetPosition());
+                maxCorner = glm::max(maxCorner, particle->GetPosition());
+            }
+            // room for the cloth to swing
+            windField = new WindField(minCorner - glm::vec3(2.0f), maxCorner + glm::vec3(2.0f), 0.5f);
+            windField->SetMeanWind(wind);
+            cloth->SetWind(glm::vec3(0.0f));
+            cloth->SetWindField(windField);
+        } else {
+            cloth->SetWindField(nullptr);
+            delete windField;
+            windField = nullptr;
+        }
+    }
+
+    if (windField) {
+        float gustStrength = windField->GetGustStrength();
+        if (ImGui::SliderFloat("gust strength", &gustStrength, 0.0f, 1.0f)) {
+            windField->SetGustStrength(gustStrength);
+        }
+
+        float gustPeriod = windField->GetGustPeriod();
+        if (ImGui::SliderFloat("gust period", &gustPeriod, 0.5f, 10.0f)) {
+            windField->SetGustPeriod(gustPeriod);
+        }
+
+        float turbulenceStrength = windField->GetTurbulenceStrength();
+        if (ImGui::SliderFloat("turbulence", &turbulenceStrength, 0.0f, 5.0f)) {
+            windField->SetTurbulenceStrength(turbulenceStrength);
+        }
+
+        // swirls smaller than two grid cells would be lost between the nodes
+        float turbulenceScale = windField->GetTurbulenceScale();
+        if (ImGui::SliderFloat("turbulence scale", &turbulenceScale, 2.0f * windField->GetCellSize(), 5.0f)) {
+            windField->SetTurbulenceScale(turbulenceScale);
+        }
+    }
+
+    bool projectiveDynamics = cloth->GetSolver() == ClothSolver::ProjectiveDynamics;
+    if (ImGui::Checkbox("projective dynamics", &projectiveDynamics)) {
+        cloth->SetSolver(projectiveDynamics ? ClothSolver::ProjectiveDynamics : ClothSolver::Explicit);
+    }
+
+    if (projectiveDynamics) {
+        int iterations = cloth->GetProjectiveDynamics()->GetNumIterations();
+        if (ImGui::SliderInt("iterations", &iterations, 1, 50)) {
+            cloth->GetProjectiveDynamics()->SetNumIterations(iterations);
+        }
+
+        float rho = cloth->GetProjectiveDynamics()->GetChebyshevRho();
+        if (ImGui::SliderFloat("chebyshev rho", &rho, 0.0f, 0.999f)) {
+            cloth->GetProjectiveDynamics()->SetChebyshevRho(rho);
+        }
+
+        float damping = cloth->GetProjectiveDynamics()->GetDamping();
+        if (ImGui::SliderFloat("damping", &damping, 0.0f, 0.1f)) {
+            cloth->GetProjectiveDynamics()->SetDamping(damping);
+        }
+    } else {
+        // tearing is part of the explicit spring pass, and a cache can't record it
+        bool tearing = cloth->IsTearingEnabled();
+        if (cacheWriter) {
+            ImGui::Text("stop recording to change tearing");
+        } else if (ImGui::Checkbox("tearing", &tearing)) {
+            cloth->SetTearingEnabled(tearing);
+        }
+
+        if (tearing) {
+            float tearStretch = cloth->GetTearStretch();
+            if (ImGui::SliderFloat("tear stretch", &tearStretch, 1.1f, 5.0f)) {
+                cloth->SetTearStretch(tearStretch);
+            }
+            ImGui::Text("torn springs: %d, triangles: %d, split particles: %d", cloth->GetNumTornSprings(), cloth->GetNumTornTriangles(), cloth->GetNumSplitParticles());
+        }
+    }
+
+    // changing the stiffness refactors the projective dynamics matrix
+    float springConstant = cloth->GetSpringConstant();
+    if (ImGui::InputFloat("spring constant", &springConstant, 0.0f, 0.0f, "%.1f", ImGuiInputTextFlags_EnterReturnsTrue)) {
+        cloth->SetSpringConstant(glm::max(springConstant, 1.0f));
+    }
+
+    bool sleeping = cloth->IsSleepingEnabled();
+    if (ImGui::Checkbox("sleeping", &sleeping)) {
+        cloth->SetSleepingEnabled(sleeping);
+    }
+
+    if (sleeping) {
+        ClothPatches* patches = cloth->GetPatches();
+        float sleepSpeed = patches->GetSleepSpeed();
+        if (ImGui::SliderFloat("sleep speed", &sleepSpeed, 0.001f, 0.1f, "%.3f")) {
+            patches->SetSleepSpeed(sleepSpeed);
+        }
+        ImGui::Text("awake patches: %d / %d", patches->GetNumAwakePatches(), patches->GetNumPatches());
+    }
+
+    ImGui::Separator();
+
+    ImGui::Text("collision");
+
+    bool selfCollision = cloth->IsSelfCollisionEnabled();
+    if (ImGui::Checkbox("self collision", &selfCollision)) {
+        cloth->SetSelfCollisionEnabled(selfCollision);
+    }
+
+    if (selfCollision) {
+        float thickness = cloth->GetSelfCollision()->GetThickness();
+        if (ImGui::SliderFloat("thickness", &thickness, 0.001f, 0.2f)) {
+            cloth->GetSelfCollision()->SetThickness(thickness);
+        }
+        ImGui::Text("contacts: %d", cloth->GetSelfCollision()->GetNumContacts());
+    }
+
+    // obstacles around the default cloth, which hangs from y = 2 along x
+    ClothObstacles* obstacles = cloth->GetObstacles();
+    if (ImGui::Button("add floor")) {
+        obstacles->AddPlane(glm::vec3(0.0f, 1.0f, 0.0f), -1.0f);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("add sphere")) {
+        obstacles->AddSphere(glm::vec3(2.0f, 0.5f, 1.0f), 0.7f);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("clear")) {
+        obstacles->Clear();
+    }
+
+    if (obstacles->GetNumObstacles() > 0) {
+        // the sliders show the first obstacle and set all of them
+        ClothObstacle first = obstacles->GetObstacle(0);
+        bool friction = ImGui::SliderFloat("obstacle friction", &first.friction, 0.0f, 2.0f);
+        bool restitution = ImGui::SliderFloat("obstacle restitution", &first.restitution, 0.0f, 1.0f);
+        if (friction || restitution) {
+            for (int i = 0; i < obstacles->GetNumObstacles(); i++) {
+                ClothObstacle obstacle = obstacles->GetObstacle(i);
+                obstacle.friction = first.friction;
+                obstacle.restitution = first.restitution;
+                obstacles->SetObstacle(i, obstacle);
+            }
+        }
+        ImGui::Text("obstacles: %d", obstacles->GetNumObstacles());
+    }
+
+    // only when there is a character to collide with
+    if (cloth->GetCollisionMesh()) {
+        float collisionThickness = cloth->GetCollisionThickness();
+        if (ImGui::SliderFloat("character thickness", &collisionThickness, 0.001f, 0.2f)) {
+            cloth->SetCollisionThickness(collisionThickness);
+        }
+
+        float collisionFriction = cloth->GetCollisionFriction();
+        if (ImGui::SliderFloat("character friction", &collisionFriction, 0.0f, 2.0f)) {
+            cloth->SetCollisionFriction(collisionFriction);
+        }
+    }
 }
 #endif
\ No newline at end of file